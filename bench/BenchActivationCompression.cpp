@@ -0,0 +1,139 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compressed activations against dense activations. A chain of ReLU convolution layers is run
+// from the memory through the DMA engine, every layer reading the outputs the previous one
+// stored: the dense planes, or the zero-value records of the output compressor expanded by the
+// input decompressor of the next layer. Print per layer the cycles, the DRAM bytes, the
+// compression ratio of the outputs and the DRAM bytes saved on the outputs and the inputs.
+//
+// Usage: BenchActivationCompression [nbOfCEs] [dramWordsPerCycle] [valuesPerCycle] [resolution]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "CNNP/Compression.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+};
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  double dramWordsPerCycle = argc > 2 ? std::atof(argv[2]) : 0.5;
+  int valuesPerCycle = argc > 3 ? std::atoi(argv[3]) : 8;
+  int resolution = argc > 4 ? std::atoi(argv[4]) : 32;
+  const int wordBytes = 2;
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  DmaHParam dmaHParam{32, 8, 40, dramWordsPerCycle};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  int r = resolution;
+  std::vector<NetLayer> network{
+    {"conv1", LayerHParam{r, r, 3, 16, 3, 1, 1}},
+    {"conv2", LayerHParam{r, r, 16, 16, 3, 1, 1}},
+    {"conv3", LayerHParam{r, r, 16, 32, 3, 2, 1}},
+    {"conv4", LayerHParam{r / 2, r / 2, 32, 32, 3, 1, 1}}};
+
+  std::srand(1);
+  Tensor<BenchType> image({3, r, r});
+  for(int i = 0; i < image.size(); i++){image.data()[i] = BenchType((std::rand() % 9 - 4) * 0.125);}
+
+  std::printf("%-6s %12s %12s %12s %12s %8s %12s %12s\n", "layer", "dense cyc", "zvc cyc", "dense bytes",
+              "zvc bytes", "ratio", "out saved", "in saved");
+  Tensor<BenchType> denseInputs = image;
+  std::shared_ptr< CompressedTensor<BenchType> > records;   // Outputs of the previous layer
+  long totalDense = 0, totalCompressed = 0;
+  for(int l = 0; l < network.size(); l++)
+  {
+    LayerHParam p = network[l].layerHParam;
+    Tensor<BenchType> weights({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize});
+    Tensor<BenchType> bias({p.nbOfFilter});
+    for(int i = 0; i < weights.size(); i++){weights.data()[i] = BenchType((std::rand() % 9 - 4) * 0.0625);}
+    bias.fill(BenchType(-0.125));
+
+    long cycles[2], dramBytes[2];
+    double ratio = 0;
+    long outSaved = 0, inSaved = 0;
+    Tensor<BenchType> denseOutputs;
+    std::shared_ptr< CompressedTensor<BenchType> > outputs;
+    for(int run = 0; run < 2; run++)
+    {
+      // The first layer read the dense image
+      bool compress = run == 1;
+      bool compressedInputs = compress && records;
+      std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(p.filterSize, p.inputWidth + 2 * p.padding));
+      Controller<BenchType> ctrl(CEs, p);
+      int plane = ctrl.outputHeight() * ctrl.outputWidth();
+      // Room for the records of the outputs, a mask bit per value on top of the values
+      int maskBits = CompressedTensor<BenchType>::maskBits;
+      long outputWords = (long)p.nbOfFilter * (plane + (plane + maskBits - 1) / maskBits);
+      size_t weightWords = weights.size();
+      size_t inputWords = compressedInputs ? records->getWords() : denseInputs.size();
+      DmaLayout layout{0, weightWords, weightWords + bias.size(), weightWords + bias.size() + inputWords};
+      Memory<BenchType> memory(layout.outputs + outputWords);
+      memory.Write(layout.weights, weights.data(), weights.size());
+      memory.Write(layout.bias, bias.data(), bias.size());
+      DmaEngine<BenchType> dma(memory, dmaHParam);
+      ctrl.setDma(dma, layout);
+      std::shared_ptr< Decompressor<BenchType> > decompressor;
+      if(compressedInputs)
+      {
+        records->write(memory, layout.inputs);
+        decompressor = std::make_shared< Decompressor<BenchType> >(dma, *records, valuesPerCycle);
+        ctrl.setInputDecompressor(*decompressor);
+      }
+      else
+      {
+        memory.Write(layout.inputs, denseInputs.data(), denseInputs.size());
+      }
+      std::shared_ptr< Compressor<BenchType> > compressor;
+      if(compress)
+      {
+        outputs = std::make_shared< CompressedTensor<BenchType> >(p.nbOfFilter, plane);
+        compressor = std::make_shared< Compressor<BenchType> >(dma, *outputs, valuesPerCycle);
+        ctrl.setOutputCompressor(*compressor);
+      }
+      ctrl.setRelu(true);
+      ctrl.setShadowWeights(true);
+      Simulator<BenchType> sim(ctrl, CEs);
+      cycles[run] = sim.run(1L << 40);
+      EventCounts events = ctrl.getEventCounts();
+      dramBytes[run] = (events.dramReads + events.dramWrites) * wordBytes;
+      if(compress)
+      {
+        ratio = compressor->getRatio();
+        outSaved = compressor->getSavedWords() * wordBytes;
+        inSaved = decompressor ? decompressor->getSavedWords() * wordBytes : 0;
+      }
+      else
+      {
+        denseOutputs = ctrl.getOutputs().clone();
+      }
+    }
+    std::printf("%-6s %12ld %12ld %12ld %12ld %8.2f %12ld %12ld\n", network[l].name, cycles[0], cycles[1],
+                dramBytes[0], dramBytes[1], ratio, outSaved, inSaved);
+    totalDense += dramBytes[0];
+    totalCompressed += dramBytes[1];
+    denseInputs = denseOutputs;
+    records = outputs;
+  }
+  std::printf("total DRAM bytes: dense %ld, compressed %ld\n", totalDense, totalCompressed);
+  return 0;
+}
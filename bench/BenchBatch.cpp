@@ -0,0 +1,56 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Push a batch of independent images through the same convolution layer with 1 to maxThreads
+// host threads, every thread with its own simulator instance. Print the scaling report.
+//
+// Usage: BenchBatch [images] [maxThreads]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/BatchRunner.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Tensor.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+int main(int argc, char* argv[])
+{
+  int nbOfImages = argc > 1 ? std::atoi(argv[1]) : 256;
+  int maxThreads = argc > 2 ? std::atoi(argv[2]) : int(std::thread::hardware_concurrency());
+  if(maxThreads < 1){maxThreads = 1;}
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam layerHParam{16, 16, 4, 8, 3, 1, 1};
+  Tensor<BenchType> weights({layerHParam.nbOfFilter, layerHParam.inputDepth, 3, 3});
+  weights.fill(BenchType(0.125));
+  Tensor<BenchType> bias({layerHParam.nbOfFilter});
+
+  // Images of different densities, so they take different cycles
+  std::srand(1);
+  std::vector< Tensor<BenchType> > images;
+  for(int i = 0; i < nbOfImages; i++)
+  {
+    Tensor<BenchType> image({layerHParam.inputDepth, layerHParam.inputHeight, layerHParam.inputWidth});
+    int density = std::rand() % 100;
+    for(int j = 0; j < image.size(); j++)
+    {
+      if(std::rand() % 100 < density){image.data()[j] = BenchType(0.25);}
+    }
+    images.push_back(image);
+  }
+
+  std::printf("%d images of %dx%dx%d, %d 3x3 filters on 2 CEs, 1 to %d threads\n", nbOfImages,
+              layerHParam.inputWidth, layerHParam.inputHeight, layerHParam.inputDepth, layerHParam.nbOfFilter,
+              maxThreads);
+  BatchRunner<BenchType> runner(layerHParam, 2, weights, bias);
+  runner.setShadowWeights(true);
+  BatchRunner<BenchType>::writeScaling(std::cout, runner.scaling(images, maxThreads));
+  return 0;
+}
@@ -0,0 +1,94 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Measure the host time of one CE step, serial and with the PE rows split across threads,
+// to find the filter size where the threads start to pay for the per step barrier.
+//
+// Usage: BenchCEThreads [maxThreads] [steps]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+/// Host nanoseconds per CE step
+double nsPerStep(int filterSize, int fifoSize, int nbThreads, int steps)
+{
+  CE<BenchType> ce(filterSize, fifoSize);
+  ce.setThreads(nbThreads, 1);
+  ce.setActivityTracking(false);
+
+  std::vector< std::vector<BenchType> > weights(filterSize, std::vector<BenchType>(filterSize, BenchType(0.125)));
+  ce.setSigs(BenchType(0), weights, true, BenchType(0), true);
+  ce.step();
+  ce.step();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int i = 0; i < steps; i++)
+  {
+    ce.setSigs(BenchType((i % 7) * 0.125), weights, false, BenchType(0), false);
+    ce.step();
+  }
+  std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(stop - start).count() / steps;
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+  int steps = argc > 2 ? std::atoi(argv[2]) : 20000;
+  if(maxThreads < 2)
+  {
+    // One core: the threads would only be oversubscribed, no crossover can be measured
+    std::fprintf(stderr, "BenchCEThreads need at least 2 threads, the host report %d\n", maxThreads);
+    return 1;
+  }
+
+  std::printf("%10s %10s %12s", "filterSize", "fifoSize", "serial ns");
+  for(int t = 2; t <= maxThreads; t *= 2)
+  {
+    std::printf(" %9d thr", t);
+  }
+  std::printf("   best\n");
+
+  int crossover = 0;
+  for(int filterSize = 3; filterSize <= 48; filterSize += (filterSize < 16) ? 2 : 4)
+  {
+    int fifoSize = filterSize * 8;
+    double serial = nsPerStep(filterSize, fifoSize, 1, steps);
+    double best = serial;
+    int bestThreads = 1;
+    std::printf("%10d %10d %12.0f", filterSize, fifoSize, serial);
+    for(int t = 2; t <= maxThreads; t *= 2)
+    {
+      double threaded = nsPerStep(filterSize, fifoSize, t, steps);
+      std::printf(" %13.0f", threaded);
+      if(threaded < best)
+      {
+        best = threaded;
+        bestThreads = t;
+      }
+    }
+    std::printf("   %d thr\n", bestThreads);
+    if(bestThreads > 1 && crossover == 0){crossover = filterSize;}
+    if(bestThreads == 1){crossover = 0;}
+  }
+
+  if(crossover > 0)
+  {
+    std::printf("\nCrossover filter size: %d, give it to CE<T>::setThreads()\n", crossover);
+  }
+  else
+  {
+    std::printf("\nCrossover filter size: none, the threads never pay, keep the CEs serial\n");
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compressed weights against dense weights. Every layer is pruned to several densities and run
+// from the memory through the DMA engine, with the dense weights or the bitmap-plus-values
+// records expanded by the weight decompressor. Print the cycles, the steps waiting for the
+// memory, the DRAM bytes saved, the decompression cycles and the roofline bound of the layer.
+//
+// Usage: BenchCompression [nbOfCEs] [dramWordsPerCycle] [weightsPerCycle]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Roofline.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "CNNP/Compression.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+};
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  double dramWordsPerCycle = argc > 2 ? std::atof(argv[2]) : 0.5;
+  int weightsPerCycle = argc > 3 ? std::atoi(argv[3]) : 8;
+  const int ceSize = 3;
+  const int wordBytes = 2;
+  const double clockMHz = 100.0;
+  MemHParam memHParam{wordBytes, dramWordsPerCycle * wordBytes, 0};
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  DmaHParam dmaHParam{32, 8, 40, dramWordsPerCycle};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  std::vector<NetLayer> network{
+    {"conv", LayerHParam{16, 16, 32, 32, 3, 1, 1, 0, CONVOLUTION}},
+    {"conv_s2", LayerHParam{16, 16, 64, 64, 3, 2, 1, 0, CONVOLUTION}},
+    {"fc", LayerHParam{1, 1, 1024, 64, 1, 1, 0, 0, FULLY_CONNECTED}}};
+  std::vector<int> densities{100, 50, 25, 10};
+
+  std::printf("%-8s %8s %10s %10s %10s %12s %12s %10s %8s\n", "layer", "density", "weights", "cycles",
+              "dma stall", "dram bytes", "saved bytes", "decomp", "bound");
+  for(int l = 0; l < network.size(); l++)
+  {
+    LayerHParam p = network[l].layerHParam;
+    bool fc = p.type == FULLY_CONNECTED;
+    for(int d = 0; d < densities.size(); d++)
+    {
+      Tensor<BenchType> weights({p.nbOfFilter, p.inputDepth, fc ? 1 : p.filterSize, fc ? 1 : p.filterSize});
+      Tensor<BenchType> bias({p.nbOfFilter});
+      Tensor<BenchType> inputs({p.inputDepth, fc ? 1 : p.inputHeight, p.inputWidth});
+      std::srand(1);
+      for(int i = 0; i < weights.size(); i++)
+      {
+        weights.data()[i] = (std::rand() % 100 < densities[d]) ? BenchType(0.125) : BenchType(0);
+      }
+      inputs.fill(BenchType(0.25));
+      CompressedTensor<BenchType> compressed = CompressedTensor<BenchType>::compress(weights);
+
+      for(int run = 0; run < 2; run++)
+      {
+        bool compress = run == 1;
+        std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(ceSize, fc ? 1 : p.inputWidth + 2 * p.padding));
+        Controller<BenchType> ctrl(CEs, p, p.filterSize == 1 ? POINTWISE_MAPPING : STREAM_MAPPING);
+        size_t weightWords = compress ? compressed.getWords() : weights.size();
+        DmaLayout layout{0, weightWords, weightWords + bias.size(), weightWords + bias.size() + inputs.size()};
+        Memory<BenchType> memory(layout.outputs + (size_t)p.nbOfFilter * ctrl.outputHeight() * ctrl.outputWidth());
+        memory.Write(layout.bias, bias.data(), bias.size());
+        memory.Write(layout.inputs, inputs.data(), inputs.size());
+        DmaEngine<BenchType> dma(memory, dmaHParam);
+        Decompressor<BenchType> decompressor(dma, compressed, weightsPerCycle);
+        ctrl.setDma(dma, layout);
+        if(compress)
+        {
+          compressed.write(memory, layout.weights);
+          ctrl.setWeightDecompressor(decompressor);
+        }
+        else
+        {
+          memory.Write(layout.weights, weights.data(), weights.size());
+        }
+        ctrl.setShadowWeights(true);
+        Simulator<BenchType> sim(ctrl, CEs);
+        long cycles = sim.run(1L << 40);
+        EventCounts events = ctrl.getEventCounts();
+
+        PerfModel model(p, ceSize, nbOfCEs, memHParam);
+        model.setShadowWeights(true);
+        model.setCompressedWeights(compress ? compressed.getWords() : 0);
+        Roofline roofline(nbOfCEs * ceSize * ceSize, memHParam, clockMHz);
+        roofline.addLayer(network[l].name, model, cycles);
+
+        std::printf("%-8s %7d%% %10s %10ld %10ld %12ld %12ld %10ld %8s\n", network[l].name, densities[d],
+                    compress ? "records" : "dense", cycles, ctrl.getDmaStallSteps(),
+                    (events.dramReads + events.dramWrites) * wordBytes, decompressor.getSavedWords() * wordBytes,
+                    decompressor.getBusyCycles(), roofline.getLayers().front().memoryBound ? "memory" : "compute");
+      }
+    }
+  }
+  return 0;
+}
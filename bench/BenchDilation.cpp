@@ -0,0 +1,54 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compare a dilated 3x3 layer computed by a 3x3 CE that tap its line buffer at dilated offsets
+// with the same layer as a zero-stuffed (2 * dilation + 1)^2 filter on a CE of that size. The
+// padding keep the input size, like the dilated layers of the segmentation networks.
+//
+// Usage: BenchDilation [inputWidth] [inputDepth] [nbOfFilter]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "BenchHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+/// Run a layer with constant data on 2 CEs of the filter size and dilation
+LayerRun<BenchType> runDilatedLayer(const LayerHParam& p)
+{
+  LayerRunOptions options;
+  options.nbOfCEs = 2;
+  options.shadowWeights = true;
+  return runConstantLayer<BenchType>(p, options);
+}
+
+int main(int argc, char* argv[])
+{
+  int inputWidth = argc > 1 ? std::atoi(argv[1]) : 32;
+  int inputDepth = argc > 2 ? std::atoi(argv[2]) : 2;
+  int nbOfFilter = argc > 3 ? std::atoi(argv[3]) : 4;
+
+  std::printf("3x3 dilated filters, %dx%d inputs, %d channels, %d filters on 2 CEs\n", inputWidth, inputWidth,
+              inputDepth, nbOfFilter);
+  std::printf("%8s %6s %10s %10s %8s %6s %11s %10s %13s\n", "dilation", "extent", "cycles", "stuffed",
+              "speedup", "PEs", "stuffed PEs", "FIFO words", "stuffed words");
+  for(int dilation = 1; dilation <= 8; dilation *= 2)
+  {
+    int extent = 2 * dilation + 1;
+    // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type, dilation
+    LayerHParam dilated{inputWidth, inputWidth, inputDepth, nbOfFilter, 3, 1, dilation, 0, CONVOLUTION, dilation};
+    LayerHParam stuffed{inputWidth, inputWidth, inputDepth, nbOfFilter, extent, 1, dilation, 0, CONVOLUTION, 1};
+    LayerRun<BenchType> run = runDilatedLayer(dilated);
+    LayerRun<BenchType> stuffedRun = runDilatedLayer(stuffed);
+    std::printf("%8d %6d %10ld %10ld %7.3fx %6d %11d %10ld %13ld\n", dilation, extent, run.cycles, stuffedRun.cycles,
+                double(stuffedRun.cycles) / run.cycles, 2 * 9, 2 * extent * extent, run.fifoWords,
+                stuffedRun.fifoWords);
+  }
+  return 0;
+}
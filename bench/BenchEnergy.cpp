@@ -0,0 +1,89 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Energy report of a small network. Every layer is simulated with the activity tracking, its
+// events are turned into energy with the default costs (normalized to a MAC). Print the energy per
+// layer and per inference by hierarchy level, and a CSV table, also written to a file if one is given.
+//
+// Usage: BenchEnergy [nbOfCEs] [inputDensity] [csvFile]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/EnergyModel.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+  bool pointwise;
+};
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  double density = argc > 2 ? std::atof(argv[2]) : 0.5;
+  const int ceSize = 3;
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  std::vector<NetLayer> network{
+    {"conv1", LayerHParam{32, 32, 3, 8, 3, 1, 1, 0, CONVOLUTION}, false},
+    {"conv2", LayerHParam{32, 32, 8, 16, 3, 2, 1, 0, CONVOLUTION}, false},
+    {"dw3", LayerHParam{16, 16, 16, 16, 3, 1, 1, 16, CONVOLUTION}, false},
+    {"pw3", LayerHParam{16, 16, 16, 32, 1, 1, 0, 0, CONVOLUTION}, true},
+    {"conv4", LayerHParam{16, 16, 32, 32, 3, 2, 1, 0, CONVOLUTION}, false},
+    {"fc5_batch16", LayerHParam{16, 1, 2048, 10, 1, 1, 0, 0, FULLY_CONNECTED}, true}};
+
+  EnergyModel energy;
+  std::srand(1);
+  for(int l = 0; l < network.size(); l++)
+  {
+    LayerHParam p = network[l].layerHParam;
+    bool fc = p.type == FULLY_CONNECTED;
+    int groups = p.groups > 0 ? p.groups : 1;
+    int filterSize = network[l].pointwise ? ceSize : p.filterSize;
+    std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(filterSize, fc ? 1 : p.inputWidth + 2 * p.padding));
+    Controller<BenchType> ctrl(CEs, p, network[l].pointwise ? POINTWISE_MAPPING : STREAM_MAPPING);
+    Tensor<BenchType> weights(fc ? std::vector<int>{p.nbOfFilter, p.inputDepth}
+                                 : std::vector<int>{p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize});
+    Tensor<BenchType> inputs(fc ? std::vector<int>{p.inputWidth, p.inputDepth}
+                                : std::vector<int>{p.inputDepth, p.inputHeight, p.inputWidth});
+    weights.fill(BenchType(0.125));
+    // Only a "density" fraction of the inputs are non zero, like after a ReLU
+    for(int i = 0; i < inputs.dim(0); i++)
+      for(int j = 0; j < inputs.dim(1); j++)
+        for(int k = 0; k < (fc ? 1 : inputs.dim(2)); k++)
+          if(std::rand() % 100 < density * 100)
+            (fc ? inputs(i, j) : inputs(i, j, k)) = BenchType(0.25);
+    ctrl.setWeights(weights, Tensor<BenchType>({p.nbOfFilter}));
+    ctrl.setInputs(inputs);
+    ctrl.setShadowWeights(true);
+    Simulator<BenchType> sim(ctrl, CEs);
+    sim.run(1L << 40);
+    // The images of a fully connected batch share the layer
+    energy.addLayer(network[l].name, ctrl.getEventCounts(), fc ? p.inputWidth : 1);
+  }
+
+  energy.writeReport(std::cout);
+  std::cout << "\n";
+  energy.writeCsv(std::cout);
+  if(argc > 3)
+  {
+    std::ofstream csv(argv[3]);
+    energy.writeCsv(csv);
+  }
+  return 0;
+}
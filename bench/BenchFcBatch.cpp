@@ -0,0 +1,51 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Run a fully connected layer on a 3x3 CE for growing batch sizes. The weights come through the
+// one word per cycle weight port, so a small batch is bound by the weight fetches and a bigger
+// batch reuse every fetched weight across more images.
+//
+// Usage: BenchFcBatch [nbOfInputs] [nbOfOutputs]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+int main(int argc, char* argv[])
+{
+  int nbOfInputs = argc > 1 ? std::atoi(argv[1]) : 512;
+  int nbOfOutputs = argc > 2 ? std::atoi(argv[2]) : 128;
+  const int ceSize = 3;
+
+  std::printf("FC %d -> %d on a %dx%d CE\n", nbOfInputs, nbOfOutputs, ceSize, ceSize);
+  std::printf("%6s %12s %12s %14s %10s\n", "batch", "cycles", "cyc/image", "weight reuse", "PE util");
+  for(int batch = 1; batch <= 64; batch *= 2)
+  {
+    // inputWidth (batch), inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+    LayerHParam layerHParam{batch, 1, nbOfInputs, nbOfOutputs, 1, 1, 0, 0, FULLY_CONNECTED};
+    std::vector< CE<BenchType> > CEs(1, CE<BenchType>(ceSize, 1));
+    Controller<BenchType> ctrl(CEs, layerHParam);
+    ctrl.setWeights(std::vector< std::vector<BenchType> >(nbOfOutputs, std::vector<BenchType>(nbOfInputs, BenchType(0.125))),
+                    std::vector<BenchType>(nbOfOutputs, BenchType(0.5)));
+    ctrl.setInputs(std::vector< std::vector<BenchType> >(batch, std::vector<BenchType>(nbOfInputs, BenchType(0.25))));
+    ctrl.setShadowWeights(true);
+    while(!ctrl.isHalted())
+    {
+      ctrl.step();
+    }
+
+    long cycles = ctrl.getTotalSteps();
+    std::printf("%6d %12ld %12.1f %14.2f %9.1f%%\n", batch, cycles, double(cycles) / batch,
+                double(ctrl.getMacs()) / ctrl.getWeightFetches(),
+                100.0 * ctrl.getMacs() / (double(cycles) * ceSize * ceSize));
+  }
+  return 0;
+}
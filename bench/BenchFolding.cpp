@@ -0,0 +1,129 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Run networks mixing filter sizes on a fixed physical CE array with the window generator. The
+// filters larger than the array are folded in tiles, the smaller ones use the array alone or with
+// the channel packing. Every layer is simulated with deterministic synthetic data, the simulated
+// cycles are printed next to the performance model cycles, the PE utilization is the simulated one.
+//
+// The spatial and channel dimensions are divided by the two divisors so the networks run in
+// seconds, a divisor of 1 run the real layers.
+//
+// Usage: BenchFolding [nbOfCEs] [resolutionDivisor] [channelDivisor]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Tensor.hpp"
+#include "BenchHelpers.hpp"
+#include "TestHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+};
+
+struct Network
+{
+  const char* name;
+  std::vector<NetLayer> layers;
+};
+
+/// Model of a layer on the array
+PerfModel layerModel(const LayerHParam& p, int ceSize, int nbOfCEs, bool packing)
+{
+  PerfModel model(p, ceSize, nbOfCEs, MemHParam{2, 4.0});
+  model.setWindowGenerator(true);
+  model.setChannelPacking(packing);
+  model.setShadowWeights(true);
+  return model;
+}
+
+/// Simulated cycles of a layer on the array
+long layerCycles(const LayerHParam& p, int ceSize, int nbOfCEs, bool packing, const Tensor<BenchType>& weights,
+                 const Tensor<BenchType>& bias, const Tensor<BenchType>& inputs)
+{
+  LayerRunOptions options;
+  options.nbOfCEs = nbOfCEs;
+  options.ceSize = ceSize;
+  options.mapping = WINDOW_MAPPING;
+  options.packing = packing;
+  options.shadowWeights = true;
+  return runLayer(p, weights, bias, inputs, options).cycles;
+}
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  int resolutionDivisor = argc > 2 ? std::atoi(argv[2]) : 4;
+  int channelDivisor = argc > 3 ? std::atoi(argv[3]) : 8;
+  const int arrays[] = {3, 5, 11};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  std::vector<Network> networks = {
+    {"AlexNet", {{"conv1", {227, 227, 3, 96, 11, 4, 0}},
+                 {"conv2", {27, 27, 96, 256, 5, 1, 2, 2}},
+                 {"conv3", {13, 13, 256, 384, 3, 1, 1}},
+                 {"conv4", {13, 13, 384, 384, 3, 1, 1, 2}},
+                 {"conv5", {13, 13, 384, 256, 3, 1, 1, 2}}}},
+    {"Inception", {{"1x1", {28, 28, 192, 64, 1, 1, 0}},
+                   {"3x3 reduce", {28, 28, 192, 96, 1, 1, 0}},
+                   {"3x3", {28, 28, 96, 128, 3, 1, 1}},
+                   {"5x5 reduce", {28, 28, 192, 16, 1, 1, 0}},
+                   {"5x5", {28, 28, 16, 32, 5, 1, 2}},
+                   {"pool proj", {28, 28, 192, 32, 1, 1, 0}}}}};
+
+  std::printf("%d CEs, shadow weights, resolution / %d, channels / %d\n", nbOfCEs, resolutionDivisor,
+              channelDivisor);
+  std::printf("%-10s %-11s %-16s %5s %5s %5s %10s %10s %6s %10s %10s %6s\n", "network", "layer", "shape", "array",
+              "tiles", "lanes", "sim cyc", "model cyc", "util", "packed sim", "packed mod", "util");
+  for(int n = 0; n < networks.size(); n++)
+  {
+    const Network& network = networks[n];
+    for(int a = 0; a < 3; a++)
+    {
+      long cycles[2] = {0, 0};
+      long macs = 0;
+      std::srand(n + 1);
+      for(int l = 0; l < network.layers.size(); l++)
+      {
+        LayerHParam p = scaleLayer(network.layers[l].layerHParam, resolutionDivisor, channelDivisor);
+        int groups = p.groups > 0 ? p.groups : 1;
+        Tensor<BenchType> weights = randomTensor<BenchType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize,
+                                                            p.filterSize}, 0.0625);
+        Tensor<BenchType> bias = randomTensor<BenchType>({p.nbOfFilter}, 0.125);
+        Tensor<BenchType> inputs = randomTensor<BenchType>({p.inputDepth, p.inputHeight, p.inputWidth}, 0.125);
+
+        PerfModel alone = layerModel(p, arrays[a], nbOfCEs, false);
+        PerfModel packed = layerModel(p, arrays[a], nbOfCEs, true);
+        long simulated[2] = {layerCycles(p, arrays[a], nbOfCEs, false, weights, bias, inputs),
+                             layerCycles(p, arrays[a], nbOfCEs, true, weights, bias, inputs)};
+        double pes = double(nbOfCEs) * arrays[a] * arrays[a];
+        cycles[0] += simulated[0];
+        cycles[1] += simulated[1];
+        macs += alone.getMacs();
+        char shape[32];
+        std::snprintf(shape, sizeof(shape), "%dx%dx%d->%d k%d", p.inputWidth, p.inputHeight, p.inputDepth,
+                      p.nbOfFilter, p.filterSize);
+        std::printf("%-10s %-11s %-16s %5d %5d %5d %10ld %10ld %5.1f%% %10ld %10ld %5.1f%%\n", network.name,
+                    network.layers[l].name, shape, arrays[a], packed.getTiles(), packed.getLanes(), simulated[0],
+                    alone.getCycles(), 100.0 * alone.getMacs() / (simulated[0] * pes), simulated[1],
+                    packed.getCycles(), 100.0 * alone.getMacs() / (simulated[1] * pes));
+      }
+      double pes = double(nbOfCEs) * arrays[a] * arrays[a];
+      std::printf("%-10s %-11s %-16s %5d %5s %5s %10ld %10s %5.1f%% %10ld %10s %5.1f%%\n", network.name, "total", "",
+                  arrays[a], "", "", cycles[0], "", 100.0 * macs / (cycles[0] * pes), cycles[1], "",
+                  100.0 * macs / (cycles[1] * pes));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Helpers shared by the benches
+
+#ifndef CNNP_BENCHHELPERS_H
+#define CNNP_BENCHHELPERS_H
+
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Tensor.hpp"
+#include "LayerRun.hpp"
+#include <algorithm>
+#include <vector>
+
+/// Size divided, but not below the floor if it was above
+inline int scaleSize(int size, int divisor, int floor)
+{
+  return std::max(size / divisor, std::min(size, floor));
+}
+
+/// Layer with its dimensions divided, a depthwise layer stay depthwise
+inline LayerHParam scaleLayer(LayerHParam p, int resolutionDivisor, int channelDivisor)
+{
+  int groups = p.groups > 0 ? p.groups : 1;
+  bool depthwise = groups > 1 && groups == p.inputDepth;
+  int extent = (p.filterSize - 1) * std::max(p.dilation, 1) + 1;
+  p.inputWidth = scaleSize(p.inputWidth, resolutionDivisor, std::max(8, extent));
+  p.inputHeight = scaleSize(p.inputHeight, resolutionDivisor, std::max(8, extent));
+  p.inputDepth = scaleSize(p.inputDepth, channelDivisor, 16);
+  p.nbOfFilter = scaleSize(p.nbOfFilter, channelDivisor, 16);
+  if(depthwise)
+  {
+    p.groups = p.inputDepth;
+    p.nbOfFilter = p.inputDepth;
+  }
+  else
+  {
+    p.inputDepth -= p.inputDepth % groups;
+    p.nbOfFilter -= p.nbOfFilter % groups;
+  }
+  return p;
+}
+
+/// Run a layer with constant data: the weights 0.125, the inputs 0.25 and the bias
+template <typename T>
+LayerRun<T> runConstantLayer(const LayerHParam& p, const LayerRunOptions& options, double bias = 0)
+{
+  int groups = p.groups > 0 ? p.groups : 1;
+  Tensor<T> weights({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize});
+  Tensor<T> biasTensor({p.nbOfFilter});
+  Tensor<T> inputs({p.inputDepth, p.inputHeight, p.inputWidth});
+  weights.fill(T(0.125));
+  biasTensor.fill(T(bias));
+  inputs.fill(T(0.25));
+  return runLayer(p, weights, biasTensor, inputs, options);
+}
+
+#endif //CNNP_BENCHHELPERS_H
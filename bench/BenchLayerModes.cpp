@@ -0,0 +1,82 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compare the cycles and the PE utilization of a MobileNet style depthwise separable block on a
+// 3x3 CE: the depthwise layer run as a dense layer with zero weights out of the diagonal, or with
+// groups = inputDepth, and the pointwise layer run on a single PE, or mapped across the input
+// channels on the whole PE array.
+//
+// Usage: BenchLayerModes
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Tensor.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+static const int arraySize = 3;   ///< The CE of the accelerator is 3x3, whatever the layer
+
+/// Run a layer with constant data on a CE of ceSize and return the number of cycles
+long runModeLayer(const LayerHParam& p, int ceSize, bool pointwise, bool blockDiagonal)
+{
+  int groups = p.groups > 0 ? p.groups : 1;
+  Tensor<BenchType> weights({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize});
+  Tensor<BenchType> bias({p.nbOfFilter});
+  Tensor<BenchType> inputs({p.inputDepth, p.inputHeight, p.inputWidth});
+  weights.fill(BenchType(0.125));
+  bias.fill(BenchType(0.5));
+  inputs.fill(BenchType(0.25));
+  if(blockDiagonal)
+  {
+    for(int f = 0; f < p.nbOfFilter; f++)
+      for(int d = 0; d < p.inputDepth; d++)
+        if(d != f)
+          weights[f][d].fill(BenchType(0));
+  }
+  LayerRunOptions options;
+  options.ceSize = ceSize;
+  options.mapping = pointwise ? POINTWISE_MAPPING : STREAM_MAPPING;
+  options.shadowWeights = true;
+  return runLayer(p, weights, bias, inputs, options).cycles;
+}
+
+/// Print one mapping of a layer
+void report(const char* layer, const char* mapping, long cycles, long macs, long naiveCycles)
+{
+  std::printf("%-22s %-28s %10ld %9.1f%% %8.2fx\n", layer, mapping, cycles,
+              100.0 * macs / (double(cycles) * arraySize * arraySize), double(naiveCycles) / cycles);
+}
+
+int main()
+{
+  std::printf("%-22s %-28s %10s %10s %9s\n", "layer", "mapping", "cycles", "PE util", "speedup");
+
+  const int sizes[][2] = {{56, 32}, {28, 64}, {14, 128}};
+  for(int s = 0; s < 3; s++)
+  {
+    int width = sizes[s][0], depth = sizes[s][1];
+    char name[32];
+
+    // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+    LayerHParam dense{width, width, depth, depth, 3, 1, 1, 1};
+    LayerHParam depthwise{width, width, depth, depth, 3, 1, 1, depth};
+    long macs = (long)depth * width * width * 9;
+    long naive = runModeLayer(dense, arraySize, false, true);
+    std::snprintf(name, sizeof(name), "dw %dx%dx%d", width, width, depth);
+    report(name, "dense, zero weights", naive, macs, naive);
+    report(name, "depthwise (groups = depth)", runModeLayer(depthwise, arraySize, false, false), macs, naive);
+
+    LayerHParam pointwise{width, width, depth, 2 * depth, 1, 1, 0, 1};
+    macs = (long)2 * depth * depth * width * width;
+    naive = runModeLayer(pointwise, 1, false, false);
+    std::snprintf(name, sizeof(name), "pw %dx%dx%d->%d", width, width, depth, 2 * depth);
+    report(name, "single PE", naive, macs, naive);
+    report(name, "pointwise (channel lanes)", runModeLayer(pointwise, arraySize, true, false), macs, naive);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Layer-pipelined against layer-sequential execution of a chain of ReLU convolution layers. In
+// pipelined mode every layer run on its own CEs and the layers exchange rows through bounded
+// FIFOs, in sequential mode every layer run on all the CEs. Print, for several band heights,
+// the first row latency, the image latency and the steady-state cycles per image of the two
+// modes, then the stages of the band with the lowest latency.
+//
+// Usage: BenchLayerPipeline [cesPerStage] [images] [resolution]
+//        cesPerStage 0 give a CE per filter of the layer
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/LayerPipeline.hpp"
+#include "CNNP/Tensor.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+int main(int argc, char* argv[])
+{
+  int cesPerStage = argc > 1 ? std::atoi(argv[1]) : 0;
+  int nbOfImages = argc > 2 ? std::atoi(argv[2]) : 4;
+  int resolution = argc > 3 ? std::atoi(argv[3]) : 24;
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  int r = resolution;
+  std::vector<LayerHParam> network{
+    LayerHParam{r, r, 3, 4, 3, 1, 1},
+    LayerHParam{r, r, 4, 4, 3, 1, 1},
+    LayerHParam{r, r, 4, 8, 3, 2, 1},
+    LayerHParam{r / 2, r / 2, 8, 4, 1, 1, 0}};
+
+  std::srand(1);
+  LayerPipeline<BenchType> pipeline;
+  for(int l = 0; l < network.size(); l++)
+  {
+    const LayerHParam& p = network[l];
+    Tensor<BenchType> weights({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize});
+    Tensor<BenchType> bias({p.nbOfFilter});
+    for(int i = 0; i < weights.size(); i++){weights.data()[i] = BenchType((std::rand() % 9 - 4) * 0.0625);}
+    pipeline.addLayer(p, weights, bias, cesPerStage > 0 ? cesPerStage : p.nbOfFilter);
+  }
+  pipeline.setShadowWeights(true);
+  std::vector< Tensor<BenchType> > images;
+  for(int i = 0; i < nbOfImages; i++)
+  {
+    Tensor<BenchType> image({3, r, r});
+    for(int j = 0; j < image.size(); j++){image.data()[j] = BenchType((std::rand() % 9 - 4) * 0.125);}
+    images.push_back(image);
+  }
+
+  PipelineStats sequential = pipeline.runSequential(images);
+  std::printf("%-10s %6s %12s %12s %14s %8s\n", "mode", "band", "first row", "latency", "cycles/image", "speedup");
+  std::printf("%-10s %6s %12ld %12ld %14.1f %8.2f\n", "sequential", "-", sequential.firstRowLatency,
+              sequential.latency, sequential.cyclesPerImage, 1.0);
+  PipelineStats best;
+  int bestRows = 0;
+  for(int rows = 1; rows <= r; rows *= 2)
+  {
+    pipeline.setBandRows(rows);
+    PipelineStats pipelined = pipeline.run(images);
+    std::printf("%-10s %6d %12ld %12ld %14.1f %8.2f\n", "pipelined", rows, pipelined.firstRowLatency,
+                pipelined.latency, pipelined.cyclesPerImage, sequential.cyclesPerImage / pipelined.cyclesPerImage);
+    if(bestRows == 0 || pipelined.latency < best.latency)
+    {
+      best = pipelined;
+      bestRows = rows;
+    }
+  }
+  std::printf("\nLowest latency, band of %d rows\n", bestRows);
+  LayerPipeline<BenchType>::writeComparison(std::cout, sequential, best);
+  return 0;
+}
@@ -0,0 +1,116 @@
+//
+// Created by gortium on 10/19/18.
+//
+// A small VGG-like network (convolution, batch norm, ReLU, max pooling) compiled in an instruction
+// stream and run on the microcoded controller. The batch norms are folded and the ReLU and the
+// pooling fused by the compiler, the layers are tiled for the on-chip buffers. Print the start of
+// the program, then with and without the tile ordering the instructions of every opcode, the
+// input tiles loaded, the DRAM words and the cycles.
+//
+// Usage: BenchMicrocode [nbOfCEs] [inputBufferWords] [weightBufferWords] [accumulatorWords] [resolution]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/MicroController.hpp"
+#include "CNNP/NetworkCompiler.hpp"
+#include "CNNP/Program.hpp"
+#include "CNNP/Tensor.hpp"
+#include "BenchHelpers.hpp"
+#include "TestHelpers.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  long inputBufferWords = argc > 2 ? std::atol(argv[2]) : 1024;
+  long weightBufferWords = argc > 3 ? std::atol(argv[3]) : 512;
+  long accumulatorWords = argc > 4 ? std::atol(argv[4]) : 2048;
+  int resolution = argc > 5 ? std::atoi(argv[5]) : 16;
+  MemHParam memHParam{2, 2.0};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  int r = resolution;
+  std::vector<LayerHParam> network{
+    LayerHParam{r, r, 3, 16, 3, 1, 1},
+    LayerHParam{r, r, 16, 16, 3, 1, 1},
+    LayerHParam{r / 2, r / 2, 16, 32, 3, 1, 1},
+    LayerHParam{r / 2, r / 2, 32, 32, 3, 1, 1}};
+  std::vector<bool> pools{false, true, false, true};
+
+  std::srand(1);
+  std::vector< Tensor<BenchType> > weights, bias;
+  std::vector< std::vector<double> > gamma, beta, mean, variance;
+  for(int l = 0; l < network.size(); l++)
+  {
+    const LayerHParam& p = network[l];
+    weights.push_back(randomTensor<BenchType>({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize}, 0.0625));
+    bias.push_back(randomTensor<BenchType>({p.nbOfFilter}, 0.125));
+    gamma.push_back(std::vector<double>(p.nbOfFilter));
+    beta.push_back(std::vector<double>(p.nbOfFilter));
+    mean.push_back(std::vector<double>(p.nbOfFilter));
+    variance.push_back(std::vector<double>(p.nbOfFilter));
+    for(int f = 0; f < p.nbOfFilter; f++)
+    {
+      gamma[l][f] = 0.5 + (std::rand() % 4) * 0.25;
+      beta[l][f] = (std::rand() % 5 - 2) * 0.125;
+      mean[l][f] = (std::rand() % 5 - 2) * 0.0625;
+      variance[l][f] = 0.5 + (std::rand() % 4) * 0.5;
+    }
+  }
+  Tensor<BenchType> image = randomTensor<BenchType>({3, r, r}, 0.25);
+
+  std::printf("%d CEs, buffers: input %ld, weights %ld, accumulators %ld words\n", nbOfCEs, inputBufferWords,
+              weightBufferWords, accumulatorWords);
+  std::printf("%-9s %6s %6s %6s %6s %6s %6s %6s %6s %10s %10s %10s %10s\n", "ordering", "ltile", "lwgt", "conv",
+              "acc", "act", "pool", "store", "sync", "dram rd", "dram wr", "conv cyc", "cycles");
+  for(int ordering = 0; ordering < 2; ordering++)
+  {
+    NetworkCompiler<BenchType> compiler(inputBufferWords, weightBufferWords, accumulatorWords);
+    compiler.setTileOrdering(ordering);
+    for(int l = 0; l < network.size(); l++)
+    {
+      compiler.addConvolution(network[l], weights[l], bias[l]);
+      compiler.addBatchNorm(gamma[l], beta[l], mean[l], variance[l]);
+      compiler.addRelu();
+      if(pools[l])
+      {
+        compiler.addMaxPool(2, 2);
+      }
+    }
+    Program<BenchType> program = compiler.compile();
+    MicroController<BenchType> micro(program, nbOfCEs, memHParam);
+    micro.setShadowWeights(true);
+    micro.setInputs(image);
+    long cycles = micro.run();
+    std::printf("%-9s", ordering ? "reuse" : "in order");
+    for(int op = 0; op < NB_OF_OPCODES; op++)
+    {
+      std::printf(" %6ld", micro.getExecuted((Opcode)op));
+    }
+    std::printf(" %10ld %10ld %10ld %10ld\n", micro.getDramReads(), micro.getDramWrites(), micro.getConvCycles(),
+                cycles);
+    if(ordering)
+    {
+      std::ostringstream listing;
+      program.write(listing);
+      std::istringstream lines(listing.str());
+      std::string line;
+      std::printf("\n%zu instructions, %zu bytes packed. First ones:\n", program.instructions.size(),
+                  program.encode().size() * sizeof(uint64_t));
+      for(int i = 0; i < 16 && std::getline(lines, line); i++)
+      {
+        std::printf("  %s\n", line.c_str());
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,154 @@
+//
+// Created by gortium on 10/19/18.
+//
+// End-to-end suite of reference networks: the convolution layers of LeNet-5, AlexNet, VGG-16 and
+// a MobileNet block, with deterministic synthetic weights and inputs. Every layer is simulated on
+// a fixed CE array (window generator, folding of the larger filters, pointwise mode for the 1x1
+// filters). Print per layer the simulated cycles against the performance model, the PE
+// utilization and the DRAM traffic, then the host time of the simulation and the simulated cycles
+// per host second, to track the hardware model and the simulator speed.
+//
+// The spatial and channel dimensions are divided by the two divisors so the full suite run in
+// seconds, a divisor of 1 run the real layers.
+//
+// Usage: BenchNetworks [network|all] [nbOfCEs] [resolutionDivisor] [channelDivisor] [ceSize]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "BenchHelpers.hpp"
+#include "TestHelpers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+};
+
+struct Network
+{
+  const char* name;
+  std::vector<NetLayer> layers;
+};
+
+int main(int argc, char* argv[])
+{
+  std::string selected = argc > 1 ? argv[1] : "all";
+  int nbOfCEs = argc > 2 ? std::atoi(argv[2]) : 4;
+  int resolutionDivisor = argc > 3 ? std::atoi(argv[3]) : 4;
+  int channelDivisor = argc > 4 ? std::atoi(argv[4]) : 4;
+  int ceSize = argc > 5 ? std::atoi(argv[5]) : 3;
+  const int wordBytes = 2;
+  MemHParam memHParam{wordBytes, 4.0};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  std::vector<Network> networks = {
+    {"LeNet-5", {{"conv1", {32, 32, 1, 6, 5, 1, 0}},
+                 {"conv2", {14, 14, 6, 16, 5, 1, 0}}}},
+    {"AlexNet", {{"conv1", {227, 227, 3, 96, 11, 4, 0}},
+                 {"conv2", {27, 27, 96, 256, 5, 1, 2, 2}},
+                 {"conv3", {13, 13, 256, 384, 3, 1, 1}},
+                 {"conv4", {13, 13, 384, 384, 3, 1, 1, 2}},
+                 {"conv5", {13, 13, 384, 256, 3, 1, 1, 2}}}},
+    {"VGG-16", {{"conv1_1", {224, 224, 3, 64, 3, 1, 1}},
+                {"conv1_2", {224, 224, 64, 64, 3, 1, 1}},
+                {"conv2_1", {112, 112, 64, 128, 3, 1, 1}},
+                {"conv2_2", {112, 112, 128, 128, 3, 1, 1}},
+                {"conv3_1", {56, 56, 128, 256, 3, 1, 1}},
+                {"conv3_2", {56, 56, 256, 256, 3, 1, 1}},
+                {"conv3_3", {56, 56, 256, 256, 3, 1, 1}},
+                {"conv4_1", {28, 28, 256, 512, 3, 1, 1}},
+                {"conv4_2", {28, 28, 512, 512, 3, 1, 1}},
+                {"conv4_3", {28, 28, 512, 512, 3, 1, 1}},
+                {"conv5_1", {14, 14, 512, 512, 3, 1, 1}},
+                {"conv5_2", {14, 14, 512, 512, 3, 1, 1}},
+                {"conv5_3", {14, 14, 512, 512, 3, 1, 1}}}},
+    {"MobileNet", {{"dw1", {56, 56, 128, 128, 3, 1, 1, 128}},
+                   {"pw1", {56, 56, 128, 128, 1, 1, 0}},
+                   {"dw2", {56, 56, 128, 128, 3, 2, 1, 128}},
+                   {"pw2", {28, 28, 128, 256, 1, 1, 0}}}}};
+
+  bool found = selected == "all";
+  for(int n = 0; n < networks.size(); n++)
+  {
+    found = found || selected == networks[n].name;
+  }
+  if(!found)
+  {
+    std::fprintf(stderr, "Unknown network %s: LeNet-5, AlexNet, VGG-16, MobileNet or all\n", selected.c_str());
+    return 1;
+  }
+
+  std::printf("%d CEs of %dx%d, resolution / %d, channels / %d, shadow weights\n", nbOfCEs, ceSize, ceSize,
+              resolutionDivisor, channelDivisor);
+  std::printf("%-10s %-8s %-16s %12s %12s %7s %12s %10s %12s\n", "network", "layer", "shape", "cycles",
+              "model cyc", "util", "DRAM bytes", "host ms", "cycles/s");
+  for(int n = 0; n < networks.size(); n++)
+  {
+    const Network& network = networks[n];
+    if(selected != "all" && selected != network.name)
+    {
+      continue;
+    }
+    std::srand(n + 1);
+    long totalCycles = 0, totalMacs = 0, totalBytes = 0;
+    double totalSeconds = 0;
+    for(int l = 0; l < network.layers.size(); l++)
+    {
+      LayerHParam p = scaleLayer(network.layers[l].layerHParam, resolutionDivisor, channelDivisor);
+      int groups = p.groups > 0 ? p.groups : 1;
+      bool pointwise = p.filterSize == 1;
+      Tensor<BenchType> weights = randomTensor<BenchType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize,
+                                                          p.filterSize}, 0.0625);
+      Tensor<BenchType> bias = randomTensor<BenchType>({p.nbOfFilter}, 0.125);
+      Tensor<BenchType> inputs = randomTensor<BenchType>({p.inputDepth, p.inputHeight, p.inputWidth}, 0.125);
+
+      std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(ceSize, p.inputWidth + 2 * p.padding));
+      Controller<BenchType> ctrl(CEs, p, pointwise ? POINTWISE_MAPPING : WINDOW_MAPPING);
+      ctrl.setWeights(weights, bias);
+      ctrl.setInputs(inputs);
+      ctrl.setShadowWeights(true);
+      Simulator<BenchType> sim(ctrl, CEs);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      long cycles = sim.run(1L << 40);
+      std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+      double seconds = std::chrono::duration<double>(stop - start).count();
+
+      PerfModel model(p, ceSize, nbOfCEs, memHParam);
+      model.setPointwise(pointwise);
+      model.setWindowGenerator(!pointwise);
+      model.setShadowWeights(true);
+      EventCounts events = ctrl.getEventCounts();
+      long bytes = (events.dramReads + events.dramWrites) * wordBytes;
+      double utilization = (double)ctrl.getMacs() / ((double)cycles * nbOfCEs * ceSize * ceSize);
+      char shape[32];
+      std::snprintf(shape, sizeof(shape), "%dx%dx%d->%d k%d", p.inputWidth, p.inputHeight, p.inputDepth,
+                    p.nbOfFilter, p.filterSize);
+      std::printf("%-10s %-8s %-16s %12ld %12ld %6.1f%% %12ld %10.1f %12.0f\n", network.name,
+                  network.layers[l].name, shape, cycles, model.getCycles(), 100.0 * utilization, bytes,
+                  1000.0 * seconds, cycles / seconds);
+      totalCycles += cycles;
+      totalMacs += ctrl.getMacs();
+      totalBytes += bytes;
+      totalSeconds += seconds;
+    }
+    std::printf("%-10s %-8s %-16s %12ld %12s %6.1f%% %12ld %10.1f %12.0f\n", network.name, "total", "", totalCycles,
+                "", 100.0 * totalMacs / ((double)totalCycles * nbOfCEs * ceSize * ceSize), totalBytes,
+                1000.0 * totalSeconds, totalCycles / totalSeconds);
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Roofline report of a small network. Every layer is simulated, fetched from the memory by a DMA
+// engine with the DRAM bandwidth, then placed against the roof of the processor (PEs * clock, DRAM
+// bandwidth) with its arithmetic intensity from the performance model and its simulated transfer
+// cycles. Print an ASCII chart and a CSV table, also written to a file if one is given.
+//
+// Usage: BenchRoofline [nbOfCEs] [dramBytesPerCycle] [inputBufferWords] [clockMHz] [csvFile]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Roofline.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+struct NetLayer
+{
+  const char* name;
+  LayerHParam layerHParam;
+  bool pointwise;
+};
+
+int main(int argc, char* argv[])
+{
+  int nbOfCEs = argc > 1 ? std::atoi(argv[1]) : 4;
+  MemHParam memHParam{2, argc > 2 ? std::atof(argv[2]) : 4.0, argc > 3 ? std::atol(argv[3]) : 0};
+  double clockMHz = argc > 4 ? std::atof(argv[4]) : 100.0;
+  const int ceSize = 3;
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  DmaHParam dmaHParam{16, 8, 20, memHParam.dramBytesPerCycle / memHParam.wordBytes};
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  std::vector<NetLayer> network{
+    {"conv1", LayerHParam{32, 32, 3, 8, 3, 1, 1, 0, CONVOLUTION}, false},
+    {"conv2", LayerHParam{32, 32, 8, 16, 3, 2, 1, 0, CONVOLUTION}, false},
+    {"dw3", LayerHParam{16, 16, 16, 16, 3, 1, 1, 16, CONVOLUTION}, false},
+    {"pw3", LayerHParam{16, 16, 16, 32, 1, 1, 0, 0, CONVOLUTION}, true},
+    {"conv4", LayerHParam{16, 16, 32, 32, 3, 2, 1, 0, CONVOLUTION}, false},
+    {"fc5", LayerHParam{1, 1, 2048, 10, 1, 1, 0, 0, FULLY_CONNECTED}, true},
+    {"fc5_batch16", LayerHParam{16, 1, 2048, 10, 1, 1, 0, 0, FULLY_CONNECTED}, true}};
+
+  Roofline roofline(nbOfCEs * ceSize * ceSize, memHParam, clockMHz);
+  for(int l = 0; l < network.size(); l++)
+  {
+    LayerHParam p = network[l].layerHParam;
+    bool fc = p.type == FULLY_CONNECTED;
+    int groups = p.groups > 0 ? p.groups : 1;
+    int filterSize = network[l].pointwise ? ceSize : p.filterSize;
+    std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(filterSize, fc ? 1 : p.inputWidth + 2 * p.padding));
+    Controller<BenchType> ctrl(CEs, p, network[l].pointwise ? POINTWISE_MAPPING : STREAM_MAPPING);
+    Tensor<BenchType> weights(fc ? std::vector<int>{p.nbOfFilter, p.inputDepth}
+                                 : std::vector<int>{p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize});
+    Tensor<BenchType> inputs(fc ? std::vector<int>{p.inputWidth, p.inputDepth}
+                                : std::vector<int>{p.inputDepth, p.inputHeight, p.inputWidth});
+    weights.fill(BenchType(0.125));
+    inputs.fill(BenchType(0.25));
+
+    // The layer tensors back to back in the memory
+    DmaLayout layout{0, size_t(weights.size()), size_t(weights.size() + p.nbOfFilter),
+                     size_t(weights.size() + p.nbOfFilter + inputs.size())};
+    Memory<BenchType> memory(layout.outputs + (size_t)p.nbOfFilter * ctrl.outputHeight() * ctrl.outputWidth());
+    memory.Write(layout.weights, weights.data(), weights.size());
+    memory.Write(layout.inputs, inputs.data(), inputs.size());
+    DmaEngine<BenchType> dma(memory, dmaHParam);
+    ctrl.setDma(dma, layout);
+    ctrl.setShadowWeights(true);
+    Simulator<BenchType> sim(ctrl, CEs);
+    long cycles = sim.run(1L << 40);
+
+    PerfModel model(p, filterSize, nbOfCEs, memHParam);
+    model.setPointwise(network[l].pointwise);
+    model.setShadowWeights(true);
+    roofline.addLayer(network[l].name, model, cycles, dma.getBusyCycles());
+  }
+
+  roofline.writeChart(std::cout);
+  std::cout << "\n";
+  roofline.writeCsv(std::cout);
+  if(argc > 5)
+  {
+    std::ofstream csv(argv[5]);
+    roofline.writeCsv(csv);
+  }
+  return 0;
+}
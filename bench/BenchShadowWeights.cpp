@@ -0,0 +1,54 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Count the simulated cycles of multi-filter layers with the weights reloaded between the
+// passes, and with the next pass weights loaded in the CE shadow bank in the background.
+//
+// Usage: BenchShadowWeights
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "BenchHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+/// Run a layer with constant data on a CE of the filter size
+LayerRun<BenchType> runShadowLayer(const LayerHParam& p, bool shadow)
+{
+  LayerRunOptions options;
+  options.shadowWeights = shadow;
+  return runConstantLayer<BenchType>(p, options, 0.5);
+}
+
+int main()
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  const LayerHParam layers[] = {
+      LayerHParam{28,28,1,8,5,1,2},
+      LayerHParam{14,14,8,16,3,1,1},
+      LayerHParam{14,14,16,16,1,1,0},
+      LayerHParam{32,32,3,16,3,2,1},
+      LayerHParam{7,7,32,32,3,1,1}
+  };
+
+  std::printf("%24s %12s %9s %12s %9s %9s %8s\n",
+              "layer (WxHxD, NxFxF/S)", "reload cyc", "exposed", "shadow cyc", "exposed", "hidden", "speedup");
+  for(int l = 0; l < sizeof(layers) / sizeof(layers[0]); l++)
+  {
+    const LayerHParam& p = layers[l];
+    LayerRun<BenchType> reload = runShadowLayer(p, false);
+    LayerRun<BenchType> shadow = runShadowLayer(p, true);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%dx%dx%d, %dx%dx%d/%d", p.inputWidth, p.inputHeight, p.inputDepth,
+                  p.nbOfFilter, p.filterSize, p.filterSize, p.stride);
+    std::printf("%24s %12ld %9ld %12ld %9ld %9ld %7.2fx\n", name, reload.cycles, reload.exposedLoadSteps,
+                shadow.cycles, shadow.exposedLoadSteps, shadow.hiddenLoadSteps, double(reload.cycles) / shadow.cycles);
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compute a layer with 1 to 8 CEs reading a shared line buffer, one filter per CE. Print the
+// cycles and the input writes and buffer words, against one line buffer per CE.
+//
+// Usage: BenchSharedLineBuffer
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include <cstdio>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+int main()
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{28, 28, 8, 16, 3, 1, 1};
+  int fifoSize = p.inputWidth + 2 * p.padding;
+
+  std::printf("Layer %dx%dx%d, %d filters %dx%d\n", p.inputWidth, p.inputHeight, p.inputDepth,
+              p.nbOfFilter, p.filterSize, p.filterSize);
+  std::printf("%4s %10s %14s %14s %12s %12s\n", "CEs", "cycles", "input writes", "unshared", "buf words", "unshared");
+  for(int nbOfCEs = 1; nbOfCEs <= 8; nbOfCEs *= 2)
+  {
+    std::vector< CE<BenchType> > CEs(nbOfCEs, CE<BenchType>(p.filterSize, fifoSize));
+    Controller<BenchType> ctrl(CEs, p);
+    ctrl.setWeights(std::vector< std::vector< std::vector< std::vector<BenchType> > > >(p.nbOfFilter,
+                        std::vector< std::vector< std::vector<BenchType> > >(p.inputDepth,
+                        std::vector< std::vector<BenchType> >(p.filterSize, std::vector<BenchType>(p.filterSize, BenchType(0.125))))),
+                    std::vector<BenchType>(p.nbOfFilter, BenchType(0.5)));
+    ctrl.setInputs(std::vector< std::vector< std::vector<BenchType> > >(p.inputDepth,
+                       std::vector< std::vector<BenchType> >(p.inputHeight, std::vector<BenchType>(p.inputWidth, BenchType(0.25)))));
+    ctrl.setShadowWeights(true);
+    while(!ctrl.isHalted())
+    {
+      ctrl.step();
+    }
+
+    // A single CE own its line buffer
+    long writes = (nbOfCEs > 1) ? ctrl.getInputWrites() : ctrl.getTotalSteps();
+    long words = (long)p.filterSize * fifoSize;
+    std::printf("%4d %10ld %14ld %14ld %12ld %12ld\n", nbOfCEs, ctrl.getTotalSteps(),
+                writes, writes + ctrl.getSavedInputWrites(), words, words * nbOfCEs);
+  }
+  return 0;
+}
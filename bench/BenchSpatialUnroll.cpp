@@ -0,0 +1,61 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Trade area for throughput with the spatial unroll: a 3x3 layer run with the window generator on
+// 2 groups of P CEs, every group computing P adjacent outputs of a filter per cycle. The cycles
+// are simulated, the PEs and registers come from PerfModel::getResources().
+//
+// Usage: BenchSpatialUnroll [inputWidth] [inputDepth] [nbOfFilter]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "BenchHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+/// Run a layer with constant data on nbOfCEs CEs fed by the window generator
+LayerRun<BenchType> runUnrolledLayer(const LayerHParam& p, int nbOfCEs, int unroll)
+{
+  LayerRunOptions options;
+  options.nbOfCEs = nbOfCEs;
+  options.mapping = WINDOW_MAPPING;
+  options.unroll = unroll;
+  options.shadowWeights = true;
+  return runConstantLayer<BenchType>(p, options);
+}
+
+int main(int argc, char* argv[])
+{
+  int inputWidth = argc > 1 ? std::atoi(argv[1]) : 32;
+  int inputDepth = argc > 2 ? std::atoi(argv[2]) : 2;
+  int nbOfFilter = argc > 3 ? std::atoi(argv[3]) : 4;
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{inputWidth, inputWidth, inputDepth, nbOfFilter, 3, 1, 1};
+
+  std::printf("3x3 filters, %dx%d inputs, %d channels, %d filters, 2 filters in parallel\n",
+              inputWidth, inputWidth, inputDepth, nbOfFilter);
+  std::printf("%6s %5s %10s %9s %10s %8s %12s %12s\n", "unroll", "PEs", "cycles", "speedup", "PE x cyc",
+              "out reg", "window regs", "utilization");
+  long base = 0;
+  for(int unroll = 1; unroll <= 8; unroll *= 2)
+  {
+    PerfModel model(p, p.filterSize, 2 * unroll, MemHParam{2, 4.0});
+    model.setWindowGenerator(true);
+    model.setSpatialUnroll(unroll);
+    model.setShadowWeights(true);
+    Resources resources = model.getResources();
+    long cycles = runUnrolledLayer(p, 2 * unroll, unroll).cycles;
+    if(unroll == 1){base = cycles;}
+    std::printf("%6d %5ld %10ld %8.3fx %10ld %8ld %12ld %11.1f%%\n", unroll, resources.pes, cycles,
+                double(base) / cycles, resources.pes * cycles, resources.outputRegisters,
+                resources.windowRegisters, 100.0 * model.getUtilization());
+  }
+  return 0;
+}
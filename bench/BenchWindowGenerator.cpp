@@ -0,0 +1,64 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Compare the cycles of a 3x3 layer streamed in the CE FIFOs, where every output row pay the
+// filterSize - 1 windows straddling two rows and the padding steps, with the window generator
+// that only step the valid windows. The window generator refill the first window of every output
+// row through its input buffer read port: with the default port, one new column per step, and
+// with a port wide enough for a whole window in one step. The inputs are square, from 7 to 224
+// wide, with and without padding.
+//
+// Usage: BenchWindowGenerator [inputDepth] [nbOfFilter]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "BenchHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> BenchType;
+
+/// Run a layer with constant data on 2 CEs, streamed in the FIFOs or fed by the window generator
+long runWindowLayer(const LayerHParam& p, bool windowed, int readColumns)
+{
+  LayerRunOptions options;
+  options.nbOfCEs = 2;
+  options.mapping = windowed ? WINDOW_MAPPING : STREAM_MAPPING;
+  options.readColumns = readColumns;
+  options.shadowWeights = true;
+  return runConstantLayer<BenchType>(p, options).cycles;
+}
+
+int main(int argc, char* argv[])
+{
+  int inputDepth = argc > 1 ? std::atoi(argv[1]) : 2;
+  int nbOfFilter = argc > 2 ? std::atoi(argv[2]) : 2;
+  const int widths[] = {7, 14, 28, 56, 112, 224};
+
+  std::printf("3x3 filters, %d channels, %d filters on 2 CEs\n", inputDepth, nbOfFilter);
+  PerfModel model(LayerHParam{7, 7, inputDepth, nbOfFilter, 3, 1, 1}, 3, 2, MemHParam{2, 4.0});
+  model.setWindowGenerator(true);
+  std::printf("Window read port: %ld words per step, %d for a whole window\n", model.getResources().windowReadWords,
+              3 * 3);
+  std::printf("%8s %6s %12s %12s %9s %10s %12s %9s\n", "padding", "width", "FIFO cycles", "window cyc", "speedup",
+              "bubbles", "wide port", "refill");
+  for(int padding = 1; padding >= 0; padding--)
+  {
+    for(int w = 0; w < 6; w++)
+    {
+      // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+      LayerHParam p{widths[w], widths[w], inputDepth, nbOfFilter, 3, 1, padding};
+      long fifo = runWindowLayer(p, false, 0);
+      long window = runWindowLayer(p, true, 0);
+      long wide = runWindowLayer(p, true, 3);
+      std::printf("%8d %6d %12ld %12ld %8.3fx %9.1f%% %12ld %8.1f%%\n", padding, widths[w], fifo, window,
+                  double(fifo) / window, 100.0 * (fifo - window) / fifo, wide, 100.0 * (window - wide) / window);
+    }
+  }
+  return 0;
+}
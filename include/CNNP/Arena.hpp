@@ -0,0 +1,117 @@
+/**
+ *  @file    Arena.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Arena allocator
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module hand out memory from big blocks by bumping a pointer. Nothing is freed before the
+ *  arena itself, so the buffers of a layer can be allocated back to back in one block and the
+ *  allocation cost is a few additions.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Arena allocator. Objects that allocate memory from blocks freed all at once
+ */
+class Arena
+{
+  private:
+  std::vector< std::unique_ptr<unsigned char[]> > _blocks;   ///< The memory blocks
+  size_t _blockSize;          ///< Size of a new block, unless an allocation need more
+  size_t _blockUsed;          ///< Bytes used in the last block
+  size_t _lastBlockSize;      ///< Size of the last block
+  size_t _allocated;          ///< Bytes handed out since construction
+
+  public:
+  static const size_t defaultBlockSize = 1 << 20;   ///< 1 MiB
+
+  explicit Arena(size_t blockSize = defaultBlockSize);
+  ~Arena();
+  void* allocate(size_t bytes, size_t alignment);
+  size_t getAllocated();
+  size_t getNbOfBlocks();
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  Arena object constructor. No memory is taken before the first allocation.
+*
+* @param  blockSize is the size of the blocks in bytes
+*/
+inline Arena::Arena(size_t blockSize) :
+    _blockSize(blockSize),
+    _blockUsed(0),
+    _lastBlockSize(0),
+    _allocated(0)
+{
+  if(blockSize == 0)
+  {
+    throw std::runtime_error("Arena block size cannot be 0");
+  }
+}
+
+/**
+* @brief  Arena object destructor. Free all the blocks.
+*/
+inline Arena::~Arena()
+{}
+
+/**
+* @brief  Allocate memory in the last block, or in a new one if it does not fit
+*
+* @param  bytes is the size to allocate
+* @param  alignment is the alignment of the memory, a power of 2
+*
+* @return the allocated memory
+*/
+inline void* Arena::allocate(size_t bytes, size_t alignment)
+{
+  size_t offset = 0;
+  if(!_blocks.empty())
+  {
+    size_t address = reinterpret_cast<size_t>(_blocks.back().get()) + _blockUsed;
+    offset = ((address + alignment - 1) & ~(alignment - 1)) - address;
+  }
+  if(_blocks.empty() || _blockUsed + offset + bytes > _lastBlockSize)
+  {
+    _lastBlockSize = (bytes + alignment > _blockSize) ? bytes + alignment : _blockSize;
+    _blocks.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[_lastBlockSize]));
+    _blockUsed = 0;
+    size_t address = reinterpret_cast<size_t>(_blocks.back().get());
+    offset = ((address + alignment - 1) & ~(alignment - 1)) - address;
+  }
+
+  void* memory = _blocks.back().get() + _blockUsed + offset;
+  _blockUsed += offset + bytes;
+  _allocated += bytes;
+  return memory;
+}
+
+/**
+* @brief  Function used to know how many bytes were handed out
+*
+* @return the allocated bytes, without the alignment padding
+*/
+inline size_t Arena::getAllocated()
+{
+  return _allocated;
+}
+
+inline size_t Arena::getNbOfBlocks()
+{
+  return _blocks.size();
+}
+
+#endif //ARENA_HPP
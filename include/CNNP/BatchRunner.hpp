@@ -0,0 +1,370 @@
+/**
+ *  @file    BatchRunner.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Multi-image batch runner
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module push many independent images through the same layer on the host cores. Every worker
+ *  thread own a simulator instance (CEs, controller and simulator) built once: the weights are
+ *  loaded in its buffers from the tensors shared read-only by all the workers, then the primed
+ *  state is saved in a Snapshot. Every image restore that snapshot, set its inputs and run.
+ *
+ *  The images are spread by a WorkStealingQueue: every worker start with a contiguous range and
+ *  steal half of the range of another worker when its own is empty. Every image write its own
+ *  result slot and the totals are atomics, so no lock is taken.
+ */
+
+#ifndef BATCHRUNNER_HPP
+#define BATCHRUNNER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "CE.hpp"
+#include "Controller.hpp"
+#include "EventCounts.hpp"
+#include "HyperParams.hpp"
+#include "Simulator.hpp"
+#include "Snapshot.hpp"
+#include "Tensor.hpp"
+#include "WorkerPool.hpp"
+
+/**
+ * @brief Lock-free work-stealing queue of item indices. Objects that hold one range of items per
+ *        worker, packed [begin, end) in one atomic word.
+ */
+class WorkStealingQueue
+{
+  private:
+  std::vector< std::atomic<uint64_t> > _ranges;   ///< Range of every worker, begin in the high half
+  std::atomic<long> _steals;
+
+  static uint64_t pack(uint64_t begin, uint64_t end){return (begin << 32) | end;}
+  static long begin(uint64_t range){return long(range >> 32);}
+  static long end(uint64_t range){return long(range & 0xFFFFFFFFu);}
+
+  public:
+  WorkStealingQueue(int workers, long items);
+  ~WorkStealingQueue();
+  bool pop(int worker, long& item);
+  long getSteals();
+};
+
+/// Result of one image
+struct BatchImageStats
+{
+  long cycles;           ///< Simulated cycles of the image
+  int worker;            ///< Thread that ran the image
+  EventCounts events;    ///< Events of the image, the weights load of the worker excluded
+};
+
+/// Result of a batch
+struct BatchStats
+{
+  int threads;
+  long images;
+  long totalCycles;      ///< Simulated cycles of all the images
+  long steals;           ///< Ranges stolen between the workers
+  double hostMs;         ///< Wall clock time of the batch
+  std::vector<BatchImageStats> perImage;
+};
+
+/**
+ * @brief Batch runner. Objects that simulate a layer on many images with several host threads
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class BatchRunner
+{
+  private:
+  LayerHParam _layerHParam;
+  int _nbOfCEs;
+  int _ceSize;
+  Tensor<T> _weights;            ///< Shared read-only by the workers
+  Tensor<T> _bias;
+  bool _shadowWeights;
+  bool _pointwise;
+
+  void work(int worker, WorkStealingQueue& queue, const std::vector< Tensor<T> >& images,
+            std::vector< Tensor<T> >* outputs, BatchStats& stats, std::atomic<long>& totalCycles);
+
+  public:
+  BatchRunner(LayerHParam layerHParam, int nbOfCEs, const Tensor<T>& weights, const Tensor<T>& bias,
+              int ceSize = 0);
+  ~BatchRunner();
+  void setShadowWeights(bool enable);
+  void setPointwise(bool enable);
+  BatchStats run(const std::vector< Tensor<T> >& images, int nbThreads,
+                 std::vector< Tensor<T> >* outputs = nullptr);
+  std::vector<BatchStats> scaling(const std::vector< Tensor<T> >& images, int maxThreads);
+  static void writeScaling(std::ostream& os, const std::vector<BatchStats>& scaling);
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  WorkStealingQueue object constructor. The items are split in equal contiguous ranges.
+*
+* @param  workers is the number of workers
+* @param  items is the number of items, less than 2^32
+*/
+inline WorkStealingQueue::WorkStealingQueue(int workers, long items) :
+    _ranges(workers),
+    _steals(0)
+{
+  if(workers < 1 || items < 0 || items > long(0xFFFFFFFFu))
+  {
+    throw std::runtime_error("WorkStealingQueue need workers and less than 2^32 items");
+  }
+  for(int w = 0; w < workers; w++)
+  {
+    _ranges[w].store(pack(items * w / workers, items * (w + 1) / workers), std::memory_order_relaxed);
+  }
+}
+
+inline WorkStealingQueue::~WorkStealingQueue()
+{}
+
+/**
+* @brief  Take the next item of a worker. The worker take the front of its range, or steal the back
+*         half of the range of another worker. The ranges only shrink, except the one of a thief
+*         that was empty, so a CAS can not succeed on a stale range.
+*
+* @param  worker is the worker index
+* @param  item is set to the item taken
+*
+* @return false if all the ranges are empty
+*/
+inline bool WorkStealingQueue::pop(int worker, long& item)
+{
+  std::atomic<uint64_t>& own = _ranges[worker];
+  uint64_t range = own.load(std::memory_order_acquire);
+  while(begin(range) < end(range))
+  {
+    if(own.compare_exchange_weak(range, pack(begin(range) + 1, end(range)), std::memory_order_acq_rel))
+    {
+      item = begin(range);
+      return true;
+    }
+  }
+
+  for(int i = 1; i < _ranges.size(); i++)
+  {
+    std::atomic<uint64_t>& victim = _ranges[(worker + i) % _ranges.size()];
+    range = victim.load(std::memory_order_acquire);
+    while(begin(range) < end(range))
+    {
+      long middle = begin(range) + (end(range) - begin(range)) / 2;
+      if(victim.compare_exchange_weak(range, pack(begin(range), middle), std::memory_order_acq_rel))
+      {
+        item = middle;
+        own.store(pack(middle + 1, end(range)), std::memory_order_release);
+        _steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+inline long WorkStealingQueue::getSteals()
+{
+  return _steals.load(std::memory_order_relaxed);
+}
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  BatchRunner object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  layerHParam is the layer run on every image
+* @param  nbOfCEs is the number of CEs of every simulator instance
+* @param  weights is the layer weights, shared read-only by the workers
+* @param  bias is the layer bias
+* @param  ceSize is the CE size, 0 use the filter size
+*/
+template<typename T>
+BatchRunner<T>::BatchRunner(LayerHParam layerHParam, int nbOfCEs, const Tensor<T>& weights, const Tensor<T>& bias,
+                            int ceSize) :
+    _layerHParam(layerHParam),
+    _nbOfCEs(nbOfCEs),
+    _ceSize(ceSize > 0 ? ceSize : layerHParam.filterSize),
+    _weights(weights),
+    _bias(bias),
+    _shadowWeights(false),
+    _pointwise(false)
+{
+  if(nbOfCEs < 1)
+  {
+    throw std::runtime_error("BatchRunner need at least one CE");
+  }
+}
+
+template<typename T>
+BatchRunner<T>::~BatchRunner()
+{}
+
+template<typename T>
+void BatchRunner<T>::setShadowWeights(bool enable)
+{
+  _shadowWeights = enable;
+}
+
+template<typename T>
+void BatchRunner<T>::setPointwise(bool enable)
+{
+  _pointwise = enable;
+}
+
+/**
+* @brief  Worker thread. Build the simulator instance, then run the images taken from the queue.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void BatchRunner<T>::work(int worker, WorkStealingQueue& queue, const std::vector< Tensor<T> >& images,
+                          std::vector< Tensor<T> >* outputs, BatchStats& stats, std::atomic<long>& totalCycles)
+{
+  bool fc = _layerHParam.type == FULLY_CONNECTED;
+  std::vector< CE<T> > CEs(_nbOfCEs, CE<T>(_ceSize, fc ? 1 : _layerHParam.inputWidth + 2 * _layerHParam.padding));
+  Controller<T> ctrl(CEs, _layerHParam, _pointwise ? POINTWISE_MAPPING : STREAM_MAPPING);
+  ctrl.setWeights(_weights, _bias);
+  ctrl.setShadowWeights(_shadowWeights);
+  Simulator<T> sim(ctrl, CEs);
+  Snapshot primed;
+  sim.save(primed);
+  EventCounts primedEvents = ctrl.getEventCounts();
+
+  long image;
+  while(queue.pop(worker, image))
+  {
+    primed.rewind();
+    sim.restore(primed);
+    ctrl.setInputs(images[image]);
+    long cycles = sim.run(1L << 40);
+    if(!ctrl.isHalted())
+    {
+      throw std::runtime_error("BatchRunner image did not halt");
+    }
+
+    BatchImageStats& result = stats.perImage[image];
+    result.cycles = cycles;
+    result.worker = worker;
+    result.events = ctrl.getEventCounts();
+    result.events -= primedEvents;
+    totalCycles.fetch_add(cycles, std::memory_order_relaxed);
+    if(outputs)
+    {
+      (*outputs)[image] = ctrl.getOutputs().clone();
+    }
+  }
+}
+
+/**
+* @brief  Run the layer on every image
+*
+* @tparam T Type of input and output data
+*
+* @param  images is the inputs of every image, like Controller::setInputs()
+* @param  nbThreads is the number of host threads, caller included
+* @param  outputs is resized and set to the outputs of every image, when not null
+*
+* @return the batch stats
+*/
+template<typename T>
+BatchStats BatchRunner<T>::run(const std::vector< Tensor<T> >& images, int nbThreads,
+                               std::vector< Tensor<T> >* outputs)
+{
+  BatchStats stats;
+  stats.threads = nbThreads;
+  stats.images = images.size();
+  stats.perImage.assign(images.size(), BatchImageStats());
+  if(outputs)
+  {
+    outputs->assign(images.size(), Tensor<T>());
+  }
+
+  WorkStealingQueue queue(nbThreads, images.size());
+  std::atomic<long> totalCycles(0);
+  std::vector<std::exception_ptr> errors(nbThreads);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    WorkerPool pool(nbThreads);
+    pool.run([&](int worker)
+    {
+      try
+      {
+        work(worker, queue, images, outputs, stats, totalCycles);
+      }
+      catch(...)
+      {
+        errors[worker] = std::current_exception();
+      }
+    });
+  }
+  stats.hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  for(int w = 0; w < nbThreads; w++)
+  {
+    if(errors[w])
+    {
+      std::rethrow_exception(errors[w]);
+    }
+  }
+  stats.totalCycles = totalCycles.load();
+  stats.steals = queue.getSteals();
+  return stats;
+}
+
+/**
+* @brief  Run the same images with 1 to maxThreads host threads
+*
+* @tparam T Type of input and output data
+*
+* @return the stats of every thread count
+*/
+template<typename T>
+std::vector<BatchStats> BatchRunner<T>::scaling(const std::vector< Tensor<T> >& images, int maxThreads)
+{
+  std::vector<BatchStats> scaling;
+  for(int threads = 1; threads <= maxThreads; threads++)
+  {
+    scaling.push_back(run(images, threads));
+  }
+  return scaling;
+}
+
+/**
+* @brief  Write the scaling report, one line per thread count. The speedup and efficiency are
+*         relative to the first line.
+*
+* @param  os is the stream written
+* @param  scaling is the stats returned by scaling()
+*/
+template<typename T>
+void BatchRunner<T>::writeScaling(std::ostream& os, const std::vector<BatchStats>& scaling)
+{
+  os << "threads,images,host ms,images/s,speedup,efficiency,steals,cycles/image\n";
+  for(int i = 0; i < scaling.size(); i++)
+  {
+    const BatchStats& stats = scaling[i];
+    double speedup = stats.hostMs > 0 ? scaling.front().hostMs / stats.hostMs : 0;
+    os << stats.threads << "," << stats.images << "," << stats.hostMs << ","
+       << (stats.hostMs > 0 ? stats.images * 1000.0 / stats.hostMs : 0) << "," << speedup << ","
+       << speedup * scaling.front().threads / stats.threads << "," << stats.steals << ","
+       << (stats.images > 0 ? double(stats.totalCycles) / stats.images : 0) << "\n";
+  }
+}
+
+#endif //BATCHRUNNER_HPP
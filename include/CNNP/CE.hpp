@@ -9,7 +9,8 @@
  *  @section DESCRIPTION
  *  
  *  This module, when given weights, bias and input, compute a convolution. The PE placement and
- *  it input FIFO permit a stride in the input matrix at each step.
+ *  it input FIFO permit a stride in the input matrix at each step. The input FIFOs (inputRegs) are
+ *  a LineBuffer, owned by the CE or shared with other CEs computing other filters on the same input.
  *
  *                                                             biasSig
  *                                                                |
@@ -27,14 +28,38 @@
  *       /\                                                       |
  *       |                                                       \/
  *     inputSig                                                outputReg
+ *
+ *  A shadow bank of weight and bias registers is written one word per step from the narrow weight
+ *  port (portSig, portEnable), weights in raster order then the bias, while the active bank
+ *  compute. The swap signal copy the whole shadow bank in the PEs weights and in the bias register
+ *  in a single step, so a new filter is loaded without draining the pipeline.
+ *
+ *  In pointwise mode (1x1 filters) the FIFOs are bypassed. Every PE get its own input lane, one
+ *  input channel of the same pixel, through a skew register chain (j registers for the PE column
+ *  j) that line the lanes up with the PE partial sums. The PE array then compute a filterSize^2
+ *  channels dot product per step, instead of using a single PE.
+ *
+ *  For a dilated filter the PE rows tap the line buffer dilation input rows apart, and dilation - 1
+ *  registers between two PEs of a row delay the input so the PE columns are dilation pixels
+ *  apart. The filterSize^2 PE array then compute the dilated window without the zero weights of
+ *  a stuffed filter.
  */
 
 #ifndef CE_H
 #define CE_H
 
+#include "CNNP/EventCounts.hpp"
+#include "CNNP/LineBuffer.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/PassTiming.hpp"
 #include "CNNP/PE.hpp"
-#include <vector>
+#include "CNNP/RangeProfile.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "CNNP/WorkerPool.hpp"
+#include <memory>
 #include <queue>
+#include <stdexcept>
+#include <vector>
 
 /**
  * @brief Convolutionnal Element. Objects that compute a convolution
@@ -45,32 +70,92 @@
 template <typename T>
 class CE
 {
+  public:
+  typedef typename NumericTraits<T>::acc_type acc_type;   ///< Type of the partial sums
+
   private:
   // Parameter
   int _size;                                  ///< The size of the filter as int 
+  int _dilation;                              ///< The spacing of the filter taps
   // Input signals
   T _biasSig;                                 ///< The bias signal as a T type
   std::vector< std::vector<T> > _weightSigs;  ///< The weights signals as a vector of vector of T type
-  T _inputSig;                                ///< The inputs signal as a T type
   // Control signals
   bool _bEnableSig;                           ///< The control signal that enable the writing of the bias register
   bool _wEnableSig;                           ///< The control signal that enable the writing of the weights register
+  T _portSig;                                 ///< The narrow weight port signal, one shadow register per step
+  bool _portEnableSig;                        ///< The control signal that enable the writing of the weight port
+  bool _swapSig;                              ///< The control signal that swap the shadow bank in the active registers
+  std::vector< std::vector<T> > _laneSigs;    ///< The pointwise mode input lanes, one per PE
   // Registers
   T _outputReg;                               ///< The output register as a T type
-  std::vector<T> _adderRegs;                  ///< The adder registers as a vector of T type
-  std::vector< std::queue<T> > _syncRegs;     ///< The synchronization registers as a vector of queue of T type
+  std::vector<acc_type> _adderRegs;           ///< The adder registers, in the accumulator type
+  std::vector< std::queue<acc_type> > _syncRegs;   ///< The synchronization registers, in the accumulator type
   std::vector< std::vector<T> > _weightRegs;  ///< The weights registers as a vector of vector of T type 
-  std::vector< std::queue<T> > _inputRegs;    ///< The inputs registers as a vector of queue of T type 
+  LineBuffer<T> _lines;                       ///< The inputs registers, when not shared
+  std::shared_ptr< LineBuffer<T> > _sharedLines;  ///< The inputs registers shared with other CEs, stepped by their owner
+  std::vector< std::vector<T> > _shadowWeightRegs;  ///< The shadow weights registers, loaded from the weight port
+  T _shadowBiasReg;                           ///< The shadow bias register, loaded from the weight port after the weights
+  int _shadowCount;                           ///< Number of shadow registers written since the last swap
+  std::vector< std::vector< std::queue<T> > > _laneRegs;  ///< The pointwise mode lanes skew registers
+  std::vector< std::vector< std::queue<T> > > _dilationRegs;  ///< The input delay registers between the PEs of a row
+  // Mode
+  bool _pointwise;                            ///< The PEs take their input from the lanes instead of the FIFOs
   // Submodule
   std::vector< std::vector< PE<T> > > _PEs;   ///< A vector of vector containning PE submodules
+  // Activity tracking
+  bool _activityTracking;                     ///< Skip the work of the quiescent rows and steps when true
+  int _rowDrainSteps;                         ///< Steps of zeros that flush the input chain of a row
+  std::vector<int> _rowQuietSteps;            ///< Consecutive steps each PE row only received zeros
+  int _quietSteps;                            ///< Consecutive steps all the PE rows only received zeros
+  long _steps;                                ///< Number of steps (cycles) since construction
+  long _idleSteps;                            ///< Number of steps skipped because the CE was idle
+  long _skippedRowSteps;                      ///< Number of PE row steps skipped because the row was quiet
+  EventCounts _events;                        ///< Operations of the PEs, registers and adders, for the energy
+  std::vector<acc_type> _rowSums;             ///< The adder result of every row, committed after all rows are done
+  std::vector< RangeProfile<T> > _rowRanges;  ///< Values written by every row, one profile per row for the threads
+  RangeStats<T> _outputRange;                 ///< Values written in the output register
+  std::vector<char> _rowActive;               ///< 1 if the row received a non zero input this step
+  std::vector<char> _rowSkipped;              ///< 1 if the row PEs were not stepped this step
+  // Threads
+  OwnedWorkerPool _workers;                   ///< The threads stepping the PE rows. A copy of the CE start its own
+
+  void stepRows(int first, int last);
+  void recordIdle(long steps);
+  LineBuffer<T>& lines();
 
   public:
-  CE(int filterSize, int fifoSize);
+  static const unsigned int snapshotTag = 0x43450001;   ///< Snapshot tag of the CE
+
+  CE(int filterSize, int fifoSize, int dilation = 1);
   ~CE();
   int latency();
+  int getSize();
+  int getDilation();
   void step();
+  void skip(long steps);
+  bool isDrained();
+  bool isIdle();
+  void setActivityTracking(bool enable);
+  void setThreads(int nbThreads, int minSize);
+  bool isParallel();
+  long getSteps();
+  long getIdleSteps();
+  long getSkippedRowSteps();
+  EventCounts getEventCounts();
+  RangeProfile<T> getRangeProfile();
   T getOutputReg();
-  void setSigs(T input, std::vector< std::vector<T> > weights, bool wEnable, T bias, bool bEnable);
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
+  void setSigs(T input, const std::vector< std::vector<T> >& weights, bool wEnable, T bias, bool bEnable);
+  void setShadowSigs(T port, bool portEnable, bool swap);
+  bool isShadowReady();
+  void setPointwise(bool enable);
+  bool isPointwise();
+  void setLaneSigs(const std::vector< std::vector<T> >& lanes);
+  void shareLineBuffer(const std::shared_ptr< LineBuffer<T> >& lineBuffer);
+  bool isLineBufferShared();
+  LineBuffer<T>& getLineBuffer();
 };
 
 // --------------- Templatized Implementation ---------------
@@ -83,15 +168,37 @@ template<typename T>
 *
 * @param  filterSize is the filter size (height and width are equal) as a int
 * @param  fifoSize is the FIFO queue size as a int. Should be equal to the input width 
+* @param  dilation is the spacing of the filter taps, in input rows and columns
 */  
-CE<T>::CE(int filterSize, int fifoSize) :
+CE<T>::CE(int filterSize, int fifoSize, int dilation) :
     _size(filterSize),
+    _dilation(dilation),
     _biasSig(T(0)),
-    _inputSig(T(0)),
-    _outputReg(T(0)),
-    _adderRegs(_size, T(0)),
     _bEnableSig(0),
-    _wEnableSig(0)
+    _wEnableSig(0),
+    _portSig(T(0)),
+    _portEnableSig(false),
+    _swapSig(false),
+    _laneSigs(_size, std::vector<T>(_size, T(0))),
+    _outputReg(T(0)),
+    _adderRegs(_size, NumericTraits<T>::widen(T(0))),
+    _lines(filterSize > 0 ? filterSize : 1, fifoSize, dilation),
+    _shadowWeightRegs(_size, std::vector<T>(_size, T(0))),
+    _shadowBiasReg(T(0)),
+    _shadowCount(0),
+    _pointwise(false),
+    _activityTracking(true),
+    _rowDrainSteps(2 * _size + (dilation - 1) * (_size - 1)),
+    _rowQuietSteps(_size, _rowDrainSteps),
+    _quietSteps(_rowDrainSteps + 2 * _size),
+    _steps(0),
+    _idleSteps(0),
+    _skippedRowSteps(0),
+    _events(),
+    _rowSums(_size, NumericTraits<T>::widen(T(0))),
+    _rowRanges(_size),
+    _rowActive(_size, 0),
+    _rowSkipped(_size, 0)
 {
   if(_size == 0)
   {
@@ -117,12 +224,29 @@ CE<T>::CE(int filterSize, int fifoSize) :
     _weightRegs[i].assign(_size, T(0));
   }
 
-  _inputRegs.resize(_size);
-  for(int i=0; i < _inputRegs.size(); i++)
+  _lines.addReader();
+
+  _laneRegs.resize(_size, std::vector< std::queue<T> >(_size));
+  for(int i=0; i < _laneRegs.size(); i++)
+  {
+    for(int j=0; j < _size; j++)
+    {
+      for(int k=0; k < j; k++)
+      {
+        _laneRegs[i][j].emplace(T(0));
+      }
+    }
+  }
+
+  _dilationRegs.resize(_size, std::vector< std::queue<T> >(_size));
+  for(int i=0; i < _dilationRegs.size(); i++)
   {
-    for(int j=0; j < fifoSize; j++)
+    for(int j=1; j < _size; j++)
     {
-      _inputRegs[i].emplace(T(0));
+      for(int k=0; k < _dilation - 1; k++)
+      {
+        _dilationRegs[i][j].emplace(T(0));
+      }
     }
   }
 
@@ -131,7 +255,7 @@ CE<T>::CE(int filterSize, int fifoSize) :
   {
     for(int j=0; j < i+1; j++)
     {
-      _syncRegs[i].emplace(T(0));
+      _syncRegs[i].emplace(NumericTraits<T>::widen(T(0)));
     }
   }
 }
@@ -145,20 +269,214 @@ template<typename T>
 CE<T>::~CE()
 {}
 /**  
-* @brief  Function used to know the CE latency
+* @brief  Function used to know the CE latency. The partial sums of a window cross the size PEs of
+*         the rows, then the size adders.
 *
 * @tparam T Type of input and output data
 *  
-* @return the CE latency in step as a int
+* @return the steps between the step a window is on the PE rows and the step its sum is in the
+*         output register
 */  
 template<typename T>
 int CE<T>::latency()
 {
-  int lag=0;
+  return ceLatency(_size);
+}
+template<typename T>
+int CE<T>::getSize()
+{
+  return _size;
+}
+
+template<typename T>
+int CE<T>::getDilation()
+{
+  return _dilation;
+}
 
-  // PE lag
-  lag += (_PEs[0][0].latency())*_PEs.size()*2;
-  return lag;
+template<typename T>
+LineBuffer<T>& CE<T>::lines()
+{
+  return _sharedLines ? *_sharedLines : _lines;
+}
+
+/**
+* @brief  Function used to read the inputs from a line buffer shared with other CEs instead of the
+*         CE own FIFOs. The owner of the line buffer set its input and step it after all the CEs.
+*
+* @tparam T Type of input and output data
+*
+* @param  lineBuffer is the shared line buffer, with the CE size rows
+*/
+template<typename T>
+void CE<T>::shareLineBuffer(const std::shared_ptr< LineBuffer<T> >& lineBuffer)
+{
+  if(lineBuffer->getNbOfRows() != _size)
+  {
+    throw std::runtime_error("Shared line buffer rows must match the CE size");
+  }
+  _sharedLines = lineBuffer;
+  _sharedLines->addReader();
+}
+
+template<typename T>
+bool CE<T>::isLineBufferShared()
+{
+  return static_cast<bool>(_sharedLines);
+}
+
+template<typename T>
+LineBuffer<T>& CE<T>::getLineBuffer()
+{
+  return lines();
+}
+/**  
+* @brief  Function used to know if no non zero value is left in the FIFOs, the PEs and the sync
+*         registers, and the bias has reached all the adders.
+*
+* @tparam T Type of input and output data
+*  
+* @return true if the CE is drained
+*/  
+template<typename T>
+bool CE<T>::isDrained()
+{
+  return lines().isEmpty() && _quietSteps >= _rowDrainSteps + 2 * _size;
+}
+/**  
+* @brief  Function used to know if the next step would leave the CE unchanged. It is the case when
+*         the CE is drained, the next input is zero and no register is being written.
+*
+* @tparam T Type of input and output data
+*  
+* @return true if the CE is idle
+*/  
+template<typename T>
+bool CE<T>::isIdle()
+{
+  return isDrained() && !_pointwise && lines().getInputSig() == T(0) && !_wEnableSig && !_bEnableSig && !_portEnableSig && !_swapSig;
+}
+/**  
+* @brief  Fast-forward a drained CE over steps where the input is zero and no register is written,
+*         with bulk cycle accounting
+*
+* @tparam T Type of input and output data
+*
+* @param  steps is the number of steps to skip
+*/  
+template<typename T>
+void CE<T>::skip(long steps)
+{
+  if(!isDrained())
+  {
+    throw std::logic_error("Cannot skip steps of a CE that is not drained");
+  }
+  if(!_sharedLines)
+  {
+    _lines.skip(steps);
+  }
+  _wEnableSig = false;
+  _bEnableSig = false;
+  _portEnableSig = false;
+  _swapSig = false;
+  _steps += steps;
+  _idleSteps += steps;
+  recordIdle(steps);
+}
+/**  
+* @brief  Function used to enable or disable the activity tracking. The outputs are the same
+*         either way, only the work done by step() differ.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to skip the work of quiescent rows and steps
+*/  
+template<typename T>
+void CE<T>::setActivityTracking(bool enable)
+{
+  _activityTracking = enable;
+}
+/**  
+* @brief  Function used to step the PE rows with several threads. Every row only depend on its own
+*         registers and on the adder and sync registers of the previous step, so the rows are split
+*         in contiguous chunks and synchronized once per step. The outputs are the same as with
+*         serial stepping. Small arrays are stepped serially because the barrier cost more
+*         than the rows, no thread is started for them.
+*
+* @tparam T Type of input and output data
+*
+* @param  nbThreads is the number of threads, caller included. 1 to step serially
+* @param  minSize is the smallest filter size that use the threads, the crossover measured by
+*         BenchCEThreads on the host. The crossover depend on the host, there is no default
+*/  
+template<typename T>
+void CE<T>::setThreads(int nbThreads, int minSize)
+{
+  if(nbThreads > _size){nbThreads = _size;}
+  _workers.reset(nbThreads > 1 && _size >= minSize ? nbThreads : 0);
+}
+/**  
+* @brief  Function used to know if the PE rows are stepped by several threads
+*
+* @tparam T Type of input and output data
+*  
+* @return true if step() use the worker threads
+*/  
+template<typename T>
+bool CE<T>::isParallel()
+{
+  return _workers.get() != NULL;
+}
+template<typename T>
+long CE<T>::getSteps()
+{
+  return _steps;
+}
+template<typename T>
+long CE<T>::getIdleSteps()
+{
+  return _idleSteps;
+}
+template<typename T>
+long CE<T>::getSkippedRowSteps()
+{
+  return _skippedRowSteps;
+}
+/**
+* @brief  Function used to get the operations counted since construction. The FIFO shifts of a
+*         shared line buffer are counted by its owner.
+*
+* @tparam T Type of input and output data
+*
+* @return the event counts
+*/
+template<typename T>
+EventCounts CE<T>::getEventCounts()
+{
+  EventCounts events = _events;
+  if(!_sharedLines)
+  {
+    events.fifoShifts += _lines.getShifts();
+  }
+  return events;
+}
+/**
+* @brief  Function used to get the range of the values written since construction
+*
+* @tparam T Type of input and output data
+*
+* @return the profile of the PE outputs, synchronization registers, row adders and output register
+*/
+template<typename T>
+RangeProfile<T> CE<T>::getRangeProfile()
+{
+  RangeProfile<T> profile;
+  for(int i = 0; i < _size; i++)
+  {
+    profile += _rowRanges[i];
+  }
+  profile.outputs += _outputRange;
+  return profile;
 }
 /**  
 * @brief  Function used get the output register of the CE
@@ -173,12 +491,120 @@ T CE<T>::getOutputReg()
   return _outputReg;
 }
 /**  
+* @brief  Write all the CE registers and signals to a snapshot. The threads settings are not saved.
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/  
+template<typename T>
+void CE<T>::save(Snapshot& snap)
+{
+  snap.writeTag(snapshotTag);
+  snap.write(_size);
+  snap.write(lines().getFifoSize());
+  // Signals
+  snap.write(_biasSig);
+  snap.write(_weightSigs);
+  snap.write(_bEnableSig);
+  snap.write(_wEnableSig);
+  snap.write(_portSig);
+  snap.write(_portEnableSig);
+  snap.write(_swapSig);
+  snap.write(_laneSigs);
+  // Registers
+  snap.write(_outputReg);
+  snap.write(_adderRegs);
+  snap.write(_syncRegs);
+  snap.write(_weightRegs);
+  lines().save(snap);
+  snap.write(_shadowWeightRegs);
+  snap.write(_shadowBiasReg);
+  snap.write(_shadowCount);
+  snap.write(_laneRegs);
+  snap.write(_dilationRegs);
+  snap.write(_pointwise);
+  for(int i = 0; i < _size; i++)
+  {
+    for(int j = 0; j < _size; j++)
+    {
+      _PEs[i][j].save(snap);
+    }
+  }
+  // Activity tracking
+  snap.write(_rowQuietSteps);
+  snap.write(_quietSteps);
+  snap.write(_steps);
+  snap.write(_idleSteps);
+  snap.write(_skippedRowSteps);
+  snap.write(_events);
+  snap.write(_rowRanges);
+  snap.write(_outputRange);
+}
+/**  
+* @brief  Read all the CE registers and signals from a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read. It must come from a CE of the same filter and FIFO size
+*/  
+template<typename T>
+void CE<T>::restore(Snapshot& snap)
+{
+  int size = 0, fifoSize = 0;
+  snap.expect(snapshotTag, "CE");
+  snap.read(size);
+  snap.read(fifoSize);
+  if(size != _size || fifoSize != lines().getFifoSize())
+  {
+    throw std::runtime_error("Snapshot CE size does not match");
+  }
+  // Signals
+  snap.read(_biasSig);
+  snap.read(_weightSigs);
+  snap.read(_bEnableSig);
+  snap.read(_wEnableSig);
+  snap.read(_portSig);
+  snap.read(_portEnableSig);
+  snap.read(_swapSig);
+  snap.read(_laneSigs);
+  // Registers
+  snap.read(_outputReg);
+  snap.read(_adderRegs);
+  snap.read(_syncRegs);
+  snap.read(_weightRegs);
+  lines().restore(snap);
+  snap.read(_shadowWeightRegs);
+  snap.read(_shadowBiasReg);
+  snap.read(_shadowCount);
+  snap.read(_laneRegs);
+  snap.read(_dilationRegs);
+  snap.read(_pointwise);
+  for(int i = 0; i < _size; i++)
+  {
+    for(int j = 0; j < _size; j++)
+    {
+      _PEs[i][j].restore(snap);
+    }
+  }
+  // Activity tracking
+  snap.read(_rowQuietSteps);
+  snap.read(_quietSteps);
+  snap.read(_steps);
+  snap.read(_idleSteps);
+  snap.read(_skippedRowSteps);
+  snap.read(_events);
+  snap.read(_rowRanges);
+  snap.read(_outputRange);
+}
+/**  
 * @brief  Function used to set the input signals at before each step
 *
 * @tparam T Type of input and output data
 *
 * @param  input is the next input to enter the FIFOs as a T type
-* @param  weights is the weights that are written to the weights registers if wEnable is HIGH
+* @param  weights is the weights that are written to the weights registers if wEnable is HIGH, a
+*         size x size matrix
 * @param  wEnable is the control signal that ennable the weights to be written
 * @param  bias is the bias that is written to the bias registers if bEnable is HIGH
 * @param  bEnable is the control signal that ennable the bias to be written
@@ -186,96 +612,350 @@ T CE<T>::getOutputReg()
 * @return the CE output register as a T type
 */  
 template <typename T>
-void CE<T>::setSigs(T input, std::vector< std::vector<T> > weights, bool wEnable, T bias, bool bEnable)
+void CE<T>::setSigs(T input, const std::vector< std::vector<T> >& weights, bool wEnable, T bias, bool bEnable)
 {
-  _inputSig = input;
+  if(weights.size() != _size)
+  {
+    throw std::runtime_error("The weights must be a matrix of the CE size");
+  }
+  for(int i = 0; i < _size; i++)
+  {
+    if(weights[i].size() != _size)
+    {
+      throw std::runtime_error("The weights must be a matrix of the CE size");
+    }
+  }
+  lines().setSigs(input);
   _biasSig = bias;
   _weightSigs = weights;
   _wEnableSig = wEnable;
   _bEnableSig = bEnable;
 }
 /**  
-* @brief Execute one step. Need to be called every step 
+* @brief  Function used to set the shadow bank signals before each step. The shadow bank is loaded
+*         serially through the weight port while the active registers compute: the weights in
+*         raster order (in the same order as setSigs), then the bias.
+*
+* @tparam T Type of input and output data
+*
+* @param  port is the next weight (or the bias) written in the shadow bank if portEnable is HIGH
+* @param  portEnable is the control signal that enable the weight port
+* @param  swap is the control signal that write the whole shadow bank in the PEs weights and in
+*         the bias register, in one step
+*/  
+template <typename T>
+void CE<T>::setShadowSigs(T port, bool portEnable, bool swap)
+{
+  _portSig = port;
+  _portEnableSig = portEnable;
+  _swapSig = swap;
+}
+/**  
+* @brief  Function used to know if the whole shadow bank was written since the last swap
 *
 * @tparam T Type of input and output data
+*  
+* @return true if the shadow bank can be swapped
 */  
 template<typename T>
-void CE<T>::step()
+bool CE<T>::isShadowReady()
+{
+  return _shadowCount == _size * _size + 1;
+}
+/**
+* @brief  Function used to switch the PEs inputs between the FIFOs and the pointwise lanes. The
+*         skew registers are not cleared, the pipeline should be drained before switching.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true for the pointwise mode
+*/
+template<typename T>
+void CE<T>::setPointwise(bool enable)
+{
+  _pointwise = enable;
+}
+
+template<typename T>
+bool CE<T>::isPointwise()
+{
+  return _pointwise;
+}
+
+/**
+* @brief  Function used to set the pointwise mode input lanes before each step
+*
+* @tparam T Type of input and output data
+*
+* @param  lanes is indexed [row][column], the input of the PE at the same place
+*/
+template<typename T>
+void CE<T>::setLaneSigs(const std::vector< std::vector<T> >& lanes)
+{
+  _laneSigs = lanes;
+}
+/**  
+* @brief Step the PE rows first to last - 1. The rows only write their own registers, the adders
+*        results are kept in _rowSums until all the rows are done.
+*
+* @tparam T Type of input and output data
+*
+* @param  first is the first row
+* @param  last is one past the last row
+*/  
+template<typename T>
+void CE<T>::stepRows(int first, int last)
 {
-  // PE process
   // Example _size = 5. From 4 to 0
-  for (int i = _size - 1; i >= 0; i--)
+  for (int i = last - 1; i >= first; i--)
   {
     /// Row adders
-    // If there is only one PE
-    if(_size - 1 == 0)
-    {
-      _outputReg = _PEs[i][_size - 1].getReg2() + _adderRegs[i];
-    }
-    // For the first cycle, last adder
-    else if (i == _size - 1)
+    // For the first row (or the only PE), first adder
+    if (i == 0)
     {
-      _outputReg = _syncRegs[i - 1].front() + _adderRegs[i];
+      _rowSums[i] = NumericTraits<T>::accumulate(_PEs[i][_size - 1].getReg2(), _adderRegs[i]);
     }
-      // For the last cycle, first adder
-    else if (i == 0)
-    {
-      _adderRegs[i + 1] = _PEs[i][_size - 1].getReg2() + _adderRegs[i];
-    }
-      // All the others in the middle
+    // All the others
     else
     {
-      _adderRegs[i + 1] = _syncRegs[i - 1].front() + _adderRegs[i];
+      _rowSums[i] = NumericTraits<T>::accumulate(_syncRegs[i - 1].front(), _adderRegs[i]);
     }
+    _rowRanges[i].adders.record(_rowSums[i]);
 
     /// Sycn Registery
     if(i != 0)
     {
       _syncRegs[i - 1].push(_PEs[i][_size - 1].getReg2());
       _syncRegs[i - 1].pop();
+      _rowRanges[i].syncRegs.record(_syncRegs[i - 1].back());
+    }
+
+    /// Row activity
+    // After _rowDrainSteps steps of zeros, all the PE and dilation registers of the row are zeros
+    // and stay that way. The PEs still need to be stepped to write their weight registers.
+    _rowSkipped[i] = 0;
+    if(_pointwise)
+    {
+      _rowActive[i] = 1;
+      _rowQuietSteps[i] = 0;
+    }
+    else if(lines().getRow(i) == T(0))
+    {
+      _rowActive[i] = 0;
+      if(_activityTracking && _rowQuietSteps[i] >= _rowDrainSteps && !_wEnableSig && !_swapSig)
+      {
+        _rowSkipped[i] = 1;
+        _rowRanges[i].peOutputs.record(NumericTraits<T>::widen(T(0)), _size);
+        continue;
+      }
+      if(_rowQuietSteps[i] < _rowDrainSteps){_rowQuietSteps[i]++;}
+    }
+    else
+    {
+      _rowActive[i] = 1;
+      _rowQuietSteps[i] = 0;
     }
 
     /// Column Mac
     // Example _size = 5. From 4 to 0
     for(int j = _size - 1; j >= 0; j--)
     {
-      // Every cycle exept the last one, first PE
-      if (j != 0)
+      // Pointwise, the lanes through the skew registers
+      if (_pointwise)
+      {
+        T lane = _laneSigs[i][j];
+        if (j != 0)
+        {
+          _laneRegs[i][j].push(lane);
+          lane = _laneRegs[i][j].front();
+          _laneRegs[i][j].pop();
+        }
+        _PEs[i][j].setSigs(lane, (j != 0) ? _PEs[i][j - 1].getReg2() : NumericTraits<T>::widen(T(0)),
+                           _swapSig ? _shadowWeightRegs[i][j] : _weightRegs[i][j], _wEnableSig || _swapSig);
+      }
+      // Every cycle exept the last one, first PE. Dilated, through the delay registers
+      else if (j != 0)
       {
-        _PEs[i][j].setSigs(_PEs[i][j - 1].getReg1(), _PEs[i][j - 1].getReg2(), _weightRegs[i][j], _wEnableSig);
+        T input = _PEs[i][j - 1].getReg1();
+        if (_dilation > 1)
+        {
+          _dilationRegs[i][j].push(input);
+          input = _dilationRegs[i][j].front();
+          _dilationRegs[i][j].pop();
+        }
+        _PEs[i][j].setSigs(input, _PEs[i][j - 1].getReg2(),
+                           _swapSig ? _shadowWeightRegs[i][j] : _weightRegs[i][j], _wEnableSig || _swapSig);
       }
       // For the last cycle, the first colum of PE
       else
       {
-        _PEs[i][j].setSigs(_inputRegs[i].front(), T(0), _weightRegs[i][j], _wEnableSig);
+        _PEs[i][j].setSigs(lines().getRow(i), NumericTraits<T>::widen(T(0)),
+                           _swapSig ? _shadowWeightRegs[i][j] : _weightRegs[i][j], _wEnableSig || _swapSig);
       }
 
-      _PEs[i][j].step();
+      _rowRanges[i].peOutputs.record(_PEs[i][j].step());
+    }
+  }
+}
+/**  
+* @brief Record the values written by idle steps, like step() would. A drained CE hold zeros in its
+*        PEs and sync registers, so the row adders write their adder register (the bias).
+*
+* @tparam T Type of input and output data
+*
+* @param  steps is the number of idle steps
+*/  
+template<typename T>
+void CE<T>::recordIdle(long steps)
+{
+  for(int i = 0; i < _size; i++)
+  {
+    _rowRanges[i].adders.record(_adderRegs[i], steps);
+    if(i != 0)
+    {
+      _rowRanges[i].syncRegs.record(NumericTraits<T>::widen(T(0)), steps);
+    }
+    _rowRanges[i].peOutputs.record(NumericTraits<T>::widen(T(0)), steps * _size);
+  }
+  _outputRange.record(_outputReg, steps);
+}
+/**  
+* @brief Execute one step. Need to be called every step 
+*
+* @tparam T Type of input and output data
+*/  
+template<typename T>
+void CE<T>::step()
+{
+  _steps++;
+
+  // Nothing would change, only count the step
+  if(_activityTracking && isIdle())
+  {
+    if(!_sharedLines)
+    {
+      _lines.skip(1);
+    }
+    _idleSteps++;
+    recordIdle(1);
+    return;
+  }
+
+  // PE process
+  if(isParallel())
+  {
+    // Bound once, again only if the CE was moved with its workers
+    WorkerPool& workers = *_workers.get();
+    if(!workers.isBoundTo(this))
+    {
+      int chunks = workers.size();
+      workers.bind([this, chunks](int chunk)
+      {
+        stepRows(_size * chunk / chunks, _size * (chunk + 1) / chunks);
+      }, this);
+    }
+    workers.run();
+  }
+  else
+  {
+    stepRows(0, _size);
+  }
+
+  /// Row adders registers
+  bool quiet = true;
+  for(int i = 0; i < _size; i++)
+  {
+    if(i == _size - 1)
+    {
+      // The sum is saturated to T in the output register
+      _outputReg = NumericTraits<T>::narrow(_rowSums[i]);
+      _outputRange.record(_outputReg);
+    }
+    else
+    {
+      _adderRegs[i + 1] = _rowSums[i];
     }
+    if(_rowActive[i]){quiet = false;}
+    if(_rowSkipped[i]){_skippedRowSteps++;}
+
+    /// Events. A PE read the previous PE registers (or the row input) and its weight, and write
+    /// its three registers. Every row adder read its adder register and write the next one.
+    /// Pointwise, the lanes of the row shift through their skew registers. Dilated, the inputs
+    /// shift through the delay registers.
+    if(!_rowSkipped[i])
+    {
+      _events.macs += _size;
+      _events.regReads += 3 * _size;
+      _events.regWrites += 3 * _size;
+      if(_pointwise){_events.fifoShifts += _size - 1;}
+      else{_events.fifoShifts += (long)(_size - 1) * (_dilation - 1);}
+    }
+    _events.adds++;
+    _events.regReads++;
+    _events.regWrites++;
+    if(i != 0){_events.syncShifts++;}
+  }
+
+  if(!quiet)
+  {
+    _quietSteps = 0;
+  }
+  else if((_bEnableSig || _swapSig) && _quietSteps >= _rowDrainSteps + _size)
+  {
+    _quietSteps = _rowDrainSteps + _size - 1;  // A new bias need _size steps to reach all the adders
+  }
+  else if(_quietSteps < _rowDrainSteps + 2 * _size)
+  {
+    _quietSteps++;
   }
 
   /// Bias mux
   if (_bEnableSig)
   {
-    _adderRegs.front() = _biasSig;
+    _adderRegs.front() = NumericTraits<T>::widen(_biasSig);
   }
 
   /// Weights mux
   if (_wEnableSig)
   {
     _weightRegs = _weightSigs;
+    _events.regWrites += _size * _size;
+  }
+  if (_bEnableSig)
+  {
+    _events.regWrites++;
+  }
+
+  /// Shadow bank swap
+  if (_swapSig)
+  {
+    _adderRegs.front() = NumericTraits<T>::widen(_shadowBiasReg);
+    _weightRegs = _shadowWeightRegs;
+    _shadowCount = 0;
+    _events.regReads += _size * _size + 1;
+    _events.regWrites += _size * _size + 1;
+  }
+
+  /// Weight port
+  if (_portEnableSig && _shadowCount < _size * _size)
+  {
+    _shadowWeightRegs[_shadowCount / _size][_shadowCount % _size] = _portSig;
+    _shadowCount++;
+    _events.regWrites++;
+  }
+  else if (_portEnableSig && _shadowCount == _size * _size)
+  {
+    _shadowBiasReg = _portSig;
+    _shadowCount++;
+    _events.regWrites++;
   }
 
   /// Inputs
-  // new input into the lower fifo
-  _inputRegs.back().push(_inputSig);
-  // top of other fifo into the bottom of the next fifo
-  for (int i = _inputRegs.size() - 1; i >= 1; i--)
+  // A shared line buffer is stepped by its owner, after all its readers
+  if(!_sharedLines)
   {
-    _inputRegs[i - 1].push(_inputRegs[i].front());
-    _inputRegs[i].pop();
+    _lines.step();
   }
-  _inputRegs.front().pop();
 }
 
 #endif //CE_H
\ No newline at end of file
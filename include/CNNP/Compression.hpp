@@ -0,0 +1,809 @@
+/**
+ *  @file    Compression.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Bitmap-plus-values compression and the decompressor stage
+ *
+ *  @section DESCRIPTION
+ *
+ *  A sparse tensor is stored in the memory as one bitmap-plus-values record per index of its
+ *  first dimension (one per filter for the weights of a layer):
+ *    [mask words][non zero values]
+ *  The masks hold one bit per value of the record, set if the value is not zero, 8 * sizeof(T)
+ *  bits per word. The mask words are raw bytes copied in the words of T (like a Snapshot, T is
+ *  trivially copyable), they are moved by the DMA but never computed on. The records are back to
+ *  back, so consecutive records are one DMA transfer.
+ *
+ *  The Decompressor is a stage between the DMA engine and a dense buffer of the controller. The
+ *  records are fetched in its own buffer, then every job expand a range of values of some
+ *  records, valuesPerCycle dense values per cycle, once its records are in. Like the DMA, the
+ *  dense values are written when the job complete.
+ *
+ *  The Compressor is the stage on the output path: the zero-value compression of the output
+ *  channels of a layer, one record per channel. It append the records of a block of channels to
+ *  a CompressedTensor, then store them once its cycles are done. The next layer fetch its input
+ *  channels from that image through a Decompressor, so the activations move compressed between
+ *  the layers. The record offsets stay on chip with the image.
+ *
+ *  The saved words are the DRAM words the dense values would have taken. With the decompression
+ *  cycles, they tell if the compression turn a memory bound layer in a compute bound one.
+ */
+
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+#include "DmaEngine.hpp"
+#include "Memory.hpp"
+#include "NumericTraits.hpp"
+#include "Tensor.hpp"
+
+/**
+ * @brief Compressed tensor. Objects that hold the bitmap-plus-values image of a tensor, one
+ *        record per index of its first dimension
+ *
+ * @tparam T Type of the values
+ */
+template <typename T>
+class CompressedTensor
+{
+  private:
+  int _records;
+  int _recordWords;              ///< Dense values of a record
+  long _nonZeros;
+  std::vector<T> _words;         ///< The records, as stored in the memory
+  std::vector<long> _offsets;    ///< First word of every record, plus the end of the last one
+
+  static bool maskBit(const T& word, int bit);
+
+  public:
+  static const int maskBits = 8 * sizeof(T);   ///< Values per mask word
+
+  CompressedTensor();
+  CompressedTensor(int records, int recordWords);
+  ~CompressedTensor();
+  static CompressedTensor compress(const Tensor<T>& tensor);
+  long append(const T* values);
+  void write(Memory<T>& memory, size_t address) const;
+  void expand(const T* records, int record, int first, int count, T* dense) const;
+  int getRecords() const;
+  int getAppended() const;
+  int getRecordWords() const;
+  int getMaskWords() const;
+  long getNonZeros() const;
+  long getOffset(int record) const;
+  long getWords() const;
+  long getDenseWords() const;
+  const std::vector<T>& getImage() const;
+};
+
+/**
+ * @brief Decompressor. Objects that expand the records fetched by a DMA engine into a dense buffer
+ *
+ * @tparam T Type of the values
+ */
+template <typename T>
+class Decompressor
+{
+  private:
+  /// The values [first, first + count) of consecutive records
+  struct Job
+  {
+    long transfer;        ///< DMA descriptor of the records, -1 if they are already in
+    T* dense;             ///< Dense buffer, indexed [record][value]
+    int record;
+    int records;
+    int first;
+    int count;
+    long done;            ///< Dense values produced
+  };
+
+  DmaEngine<T>* _dma;
+  const CompressedTensor<T>* _tensor;
+  int _valuesPerCycle;
+  std::vector<T> _records;       ///< Records buffer, at the offsets of the image
+  std::deque<Job> _queue;
+  long _jobs;                    ///< Jobs submitted
+  long _completed;               ///< Jobs done, in order
+  /// Counters
+  long _cycle;
+  long _busyCycles;              ///< Cycles expanding values
+  long _waitCycles;              ///< Cycles a job waited for its records
+  long _words;                   ///< Dense values produced
+  long _fetchedWords;            ///< Record words fetched
+  long _savedWords;              ///< DRAM words saved against the dense values
+
+  public:
+  Decompressor(DmaEngine<T>& dma, const CompressedTensor<T>& tensor, int valuesPerCycle);
+  ~Decompressor();
+  DmaDescriptor<T> fetch(size_t address, int record, int records);
+  long submit(long transfer, T* dense, int record, int records, int first, int count);
+  bool isDone(long job);
+  bool isIdle();
+  void step();
+  void skip(long steps);
+  const CompressedTensor<T>& getTensor();
+  DmaEngine<T>& getDma();
+  long getCycles();
+  long getBusyCycles();
+  long getWaitCycles();
+  long getWords();
+  long getFetchedWords();
+  long getSavedWords();
+};
+
+/**
+ * @brief Compressor. Objects that compress blocks of a dense buffer in the records of a
+ *        CompressedTensor and store them with a DMA engine
+ *
+ * @tparam T Type of the values
+ */
+template <typename T>
+class Compressor
+{
+  private:
+  /// The records of consecutive rows of a dense buffer
+  struct Job
+  {
+    size_t address;       ///< First word of the records image in the memory
+    int record;
+    int records;
+    long done;            ///< Dense values read
+  };
+
+  DmaEngine<T>* _dma;
+  CompressedTensor<T>* _tensor;
+  int _valuesPerCycle;
+  std::deque<Job> _queue;
+  /// Counters
+  long _cycle;
+  long _busyCycles;              ///< Cycles compressing values
+  long _words;                   ///< Dense values compressed
+  long _storedWords;             ///< Record words stored
+
+  public:
+  Compressor(DmaEngine<T>& dma, CompressedTensor<T>& tensor, int valuesPerCycle);
+  ~Compressor();
+  long submit(size_t address, const T* dense, int record, int records);
+  bool isIdle();
+  void step();
+  void skip(long steps);
+  CompressedTensor<T>& getTensor();
+  DmaEngine<T>& getDma();
+  long getCycles();
+  long getBusyCycles();
+  long getWords();
+  long getStoredWords();
+  long getSavedWords();
+  double getRatio();
+};
+
+// --------------- Templatized Implementation ---------------
+
+template<typename T>
+CompressedTensor<T>::CompressedTensor() :
+    _records(0),
+    _recordWords(0),
+    _nonZeros(0),
+    _offsets(1, 0)
+{}
+
+/**
+* @brief  CompressedTensor object constructor. The records are appended in order.
+*
+* @tparam T Type of the values
+*
+* @param  records is the number of records
+* @param  recordWords is the number of dense values of a record
+*/
+template<typename T>
+CompressedTensor<T>::CompressedTensor(int records, int recordWords) :
+    _records(records),
+    _recordWords(recordWords),
+    _nonZeros(0),
+    _offsets(1, 0)
+{
+  if(records <= 0 || recordWords <= 0)
+  {
+    throw std::runtime_error("Cannot compress an empty tensor");
+  }
+  // The image never move, the DMA store the records from it
+  _words.reserve((long)records * (getMaskWords() + recordWords));
+}
+
+template<typename T>
+CompressedTensor<T>::~CompressedTensor()
+{}
+
+/**
+* @brief  Compression tool. Build the records of a tensor, like the weights of a layer.
+*
+* @tparam T Type of the values
+*
+* @param  tensor is indexed [record][...], one record per filter for the weights
+*
+* @return the compressed tensor
+*/
+template<typename T>
+CompressedTensor<T> CompressedTensor<T>::compress(const Tensor<T>& tensor)
+{
+  if(tensor.rank() == 0 || tensor.empty())
+  {
+    throw std::runtime_error("Cannot compress an empty tensor");
+  }
+  Tensor<T> dense = tensor.isContiguous() ? tensor : tensor.clone();
+  CompressedTensor<T> compressed(dense.dim(0), int(dense.size() / dense.dim(0)));
+  for(int record = 0; record < compressed._records; record++)
+  {
+    compressed.append(dense.data() + (long)record * compressed._recordWords);
+  }
+  return compressed;
+}
+
+/**
+* @brief  Compress the next record
+*
+* @tparam T Type of the values
+*
+* @param  values is the recordWords dense values of the record
+*
+* @return the number of words of the record
+*/
+template<typename T>
+long CompressedTensor<T>::append(const T* values)
+{
+  if(getAppended() >= _records)
+  {
+    throw std::logic_error("All the records are compressed");
+  }
+  int maskWords = getMaskWords();
+  std::vector<unsigned char> masks(maskWords * sizeof(T), 0);
+  size_t offset = _words.size();
+  _words.resize(offset + maskWords, T(0));
+  for(int i = 0; i < _recordWords; i++)
+  {
+    if(!(values[i] == NumericTraits<T>::zero()))
+    {
+      masks[i / 8] |= (unsigned char)(1 << (i % 8));
+      _words.push_back(values[i]);
+      _nonZeros++;
+    }
+  }
+  std::memcpy(reinterpret_cast<unsigned char*>(&_words[offset]), masks.data(), masks.size());
+  _offsets.push_back(_words.size());
+  return _words.size() - offset;
+}
+
+/**
+* @brief  Write the records in a memory, for the DMA engine
+*
+* @tparam T Type of the values
+*
+* @param  memory is the memory written
+* @param  address is the first word of the records
+*/
+template<typename T>
+void CompressedTensor<T>::write(Memory<T>& memory, size_t address) const
+{
+  memory.Write(address, _words.data(), _words.size());
+}
+
+template<typename T>
+bool CompressedTensor<T>::maskBit(const T& word, int bit)
+{
+  unsigned char bytes[sizeof(T)];
+  std::memcpy(bytes, reinterpret_cast<const unsigned char*>(&word), sizeof(T));
+  return (bytes[bit / 8] >> (bit % 8)) & 1;
+}
+
+/**
+* @brief  Expand some values of a record. The non zero values before the first one are skipped by
+*         counting the mask bits.
+*
+* @tparam T Type of the values
+*
+* @param  records is the records, at the offsets of the image
+* @param  record is the record index
+* @param  first is the first value expanded
+* @param  count is the number of values expanded
+* @param  dense is where the value first is written
+*/
+template<typename T>
+void CompressedTensor<T>::expand(const T* records, int record, int first, int count, T* dense) const
+{
+  if(record < 0 || record >= getAppended() || first < 0 || count < 0 || first + count > _recordWords)
+  {
+    throw std::runtime_error("Values out of the compressed record");
+  }
+  const T* masks = records + _offsets[record];
+  const T* value = masks + getMaskWords();
+  for(int i = 0; i < first + count; i++)
+  {
+    bool nonZero = maskBit(masks[i / maskBits], i % maskBits);
+    if(i >= first)
+    {
+      dense[i - first] = nonZero ? *value : NumericTraits<T>::zero();
+    }
+    if(nonZero)
+    {
+      value++;
+    }
+  }
+}
+
+template<typename T>
+int CompressedTensor<T>::getRecords() const
+{
+  return _records;
+}
+
+/**
+* @brief  Function used to know how many records were compressed
+*
+* @tparam T Type of the values
+*
+* @return the number of records appended
+*/
+template<typename T>
+int CompressedTensor<T>::getAppended() const
+{
+  return int(_offsets.size()) - 1;
+}
+
+template<typename T>
+int CompressedTensor<T>::getRecordWords() const
+{
+  return _recordWords;
+}
+
+template<typename T>
+int CompressedTensor<T>::getMaskWords() const
+{
+  return (_recordWords + maskBits - 1) / maskBits;
+}
+
+template<typename T>
+long CompressedTensor<T>::getNonZeros() const
+{
+  return _nonZeros;
+}
+
+/**
+* @brief  Function used to know where a record start
+*
+* @tparam T Type of the values
+*
+* @param  record is the record index, getRecords() give the end of the last record
+*
+* @return the word offset of the record
+*/
+template<typename T>
+long CompressedTensor<T>::getOffset(int record) const
+{
+  return _offsets.at(record);
+}
+
+/**
+* @brief  Function used to know the size of the records
+*
+* @tparam T Type of the values
+*
+* @return the number of words of the masks and non zero values
+*/
+template<typename T>
+long CompressedTensor<T>::getWords() const
+{
+  return _words.size();
+}
+
+template<typename T>
+long CompressedTensor<T>::getDenseWords() const
+{
+  return (long)_records * _recordWords;
+}
+
+template<typename T>
+const std::vector<T>& CompressedTensor<T>::getImage() const
+{
+  return _words;
+}
+
+/**
+* @brief  Decompressor object constructor
+*
+* @tparam T Type of the values
+*
+* @param  dma is the DMA engine fetching the records
+* @param  tensor is the compressed tensor, kept by the caller. Its records must be compressed
+* @param  valuesPerCycle is the number of dense values produced per cycle
+*/
+template<typename T>
+Decompressor<T>::Decompressor(DmaEngine<T>& dma, const CompressedTensor<T>& tensor, int valuesPerCycle) :
+    _dma(&dma),
+    _tensor(&tensor),
+    _valuesPerCycle(valuesPerCycle),
+    _records(tensor.getWords(), T(0)),
+    _jobs(0),
+    _completed(0),
+    _cycle(0),
+    _busyCycles(0),
+    _waitCycles(0),
+    _words(0),
+    _fetchedWords(0),
+    _savedWords(0)
+{
+  if(valuesPerCycle <= 0)
+  {
+    throw std::runtime_error("Decompressor need a throughput");
+  }
+}
+
+template<typename T>
+Decompressor<T>::~Decompressor()
+{}
+
+/**
+* @brief  Build the transfer of consecutive records in the records buffer
+*
+* @tparam T Type of the values
+*
+* @param  address is the first word of the records in the memory
+* @param  record is the first record
+* @param  records is the number of records
+*
+* @return the descriptor, to submit to the DMA engine
+*/
+template<typename T>
+DmaDescriptor<T> Decompressor<T>::fetch(size_t address, int record, int records)
+{
+  long offset = _tensor->getOffset(record);
+  long words = _tensor->getOffset(record + records) - offset;
+  if(offset + words > _records.size())
+  {
+    throw std::logic_error("The records were compressed after the decompressor was built");
+  }
+  _fetchedWords += words;
+  _savedWords += (long)records * _tensor->getRecordWords() - words;
+  return DmaDescriptor<T>{address + offset, _records.data() + offset, 1, int(words), 0, 0, false};
+}
+
+/**
+* @brief  Queue the expansion of the values [first, first + count) of consecutive records. The
+*         jobs are done in order.
+*
+* @tparam T Type of the values
+*
+* @param  transfer is the DMA descriptor of the records, -1 if they are already in
+* @param  dense is the dense buffer, indexed [record][value]
+*
+* @return the job index, for isDone()
+*/
+template<typename T>
+long Decompressor<T>::submit(long transfer, T* dense, int record, int records, int first, int count)
+{
+  _queue.push_back(Job{transfer, dense, record, records, first, count, 0});
+  return _jobs++;
+}
+
+/**
+* @brief  Function used to know if the dense values of a job were written
+*
+* @tparam T Type of the values
+*
+* @param  job is the index returned by submit(), -1 is always done
+*
+* @return true if the job is done
+*/
+template<typename T>
+bool Decompressor<T>::isDone(long job)
+{
+  return job < _completed;
+}
+
+template<typename T>
+bool Decompressor<T>::isIdle()
+{
+  return _queue.empty();
+}
+
+/**
+* @brief Execute one cycle. Expand valuesPerCycle values of the first job once its records are in.
+*
+* @tparam T Type of the values
+*/
+template<typename T>
+void Decompressor<T>::step()
+{
+  _cycle++;
+  if(_queue.empty())
+  {
+    return;
+  }
+  Job& job = _queue.front();
+  if(job.transfer >= 0 && !_dma->isDone(job.transfer))
+  {
+    _waitCycles++;
+    return;
+  }
+  _busyCycles++;
+  job.done += _valuesPerCycle;
+  if(job.done >= (long)job.records * job.count)
+  {
+    int recordWords = _tensor->getRecordWords();
+    for(int r = job.record; r < job.record + job.records; r++)
+    {
+      _tensor->expand(_records.data(), r, job.first, job.count, job.dense + (long)r * recordWords + job.first);
+    }
+    _words += (long)job.records * job.count;
+    _completed++;
+    _queue.pop_front();
+  }
+}
+
+/**
+* @brief  Advance several cycles
+*
+* @tparam T Type of the values
+*
+* @param  steps is the number of cycles
+*/
+template<typename T>
+void Decompressor<T>::skip(long steps)
+{
+  while(steps > 0 && !isIdle())
+  {
+    step();
+    steps--;
+  }
+  _cycle += steps;
+}
+
+template<typename T>
+const CompressedTensor<T>& Decompressor<T>::getTensor()
+{
+  return *_tensor;
+}
+
+template<typename T>
+DmaEngine<T>& Decompressor<T>::getDma()
+{
+  return *_dma;
+}
+
+template<typename T>
+long Decompressor<T>::getCycles()
+{
+  return _cycle;
+}
+
+/**
+* @brief  Function used to know how many cycles the decompressor expanded values
+*
+* @tparam T Type of the values
+*
+* @return the decompression cycles
+*/
+template<typename T>
+long Decompressor<T>::getBusyCycles()
+{
+  return _busyCycles;
+}
+
+template<typename T>
+long Decompressor<T>::getWaitCycles()
+{
+  return _waitCycles;
+}
+
+template<typename T>
+long Decompressor<T>::getWords()
+{
+  return _words;
+}
+
+template<typename T>
+long Decompressor<T>::getFetchedWords()
+{
+  return _fetchedWords;
+}
+
+/**
+* @brief  Function used to know how many DRAM words the compression saved. Multiply by
+*         MemHParam::wordBytes for the bytes.
+*
+* @tparam T Type of the values
+*
+* @return the dense words of the fetched records minus their words
+*/
+template<typename T>
+long Decompressor<T>::getSavedWords()
+{
+  return _savedWords;
+}
+
+/**
+* @brief  Compressor object constructor
+*
+* @tparam T Type of the values
+*
+* @param  dma is the DMA engine storing the records
+* @param  tensor is the compressed tensor the records are appended to, kept by the caller
+* @param  valuesPerCycle is the number of dense values compressed per cycle
+*/
+template<typename T>
+Compressor<T>::Compressor(DmaEngine<T>& dma, CompressedTensor<T>& tensor, int valuesPerCycle) :
+    _dma(&dma),
+    _tensor(&tensor),
+    _valuesPerCycle(valuesPerCycle),
+    _cycle(0),
+    _busyCycles(0),
+    _words(0),
+    _storedWords(0)
+{
+  if(valuesPerCycle <= 0)
+  {
+    throw std::runtime_error("Compressor need a throughput");
+  }
+}
+
+template<typename T>
+Compressor<T>::~Compressor()
+{}
+
+/**
+* @brief  Queue the compression of consecutive rows of a dense buffer. The records are built at
+*         once, the dense buffer can be reused, and stored once the job cycles are done.
+*
+* @tparam T Type of the values
+*
+* @param  address is the first word of the records image in the memory
+* @param  dense is the first row, recordWords values each
+* @param  record is the record of the first row, the next one to append
+* @param  records is the number of rows
+*
+* @return the number of record words to store
+*/
+template<typename T>
+long Compressor<T>::submit(size_t address, const T* dense, int record, int records)
+{
+  if(record != _tensor->getAppended())
+  {
+    throw std::logic_error("The records must be compressed in order");
+  }
+  long words = 0;
+  for(int r = 0; r < records; r++)
+  {
+    words += _tensor->append(dense + (long)r * _tensor->getRecordWords());
+  }
+  _queue.push_back(Job{address, record, records, 0});
+  _words += (long)records * _tensor->getRecordWords();
+  _storedWords += words;
+  return words;
+}
+
+template<typename T>
+bool Compressor<T>::isIdle()
+{
+  return _queue.empty();
+}
+
+/**
+* @brief Execute one cycle. Read valuesPerCycle values of the first job, store its records once done.
+*
+* @tparam T Type of the values
+*/
+template<typename T>
+void Compressor<T>::step()
+{
+  _cycle++;
+  if(_queue.empty())
+  {
+    return;
+  }
+  Job& job = _queue.front();
+  _busyCycles++;
+  job.done += _valuesPerCycle;
+  if(job.done >= (long)job.records * _tensor->getRecordWords())
+  {
+    long offset = _tensor->getOffset(job.record);
+    long words = _tensor->getOffset(job.record + job.records) - offset;
+    T* records = const_cast<T*>(_tensor->getImage().data()) + offset;
+    _dma->submit(DmaDescriptor<T>{job.address + offset, records, 1, int(words), 0, 0, true});
+    _queue.pop_front();
+  }
+}
+
+/**
+* @brief  Advance several cycles
+*
+* @tparam T Type of the values
+*
+* @param  steps is the number of cycles
+*/
+template<typename T>
+void Compressor<T>::skip(long steps)
+{
+  while(steps > 0 && !isIdle())
+  {
+    step();
+    steps--;
+  }
+  _cycle += steps;
+}
+
+template<typename T>
+CompressedTensor<T>& Compressor<T>::getTensor()
+{
+  return *_tensor;
+}
+
+template<typename T>
+DmaEngine<T>& Compressor<T>::getDma()
+{
+  return *_dma;
+}
+
+template<typename T>
+long Compressor<T>::getCycles()
+{
+  return _cycle;
+}
+
+/**
+* @brief  Function used to know how many cycles the compressor read values
+*
+* @tparam T Type of the values
+*
+* @return the compression cycles
+*/
+template<typename T>
+long Compressor<T>::getBusyCycles()
+{
+  return _busyCycles;
+}
+
+template<typename T>
+long Compressor<T>::getWords()
+{
+  return _words;
+}
+
+template<typename T>
+long Compressor<T>::getStoredWords()
+{
+  return _storedWords;
+}
+
+/**
+* @brief  Function used to know how many DRAM words the compression saved. Multiply by
+*         MemHParam::wordBytes for the bytes.
+*
+* @tparam T Type of the values
+*
+* @return the dense words compressed minus the record words
+*/
+template<typename T>
+long Compressor<T>::getSavedWords()
+{
+  return _words - _storedWords;
+}
+
+/**
+* @brief  Function used to know the compression ratio
+*
+* @tparam T Type of the values
+*
+* @return the dense words over the record words, 0 before the first job
+*/
+template<typename T>
+double Compressor<T>::getRatio()
+{
+  return _storedWords > 0 ? double(_words) / _storedWords : 0;
+}
+
+#endif //COMPRESSION_HPP
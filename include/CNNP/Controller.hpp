@@ -1,20 +1,120 @@
-//
-// Created by gortium on 1/10/18.
-//
+/**
+ *  @file    Controller.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    10/01/2018
+ *  @version 1.0
+ *
+ *  @brief Controller module
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module sequence the CE to compute a whole convolution layer. For every filter and every
+ *  input channel it load the weights and bias in the CE, stream the (padded) input channel in the
+ *  CE FIFOs and save the valid outputs. Partial results of every input channel are accumulated
+ *  in the output buffer. The input and output addresses of a pass are walked by the mapping of
+ *  the layer on the CEs (PassMapping.hpp: streamed, pointwise or window generator), the
+ *  controller sequence the passes.
+ *
+ *  With the shadow weights enabled, the weights of the next pass are loaded serially in the CE
+ *  shadow bank during the current pass. The input of the next pass is streamed right after the
+ *  current one and the banks are swapped between the last window of the current pass and the
+ *  first window of the next one, so the pipeline does not drain between passes.
+ *
+ *  Grouped layers only accumulate the input channels of the filter group, a depthwise layer
+ *  (groups = inputDepth) take a single pass per filter. In pointwise mode (1x1 filters) the CE PE
+ *  array is mapped across the input channels: a pass stream the pixels with CE size^2 channels at
+ *  once on the CE lanes, instead of one channel on a single PE.
+ *
+ *  With the window generator, a convolution pass also use the lanes: every step the K x K window
+ *  of the next valid output is put on the lanes, one window pixel per PE. The window generator
+ *  keep the rows of the window, only the pixels entering it are read from the input buffer. The
+ *  filterSize - 1 windows straddling two rows and the padding steps are never computed, a pass
+ *  take one step per output instead of one per padded input. The input buffer deliver a number of
+ *  columns of every window row per step, by default the columns entering the window on a step: the
+ *  first window of an output row is refilled over ceil(window width / columns) steps, the lanes
+ *  are idle meanwhile (setWindowReadPort()).
+ *
+ *  The spatial unroll put P CEs on every filter, each computing one of P horizontally adjacent
+ *  outputs. The window generator is widened to (P - 1) * stride + filterSize columns and every
+ *  CE of the group read its own window out of it, so the overlapping columns are read once from
+ *  the input buffer. The weights are broadcast to the P CEs and the P output registers are saved
+ *  together, a pass take one step per P outputs of a row.
+ *
+ *  The window generator also fold the filters on the CE array. A filter larger than the CE is
+ *  cut in tiles of CE size^2 weights, every tile being an extra pass over the channel whose
+ *  partial outputs are accumulated like the chunks. With the channel packing, the windows of
+ *  (CE size / filterSize)^2 input channels are put side by side on the lanes, so a small filter
+ *  use the PEs of a large CE. The streamed path need CEs of the filter size, a controller built
+ *  on CEs of another size is given the pointwise or window mapping at construction.
+ *
+ *  A dilated layer is streamed like a dense one on CEs built with the same dilation: the line
+ *  buffer and the PE rows space the filter taps, so the steps constants only change with the
+ *  filter extent (filterSize - 1) * dilation + 1.
+ *
+ *  With the row bands, the passes compute a band of output rows before the next band, instead of
+ *  the whole layer. A band start once the rows under it are allowed by the row limit, so a
+ *  producer of the input rows (a LayerPipeline stage) can stream them in as they are computed and
+ *  hold the band while there is no room for its outputs. The CEs keep their state from a band to
+ *  the next one, and from an image to the next one with restart().
+ *
+ *  A fully connected layer is a pointwise layer where the pixels are the images of the batch, so
+ *  every weight fetched for a pass is reused by all the images of the batch.
+ *
+ *  With several CEs, every CE compute a different filter of the same pass. The CEs read a single
+ *  shared line buffer (and the same lanes in pointwise mode), so the input is fetched and buffered
+ *  once for all the filters computed in parallel.
+ *
+ *  The weights, bias, inputs and outputs buffers are contiguous tensors allocated in the
+ *  controller arena, so every layer buffer can be copied or moved to a memory in one piece.
+ *
+ *  With a DMA engine, the buffers are filled from the memory instead of setWeights()/setInputs().
+ *  The input channels and the weights of a pass are fetched while the previous pass compute (the
+ *  buffers are double buffered by pass), a pass only start once its data is in. The outputs of a
+ *  block of filters are written back after its last chunk, the controller halt once they are
+ *  stored. The steps waiting for the DMA are the exposed transfer time. A snapshot hold the
+ *  buffers but not the DMA engine nor the memory: a controller restored with a DMA engine fetch
+ *  the passes left again and write back again the blocks already stored.
+ *
+ *  With a weight decompressor, the weights are stored compressed in the memory. The records of a
+ *  block of filters are fetched with its first chunk, then every pass queue the expansion of its
+ *  channels in the weights buffer. A pass also wait for its weights to be expanded.
+ *
+ *  The activations between two layers can be compressed the same way, one record per channel.
+ *  With an output compressor, the outputs of a block of filters are compressed when complete and
+ *  their records stored instead of the dense planes. With an input decompressor, the input
+ *  channels of a pass are fetched as records and expanded in the inputs buffer. The ReLU can be
+ *  applied to the outputs of the last chunk, so the zeros reach the compressor.
+ *
+ *  States:
+ *  0 -> Halt
+ *  1 -> Load weights and bias
+ *  2 -> Compute convolution
+ *  3 -> Write back the outputs
+ */
 
 #ifndef CONTROLLER_HPP
 #define CONTROLLER_HPP
 
+#include <algorithm>      // std::min, std::fill
 #include <iostream>       // std::cout
+#include <memory>         // std::shared_ptr, std::unique_ptr
 #include <string>         // std::string
+#include <stdexcept>
+#include <vector>
 #include "HyperParams.hpp"
 #include "CE.hpp"
-
-#define FILTER_SIZE 9
-#define BIT_WIDHT 8
+#include "DmaEngine.hpp"
+#include "EventCounts.hpp"
+#include "NumericTraits.hpp"
+#include "PassMapping.hpp"
+#include "PassTiming.hpp"
+#include "RangeProfile.hpp"
+#include "Snapshot.hpp"
+#include "Tensor.hpp"
+#include "Compression.hpp"
 
 /**
- * Objects that control multiple (one for now) CE to perform convolution neural network computation.
+ * Objects that control multiple CE to perform convolution neural network computation.
  *
  *@tparam T      Type of input and output data.
  */
@@ -23,142 +123,2113 @@ class Controller
 {
   private:
   T relu(T input);
+  int filterExtent();
+  void initSteps();
+  int nbOfPasses();
+  int passChannel(int pass);
+  int passFirst(int pass);
+  int passTile(int pass);
+  int passFilter(int pass, int ce);
+  int passFilters(int pass);
+  T passBias(int pass, int ce);
+  void initInputPass();
+  void initOutputPass();
+  std::vector< std::vector<T> > passWeights(int pass, int ce);
+  void saveOutputs(int saveHI, int saveWI);
+  int passBand(int pass);
+  bool rowsReady(int pass);
+  void startPass(int pass);
+  void stepCEs();
+  void initDma();
+  void resumeDma();
+  long transfer(const DmaDescriptor<T>& descriptor);
+  void issuePass(int pass);
+  void fetchRecords(int block);
+  bool passReady(int pass);
+  void storeOutputs(int pass);
+  void stepStages();
+  bool stagesIdle();
 
+  /// Modules
+  CE<T>* _CE;                    ///< The first CE, all the CEs have the same size
+  std::vector< CE<T> >* _CEs;    ///< The CEs, one filter each
+  std::shared_ptr< LineBuffer<T> > _lineBuffer;   ///< The line buffer shared by the CEs, if more than one
+  DmaEngine<T>* _dma;            ///< Move the layer between the memory and the buffers, if any
+  Decompressor<T>* _weightDecompressor;   ///< Expand the compressed weights fetched by the DMA, if any
+  Decompressor<T>* _inputDecompressor;    ///< Expand the compressed input channels fetched by the DMA, if any
+  Compressor<T>* _outputCompressor;       ///< Compress the outputs stored by the DMA, if any
   /// Indexes
-  int _inWI, _inHI, _inDI, _outWI, _outHI, _outDI;
-  int _layerSteps;
+  int _inPass, _outPass;         ///< Pass (filter * chunks + chunk) streamed in and saved out
+  int _layerSteps;               ///< Steps since the input pass started
+  int _outSteps;                 ///< Steps since the output pass started
   int _state;
+  /// Channels mapping
+  int _groups;                   ///< Number of filter groups
+  int _lanes;                    ///< Input channels per pass, CE size^2 in pointwise mode
+  int _tiles;                    ///< Passes per channel, folding a filter larger than the CE
+  int _chunks;                   ///< Passes per filter
+  int _blocks;                   ///< Blocks of filters computed together in a group, one filter per CE
+  bool _pointwise;               ///< The CE PE array is mapped across the input channels
+  bool _windowed;                ///< The CE lanes are fed with the window of every valid output
+  int _unroll;                   ///< Adjacent outputs of a filter computed together, one per CE
+  bool _packing;                 ///< The windows of several channels are side by side on the lanes
+  int _readColumns;              ///< Columns of every window row read per step, 0 for the columns of a step
+  int _bandRows;                 ///< Output rows of a band, 0 for the whole layer
+  int _bands;                    ///< Bands of output rows, every band take all the passes of the layer
+  std::unique_ptr< PassMapping<T> > _mapping;   ///< Input and output addresses of the passes
+  /// Activation
+  bool _relu;                    ///< The ReLU is applied to the complete outputs
+  /// Shadow weights
+  bool _shadowWeights;           ///< Load the next pass weights in the CE shadow bank during the current pass
+  int _portCount;                ///< Words sent on the weight port for the next pass
+  bool _swapPending;             ///< The input pass started on the old weights, the shadow bank is to be swapped
+  std::vector< std::vector< std::vector<T> > > _nextPassWeights;   ///< Weights of the next pass of every CE, in the PE order
+  /// Row gate
+  int _rowLimit;                 ///< Output rows the bands can start on, -1 for all
+  int _rowsStarted;              ///< Output rows of the bands started
+  int _rowsDone;                 ///< Output rows complete
+  /// Counters
+  long _weightFetches;           ///< Weights words sent to the CE, to compute the weight reuse
+  long _exposedLoadSteps;        ///< Steps where the CE only loaded weights
+  long _hiddenLoadSteps;         ///< Steps where weights were loaded while the CE computed
+  long _totalSteps;              ///< Steps since construction
+  EventCounts _events;           ///< Layer buffers and DRAM accesses, the CE count their own events
+  long _dmaStallSteps;           ///< Steps waiting for a DMA transfer
+  long _rowStallSteps;           ///< Steps waiting for the row limit
+  RangeStats<T> _accumulatorRange;   ///< Outputs accumulated between the chunks
+  /// Steps constants
+  int _maxStep;
+  int _framePeriod;              ///< Steps between the input starts of two passes with the shadow weights
+  int _swapStep;                 ///< Input step of the next pass where the shadow bank is swapped
   /// Hyperparams
   LayerHParam _layerHParam;
   /// Buffers
-  std::vector< std::vector< std::vector< std::vector<T> > > > _weights;
-  std::vector< std::vector< std::vector<T> > > _inputs;
-  std::vector<T> _bias;
-  std::vector< std::vector< std::vector<T> > > _outputs;
+  std::shared_ptr<Arena> _arena;   ///< Memory of the layer buffers
+  Tensor<T> _weights;              ///< Indexed [filter][depth / groups][row][column]
+  Tensor<T> _inputs;               ///< Indexed [depth][row][column]
+  Tensor<T> _bias;                 ///< Indexed [filter]
+  Tensor<T> _outputs;              ///< Indexed [filter][row][column]
+  std::vector< std::vector< std::vector<T> > > _passWeights;   ///< Weights of the current pass of every CE, in the PE order
+  std::vector< std::vector< std::vector<T> > > _laneValues;    ///< Lanes inputs of the step, kept to not allocate every step
+  std::vector<T> _portValues;                                  ///< Weight port inputs of the step, one per CE
+  /// DMA
+  DmaLayout _dmaLayout;
+  std::vector<char> _passIssued;               ///< 1 if the transfers of the pass were issued
+  std::vector< std::vector<long> > _passTransfers;   ///< DMA descriptors of every pass
+  std::vector<long> _passJobs;                 ///< Decompressor job of every pass, -1 if none
+  std::vector<long> _passInputJobs;            ///< Input decompressor job of every pass, -1 if none
+  std::vector<long> _blockRecords;             ///< DMA descriptor of the records of every block, -2 if not issued
+  std::vector<char> _channelLoaded;            ///< 1 if the input channel was fetched
+  int _outStored;                              ///< Last output pass written back
 
   public:
-  Controller(std::vector< CE<T> >& CEs, LayerHParam[]);
-  void Step();
-//  void LoadFromMem(Memory<T>& mem, T reg, int add);
-//  void SaveToMem(Memory<T>& mem, T reg, int add);
+  static const int weightLoadSteps = 2;   ///< Steps needed for the weights to reach the PEs, through the weight registers
+  static const unsigned int snapshotTag = 0x43540002;   ///< Snapshot tag of the controller
+
+  Controller(std::vector< CE<T> >& CEs, LayerHParam layerHParam, Mapping mapping = STREAM_MAPPING);
+  ~Controller();
+  void setWeights(const Tensor<T>& weights, const Tensor<T>& bias);
+  void setWeights(const std::vector< std::vector< std::vector< std::vector<T> > > >& weights,
+                  const std::vector<T>& bias);
+  void setWeights(const std::vector< std::vector<T> >& weights, const std::vector<T>& bias);
+  void setInputs(const Tensor<T>& inputs);
+  void setInputs(const std::vector< std::vector< std::vector<T> > >& inputs);
+  void setInputs(const std::vector< std::vector<T> >& inputs);
+  void setDma(DmaEngine<T>& dma, DmaLayout layout);
+  void setWeightDecompressor(Decompressor<T>& decompressor);
+  void setInputDecompressor(Decompressor<T>& decompressor);
+  void setOutputCompressor(Compressor<T>& compressor);
+  void setRelu(bool enable);
+  const Tensor<T>& getOutputs();
+  Tensor<T> getBatchOutputs();
+  int outputWidth();
+  int outputHeight();
+  int passSteps();
+  int getState();
+  bool isHalted();
+  int quietSteps();
+  void skip(int steps);
+  void setShadowWeights(bool enable);
+  void setPointwise(bool enable);
+  void setWindowGenerator(bool enable);
+  void setSpatialUnroll(int factor);
+  int getSpatialUnroll();
+  void setChannelPacking(bool enable);
+  void setWindowReadPort(int columns);
+  void setRowBands(int rows);
+  void setRowLimit(int rows);
+  int getStartedRows();
+  int getCompletedRows();
+  void setInputRow(int row, const Tensor<T>& values);
+  void restart();
+  long getMacs();
+  long getWeightFetches();
+  long getInputWrites();
+  long getSavedInputWrites();
+  long getExposedLoadSteps();
+  long getHiddenLoadSteps();
+  long getTotalSteps();
+  long getDmaStallSteps();
+  long getRowStallSteps();
+  EventCounts getEventCounts();
+  RangeProfile<T> getRangeProfile();
+  void step();
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
 };
 
 
 // --------------- Templatized Implementation ---------------
 
-
+/**
+* @brief  Controller object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  CEs is the CEs controlled. The first one need a FIFO size of inputWidth + 2 * padding
+* @param  layerHParam is the hyper parameters of the layer to compute
+* @param  mapping is the mapping of the layer on the CEs. A streamed layer need CEs of the filter
+*         size, a CE of another size is only used through the lanes (pointwise or window generator)
+*/
 template<typename T>
-Controller<T>::Controller(std::vector< CE<T> >& CEs, LayerHParam layerHParam):
+Controller<T>::Controller(std::vector< CE<T> >& CEs, LayerHParam layerHParam, Mapping mapping):
+    /// Modules
+    _CE(NULL),
+    _CEs(NULL),
+    _dma(NULL),
+    _weightDecompressor(NULL),
+    _inputDecompressor(NULL),
+    _outputCompressor(NULL),
+
     /// Indexes
-    _inWI(0), _inHI(0), _inDI(0), _outWI(0), _outHI(0), _outDI(0),
+    _inPass(0), _outPass(0),
     _layerSteps(0),
+    _outSteps(0),
     _state(1),
 
+    /// Channels mapping
+    _groups(layerHParam.groups > 0 ? layerHParam.groups : 1),
+    _lanes(1),
+    _tiles(1),
+    _chunks(1),
+    _blocks(1),
+    _pointwise(false),
+    _windowed(false),
+    _unroll(1),
+    _packing(false),
+    _readColumns(0),
+    _bandRows(0),
+    _bands(1),
+
+    /// Activation
+    _relu(false),
+
+    /// Shadow weights
+    _shadowWeights(false),
+    _portCount(0),
+    _swapPending(false),
+
+    /// Row gate
+    _rowLimit(-1),
+    _rowsStarted(0),
+    _rowsDone(0),
+
+    /// Counters
+    _weightFetches(0),
+    _exposedLoadSteps(0),
+    _hiddenLoadSteps(0),
+    _totalSteps(0),
+    _events(),
+    _dmaStallSteps(0),
+    _rowStallSteps(0),
+    _accumulatorRange(),
+
     /// Hyperparams
     _layerHParam(layerHParam),
-    _convResult()
-    {
 
+    /// Buffers
+    _arena(std::make_shared<Arena>()),
 
-      // TODO Init buffers
+    /// DMA
+    _dmaLayout(),
+    _outStored(-1)
+{
+  if(CEs.empty())
+  {
+    throw std::runtime_error("Controller need at least one CE");
+  }
+  if(_layerHParam.type == FULLY_CONNECTED)
+  {
+    // The batch is a one pixel high image, one input per channel
+    _layerHParam.inputHeight = 1;
+    _layerHParam.filterSize = 1;
+    _layerHParam.stride = 1;
+    _layerHParam.padding = 0;
+    _layerHParam.groups = 1;
+    _groups = 1;
+    _pointwise = true;
+  }
+  _layerHParam.dilation = std::max(_layerHParam.dilation, 1);
+  if(_layerHParam.stride == 0)
+  {
+    throw std::runtime_error("Stride cannot be 0");
+  }
+  if(_layerHParam.padding >= filterExtent())
+  {
+    throw std::runtime_error("Padding must be smaller than the filter extent");
+  }
+  if(!_pointwise && CEs.front().getDilation() != _layerHParam.dilation)
+  {
+    throw std::runtime_error("The CEs dilation must match the layer dilation");
+  }
+  if(_layerHParam.inputDepth % _groups != 0 || _layerHParam.nbOfFilter % _groups != 0)
+  {
+    throw std::runtime_error("Input depth and number of filters must be multiples of the groups");
+  }
+  _CE = &CEs.front();
+  _CEs = &CEs;
+  for(int k = 0; k < CEs.size(); k++)
+  {
+    if(CEs[k].getSize() != _CE->getSize() || CEs[k].getDilation() != _CE->getDilation())
+    {
+      throw std::runtime_error("All the CEs must have the same size and dilation");
+    }
+    CEs[k].setPointwise(_pointwise);
+  }
+  if(CEs.size() > 1)
+  {
+    _lineBuffer = std::make_shared< LineBuffer<T> >(_CE->getSize(), _CE->getLineBuffer().getFifoSize(),
+                                                    _CE->getDilation());
+    for(int k = 0; k < CEs.size(); k++)
+    {
+      CEs[k].shareLineBuffer(_lineBuffer);
     }
+  }
+
+  if(mapping == POINTWISE_MAPPING && !_pointwise)
+  {
+    setPointwise(true);
+  }
+  else if(mapping == WINDOW_MAPPING)
+  {
+    setWindowGenerator(true);
+  }
+  if(!_pointwise && !_windowed && _CE->getSize() != _layerHParam.filterSize)
+  {
+    throw std::runtime_error("A streamed layer need CEs of the filter size, map it on the lanes");
+  }
+  initSteps();
+
+  // The layer buffers, back to back in the arena
+  _weights = Tensor<T>(std::vector<int>{_layerHParam.nbOfFilter, _layerHParam.inputDepth / _groups,
+                                        _layerHParam.filterSize, _layerHParam.filterSize}, _arena);
+  _bias = Tensor<T>(std::vector<int>(1, _layerHParam.nbOfFilter), _arena);
+  _inputs = Tensor<T>(std::vector<int>{_layerHParam.inputDepth, _layerHParam.inputHeight, _layerHParam.inputWidth},
+                      _arena);
+  _outputs = Tensor<T>(std::vector<int>{_layerHParam.nbOfFilter, outputHeight(), outputWidth()}, _arena);
+}
 
+/**
+* @brief  Controller object destructor
+*
+* @tparam T Type of input and output data
+*/
 template<typename T>
 Controller<T>::~Controller()
 {}
 
+/**
+* @brief  Compute the mapping of the passes, and their steps constants from the CE datapath
+*
+* @tparam T Type of input and output data
+*/
 template<typename T>
-T relu(T input)
+void Controller<T>::initSteps()
 {
-  return (input > 0) ? input : 0;
+  const LayerHParam& p = _layerHParam;
+  int size = _CE->getSize();
+
+  // Input channels on the lanes, tiles of a filter larger than the CE, filters per group of CEs
+  int perRow = size / p.filterSize;
+  int tileSide = (p.filterSize + size - 1) / size;
+  int filters = _CEs->size() / _unroll;
+  _lanes = _pointwise ? size * size : (_packing && perRow > 1 ? perRow * perRow : 1);
+  _tiles = _windowed ? tileSide * tileSide : 1;
+  _chunks = (p.inputDepth / _groups + _lanes - 1) / _lanes * _tiles;
+  _blocks = (p.nbOfFilter / _groups + filters - 1) / filters;
+  int bandRows = _bandRows > 0 ? _bandRows : outputHeight();
+  _bands = (outputHeight() + bandRows - 1) / bandRows;
+
+  PassTiming timing = passTiming(p, PassDatapath{size, _CE->getLineBuffer().getFifoSize(), _pointwise, _windowed,
+                                                  _unroll, _readColumns, _bandRows});
+  _maxStep = timing.maxStep;
+  _framePeriod = timing.framePeriod;
+  _swapStep = timing.swapStep;
+
+  PassGeometry geometry{size, _unroll, _lanes, _groups, _bandRows, outputWidth(), outputHeight(), timing};
+  if(_pointwise)
+  {
+    _mapping.reset(new PointwiseMapping<T>(p, geometry, _inputs, _events));
+  }
+  else if(_windowed)
+  {
+    _mapping.reset(new WindowMapping<T>(p, geometry, _inputs, _events));
+  }
+  else
+  {
+    _mapping.reset(new StreamMapping<T>(p, geometry, _inputs, _events));
+  }
 }
 
-//template<typename T>
-//void Controller<T>::LoadFromMem(Memory<T>& mem, T& reg, int& add)
-//{
-//  reg = mem.Read(add);
-//  add++;
-//}
-//
-//template<typename T>
-//void Controller<T>::SaveToMem(Memory<T>& mem, T& reg, int& add)
-//{
-//  mem.Write(add,reg);
-//  add++;
-//}
-//
-//template<typename T>
-//void Controller<T>::SaveToBuffer(T& buffer[], T& data[])
-//{
-//  buffer = data;
-//}
+template<typename T>
+T Controller<T>::relu(T input)
+{
+  return NumericTraits<T>::relu(input);
+}
 
+/**
+* @brief  Function used to set the weights buffer. The values are copied in the controller arena.
+*
+* @tparam T Type of input and output data
+*
+* @param  weights is indexed [filter][depth / groups][row][column], or [output][input] for a fully
+*         connected layer
+* @param  bias is indexed [filter]
+*/
 template<typename T>
-void Controller<T>::step()
+void Controller<T>::setWeights(const Tensor<T>& weights, const Tensor<T>& bias)
 {
-  switch (_state)
+  if(_layerHParam.type == FULLY_CONNECTED && weights.rank() == 2)
   {
-    case 0:  /// Halt
-      break;
+    _weights.reshape(std::vector<int>{_weights.dim(0), _weights.dim(1)}).assign(weights);
+  }
+  else
+  {
+    _weights.assign(weights);
+  }
+  _bias.assign(bias);
+  // Read from the DRAM into the buffers
+  _events.dramReads += _weights.size() + _bias.size();
+  _events.bufferWrites += _weights.size() + _bias.size();
+}
 
-    case 1: /// Load weight and bias
-      /// Actions
-    _CE->setSigs(TestType(0), _weights, true, _bias, true);
+/**
+* @brief  Function used to set the weights buffer from nested vectors
+*
+* @tparam T Type of input and output data
+*
+* @param  weights is indexed [filter][depth / groups][row][column]
+* @param  bias is indexed [filter]
+*/
+template<typename T>
+void Controller<T>::setWeights(const std::vector< std::vector< std::vector< std::vector<T> > > >& weights,
+                               const std::vector<T>& bias)
+{
+  setWeights(Tensor<T>(weights), Tensor<T>::fromValues(bias));
+}
 
-      /// Transitions
-      _state = 2;
-    break;
+/**
+* @brief  Function used to set the weights buffer of a fully connected layer from nested vectors
+*
+* @tparam T Type of input and output data
+*
+* @param  weights is indexed [output][input]
+* @param  bias is indexed [output]
+*/
+template<typename T>
+void Controller<T>::setWeights(const std::vector< std::vector<T> >& weights, const std::vector<T>& bias)
+{
+  setWeights(Tensor<T>(weights), Tensor<T>::fromValues(bias));
+}
 
-    case 2: /// Compute convolution
-      /// Actions
-      // Input signals
-      if (_layerSteps < _layerHParam.inputHeight * _layerHParam.inputWidth)
-      {
-        _CE->setSigs(_inputs[inHI][inWI], _weights, false, _bias, false);
+/**
+* @brief  Function used to set the inputs buffer. The values are copied in the controller arena.
+*
+* @tparam T Type of input and output data
+*
+* @param  inputs is indexed [depth][row][column], or [image][input] for a fully connected layer,
+*         one image per batch slot
+*/
+template<typename T>
+void Controller<T>::setInputs(const Tensor<T>& inputs)
+{
+  std::vector<int> shape = _inputs.shape();
+  if(_layerHParam.type == FULLY_CONNECTED)
+  {
+    if(inputs.rank() != 2 || inputs.dim(0) != _layerHParam.inputWidth)
+    {
+      throw std::runtime_error("The number of images must be the batch size");
+    }
+    // The image b is the column b of the one row high input
+    _inputs.reshape(std::vector<int>{shape[0], shape[2]}).transpose(0, 1).assign(inputs);
+  }
+  else
+  {
+    _inputs.assign(inputs);
+  }
+  _events.dramReads += _inputs.size();
+  _events.bufferWrites += _inputs.size();
+}
 
-        // Increment input data indexes
-        if (inWI == _layerHParam.inputWidth - 1)
-        {
-          inWI = 0;
-          inHI++;
-        } else
-        {
-          inWI++;
-        }
-      } else
-      {
-        _CE->setSigs(TestType(0), _weights, false, _bias, false);
-      }
+/**
+* @brief  Function used to set the inputs buffer from nested vectors
+*
+* @tparam T Type of input and output data
+*
+* @param  inputs is indexed [depth][row][column]
+*/
+template<typename T>
+void Controller<T>::setInputs(const std::vector< std::vector< std::vector<T> > >& inputs)
+{
+  setInputs(Tensor<T>(inputs));
+}
 
-      // Outputs signals
-      if (_layerSteps > _layerHParam.filterSize * _layerHParam.inputWidth
-              + _layerHParam.inputWidth * 2)
-      {
-        EXPECT_EQ(_results[outHI][outWI], _CE->getOutputReg());
+/**
+* @brief  Function used to set the inputs buffer of a fully connected layer from nested vectors
+*
+* @tparam T Type of input and output data
+*
+* @param  inputs is indexed [image][input], one image per batch slot
+*/
+template<typename T>
+void Controller<T>::setInputs(const std::vector< std::vector<T> >& inputs)
+{
+  setInputs(Tensor<T>(inputs));
+}
 
-        // Increment output data indexes
-        if (inWI == _layerHParam.inputWidth - 1)
-        {
-          outWI = 0;
-          outHI++;
-        } else
-        {
-          outWI++;
-        }
-      }
+/**
+* @brief  Function used to fetch the layer from a memory with a DMA engine, instead of setting the
+*         buffers. Must be called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  dma is the DMA engine, stepped by the controller
+* @param  layout is the addresses of the layer tensors in the memory of the DMA engine
+*/
+template<typename T>
+void Controller<T>::setDma(DmaEngine<T>& dma, DmaLayout layout)
+{
+  if(_bands > 1)
+  {
+    throw std::runtime_error("The DMA engine fetch the whole layer, it cannot compute row bands");
+  }
+  _dma = &dma;
+  _dmaLayout = layout;
+  initDma();
+}
 
-      // Increment layer step index
-      _layerSteps++;
+/**
+* @brief  Function used to fetch compressed weights, expanded by a decompressor. Must be called
+*         after setDma() and before the first step, the weights of the layout are then the records.
+*
+* @tparam T Type of input and output data
+*
+* @param  decompressor is the decompressor, fed by the DMA engine of the controller and stepped
+*         by the controller
+*/
+template<typename T>
+void Controller<T>::setWeightDecompressor(Decompressor<T>& decompressor)
+{
+  const CompressedTensor<T>& weights = decompressor.getTensor();
+  if(_dma == NULL || &decompressor.getDma() != _dma)
+  {
+    throw std::logic_error("The weight decompressor need the DMA engine of the controller");
+  }
+  if(weights.getRecords() != _layerHParam.nbOfFilter || weights.getRecordWords() * _groups
+     != _layerHParam.inputDepth * _layerHParam.filterSize * _layerHParam.filterSize)
+  {
+    throw std::runtime_error("The compressed weights does not match the layer");
+  }
+  _weightDecompressor = &decompressor;
+  initDma();
+}
 
-      /// Transitions
-      if(_layerSteps < _layerHParam.filterSize * _layerHParam.inputWidth   // Steps to fill the inputs FIFOs
-                       + _layerHParam.filterSize * 2                           // Steps between FIFO and output
-                       + _layerHParam.inputWidth - 1)                          // Steps to get the last input out)
+/**
+* @brief  Function used to fetch compressed input channels, like the outputs of the previous layer
+*         stored by an output compressor. Must be called after setDma() and before the first step,
+*         the inputs of the layout are then the records.
+*
+* @tparam T Type of input and output data
+*
+* @param  decompressor is the decompressor, fed by the DMA engine of the controller and stepped
+*         by the controller. Its tensor hold one record per input channel.
+*/
+template<typename T>
+void Controller<T>::setInputDecompressor(Decompressor<T>& decompressor)
+{
+  const CompressedTensor<T>& inputs = decompressor.getTensor();
+  if(_dma == NULL || &decompressor.getDma() != _dma)
+  {
+    throw std::logic_error("The input decompressor need the DMA engine of the controller");
+  }
+  if(inputs.getRecords() != _layerHParam.inputDepth
+     || inputs.getRecordWords() != _layerHParam.inputHeight * _layerHParam.inputWidth)
+  {
+    throw std::runtime_error("The compressed inputs does not match the layer");
+  }
+  _inputDecompressor = &decompressor;
+  initDma();
+}
+
+/**
+* @brief  Function used to store the outputs compressed. Must be called after setDma() and before
+*         the first step, the outputs of the layout are then the records.
+*
+* @tparam T Type of input and output data
+*
+* @param  compressor is the compressor, storing with the DMA engine of the controller and stepped
+*         by the controller. Its tensor get one record per filter.
+*/
+template<typename T>
+void Controller<T>::setOutputCompressor(Compressor<T>& compressor)
+{
+  CompressedTensor<T>& outputs = compressor.getTensor();
+  if(_dma == NULL || &compressor.getDma() != _dma)
+  {
+    throw std::logic_error("The output compressor need the DMA engine of the controller");
+  }
+  if(outputs.getRecords() != _layerHParam.nbOfFilter || outputs.getRecordWords() != outputHeight() * outputWidth())
+  {
+    throw std::runtime_error("The compressed outputs does not match the layer");
+  }
+  _outputCompressor = &compressor;
+}
+
+/**
+* @brief  Function used to apply the ReLU to the outputs, once their last chunk is accumulated
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to clamp the negative outputs to zero
+*/
+template<typename T>
+void Controller<T>::setRelu(bool enable)
+{
+  _relu = enable;
+}
+
+/**
+* @brief  Reset the DMA bookkeeping for the current mapping
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::initDma()
+{
+  _passIssued.assign(nbOfPasses(), 0);
+  _passTransfers.assign(nbOfPasses(), std::vector<long>());
+  _passJobs.assign(nbOfPasses(), -1);
+  _passInputJobs.assign(nbOfPasses(), -1);
+  _blockRecords.assign(nbOfPasses() / _chunks, -2);
+  _channelLoaded.assign(_layerHParam.inputDepth, 0);
+  _outStored = -1;
+}
+
+/**
+* @brief  Reset the DMA bookkeeping after a restore. The passes started are in the restored
+*         buffers, the next ones are fetched again from the memory of this DMA engine, and the
+*         complete blocks are written back to it again.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::resumeDma()
+{
+  int outStored = _outStored;
+  initDma();
+  int groupDepth = _layerHParam.inputDepth / _groups;
+  int started = (_state == 1 && _layerSteps == 0) ? _inPass : std::min(_inPass + 1, nbOfPasses());
+  for(int pass = 0; pass < started; pass++)
+  {
+    _passIssued[pass] = 1;
+    int channels = std::min(_lanes, groupDepth - passFirst(pass));
+    std::fill(_channelLoaded.begin() + passChannel(pass), _channelLoaded.begin() + passChannel(pass) + channels, 1);
+  }
+  // The next pass is prefetched during the current one
+  if(_state == 2)
+  {
+    issuePass(_inPass + 1);
+  }
+  for(int pass = _chunks - 1; pass <= outStored; pass += _chunks)
+  {
+    storeOutputs(pass);
+  }
+  _outStored = outStored;
+}
+
+/**
+* @brief  Submit a descriptor to the DMA engine and count its buffer and DRAM accesses
+*
+* @tparam T Type of input and output data
+*
+* @return the descriptor index
+*/
+template<typename T>
+long Controller<T>::transfer(const DmaDescriptor<T>& descriptor)
+{
+  long words = (long)descriptor.rows * descriptor.rowWords;
+  if(descriptor.store)
+  {
+    _events.bufferReads += words;
+    _events.dramWrites += words;
+  }
+  else
+  {
+    _events.dramReads += words;
+    _events.bufferWrites += words;
+  }
+  return _dma->submit(descriptor);
+}
+
+/**
+* @brief  Fetch the data of a pass not in the buffers yet: its input channels, the weights of its
+*         block of filters and, with the first chunk, their bias
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index, nothing is done past the last pass
+*/
+template<typename T>
+void Controller<T>::issuePass(int pass)
+{
+  if(_dma == NULL || pass >= nbOfPasses() || _passIssued[pass])
+  {
+    return;
+  }
+  _passIssued[pass] = 1;
+  int groupDepth = _layerHParam.inputDepth / _groups;
+  int filterWords = _layerHParam.filterSize * _layerHParam.filterSize;
+  int first = passFirst(pass);
+  int channels = std::min(_lanes, groupDepth - first);
+  int channel = passChannel(pass);
+  long plane = (long)_layerHParam.inputHeight * _layerHParam.inputWidth;
+
+  // Input channels, fetched once for all the blocks of filters
+  if(!_channelLoaded[channel])
+  {
+    for(int c = 0; c < channels; c++)
+    {
+      _channelLoaded[channel + c] = 1;
+    }
+    if(_inputDecompressor)
+    {
+      long records = transfer(_inputDecompressor->fetch(_dmaLayout.inputs, channel, channels));
+      _passInputJobs[pass] = _inputDecompressor->submit(records, _inputs.data(), channel, channels, 0, int(plane));
+      _events.bufferWrites += channels * plane;
+    }
+    else
+    {
+      _passTransfers[pass].push_back(transfer(DmaDescriptor<T>{_dmaLayout.inputs + channel * plane,
+                                              _inputs.data() + channel * plane, 1, int(channels * plane), 0, 0, false}));
+    }
+  }
+
+  // Weights of the chunk channels of every filter of the block, one row per filter. The tiles of
+  // a folded filter are fetched with the first one.
+  int filter = passFilter(pass, 0);
+  int filters = passFilters(pass);
+  long offset = ((long)filter * groupDepth + first) * filterWords;
+  if(passTile(pass) == 0 && _weightDecompressor)
+  {
+    // The records have no fixed size per channel, so the records of a block are fetched whole
+    fetchRecords(pass / _chunks);
+    _passJobs[pass] = _weightDecompressor->submit(_blockRecords[pass / _chunks], _weights.data(), filter,
+                                                  filters, first * filterWords, channels * filterWords);
+    _events.bufferWrites += (long)filters * channels * filterWords;
+  }
+  else if(passTile(pass) == 0)
+  {
+    _passTransfers[pass].push_back(transfer(DmaDescriptor<T>{_dmaLayout.weights + offset, _weights.data() + offset,
+                                            filters, channels * filterWords, (long)groupDepth * filterWords,
+                                            (long)groupDepth * filterWords, false}));
+  }
+  if(pass % _chunks == 0)
+  {
+    _passTransfers[pass].push_back(transfer(DmaDescriptor<T>{_dmaLayout.bias + filter, _bias.data() + filter,
+                                            1, filters, 0, 0, false}));
+  }
+  // The next block records are prefetched during the chunks of this one, behind the data of the pass
+  if(_weightDecompressor)
+  {
+    fetchRecords(pass / _chunks + 1);
+  }
+}
+
+/**
+* @brief  Fetch the compressed weights records of a block of filters, if not fetched yet
+*
+* @tparam T Type of input and output data
+*
+* @param  block is the block index (group * blocks + block), nothing is done past the last block
+*/
+template<typename T>
+void Controller<T>::fetchRecords(int block)
+{
+  if(block < _blockRecords.size() && _blockRecords[block] == -2)
+  {
+    _blockRecords[block] = transfer(_weightDecompressor->fetch(_dmaLayout.weights, passFilter(block * _chunks, 0),
+                                                               passFilters(block * _chunks)));
+  }
+}
+
+/**
+* @brief  Function used to know if the data of a pass is in the buffers
+*
+* @tparam T Type of input and output data
+*
+* @return true without DMA engine
+*/
+template<typename T>
+bool Controller<T>::passReady(int pass)
+{
+  if(_dma == NULL || pass >= nbOfPasses())
+  {
+    return true;
+  }
+  if(!_passIssued[pass])
+  {
+    return false;
+  }
+  for(int i = 0; i < _passTransfers[pass].size(); i++)
+  {
+    if(!_dma->isDone(_passTransfers[pass][i]))
+    {
+      return false;
+    }
+  }
+  return (_weightDecompressor == NULL || _weightDecompressor->isDone(_passJobs[pass]))
+         && (_inputDecompressor == NULL || _inputDecompressor->isDone(_passInputJobs[pass]));
+}
+
+/**
+* @brief  Write back the outputs of the block of filters of a pass
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the last chunk of the block
+*/
+template<typename T>
+void Controller<T>::storeOutputs(int pass)
+{
+  int filter = passFilter(pass, 0);
+  int filters = passFilters(pass);
+  long plane = (long)outputHeight() * outputWidth();
+  if(_outputCompressor)
+  {
+    // The records are stored by the compressor, at their offsets in the image
+    _events.bufferReads += filters * plane;
+    _events.dramWrites += _outputCompressor->submit(_dmaLayout.outputs, _outputs.data() + filter * plane,
+                                                    filter, filters);
+    return;
+  }
+  transfer(DmaDescriptor<T>{_dmaLayout.outputs + filter * plane, _outputs.data() + filter * plane,
+                            1, int(filters * plane), 0, 0, true});
+}
+
+/**
+* @brief  Step the DMA engine and the compression stages, one cycle
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::stepStages()
+{
+  _dma->step();
+  if(_weightDecompressor){_weightDecompressor->step();}
+  if(_inputDecompressor){_inputDecompressor->step();}
+  if(_outputCompressor){_outputCompressor->step();}
+}
+
+/**
+* @brief  Function used to know if the compression stages have no job
+*
+* @tparam T Type of input and output data
+*
+* @return true if no stage has a job
+*/
+template<typename T>
+bool Controller<T>::stagesIdle()
+{
+  return (_weightDecompressor == NULL || _weightDecompressor->isIdle())
+         && (_inputDecompressor == NULL || _inputDecompressor->isIdle())
+         && (_outputCompressor == NULL || _outputCompressor->isIdle());
+}
+
+/**
+* @brief  Function used to get the outputs of a fully connected layer
+*
+* @tparam T Type of input and output data
+*
+* @return a view of the outputs buffer indexed [image][output]
+*/
+template<typename T>
+Tensor<T> Controller<T>::getBatchOutputs()
+{
+  return _outputs.reshape(std::vector<int>{_layerHParam.nbOfFilter, _layerHParam.inputWidth}).transpose(0, 1);
+}
+
+/**
+* @brief  Function used to get the outputs buffer
+*
+* @tparam T Type of input and output data
+*
+* @return the outputs indexed [filter][row][column]
+*/
+template<typename T>
+const Tensor<T>& Controller<T>::getOutputs()
+{
+  return _outputs;
+}
+
+template<typename T>
+int Controller<T>::outputWidth()
+{
+  return (_layerHParam.inputWidth - filterExtent() + 2 * _layerHParam.padding) / _layerHParam.stride + 1;
+}
+
+template<typename T>
+int Controller<T>::outputHeight()
+{
+  return (_layerHParam.inputHeight - filterExtent() + 2 * _layerHParam.padding) / _layerHParam.stride + 1;
+}
+
+/**
+* @brief  Function used to know the input pixels spanned by a filter row
+*
+* @tparam T Type of input and output data
+*
+* @return (filterSize - 1) * dilation + 1
+*/
+template<typename T>
+int Controller<T>::filterExtent()
+{
+  return (_layerHParam.filterSize - 1) * _layerHParam.dilation + 1;
+}
+
+/**
+* @brief  Function used to know how many compute steps one input channel take
+*
+* @tparam T Type of input and output data
+*
+* @return the number of steps in state 2 for one filter and one input channel
+*/
+template<typename T>
+int Controller<T>::passSteps()
+{
+  return _maxStep;
+}
+
+/**
+* @brief  Function used to enable the shadow weights. Must be called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to load the next pass weights in the background and swap them without
+*         draining the pipeline
+*/
+template<typename T>
+void Controller<T>::setShadowWeights(bool enable)
+{
+  _shadowWeights = enable;
+}
+
+/**
+* @brief  Function used to map the CE PE array across the input channels of a 1x1 layer. Must be
+*         called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to compute CE size^2 input channels per pass
+*/
+template<typename T>
+void Controller<T>::setPointwise(bool enable)
+{
+  if(enable && _layerHParam.filterSize != 1)
+  {
+    throw std::runtime_error("Pointwise mode need a 1x1 filter");
+  }
+  if(!enable && _layerHParam.type == FULLY_CONNECTED)
+  {
+    throw std::runtime_error("Fully connected layers are always computed in pointwise mode");
+  }
+  if(enable && _windowed)
+  {
+    throw std::runtime_error("Pointwise mode and window generator are exclusive");
+  }
+  if(!enable && _bandRows > 0 && !_windowed)
+  {
+    throw std::runtime_error("Row bands need the pointwise mode or the window generator, set the bands to 0 first");
+  }
+  if(!enable && !_windowed && _CE->getSize() != _layerHParam.filterSize)
+  {
+    throw std::runtime_error("A streamed layer need CEs of the filter size, map it on the lanes");
+  }
+  _pointwise = enable;
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    (*_CEs)[k].setPointwise(enable || _windowed);
+  }
+  initSteps();
+  if(_dma)
+  {
+    initDma();
+  }
+}
+
+/**
+* @brief  Function used to feed the CE lanes with the window of every valid output of a
+*         convolution layer, instead of streaming the padded input channel in the FIFOs. Must be
+*         called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to skip the row transitions and the padding steps
+*/
+template<typename T>
+void Controller<T>::setWindowGenerator(bool enable)
+{
+  if(enable && (_pointwise || _layerHParam.dilation > 1))
+  {
+    throw std::runtime_error("Window generator need a convolution layer without dilation");
+  }
+  if(!enable && (_unroll > 1 || _packing || _readColumns > 0 || _bandRows > 0))
+  {
+    throw std::runtime_error("Spatial unroll, channel packing, read port and row bands need the window generator");
+  }
+  if(!enable && !_pointwise && _CE->getSize() != _layerHParam.filterSize)
+  {
+    throw std::runtime_error("A streamed layer need CEs of the filter size, map it on the lanes");
+  }
+  _windowed = enable;
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    (*_CEs)[k].setPointwise(enable || _pointwise);
+  }
+  initSteps();
+  if(_dma)
+  {
+    initDma();
+  }
+}
+
+/**
+* @brief  Function used to compute factor horizontally adjacent outputs of every filter together,
+*         one per CE of a group of factor CEs. Need the window generator. Must be called before
+*         the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  factor is the number of outputs computed together, 1 to disable
+*/
+template<typename T>
+void Controller<T>::setSpatialUnroll(int factor)
+{
+  if(factor < 1 || (factor > 1 && !_windowed) || _CEs->size() % factor != 0)
+  {
+    throw std::runtime_error("Spatial unroll need the window generator and a multiple of the factor CEs");
+  }
+  _unroll = factor;
+  initSteps();
+  if(_dma)
+  {
+    initDma();
+  }
+}
+
+template<typename T>
+int Controller<T>::getSpatialUnroll()
+{
+  return _unroll;
+}
+
+/**
+* @brief  Function used to put the windows of (CE size / filterSize)^2 input channels side by side
+*         on the CE lanes. Need the window generator. Must be called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is true to compute several channels per pass with a small filter
+*/
+template<typename T>
+void Controller<T>::setChannelPacking(bool enable)
+{
+  if(enable && !_windowed)
+  {
+    throw std::runtime_error("Channel packing need the window generator");
+  }
+  _packing = enable;
+  initSteps();
+  if(_dma)
+  {
+    initDma();
+  }
+}
+
+/**
+* @brief  Function used to set the width of the input buffer read port of the window generator.
+*         Need the window generator. Must be called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  columns is the number of columns of every window row read per step, 0 for the columns
+*         entering the window on a step
+*/
+template<typename T>
+void Controller<T>::setWindowReadPort(int columns)
+{
+  if(columns < 0 || (columns > 0 && !_windowed))
+  {
+    throw std::runtime_error("Window read port need the window generator and a positive width");
+  }
+  _readColumns = columns;
+  initSteps();
+}
+
+/**
+* @brief  Function used to compute the passes band by band: all the passes of a band of output
+*         rows, then the next band. Need the pointwise mode or the window generator, and no DMA
+*         engine. Must be called before the first step.
+*
+* @tparam T Type of input and output data
+*
+* @param  rows is the number of output rows of a band, 0 for the whole layer
+*/
+template<typename T>
+void Controller<T>::setRowBands(int rows)
+{
+  if(rows < 0 || (rows > 0 && ((!_pointwise && !_windowed) || _dma)))
+  {
+    throw std::runtime_error("Row bands need the lanes, without DMA engine");
+  }
+  _bandRows = rows;
+  initSteps();
+}
+
+/**
+* @brief  Function used to gate the bands. A band only start once all its output rows are below
+*         the limit, the producer of the inputs set it to the rows whose input rows are in.
+*
+* @tparam T Type of input and output data
+*
+* @param  rows is the number of output rows the bands can start on, -1 for all
+*/
+template<typename T>
+void Controller<T>::setRowLimit(int rows)
+{
+  _rowLimit = rows;
+}
+
+/**
+* @brief  Function used to know the output rows of the bands started, their outputs are on the way
+*
+* @tparam T Type of input and output data
+*
+* @return the number of output rows from the first one
+*/
+template<typename T>
+int Controller<T>::getStartedRows()
+{
+  return _rowsStarted;
+}
+
+/**
+* @brief  Function used to know the output rows complete, after the last pass of their band
+*
+* @tparam T Type of input and output data
+*
+* @return the number of output rows from the first one
+*/
+template<typename T>
+int Controller<T>::getCompletedRows()
+{
+  return _rowsDone;
+}
+
+/**
+* @brief  Function used to write an input row, streamed in by its producer
+*
+* @tparam T Type of input and output data
+*
+* @param  row is the input row
+* @param  values is indexed [depth][column]
+*/
+template<typename T>
+void Controller<T>::setInputRow(int row, const Tensor<T>& values)
+{
+  std::vector<int> shape = _inputs.shape();
+  _inputs.slice(1, row, row + 1).assign(values.reshape(std::vector<int>{shape[0], 1, shape[2]}));
+  _events.bufferWrites += values.size();
+}
+
+/**
+* @brief  Start the layer again from its first pass, for new inputs. The CEs are not reset, the
+*         outputs are cleared.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::restart()
+{
+  if(_dma)
+  {
+    throw std::runtime_error("Cannot restart a controller fetching its layer with a DMA engine");
+  }
+  _inPass = 0;
+  _outPass = 0;
+  _layerSteps = 0;
+  _outSteps = 0;
+  _state = 1;
+  _portCount = 0;
+  _swapPending = false;
+  _rowsStarted = 0;
+  _rowsDone = 0;
+  _outputs.fill(T(0));
+}
+
+/**
+* @brief  Function used to know how many useful MACs the layer need, to compute the PE utilization
+*
+* @tparam T Type of input and output data
+*
+* @return the number of MACs
+*/
+template<typename T>
+long Controller<T>::getMacs()
+{
+  return (long)_layerHParam.nbOfFilter * outputHeight() * outputWidth()
+         * _layerHParam.filterSize * _layerHParam.filterSize * (_layerHParam.inputDepth / _groups);
+}
+
+/**
+* @brief  Function used to know how many weights were sent to the CE. The layer MACs divided by
+*         this is the number of times each fetched weight is used.
+*
+* @tparam T Type of input and output data
+*
+* @return the number of weight words, on the weight port or on the wide weight bus
+*/
+template<typename T>
+long Controller<T>::getWeightFetches()
+{
+  return _weightFetches;
+}
+
+/**
+* @brief  Function used to know how many inputs were written in the line buffer shared by the CEs
+*
+* @tparam T Type of input and output data
+*
+* @return the number of input writes, 0 with a single CE
+*/
+template<typename T>
+long Controller<T>::getInputWrites()
+{
+  return _lineBuffer ? _lineBuffer->getWrites() : 0;
+}
+
+/**
+* @brief  Function used to know how many input writes the shared line buffer saved, compared to
+*         one line buffer per CE
+*
+* @tparam T Type of input and output data
+*
+* @return the number of saved input writes
+*/
+template<typename T>
+long Controller<T>::getSavedInputWrites()
+{
+  return _lineBuffer ? _lineBuffer->getSavedWrites() : 0;
+}
+
+/**
+* @brief  Function used to know how many steps the CE spent only loading weights, or waiting for
+*         the shadow bank to be ready
+*
+* @tparam T Type of input and output data
+*
+* @return the exposed weight load steps
+*/
+template<typename T>
+long Controller<T>::getExposedLoadSteps()
+{
+  return _exposedLoadSteps;
+}
+
+/**
+* @brief  Function used to know how many weight load steps were hidden behind computation
+*
+* @tparam T Type of input and output data
+*
+* @return the hidden weight load steps
+*/
+template<typename T>
+long Controller<T>::getHiddenLoadSteps()
+{
+  return _hiddenLoadSteps;
+}
+
+/**
+* @brief  Function used to know how many steps the layer took so far
+*
+* @tparam T Type of input and output data
+*
+* @return the number of steps while not halted
+*/
+template<typename T>
+long Controller<T>::getTotalSteps()
+{
+  return _totalSteps;
+}
+
+/**
+* @brief  Function used to know how many steps the layer waited for the DMA engine, the transfer
+*         time not hidden behind computation
+*
+* @tparam T Type of input and output data
+*
+* @return the exposed transfer steps
+*/
+template<typename T>
+long Controller<T>::getDmaStallSteps()
+{
+  return _dmaStallSteps;
+}
+
+/**
+* @brief  Function used to know how many steps a band waited for the row limit
+*
+* @tparam T Type of input and output data
+*
+* @return the steps waiting for input rows or for room for the outputs
+*/
+template<typename T>
+long Controller<T>::getRowStallSteps()
+{
+  return _rowStallSteps;
+}
+
+/**
+* @brief  Function used to get the operations of the layer so far, to compute its energy. The
+*         events of the CEs and of the shared line buffer are added to the layer buffers and DRAM
+*         accesses of the controller.
+*
+* @tparam T Type of input and output data
+*
+* @return the event counts
+*/
+template<typename T>
+EventCounts Controller<T>::getEventCounts()
+{
+  EventCounts events = _events;
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    events += (*_CEs)[k].getEventCounts();
+  }
+  if(_lineBuffer)
+  {
+    events.fifoShifts += _lineBuffer->getShifts();
+  }
+  return events;
+}
+
+/**
+* @brief  Function used to get the range of the values written in the datapath since construction,
+*         of all the CEs
+*
+* @tparam T Type of input and output data
+*
+* @return the profile of the layer
+*/
+template<typename T>
+RangeProfile<T> Controller<T>::getRangeProfile()
+{
+  RangeProfile<T> profile;
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    profile += (*_CEs)[k].getRangeProfile();
+  }
+  profile.accumulators += _accumulatorRange;
+  return profile;
+}
+
+template<typename T>
+int Controller<T>::getState()
+{
+  return _state;
+}
+
+template<typename T>
+bool Controller<T>::isHalted()
+{
+  return _state == 0;
+}
+
+/**
+* @brief  Function used to know how many of the next steps only feed zeros to the CE: the padding,
+*         the zero inputs and the drain of a streamed pass. Those steps can be fast-forwarded with
+*         skip() when the CE is idle, the windows saved meanwhile are only the bias the CE hold.
+*         The lanes feed the CE every step, the pointwise and windowed passes have no quiet step.
+*         With shadow weights, the steps sending the next pass weights on the port, the swap and
+*         the start of the next pass are not quiet.
+*
+* @tparam T Type of input and output data
+*
+* @return the number of quiet steps ahead
+*/
+template<typename T>
+int Controller<T>::quietSteps()
+{
+  if(_state != 2 || _mapping->onLanes())
+  {
+    return 0;
+  }
+  // The step ending the output pass is clocked
+  int span = _maxStep - 1 - _outSteps;
+  if(_shadowWeights && _inPass + 1 < nbOfPasses())
+  {
+    if(_swapPending || _portCount <= _CE->getSize() * _CE->getSize())
+    {
+      return 0;
+    }
+    span = std::min(span, _framePeriod - 1 - _layerSteps);
+  }
+  return span > 0 ? _mapping->zeroInputSteps(_layerSteps, span) : 0;
+}
+
+/**
+* @brief  Fast-forward over quiet steps. The drivers walk the steps, the windows they save are the
+*         output registers of the idle CEs. The CEs are advanced with bulk cycle accounting.
+*
+* @tparam T Type of input and output data
+*
+* @param  steps is the number of steps to skip. Must not be more than quietSteps()
+*/
+template<typename T>
+void Controller<T>::skip(int steps)
+{
+  if(steps > quietSteps())
+  {
+    throw std::logic_error("Cannot skip steps that are not quiet");
+  }
+  for(int i = 0; i < steps; i++)
+  {
+    T input = T(0);
+    int saveHI = 0, saveWI = 0;
+    _mapping->inputLogic(_layerSteps, input);
+    if(_outSteps < _maxStep && _mapping->outputLogic(_outSteps, saveHI, saveWI))
+    {
+      saveOutputs(saveHI, saveWI);
+    }
+    _layerSteps++;
+    _outSteps++;
+  }
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    (*_CEs)[k].skip(steps);
+  }
+  if(_lineBuffer)
+  {
+    _lineBuffer->skip(steps);
+  }
+  if(_dma)
+  {
+    // The stages wait for the DMA transfers or submit some, they are stepped together while busy
+    int dmaSteps = steps;
+    for(; dmaSteps > 0 && !stagesIdle(); dmaSteps--)
+    {
+      stepStages();
+    }
+    _dma->skip(dmaSteps);
+    if(_weightDecompressor){_weightDecompressor->skip(dmaSteps);}
+    if(_inputDecompressor){_inputDecompressor->skip(dmaSteps);}
+    if(_outputCompressor){_outputCompressor->skip(dmaSteps);}
+  }
+  _totalSteps += steps;
+}
+
+/**
+* @brief  Write the controller indexes, state, driver registers and the layer buffers to a
+*         snapshot, so a controller of the same layer can resume from it without setting its
+*         weights and inputs again.
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void Controller<T>::save(Snapshot& snap)
+{
+  if((_dma && !_dma->isIdle()) || !stagesIdle())
+  {
+    throw std::logic_error("Cannot save a controller while its DMA transfers are in flight");
+  }
+  snap.writeTag(snapshotTag);
+  snap.write(_layerHParam);
+  /// Indexes
+  snap.write(_inPass);
+  snap.write(_outPass);
+  snap.write(_layerSteps);
+  snap.write(_outSteps);
+  snap.write(_state);
+  /// Channels mapping
+  snap.write(_pointwise);
+  snap.write(_windowed);
+  snap.write(_unroll);
+  snap.write(_packing);
+  snap.write(_readColumns);
+  snap.write(_bandRows);
+  /// Driver registers
+  _mapping->save(snap);
+  /// Activation
+  snap.write(_relu);
+  /// Shadow weights
+  snap.write(_shadowWeights);
+  snap.write(_portCount);
+  snap.write(_swapPending);
+  snap.write(_nextPassWeights);
+  /// Row gate
+  snap.write(_rowLimit);
+  snap.write(_rowsStarted);
+  snap.write(_rowsDone);
+  /// Counters
+  snap.write(_weightFetches);
+  snap.write(_exposedLoadSteps);
+  snap.write(_hiddenLoadSteps);
+  snap.write(_totalSteps);
+  snap.write(_events);
+  snap.write(_dmaStallSteps);
+  snap.write(_rowStallSteps);
+  snap.write(_accumulatorRange);
+  /// DMA
+  snap.write(_outStored);
+  /// Buffers
+  _weights.save(snap);
+  _bias.save(snap);
+  _inputs.save(snap);
+  _outputs.save(snap);
+  snap.write(_passWeights);
+}
+
+/**
+* @brief  Read the controller indexes, state, driver registers and the layer buffers from a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read. It must come from a controller of the same layer. The DMA
+*         engine, if any, is set before
+*/
+template<typename T>
+void Controller<T>::restore(Snapshot& snap)
+{
+  LayerHParam layerHParam;
+  snap.expect(snapshotTag, "Controller");
+  snap.read(layerHParam);
+  if(layerHParam != _layerHParam)
+  {
+    throw std::runtime_error("Snapshot layer hyper parameters does not match");
+  }
+  /// Indexes
+  snap.read(_inPass);
+  snap.read(_outPass);
+  snap.read(_layerSteps);
+  snap.read(_outSteps);
+  snap.read(_state);
+  /// Channels mapping
+  bool pointwise = false, windowed = false;
+  int unroll = 1;
+  bool packing = false;
+  int readColumns = 0, bandRows = 0;
+  snap.read(pointwise);
+  snap.read(windowed);
+  snap.read(unroll);
+  snap.read(packing);
+  snap.read(readColumns);
+  snap.read(bandRows);
+  if(pointwise != _pointwise || windowed != _windowed || unroll != _unroll || packing != _packing
+     || readColumns != _readColumns || bandRows != _bandRows)
+  {
+    if(_bandRows > 0){setRowBands(0);}
+    if(_readColumns > 0){setWindowReadPort(0);}
+    if(_unroll > 1){setSpatialUnroll(1);}
+    if(_packing){setChannelPacking(false);}
+    if(_windowed){setWindowGenerator(false);}
+    setPointwise(pointwise);
+    if(windowed){setWindowGenerator(true);}
+    if(packing){setChannelPacking(true);}
+    if(unroll > 1){setSpatialUnroll(unroll);}
+    if(readColumns > 0){setWindowReadPort(readColumns);}
+    if(bandRows > 0){setRowBands(bandRows);}
+  }
+  /// Driver registers, of the mapping set above
+  _mapping->restore(snap);
+  /// Activation
+  snap.read(_relu);
+  /// Shadow weights
+  snap.read(_shadowWeights);
+  snap.read(_portCount);
+  snap.read(_swapPending);
+  snap.read(_nextPassWeights);
+  /// Row gate
+  snap.read(_rowLimit);
+  snap.read(_rowsStarted);
+  snap.read(_rowsDone);
+  /// Counters
+  snap.read(_weightFetches);
+  snap.read(_exposedLoadSteps);
+  snap.read(_hiddenLoadSteps);
+  snap.read(_totalSteps);
+  snap.read(_events);
+  snap.read(_dmaStallSteps);
+  snap.read(_rowStallSteps);
+  snap.read(_accumulatorRange);
+  /// DMA
+  snap.read(_outStored);
+  /// Buffers
+  _weights.restore(snap);
+  _bias.restore(snap);
+  _inputs.restore(snap);
+  _outputs.restore(snap);
+  snap.read(_passWeights);
+  if(_dma)
+  {
+    resumeDma();
+  }
+}
+
+template<typename T>
+int Controller<T>::nbOfPasses()
+{
+  return _bands * _groups * _blocks * _chunks;
+}
+
+/**
+* @brief  First input channel of a pass. A pass compute a block of filters of a group, one per CE,
+*         over the _lanes input channels of a chunk of the group.
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index (((band * groups + group) * blocks + block) * chunks + chunk)
+*
+* @return the input channel index
+*/
+template<typename T>
+int Controller<T>::passChannel(int pass)
+{
+  int group = (pass / _chunks / _blocks) % _groups;
+  return group * (_layerHParam.inputDepth / _groups) + passFirst(pass);
+}
+
+/**
+* @brief  First input channel of a pass in its group. The _tiles passes of a folded filter follow
+*         each other on the same channels, a chunk is (channels * tiles + tile).
+*
+* @tparam T Type of input and output data
+*
+* @return the channel index in the group
+*/
+template<typename T>
+int Controller<T>::passFirst(int pass)
+{
+  return ((pass % _chunks) / _tiles) * _lanes;
+}
+
+/**
+* @brief  Tile of a folded filter computed by a pass, the tiles are CE size^2 weights in row order
+*
+* @tparam T Type of input and output data
+*
+* @return the tile index, 0 if the filter fit in the CE
+*/
+template<typename T>
+int Controller<T>::passTile(int pass)
+{
+  return (pass % _chunks) % _tiles;
+}
+
+/**
+* @brief  Filter computed by a CE during a pass
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index
+* @param  ce is the CE index
+*
+* @return the filter index, or -1 if the CE is idle because the last block of the group is not full
+*/
+template<typename T>
+int Controller<T>::passFilter(int pass, int ce)
+{
+  int filtersPerGroup = _layerHParam.nbOfFilter / _groups;
+  int group = (pass / _chunks / _blocks) % _groups;
+  int filter = ((pass / _chunks) % _blocks) * (_CEs->size() / _unroll) + ce / _unroll;
+  return (filter < filtersPerGroup) ? group * filtersPerGroup + filter : -1;
+}
+
+/**
+* @brief  Number of filters computed by a pass, they follow passFilter(pass, 0)
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index
+*
+* @return the number of busy groups of CEs
+*/
+template<typename T>
+int Controller<T>::passFilters(int pass)
+{
+  int filters = 0;
+  while(filters < _CEs->size() / _unroll && passFilter(pass, filters * _unroll) >= 0){filters++;}
+  return filters;
+}
+
+/**
+* @brief  Bias of a pass. It is only added once, with the first chunk.
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index
+* @param  ce is the CE index
+*
+* @return the bias or zero
+*/
+template<typename T>
+T Controller<T>::passBias(int pass, int ce)
+{
+  int filter = passFilter(pass, ce);
+  return (pass % _chunks == 0 && filter >= 0) ? _bias(filter) : T(0);
+}
+
+/**
+* @brief  Band of output rows of a pass
+*
+* @tparam T Type of input and output data
+*
+* @return the band index, 0 without row bands
+*/
+template<typename T>
+int Controller<T>::passBand(int pass)
+{
+  return pass / (_groups * _blocks * _chunks);
+}
+
+/**
+* @brief  Function used to know if the row limit let a pass start. Only the first pass of a band
+*         wait, the next ones are on the same rows.
+*
+* @tparam T Type of input and output data
+*
+* @return true if the pass can start
+*/
+template<typename T>
+bool Controller<T>::rowsReady(int pass)
+{
+  if(_rowLimit < 0 || pass >= nbOfPasses() || pass % (_groups * _blocks * _chunks) != 0)
+  {
+    return true;
+  }
+  int bandRows = _bandRows > 0 ? _bandRows : outputHeight();
+  return std::min(outputHeight(), (passBand(pass) + 1) * bandRows) <= _rowLimit;
+}
+
+/**
+* @brief  Count the output rows of the band of a pass as started
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::startPass(int pass)
+{
+  int bandRows = _bandRows > 0 ? _bandRows : outputHeight();
+  _rowsStarted = std::max(_rowsStarted, std::min(outputHeight(), (passBand(pass) + 1) * bandRows));
+}
+
+/**
+* @brief  Reset the input driver registers at the beginning of a pass (one filter, one input channel)
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::initInputPass()
+{
+  _mapping->initInputPass(passChannel(_inPass), passTile(_inPass), passBand(_inPass));
+  _layerSteps = 0;
+  _portCount = 0;
+}
+
+/**
+* @brief  Reset the output driver registers at the beginning of a pass
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::initOutputPass()
+{
+  _mapping->initOutputPass(passBand(_outPass));
+  _outSteps = _layerSteps;
+}
+
+/**
+* @brief  Weights of a pass in the CE PE order. The last PE of a row see the newest input, so the
+*         columns are mirrored.
+*
+* @tparam T Type of input and output data
+*
+* @param  pass is the pass index
+* @param  ce is the CE index
+*
+* @return the weights as a vector of vector of T type
+*/
+template<typename T>
+std::vector< std::vector<T> > Controller<T>::passWeights(int pass, int ce)
+{
+  int size = _CE->getSize();
+  int filter = passFilter(pass, ce);
+  if(filter < 0)
+  {
+    return std::vector< std::vector<T> >(size, std::vector<T>(size, T(0)));
+  }
+
+  if(_windowed)
+  {
+    // One window pixel per PE, the lanes are not reversed like the FIFO rows. The tile of the
+    // pass, or the windows of the packed channels side by side.
+    int filterSize = _layerHParam.filterSize;
+    int tileSide = (filterSize + size - 1) / size, perRow = std::max(1, size / filterSize);
+    int top = (passTile(pass) / tileSide) * size, left = (passTile(pass) % tileSide) * size;
+    int first = passFirst(pass);
+    std::vector< std::vector<T> > weights(size, std::vector<T>(size, T(0)));
+    for(int c = 0; c < _lanes && first + c < _layerHParam.inputDepth / _groups; c++)
+    {
+      int laneI = (c / perRow) * filterSize, laneJ = (c % perRow) * filterSize;
+      for(int i = 0; i < std::min(size, filterSize - top); i++)
+      {
+        for(int j = 0; j < std::min(size, filterSize - left); j++)
+        {
+          weights[laneI + i][laneJ + j] = _weights(filter, first + c, top + i, left + j);
+        }
+      }
+    }
+    return weights;
+  }
+
+  if(_pointwise)
+  {
+    // One input channel per PE, in the lanes order
+    int first = passFirst(pass);
+    std::vector< std::vector<T> > weights(size, std::vector<T>(size, T(0)));
+    for(int k = 0; k < _lanes && first + k < _layerHParam.inputDepth / _groups; k++)
+    {
+      weights[k / size][k % size] = _weights(filter, first + k, 0, 0);
+    }
+    return weights;
+  }
+
+  int filterSize = _layerHParam.filterSize;
+  std::vector< std::vector<T> > weights(filterSize, std::vector<T>(filterSize));
+  for(int i = 0; i < filterSize; i++)
+  {
+    for(int j = 0; j < filterSize; j++)
+    {
+      weights[i][j] = _weights(filter, pass % _chunks, i, filterSize - 1 - j);
+    }
+  }
+  return weights;
+}
+
+/**
+* @brief  Accumulate the CE output registers in the outputs of the output pass
+*
+* @tparam T Type of input and output data
+*
+* @param  saveHI is the output row
+* @param  saveWI is the output column of the first CE of a group
+*/
+template<typename T>
+void Controller<T>::saveOutputs(int saveHI, int saveWI)
+{
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    int filter = passFilter(_outPass, k);
+    int col = saveWI + k % _unroll;
+    if(filter >= 0 && col < outputWidth())
+    {
+      _outputs(filter, saveHI, col) = NumericTraits<T>::add(_outputs(filter, saveHI, col),
+                                                            (*_CEs)[k].getOutputReg());
+      _accumulatorRange.record(_outputs(filter, saveHI, col));
+      // The output is complete after the last chunk
+      if(_relu && _outPass % _chunks == _chunks - 1)
+      {
+        _outputs(filter, saveHI, col) = relu(_outputs(filter, saveHI, col));
+      }
+      _events.bufferReads++;
+      _events.bufferWrites++;
+    }
+  }
+}
+
+/**
+* @brief  Step all the CEs, then the line buffer they share
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::stepCEs()
+{
+  for(int k = 0; k < _CEs->size(); k++)
+  {
+    (*_CEs)[k].step();
+  }
+  if(_lineBuffer)
+  {
+    _lineBuffer->step();
+  }
+}
+
+/**
+* @brief Execute one step. Need to be called every step
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void Controller<T>::step()
+{
+  bool loadInputFlag = false;
+  bool saveOutputFlag = false;
+  bool portEnable = false;
+  bool swap = false;
+  T input = T(0);
+  std::vector<T>& ports = _portValues;
+  std::vector< std::vector< std::vector<T> > >& lanes = _laneValues;
+  int saveHI = 0, saveWI = 0;
+
+  if(_state != 0){_totalSteps++;}
+  if(_dma && _state != 0){stepStages();}
+
+  switch (_state)
+  {
+    case 0:  /// Halt
+      break;
+
+    case 1: /// Load weight and bias
+      /// DMA. Wait for the pass data, then prefetch the next pass
+      if(_layerSteps == 0 && _dma)
+      {
+        issuePass(_inPass);
+        if(!passReady(_inPass))
+        {
+          _dmaStallSteps++;
+          break;
+        }
+        issuePass(_inPass + 1);
+      }
+      /// Wait for the rows of the band
+      if(_layerSteps == 0)
+      {
+        if(!rowsReady(_inPass))
+        {
+          _rowStallSteps++;
+          break;
+        }
+        startPass(_inPass);
+      }
+
+      /// Actions
+      if(_layerSteps == 0)
+      {
+        _passWeights.resize(_CEs->size());
+        for(int k = 0; k < _CEs->size(); k++)
+        {
+          _passWeights[k] = passWeights(_inPass, k);
+          // The weights are broadcast to the CEs of a group
+          if(passFilter(_inPass, k) >= 0 && k % _unroll == 0)
+          {
+            _weightFetches += _CE->getSize() * _CE->getSize();
+            _events.bufferReads += _CE->getSize() * _CE->getSize() + 1;
+          }
+        }
+      }
+      // Bias is only added once, with the first input channel
+      for(int k = 0; k < _CEs->size(); k++)
+      {
+        (*_CEs)[k].setSigs(T(0), _passWeights[k], true, passBias(_inPass, k), true);
+        (*_CEs)[k].setShadowSigs(T(0), false, false);
+      }
+      stepCEs();
+      _layerSteps++;
+      _exposedLoadSteps++;
+
+      /// Transitions
+      if(_layerSteps == weightLoadSteps)
+      {
+        initInputPass();
+        _outPass = _inPass;
+        initOutputPass();
+        _state = 2;
+      }
+      break;
+
+    case 2: /// Compute convolution
+      /// Actions
+      // Inputs logic
+      if(_mapping->onLanes())
+      {
+        loadInputFlag = _mapping->laneLogic(_layerSteps, lanes);
+      }
+      else
+      {
+        loadInputFlag = (_inPass < nbOfPasses()) && _mapping->inputLogic(_layerSteps, input);
+      }
+
+      // Output logic
+      saveOutputFlag = (_outSteps < _maxStep) && _mapping->outputLogic(_outSteps, saveHI, saveWI);
+
+      // Shadow bank. Send the next pass weights on the ports (one per CE), swap between the two
+      // passes windows
+      ports.assign(_CEs->size(), T(0));
+      if(_shadowWeights && _inPass + 1 < nbOfPasses() && !_swapPending && (_portCount > 0 || passReady(_inPass + 1)))
+      {
+        int next = _inPass + 1;
+        int size = _CE->getSize();
+        if(_portCount == 0)
+        {
+          _nextPassWeights.resize(_CEs->size());
+          for(int k = 0; k < _CEs->size(); k++)
+          {
+            _nextPassWeights[k] = passWeights(next, k);
+          }
+        }
+        for(int k = 0; k < _CEs->size(); k++)
+        {
+          if(_portCount < size * size)
+          {
+            ports[k] = _nextPassWeights[k][_portCount / size][_portCount % size];
+            if(passFilter(next, k) >= 0 && k % _unroll == 0)
+            {
+              _weightFetches++;
+              _events.bufferReads++;
+            }
+          }
+          else if(_portCount == size * size)
+          {
+            ports[k] = passBias(next, k);
+            if(passFilter(next, k) >= 0 && k % _unroll == 0){_events.bufferReads++;}
+          }
+        }
+        if(_portCount <= size * size)
+        {
+          portEnable = true;
+          _portCount++;
+          _hiddenLoadSteps++;
+        }
+      }
+      if(_swapPending && _layerSteps == _swapStep)
+      {
+        swap = true;
+        _swapPending = false;
+        _passWeights = _nextPassWeights;
+      }
+
+      // Input signals
+      for(int k = 0; k < _CEs->size(); k++)
+      {
+        (*_CEs)[k].setSigs(loadInputFlag ? input : T(0), _passWeights[k], false, T(0), false);
+        (*_CEs)[k].setShadowSigs(ports[k], portEnable, swap);
+        if(_mapping->onLanes())
+        {
+          (*_CEs)[k].setLaneSigs(lanes[k % _unroll]);
+        }
+      }
+
+      // Step
+      stepCEs();
+
+      // Outputs signals
+      if(saveOutputFlag)
+      {
+        saveOutputs(saveHI, saveWI);
+      }
+
+      // Increment layer step index
+      _layerSteps++;
+      _outSteps++;
+
+      /// Transitions
+      // Next input pass, streamed right after this one when the shadow bank is ready
+      if(_shadowWeights && !_swapPending && _inPass + 1 < nbOfPasses() && _layerSteps >= _framePeriod)
+      {
+        if(_CE->isShadowReady() && rowsReady(_inPass + 1))  // The CEs ports are written together
+        {
+          _inPass++;
+          initInputPass();
+          _swapPending = true;
+          startPass(_inPass);
+          issuePass(_inPass + 1);
+        }
+        else if(!passReady(_inPass + 1))
+        {
+          _dmaStallSteps++;
+        }
+        else if(!rowsReady(_inPass + 1))
+        {
+          _rowStallSteps++;
+        }
+        else
+        {
+          _exposedLoadSteps++;
+        }
+      }
+      // Output pass done
+      if(_outSteps >= _maxStep)
+      {
+        // The rows of a band are complete after its last pass
+        if((_outPass + 1) % (_groups * _blocks * _chunks) == 0)
+        {
+          int bandRows = _bandRows > 0 ? _bandRows : outputHeight();
+          _rowsDone = std::min(outputHeight(), (passBand(_outPass) + 1) * bandRows);
+        }
+        // The outputs of the block are complete after its last chunk
+        if(_dma && _outPass > _outStored && _outPass % _chunks == _chunks - 1)
+        {
+          storeOutputs(_outPass);
+          _outStored = _outPass;
+        }
+        if(_outPass < _inPass)
+        {
+          _outPass++;
+          initOutputPass();
+        }
+        else if(_inPass + 1 == nbOfPasses())
+        {
+          if(_dma)
+          {
+            _state = 3;
+          }
+          else
+          {
+            _state = 0;
+            // Write the outputs back to the DRAM
+            _events.bufferReads += _outputs.size();
+            _events.dramWrites += _outputs.size();
+          }
+        }
+        else if(!_shadowWeights)
+        {
+          // Drain and load the next weights
+          _inPass++;
+          _layerSteps = 0;
+          _state = 1;
+        }
+      }
+      break;
+
+    case 3: /// Write back the outputs
+      _dmaStallSteps++;
+      if(_dma->isIdle() && stagesIdle())
       {
-        _state = 0; // TODO Next layer maybe..
+        _state = 0;
       }
       break;
   }
 }
 
-#endif //CONTROLLER_HPP
\ No newline at end of file
+#endif //CONTROLLER_HPP
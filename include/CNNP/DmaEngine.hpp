@@ -0,0 +1,309 @@
+/**
+ *  @file    DmaEngine.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief DMA engine module
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module move blocks of words between the Memory and the on-chip buffers of the controller.
+ *  A descriptor is a 2D transfer: rows of rowWords consecutive words, the rows are memStride words
+ *  apart in the memory and bufferStride words apart in the buffer. Every row is split in bursts of
+ *  at most burstWords words.
+ *
+ *  One burst request is issued per cycle, with at most maxOutstanding bursts in flight. A burst
+ *  data start latency cycles after its request, the data channel move wordsPerCycle words per
+ *  cycle and is shared by the bursts in their request order:
+ *    end = max(request + latency, previous end) + words / wordsPerCycle
+ *  The words are copied when the burst complete, so a buffer is only valid once its descriptor is
+ *  done.
+ */
+
+#ifndef DMAENGINE_HPP
+#define DMAENGINE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+#include "HyperParams.hpp"
+#include "Memory.hpp"
+
+/// A 2D transfer between the memory and an on-chip buffer
+template <typename T>
+struct DmaDescriptor
+{
+  size_t memAddress;      ///< First word in the memory
+  T* buffer;              ///< First word in the on-chip buffer
+  int rows;
+  int rowWords;           ///< Consecutive words of a row
+  long memStride;         ///< Words between two rows in the memory
+  long bufferStride;      ///< Words between two rows in the buffer
+  bool store;             ///< From the buffer to the memory, else from the memory to the buffer
+};
+
+/// Addresses of the layer tensors in the memory, stored like the controller buffers
+struct DmaLayout
+{
+  size_t weights;         ///< [filter][depth / groups][row][column]
+  size_t bias;            ///< [filter]
+  size_t inputs;          ///< [depth][row][column], [input][image] for a fully connected layer
+  size_t outputs;         ///< [filter][row][column], [output][image] for a fully connected layer
+};
+
+/**
+ * @brief DMA engine. Objects that move 2D blocks of words between a Memory and on-chip buffers
+ *        with burst transfers
+ *
+ * @tparam T Type of the words
+ */
+template <typename T>
+class DmaEngine
+{
+  private:
+  /// A burst of consecutive words
+  struct Burst
+  {
+    size_t memAddress;
+    T* buffer;
+    int words;
+    bool store;
+    long descriptor;      ///< Index of the descriptor of the burst
+    double end;           ///< Cycle the last word is moved, once issued
+  };
+
+  Memory<T>* _memory;
+  DmaHParam _dmaHParam;
+  std::deque<Burst> _queue;          ///< Bursts waiting to be issued
+  std::deque<Burst> _inFlight;       ///< Bursts issued, in request order
+  std::vector<long> _remaining;      ///< Bursts not completed of every descriptor
+  long _cycle;
+  double _channelFree;               ///< Cycle the data channel is done with the issued bursts
+  /// Counters
+  long _busyCycles;                  ///< Cycles with a burst queued or in flight
+  long _bursts;
+  long _words;
+
+  void complete(Burst& burst);
+
+  public:
+  DmaEngine(Memory<T>& memory, DmaHParam dmaHParam);
+  ~DmaEngine();
+  long submit(const DmaDescriptor<T>& descriptor);
+  bool isDone(long descriptor);
+  bool isIdle();
+  void step();
+  void skip(long steps);
+  long getCycles();
+  long getBusyCycles();
+  long getBursts();
+  long getWords();
+  Memory<T>& getMemory();
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  DmaEngine object constructor
+*
+* @tparam T Type of the words
+*
+* @param  memory is the memory read and written
+* @param  dmaHParam is the bursts size, the outstanding requests, the latency and the bandwidth
+*/
+template<typename T>
+DmaEngine<T>::DmaEngine(Memory<T>& memory, DmaHParam dmaHParam) :
+    _memory(&memory),
+    _dmaHParam(dmaHParam),
+    _cycle(0),
+    _channelFree(0),
+    _busyCycles(0),
+    _bursts(0),
+    _words(0)
+{
+  if(dmaHParam.burstWords <= 0 || dmaHParam.maxOutstanding <= 0 || dmaHParam.latency < 0
+     || dmaHParam.wordsPerCycle <= 0)
+  {
+    throw std::runtime_error("DMA engine need bursts, outstanding requests and a bandwidth");
+  }
+}
+
+/**
+* @brief  DmaEngine object destructor
+*
+* @tparam T Type of the words
+*/
+template<typename T>
+DmaEngine<T>::~DmaEngine()
+{}
+
+/**
+* @brief  Queue a descriptor. Its bursts are issued after the ones already queued.
+*
+* @tparam T Type of the words
+*
+* @param  descriptor is the transfer
+*
+* @return the descriptor index, for isDone()
+*/
+template<typename T>
+long DmaEngine<T>::submit(const DmaDescriptor<T>& descriptor)
+{
+  long index = _remaining.size();
+  _remaining.push_back(0);
+  for(int row = 0; row < descriptor.rows; row++)
+  {
+    for(int first = 0; first < descriptor.rowWords; first += _dmaHParam.burstWords)
+    {
+      Burst burst;
+      burst.memAddress = descriptor.memAddress + row * descriptor.memStride + first;
+      burst.buffer = descriptor.buffer + row * descriptor.bufferStride + first;
+      burst.words = std::min(_dmaHParam.burstWords, descriptor.rowWords - first);
+      burst.store = descriptor.store;
+      burst.descriptor = index;
+      burst.end = 0;
+      _queue.push_back(burst);
+      _remaining[index]++;
+    }
+  }
+  return index;
+}
+
+/**
+* @brief  Function used to know if all the words of a descriptor were moved
+*
+* @tparam T Type of the words
+*
+* @param  descriptor is the index returned by submit()
+*
+* @return true if the descriptor is done
+*/
+template<typename T>
+bool DmaEngine<T>::isDone(long descriptor)
+{
+  return _remaining.at(descriptor) == 0;
+}
+
+template<typename T>
+bool DmaEngine<T>::isIdle()
+{
+  return _queue.empty() && _inFlight.empty();
+}
+
+/**
+* @brief  Move the words of a completed burst
+*
+* @tparam T Type of the words
+*/
+template<typename T>
+void DmaEngine<T>::complete(Burst& burst)
+{
+  if(burst.store)
+  {
+    _memory->Write(burst.memAddress, burst.buffer, burst.words);
+  }
+  else
+  {
+    _memory->Read(burst.memAddress, burst.buffer, burst.words);
+  }
+  _words += burst.words;
+  _bursts++;
+  _remaining[burst.descriptor]--;
+}
+
+/**
+* @brief Execute one cycle. Complete the bursts done this cycle and issue the next request.
+*
+* @tparam T Type of the words
+*/
+template<typename T>
+void DmaEngine<T>::step()
+{
+  if(isIdle())
+  {
+    _cycle++;
+    return;
+  }
+  _busyCycles++;
+
+  /// Request
+  if(!_queue.empty() && _inFlight.size() < _dmaHParam.maxOutstanding)
+  {
+    Burst burst = _queue.front();
+    _queue.pop_front();
+    double start = std::max(double(_cycle + _dmaHParam.latency), _channelFree);
+    _channelFree = start + burst.words / _dmaHParam.wordsPerCycle;
+    burst.end = _channelFree;
+    _inFlight.push_back(burst);
+  }
+
+  _cycle++;
+
+  /// Completion, the channel return the bursts in order
+  while(!_inFlight.empty() && std::ceil(_inFlight.front().end) <= _cycle)
+  {
+    complete(_inFlight.front());
+    _inFlight.pop_front();
+  }
+}
+
+/**
+* @brief  Advance several cycles
+*
+* @tparam T Type of the words
+*
+* @param  steps is the number of cycles
+*/
+template<typename T>
+void DmaEngine<T>::skip(long steps)
+{
+  // Only the cycles with transfers need to be stepped
+  while(steps > 0 && !isIdle())
+  {
+    step();
+    steps--;
+  }
+  _cycle += steps;
+}
+
+template<typename T>
+long DmaEngine<T>::getCycles()
+{
+  return _cycle;
+}
+
+/**
+* @brief  Function used to know how many cycles the engine moved data
+*
+* @tparam T Type of the words
+*
+* @return the cycles with a burst queued or in flight
+*/
+template<typename T>
+long DmaEngine<T>::getBusyCycles()
+{
+  return _busyCycles;
+}
+
+template<typename T>
+long DmaEngine<T>::getBursts()
+{
+  return _bursts;
+}
+
+template<typename T>
+long DmaEngine<T>::getWords()
+{
+  return _words;
+}
+
+template<typename T>
+Memory<T>& DmaEngine<T>::getMemory()
+{
+  return *_memory;
+}
+
+#endif //DMAENGINE_HPP
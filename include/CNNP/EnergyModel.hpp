@@ -0,0 +1,230 @@
+/**
+ *  @file    EnergyModel.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Energy model
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module compute the energy of the layers from the operations counted by the simulator
+ *  (Controller::getEventCounts()) and a configurable cost per operation. The energy is broken down
+ *  by level of the memory hierarchy:
+ *    PE     -> the MACs and the PE, weight, adder and output registers
+ *    array  -> the line buffer FIFOs, the skew and synchronization registers and the row adders
+ *    buffer -> the on-chip layer buffers
+ *    DRAM   -> the layer weights and inputs read and the outputs written back
+ *
+ *  The default costs are normalized to a MAC, in the ratios of the usual 65nm figures for a
+ *  16 bits datapath: register file 1, inter-PE transfer 2, on-chip buffer 6, DRAM 200. Real costs
+ *  (pJ) of a technology can be given instead, the report is in the same unit.
+ */
+
+#ifndef ENERGYMODEL_HPP
+#define ENERGYMODEL_HPP
+
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CNNP/EventCounts.hpp"
+
+/// Energy of one operation of every kind
+struct EnergyCosts
+{
+  double mac;
+  double regRead;
+  double regWrite;
+  double fifoShift;
+  double syncShift;
+  double add;
+  double bufferRead;
+  double bufferWrite;
+  double dramRead;
+  double dramWrite;
+};
+
+/// Energy of a layer, per inference, by hierarchy level
+struct LayerEnergy
+{
+  std::string name;
+  EventCounts events;      ///< Events of the whole simulated layer
+  int images;              ///< Images computed by the simulated layer
+  double macs;             ///< MACs computed per inference
+  double pe;
+  double array;
+  double buffer;
+  double dram;
+  double total;
+};
+
+/**
+ * @brief Energy model. Objects that turn the simulated events of layers into an energy report
+ */
+class EnergyModel
+{
+  private:
+  EnergyCosts _costs;
+  std::vector<LayerEnergy> _layers;
+
+  public:
+  static EnergyCosts defaultCosts();
+
+  EnergyModel(EnergyCosts costs = defaultCosts());
+  ~EnergyModel();
+  const EnergyCosts& getCosts();
+  LayerEnergy evaluate(const std::string& name, const EventCounts& events, int images = 1);
+  void addLayer(const std::string& name, const EventCounts& events, int images = 1);
+  const std::vector<LayerEnergy>& getLayers();
+  LayerEnergy getInference();
+  void writeCsv(std::ostream& os);
+  void writeReport(std::ostream& os);
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  Function used to get the default costs, normalized to a MAC
+*
+* @return the costs
+*/
+inline EnergyCosts EnergyModel::defaultCosts()
+{
+  // mac, regRead, regWrite, fifoShift, syncShift, add, bufferRead, bufferWrite, dramRead, dramWrite
+  return EnergyCosts{1.0, 1.0, 1.0, 2.0, 2.0, 1.0, 6.0, 6.0, 200.0, 200.0};
+}
+
+/**
+* @brief  EnergyModel object constructor
+*
+* @param  costs is the energy of every operation
+*/
+inline EnergyModel::EnergyModel(EnergyCosts costs) :
+    _costs(costs)
+{}
+
+inline EnergyModel::~EnergyModel()
+{}
+
+inline const EnergyCosts& EnergyModel::getCosts()
+{
+  return _costs;
+}
+
+/**
+* @brief  Function used to compute the energy of a layer
+*
+* @param  name is the layer name
+* @param  events is the events of the simulated layer
+* @param  images is the number of images computed by the layer (the batch of a fully connected
+*         layer), the energy is divided by it
+*
+* @return the energy of the layer per inference
+*/
+inline LayerEnergy EnergyModel::evaluate(const std::string& name, const EventCounts& events, int images)
+{
+  if(images <= 0)
+  {
+    throw std::runtime_error("A layer compute at least one image");
+  }
+  LayerEnergy layer;
+  layer.name = name;
+  layer.events = events;
+  layer.images = images;
+  layer.macs = double(events.macs) / images;
+  layer.pe = (events.macs * _costs.mac + events.regReads * _costs.regRead
+              + events.regWrites * _costs.regWrite) / images;
+  layer.array = (events.fifoShifts * _costs.fifoShift + events.syncShifts * _costs.syncShift
+                 + events.adds * _costs.add) / images;
+  layer.buffer = (events.bufferReads * _costs.bufferRead + events.bufferWrites * _costs.bufferWrite) / images;
+  layer.dram = (events.dramReads * _costs.dramRead + events.dramWrites * _costs.dramWrite) / images;
+  layer.total = layer.pe + layer.array + layer.buffer + layer.dram;
+  return layer;
+}
+
+/**
+* @brief  Add a layer to the report
+*
+* @param  name is the layer name
+* @param  events is the events of the simulated layer
+* @param  images is the number of images computed by the layer
+*/
+inline void EnergyModel::addLayer(const std::string& name, const EventCounts& events, int images)
+{
+  _layers.push_back(evaluate(name, events, images));
+}
+
+inline const std::vector<LayerEnergy>& EnergyModel::getLayers()
+{
+  return _layers;
+}
+
+/**
+* @brief  Function used to get the energy of one inference through all the layers
+*
+* @return the sum of the layers energy per inference
+*/
+inline LayerEnergy EnergyModel::getInference()
+{
+  LayerEnergy inference = evaluate("inference", EventCounts(), 1);
+  for(int i = 0; i < _layers.size(); i++)
+  {
+    inference.events += _layers[i].events;
+    inference.macs += _layers[i].macs;
+    inference.pe += _layers[i].pe;
+    inference.array += _layers[i].array;
+    inference.buffer += _layers[i].buffer;
+    inference.dram += _layers[i].dram;
+    inference.total += _layers[i].total;
+  }
+  return inference;
+}
+
+/**
+* @brief  Write the layers and the inference as CSV, one line each, energies per inference
+*
+* @param  os is the stream written
+*/
+inline void EnergyModel::writeCsv(std::ostream& os)
+{
+  std::vector<LayerEnergy> rows = _layers;
+  rows.push_back(getInference());
+  char line[256];
+  os << "layer,images,macs,pe,array,buffer,dram,total\n";
+  for(int i = 0; i < rows.size(); i++)
+  {
+    const LayerEnergy& l = rows[i];
+    std::snprintf(line, sizeof(line), ",%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", l.images, l.macs,
+                  l.pe, l.array, l.buffer, l.dram, l.total);
+    os << l.name << line;
+  }
+}
+
+/**
+* @brief  Write a table of the energy of every layer and of the inference, with the share of
+*         every hierarchy level and the energy per MAC
+*
+* @param  os is the stream written
+*/
+inline void EnergyModel::writeReport(std::ostream& os)
+{
+  std::vector<LayerEnergy> rows = _layers;
+  rows.push_back(getInference());
+  char line[256];
+  std::snprintf(line, sizeof(line), "%-16s %12s %8s %8s %8s %8s %10s\n", "layer", "energy", "PE", "array",
+                "buffer", "DRAM", "per MAC");
+  os << line;
+  for(int i = 0; i < rows.size(); i++)
+  {
+    const LayerEnergy& l = rows[i];
+    double total = (l.total > 0) ? l.total : 1.0;
+    std::snprintf(line, sizeof(line), "%-16s %12.4g %7.1f%% %7.1f%% %7.1f%% %7.1f%% %10.3g\n", l.name.c_str(),
+                  l.total, 100.0 * l.pe / total, 100.0 * l.array / total, 100.0 * l.buffer / total,
+                  100.0 * l.dram / total, (l.macs > 0) ? l.total / l.macs : 0.0);
+    os << line;
+  }
+}
+
+#endif //ENERGYMODEL_HPP
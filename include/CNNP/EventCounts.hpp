@@ -0,0 +1,54 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+#ifndef CNNP_EVENTCOUNTS_H
+#define CNNP_EVENTCOUNTS_H
+
+/// Operations counted by the simulator, to compute the energy. The PE rows skipped by the
+/// activity tracking and the idle CE steps are clock gated and count no PE event.
+struct EventCounts
+{
+  long macs;             ///< PE multiply accumulates
+  long regReads;         ///< PE, weight and adder registers reads
+  long regWrites;        ///< PE, weight, shadow, adder and output registers writes
+  long fifoShifts;       ///< Words entering the line buffer row FIFOs and the pointwise skew registers
+  long syncShifts;       ///< Words entering the synchronization registers between the rows
+  long adds;             ///< Row adders operations
+  long bufferReads;      ///< On-chip layer buffers (inputs, weights, bias, outputs) reads
+  long bufferWrites;     ///< On-chip layer buffers writes
+  long dramReads;        ///< Words read from the DRAM
+  long dramWrites;       ///< Words written to the DRAM
+
+  EventCounts& operator+=(const EventCounts& other)
+  {
+    macs += other.macs;
+    regReads += other.regReads;
+    regWrites += other.regWrites;
+    fifoShifts += other.fifoShifts;
+    syncShifts += other.syncShifts;
+    adds += other.adds;
+    bufferReads += other.bufferReads;
+    bufferWrites += other.bufferWrites;
+    dramReads += other.dramReads;
+    dramWrites += other.dramWrites;
+    return *this;
+  }
+
+  EventCounts& operator-=(const EventCounts& other)
+  {
+    macs -= other.macs;
+    regReads -= other.regReads;
+    regWrites -= other.regWrites;
+    fifoShifts -= other.fifoShifts;
+    syncShifts -= other.syncShifts;
+    adds -= other.adds;
+    bufferReads -= other.bufferReads;
+    bufferWrites -= other.bufferWrites;
+    dramReads -= other.dramReads;
+    dramWrites -= other.dramWrites;
+    return *this;
+  }
+};
+
+#endif //CNNP_EVENTCOUNTS_H
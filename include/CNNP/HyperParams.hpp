@@ -5,6 +5,23 @@
 #ifndef CNNP_HYPERPARAMS_H
 #define CNNP_HYPERPARAMS_H
 
+/// Layer types
+enum LayerType
+{
+  CONVOLUTION = 0,
+  FULLY_CONNECTED
+};
+
+/// Mappings of a layer on the CE PE array
+enum Mapping
+{
+  STREAM_MAPPING = 0,   ///< The padded input channels are streamed in the CE FIFOs, the CE size is the filter size
+  POINTWISE_MAPPING,    ///< The PE array is mapped across the input channels of a 1x1 layer
+  WINDOW_MAPPING        ///< The window generator feed the lanes, the filters are folded or packed on the CE
+};
+
+/// Layer hyper parameters. For a fully connected layer, inputDepth is the number of inputs,
+/// nbOfFilter the number of outputs and inputWidth the batch size (images computed together).
 struct LayerHParam
 {
   int inputWidth;
@@ -14,6 +31,38 @@ struct LayerHParam
   int filterSize;
   int stride;
   int padding;
+  int groups = 1;   ///< Input and output channels are split in groups, 0 or 1 for a dense layer, inputDepth for depthwise
+  LayerType type = CONVOLUTION;
+  int dilation = 1; ///< Spacing of the filter taps, 0 or 1 for a dense filter
+
+  bool operator==(const LayerHParam& other) const
+  {
+    return inputWidth == other.inputWidth && inputHeight == other.inputHeight && inputDepth == other.inputDepth
+           && nbOfFilter == other.nbOfFilter && filterSize == other.filterSize && stride == other.stride
+           && padding == other.padding && groups == other.groups && type == other.type && dilation == other.dilation;
+  }
+
+  bool operator!=(const LayerHParam& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/// Memory hyper parameters
+struct MemHParam
+{
+  int wordBytes;               ///< Bytes of a data word in DRAM
+  double dramBytesPerCycle;    ///< DRAM bandwidth, in bytes per CE clock cycle
+  long inputBufferWords = 0;   ///< On-chip input buffer size, 0 if it hold a whole layer
+};
+
+/// DMA engine hyper parameters
+struct DmaHParam
+{
+  int burstWords;              ///< Maximum words of a burst, a descriptor row is split in bursts
+  int maxOutstanding;          ///< Bursts in flight at once
+  int latency;                 ///< Cycles from a burst request to its first word
+  double wordsPerCycle;        ///< Data channel bandwidth, shared by all the bursts
 };
 
 #endif //CNNP_HYPERPARAMS_H
@@ -0,0 +1,402 @@
+/**
+ *  @file    ImageStream.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Image stream with asynchronous prefetch
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module read a stream of 8 bits images from a file or from all the files of a directory
+ *  (in name order). A file is mapped with MappedFile and hold one or more frames back to back:
+ *  binary PGM (P5, one channel) or PPM (P6, three channels) frames, or raw frames of a given
+ *  width, height and depth stored channel after channel.
+ *
+ *  A background thread decode the next frames and quantize them in input tensors indexed
+ *  [depth][row][column] while the simulator process the current one. At most "prefetch" decoded
+ *  frames wait in the queue. A pixel p of a frame with a maximum value maxVal become
+ *  NumericTraits<T>::fromDouble(p / (maxVal + 1) * range).
+ */
+
+#ifndef IMAGESTREAM_HPP
+#define IMAGESTREAM_HPP
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CNNP/MappedFile.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/Tensor.hpp"
+
+/**
+ * @brief Image stream. Objects that decode image frames in a background thread
+ *
+ * @tparam T Type of the quantized pixels
+ */
+template <typename T>
+class ImageStream
+{
+  private:
+  std::vector<std::string> _paths;   ///< The files of the stream
+  int _width, _height, _depth;       ///< Shape of every frame
+  double _range;                     ///< A full scale pixel is quantized to range
+  size_t _prefetch;                  ///< Maximum number of decoded frames waiting
+  /// Prefetch thread
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque< Tensor<T> > _frames;   ///< Decoded frames, oldest first
+  bool _done;                        ///< The thread decoded the last frame
+  bool _stop;                        ///< The thread is asked to stop
+  std::exception_ptr _error;         ///< Error of the thread, thrown by next()
+  long _decoded;                     ///< Frames decoded since construction
+
+  size_t parseHeader(const unsigned char* data, size_t size, size_t pos,
+                     int& width, int& height, int& depth, int& maxVal);
+  size_t decodeFrame(const unsigned char* data, size_t size, size_t pos, Tensor<T>& frame);
+  bool isPnm(const unsigned char* data, size_t size, size_t pos);
+  void prefetchLoop();
+
+  public:
+  ImageStream(const std::string& path, int width, int height, int depth, size_t prefetch = 2, double range = 1.0);
+  ~ImageStream();
+  int getWidth();
+  int getHeight();
+  int getDepth();
+  long getDecoded();
+  bool next(Tensor<T>& frame);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  ImageStream object constructor. Start the prefetch thread.
+*
+* @tparam T Type of the quantized pixels
+*
+* @param  path is a file or a directory of files
+* @param  width is the frame width, or 0 to take it from the first PGM/PPM header
+* @param  height is the frame height, or 0 to take it from the first PGM/PPM header
+* @param  depth is the frame depth, or 0 to take it from the first PGM/PPM header
+* @param  prefetch is the maximum number of decoded frames waiting to be read
+* @param  range is the value of a full scale pixel
+*/
+template<typename T>
+ImageStream<T>::ImageStream(const std::string& path, int width, int height, int depth, size_t prefetch, double range) :
+    _width(width),
+    _height(height),
+    _depth(depth),
+    _range(range),
+    _prefetch(prefetch > 0 ? prefetch : 1),
+    _done(false),
+    _stop(false),
+    _decoded(0)
+{
+  struct stat info;
+  if(stat(path.c_str(), &info) != 0)
+  {
+    throw std::runtime_error("Cannot find " + path);
+  }
+  if(S_ISDIR(info.st_mode))
+  {
+    DIR* dir = opendir(path.c_str());
+    if(dir == NULL)
+    {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    for(struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+    {
+      std::string file = path + "/" + entry->d_name;
+      if(entry->d_name[0] != '.' && stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+      {
+        _paths.push_back(file);
+      }
+    }
+    closedir(dir);
+    std::sort(_paths.begin(), _paths.end());
+  }
+  else
+  {
+    _paths.push_back(path);
+  }
+
+  // The frame shape is known before the first frame is read, to build the layer
+  if(_width == 0 || _height == 0 || _depth == 0)
+  {
+    int maxVal = 0;
+    for(int i = 0; i < _paths.size() && (_width == 0 || _height == 0 || _depth == 0); i++)
+    {
+      MappedFile file(_paths[i]);
+      if(isPnm(file.data(), file.size(), 0))
+      {
+        parseHeader(file.data(), file.size(), 0, _width, _height, _depth, maxVal);
+      }
+    }
+    if(_width == 0 || _height == 0 || _depth == 0)
+    {
+      throw std::runtime_error("The frame shape of a raw stream must be given");
+    }
+  }
+
+  _thread = std::thread(&ImageStream<T>::prefetchLoop, this);
+}
+
+/**
+* @brief  ImageStream object destructor. Stop the prefetch thread.
+*
+* @tparam T Type of the quantized pixels
+*/
+template<typename T>
+ImageStream<T>::~ImageStream()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+template<typename T>
+int ImageStream<T>::getWidth()
+{
+  return _width;
+}
+
+template<typename T>
+int ImageStream<T>::getHeight()
+{
+  return _height;
+}
+
+template<typename T>
+int ImageStream<T>::getDepth()
+{
+  return _depth;
+}
+
+/**
+* @brief  Function used to know how many frames the prefetch thread decoded, read or not
+*
+* @tparam T Type of the quantized pixels
+*
+* @return the number of decoded frames
+*/
+template<typename T>
+long ImageStream<T>::getDecoded()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _decoded;
+}
+
+/**
+* @brief  Function used to get the next frame. Wait for the prefetch thread if it is not decoded yet.
+*
+* @tparam T Type of the quantized pixels
+*
+* @param  frame is set to the frame, indexed [depth][row][column]
+*
+* @return false at the end of the stream
+*/
+template<typename T>
+bool ImageStream<T>::next(Tensor<T>& frame)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this]{ return !_frames.empty() || _done; });
+  if(_frames.empty())
+  {
+    if(_error)
+    {
+      std::rethrow_exception(_error);
+    }
+    return false;
+  }
+  frame = _frames.front();
+  _frames.pop_front();
+  lock.unlock();
+  _cv.notify_all();
+  return true;
+}
+
+/**
+* @brief  Function used to know if a PGM/PPM header start at a position
+*
+* @tparam T Type of the quantized pixels
+*/
+template<typename T>
+bool ImageStream<T>::isPnm(const unsigned char* data, size_t size, size_t pos)
+{
+  return pos + 2 <= size && data[pos] == 'P' && (data[pos + 1] == '5' || data[pos + 1] == '6');
+}
+
+/**
+* @brief  Parse a binary PGM/PPM header
+*
+* @tparam T Type of the quantized pixels
+*
+* @param  data is the file
+* @param  size is the file size
+* @param  pos is the header position
+* @param  width is set to the image width
+* @param  height is set to the image height
+* @param  depth is set to 1 for PGM, 3 for PPM
+* @param  maxVal is set to the maximum pixel value
+*
+* @return the position of the pixels
+*/
+template<typename T>
+size_t ImageStream<T>::parseHeader(const unsigned char* data, size_t size, size_t pos,
+                                   int& width, int& height, int& depth, int& maxVal)
+{
+  depth = (data[pos + 1] == '5') ? 1 : 3;
+  pos += 2;
+  int fields[3] = {0, 0, 0};
+  for(int i = 0; i < 3; i++)
+  {
+    // Whitespaces and comments
+    while(pos < size && (std::isspace(data[pos]) || data[pos] == '#'))
+    {
+      if(data[pos] == '#')
+      {
+        while(pos < size && data[pos] != '\n'){pos++;}
+      }
+      else
+      {
+        pos++;
+      }
+    }
+    if(pos >= size || !std::isdigit(data[pos]))
+    {
+      throw std::runtime_error("Bad PGM/PPM header");
+    }
+    while(pos < size && std::isdigit(data[pos]))
+    {
+      fields[i] = fields[i] * 10 + (data[pos] - '0');
+      pos++;
+    }
+  }
+  // A single whitespace before the pixels
+  pos++;
+  width = fields[0];
+  height = fields[1];
+  maxVal = fields[2];
+  if(maxVal == 0 || maxVal > 255)
+  {
+    throw std::runtime_error("Only 8 bits PGM/PPM frames are supported");
+  }
+  return pos;
+}
+
+/**
+* @brief  Decode and quantize a frame
+*
+* @tparam T Type of the quantized pixels
+*
+* @param  data is the file
+* @param  size is the file size
+* @param  pos is the frame position
+* @param  frame is set to the frame
+*
+* @return the position of the next frame
+*/
+template<typename T>
+size_t ImageStream<T>::decodeFrame(const unsigned char* data, size_t size, size_t pos, Tensor<T>& frame)
+{
+  int width = _width, height = _height, depth = _depth, maxVal = 255;
+  bool pnm = isPnm(data, size, pos);
+  if(pnm)
+  {
+    pos = parseHeader(data, size, pos, width, height, depth, maxVal);
+    if(width != _width || height != _height || depth != _depth)
+    {
+      throw std::runtime_error("All the frames of a stream must have the same shape");
+    }
+  }
+  size_t bytes = (size_t)width * height * depth;
+  if(pos + bytes > size)
+  {
+    throw std::runtime_error("Truncated frame");
+  }
+
+  // Quantize every possible pixel once
+  std::vector<T> levels(maxVal + 1);
+  for(int p = 0; p <= maxVal; p++)
+  {
+    levels[p] = NumericTraits<T>::fromDouble(double(p) / (maxVal + 1) * _range);
+  }
+
+  frame = Tensor<T>({depth, height, width});
+  const unsigned char* pixels = data + pos;
+  for(int d = 0; d < depth; d++)
+  {
+    for(int i = 0; i < height; i++)
+    {
+      for(int j = 0; j < width; j++)
+      {
+        // PGM/PPM pixels are interleaved, raw frames are stored channel after channel
+        unsigned char pixel = pnm ? pixels[((size_t)i * width + j) * depth + d]
+                  : pixels[((size_t)d * height + i) * width + j];
+        frame(d, i, j) = levels[std::min<int>(pixel, maxVal)];
+      }
+    }
+  }
+  return pos + bytes;
+}
+
+/**
+* @brief  Prefetch thread. Decode the frames of every file until the queue is full.
+*
+* @tparam T Type of the quantized pixels
+*/
+template<typename T>
+void ImageStream<T>::prefetchLoop()
+{
+  try
+  {
+    for(int i = 0; i < _paths.size(); i++)
+    {
+      MappedFile file(_paths[i]);
+      size_t pos = 0;
+      while(pos < file.size())
+      {
+        Tensor<T> frame;
+        pos = decodeFrame(file.data(), file.size(), pos, frame);
+        // Trailing whitespaces after the last PGM/PPM frame
+        while(pos < file.size() && isPnm(file.data(), file.size(), 0) && std::isspace(file.data()[pos])){pos++;}
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]{ return _frames.size() < _prefetch || _stop; });
+        if(_stop)
+        {
+          return;
+        }
+        _frames.push_back(frame);
+        _decoded++;
+        lock.unlock();
+        _cv.notify_all();
+      }
+    }
+  }
+  catch(...)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _error = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done = true;
+  }
+  _cv.notify_all();
+}
+
+#endif //IMAGESTREAM_HPP
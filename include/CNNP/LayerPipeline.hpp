@@ -0,0 +1,696 @@
+/**
+ *  @file    LayerPipeline.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Layer-pipelined execution of a chain of convolution layers
+ *
+ *  @section DESCRIPTION
+ *
+ *  In layer-sequential mode all the CEs compute a layer, then the next one, so the first output
+ *  of a layer wait for all the outputs of the previous one. In layer-pipelined mode every layer
+ *  is a stage owning its own CEs, the stages are connected by bounded row FIFOs and compute a
+ *  band of output rows at a time: a stage start a band as soon as the input rows under its
+ *  filters are in its input FIFO, and the rows that no later output need are popped once the
+ *  band is done.
+ *
+ *  Every stage is a controller on the whole layer, computing the passes band by band (row bands)
+ *  on its own CEs. The stages are stepped together, cycle by cycle. The CEs and the controller
+ *  keep their state from a band to the next one and from an image to the next one, so a band
+ *  only cost its lanes steps and the switch of weights between its passes, hidden with the
+ *  shadow weights. A dilated layer stream whole channels in its line buffer, its band is the
+ *  whole layer.
+ *
+ *  A row completed by a stage is pushed in the FIFO of the next stage at once, and written in the
+ *  input buffer of its controller. A stage only start a band when the FIFO of the next stage has
+ *  a slot for every row of the bands started and not yet pushed: a full FIFO stall the producer
+ *  (back-pressure). The cycles a stage wait are counted as starved (the input rows are missing)
+ *  or blocked (the output FIFO is full).
+ *
+ *  The latency is the cycles from the first input row to the last output row of one image. The
+ *  throughput is the steady-state cycles between the last rows of two consecutive images. In
+ *  layer-sequential mode the images and the layers are run back to back, an output row of a
+ *  layer is only complete after the last pass over the input channels.
+ */
+
+#ifndef LAYERPIPELINE_HPP
+#define LAYERPIPELINE_HPP
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "CE.hpp"
+#include "Controller.hpp"
+#include "EventCounts.hpp"
+#include "HyperParams.hpp"
+#include "Simulator.hpp"
+#include "Snapshot.hpp"
+#include "Tensor.hpp"
+
+/// Result of a stage
+struct PipelineStageStats
+{
+  int nbOfCEs;
+  int fifoRows;          ///< Capacity of the input FIFO of the stage, in rows
+  long fifoWords;        ///< Capacity of the input FIFO of the stage, in words
+  long bandCycles;       ///< Cycles of the longest band of output rows from its first pass to its last output,
+                         ///< the layer in layer-sequential mode
+  long busyCycles;       ///< Cycles computing
+  long starvedCycles;    ///< Idle cycles waiting for input rows
+  long blockedCycles;    ///< Idle cycles waiting for a free slot in the output FIFO
+  EventCounts events;    ///< Events of all the rows, the priming excluded
+};
+
+/// Result of a run
+struct PipelineStats
+{
+  bool pipelined;
+  long images;
+  long cycles;           ///< Cycles of all the images
+  long firstRowLatency;  ///< Cycles to the first output row of the first image
+  long latency;          ///< Cycles to the last output row of the first image
+  double cyclesPerImage; ///< Steady-state cycles between two images
+  std::vector<PipelineStageStats> stages;
+};
+
+/**
+ * @brief Layer pipeline. Objects that simulate a chain of layers, stage by stage on their own CEs
+ *        or layer after layer on all the CEs
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class LayerPipeline
+{
+  private:
+  /// A layer of the chain
+  struct Stage
+  {
+    LayerHParam layerHParam;
+    Tensor<T> weights;
+    Tensor<T> bias;
+    int nbOfCEs;
+    bool relu;
+  };
+
+  /// A primed controller, restored for every run
+  struct Engine
+  {
+    std::vector< CE<T> > CEs;
+    std::shared_ptr< Controller<T> > ctrl;
+    std::shared_ptr< Simulator<T> > sim;
+    Snapshot primed;
+    EventCounts primedEvents;
+  };
+
+  /// A stage of the pipeline, stepped cycle by cycle
+  struct Streamer
+  {
+    std::vector< CE<T> > CEs;
+    std::shared_ptr< Controller<T> > ctrl;
+    EventCounts primedEvents;
+    long image;                  ///< Image computed
+    int written;                 ///< Input rows of the image written in the controller
+    int pushed;                  ///< Output rows of the image sent to the next stage
+    std::deque<long> bandStarts; ///< Cycles the bands on the way started
+  };
+
+  /// A row of a FIFO, [depth][column]
+  struct Row
+  {
+    long image;
+    int row;
+    Tensor<T> values;
+  };
+
+  std::vector<Stage> _stages;
+  int _ceSize;                   ///< 0 use the filter size
+  int _bandRows;                 ///< Output rows computed together by a stage
+  int _fifoRows;                 ///< 0 hold two bands of the consumer
+  bool _shadowWeights;
+
+  int filterExtent(const LayerHParam& p);
+  int outputHeight(const LayerHParam& p);
+  int outputWidth(const LayerHParam& p);
+  int bandRows(int stage);
+  int fifoRows(int stage);
+  int rowsUnder(const LayerHParam& p, int inputRows);
+  void buildStreamer(const Stage& stage, Streamer& streamer);
+  std::shared_ptr<Engine> buildEngine(const Stage& stage, LayerHParam layerHParam, int nbOfCEs);
+  long runEngine(Engine& engine, const Tensor<T>& inputs, EventCounts& events);
+
+  public:
+  LayerPipeline(int ceSize = 0);
+  ~LayerPipeline();
+  void addLayer(LayerHParam layerHParam, const Tensor<T>& weights, const Tensor<T>& bias, int nbOfCEs,
+                bool relu = true);
+  int getLayers();
+  void setBandRows(int rows);
+  void setFifoRows(int rows);
+  void setShadowWeights(bool enable);
+  PipelineStats run(const std::vector< Tensor<T> >& images, std::vector< Tensor<T> >* outputs = nullptr);
+  PipelineStats runSequential(const std::vector< Tensor<T> >& images, std::vector< Tensor<T> >* outputs = nullptr);
+  static void writeComparison(std::ostream& os, const PipelineStats& sequential, const PipelineStats& pipelined);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  LayerPipeline object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  ceSize is the CE size of every stage, 0 use the filter size of the layer
+*/
+template<typename T>
+LayerPipeline<T>::LayerPipeline(int ceSize) :
+    _ceSize(ceSize),
+    _bandRows(1),
+    _fifoRows(0),
+    _shadowWeights(false)
+{}
+
+template<typename T>
+LayerPipeline<T>::~LayerPipeline()
+{}
+
+/**
+* @brief  Append a convolution layer to the chain
+*
+* @tparam T Type of input and output data
+*
+* @param  layerHParam is the layer, its input must be the outputs of the previous one
+* @param  weights is indexed [filter][depth / groups][row][column]
+* @param  bias is indexed [filter]
+* @param  nbOfCEs is the number of CEs of the stage
+* @param  relu is true to apply the ReLU to the outputs
+*/
+template<typename T>
+void LayerPipeline<T>::addLayer(LayerHParam layerHParam, const Tensor<T>& weights, const Tensor<T>& bias, int nbOfCEs,
+                                bool relu)
+{
+  if(layerHParam.type == FULLY_CONNECTED)
+  {
+    throw std::runtime_error("A fully connected layer has no rows to pipeline");
+  }
+  if(nbOfCEs < 1)
+  {
+    throw std::runtime_error("A stage need at least one CE");
+  }
+  layerHParam.dilation = std::max(layerHParam.dilation, 1);
+  if(!_stages.empty())
+  {
+    const LayerHParam& previous = _stages.back().layerHParam;
+    if(layerHParam.inputDepth != previous.nbOfFilter || layerHParam.inputHeight != outputHeight(previous)
+       || layerHParam.inputWidth != outputWidth(previous))
+    {
+      throw std::runtime_error("The layer input does not match the outputs of the previous layer");
+    }
+  }
+  _stages.push_back(Stage{layerHParam, weights, bias, nbOfCEs, relu});
+}
+
+template<typename T>
+int LayerPipeline<T>::getLayers()
+{
+  return _stages.size();
+}
+
+/**
+* @brief  Function used to set the output rows a stage compute together. The passes of a layer
+*         are run once per band, larger bands amortize the switches of weights between the passes.
+*
+* @tparam T Type of input and output data
+*
+* @param  rows is the number of output rows of a band
+*/
+template<typename T>
+void LayerPipeline<T>::setBandRows(int rows)
+{
+  if(rows < 1)
+  {
+    throw std::runtime_error("A band need at least one row");
+  }
+  _bandRows = rows;
+}
+
+/**
+* @brief  Function used to set the capacity of the row FIFOs
+*
+* @tparam T Type of input and output data
+*
+* @param  rows is the capacity of every FIFO, at least the input rows of a band of its consumer
+*         plus a band of its producer, minus one. 0 add the rows the consumer pop after a band, so
+*         the producer compute the rows of the next band while the current one is computed.
+*/
+template<typename T>
+void LayerPipeline<T>::setFifoRows(int rows)
+{
+  _fifoRows = rows;
+}
+
+template<typename T>
+void LayerPipeline<T>::setShadowWeights(bool enable)
+{
+  _shadowWeights = enable;
+}
+
+template<typename T>
+int LayerPipeline<T>::filterExtent(const LayerHParam& p)
+{
+  return (p.filterSize - 1) * std::max(p.dilation, 1) + 1;
+}
+
+template<typename T>
+int LayerPipeline<T>::outputHeight(const LayerHParam& p)
+{
+  return (p.inputHeight - filterExtent(p) + 2 * p.padding) / p.stride + 1;
+}
+
+template<typename T>
+int LayerPipeline<T>::outputWidth(const LayerHParam& p)
+{
+  return (p.inputWidth - filterExtent(p) + 2 * p.padding) / p.stride + 1;
+}
+
+/**
+* @brief  Function used to know the output rows a stage compute together
+*
+* @tparam T Type of input and output data
+*
+* @return the rows of a band, all the rows of a dilated layer
+*/
+template<typename T>
+int LayerPipeline<T>::bandRows(int stage)
+{
+  const LayerHParam& p = _stages[stage].layerHParam;
+  return (p.filterSize == 1 || p.dilation == 1) ? std::min(_bandRows, outputHeight(p)) : outputHeight(p);
+}
+
+/**
+* @brief  Function used to know the output rows whose input rows are in
+*
+* @tparam T Type of input and output data
+*
+* @param  p is the layer
+* @param  inputRows is the number of input rows in, from the first one
+*
+* @return the number of output rows from the first one
+*/
+template<typename T>
+int LayerPipeline<T>::rowsUnder(const LayerHParam& p, int inputRows)
+{
+  if(inputRows >= p.inputHeight)
+  {
+    return outputHeight(p);
+  }
+  // The last input row of the output row r is r * stride - padding + extent - 1
+  int rows = inputRows + p.padding - filterExtent(p);
+  return rows < 0 ? 0 : std::min(outputHeight(p), rows / p.stride + 1);
+}
+
+/**
+* @brief  Function used to know the capacity of the input FIFO of a stage
+*
+* @tparam T Type of input and output data
+*
+* @return the capacity in rows
+*/
+template<typename T>
+int LayerPipeline<T>::fifoRows(int stage)
+{
+  const LayerHParam& p = _stages[stage].layerHParam;
+  int rows = bandRows(stage), producerRows = bandRows(stage - 1);
+  int bandInputRows = std::min(p.inputHeight, (rows - 1) * p.stride + filterExtent(p));
+  if(_fifoRows == 0)
+  {
+    return bandInputRows + rows * p.stride + producerRows - 1;
+  }
+  // Below that, the producer could wait for slots held by the rows of an incomplete band
+  if(_fifoRows < bandInputRows + producerRows - 1)
+  {
+    throw std::runtime_error("The row FIFOs must hold a band of their consumer and a band of their producer");
+  }
+  return _fifoRows;
+}
+
+/**
+* @brief  Build a controller for a layer and save its primed state. The window generator is used
+*         when the layer allow it, the pointwise mode for 1x1 filters.
+*
+* @tparam T Type of input and output data
+*
+* @param  stage is the layer of the chain, for its weights
+* @param  layerHParam is the layer computed
+* @param  nbOfCEs is the number of CEs
+*
+* @return the engine
+*/
+template<typename T>
+std::shared_ptr<typename LayerPipeline<T>::Engine> LayerPipeline<T>::buildEngine(const Stage& stage,
+                                                                                 LayerHParam layerHParam, int nbOfCEs)
+{
+  std::shared_ptr<Engine> engine = std::make_shared<Engine>();
+  int ceSize = _ceSize > 0 ? _ceSize : layerHParam.filterSize;
+  engine->CEs.assign(nbOfCEs, CE<T>(ceSize, layerHParam.inputWidth + 2 * layerHParam.padding, layerHParam.dilation));
+  Mapping mapping = layerHParam.filterSize == 1 ? POINTWISE_MAPPING
+                    : (layerHParam.dilation == 1 ? WINDOW_MAPPING : STREAM_MAPPING);
+  engine->ctrl = std::make_shared< Controller<T> >(engine->CEs, layerHParam, mapping);
+  engine->ctrl->setWeights(stage.weights, stage.bias);
+  engine->ctrl->setShadowWeights(_shadowWeights);
+  engine->ctrl->setRelu(stage.relu);
+  engine->sim = std::make_shared< Simulator<T> >(*engine->ctrl, engine->CEs);
+  engine->sim->save(engine->primed);
+  engine->primedEvents = engine->ctrl->getEventCounts();
+  return engine;
+}
+
+/**
+* @brief  Restore the primed state of an engine and run it on some inputs
+*
+* @tparam T Type of input and output data
+*
+* @param  events is incremented by the events of the run
+*
+* @return the cycles of the run
+*/
+template<typename T>
+long LayerPipeline<T>::runEngine(Engine& engine, const Tensor<T>& inputs, EventCounts& events)
+{
+  engine.primed.rewind();
+  engine.sim->restore(engine.primed);
+  engine.ctrl->setInputs(inputs);
+  long cycles = engine.sim->run(1L << 40);
+  if(!engine.ctrl->isHalted())
+  {
+    throw std::runtime_error("LayerPipeline layer did not halt");
+  }
+  EventCounts run = engine.ctrl->getEventCounts();
+  run -= engine.primedEvents;
+  events += run;
+  return cycles;
+}
+
+/**
+* @brief  Build the controller of a stage on the whole layer, computing it band by band. The window
+*         generator is used when the layer allow it, the pointwise mode for 1x1 filters.
+*
+* @tparam T Type of input and output data
+*
+* @param  stage is the layer of the chain
+* @param  streamer is set to the CEs and the controller, before the first image
+*/
+template<typename T>
+void LayerPipeline<T>::buildStreamer(const Stage& stage, Streamer& streamer)
+{
+  const LayerHParam& p = stage.layerHParam;
+  int ceSize = _ceSize > 0 ? _ceSize : p.filterSize;
+  streamer.CEs.assign(stage.nbOfCEs, CE<T>(ceSize, p.inputWidth + 2 * p.padding, p.dilation));
+  Mapping mapping = p.filterSize == 1 ? POINTWISE_MAPPING : (p.dilation == 1 ? WINDOW_MAPPING : STREAM_MAPPING);
+  streamer.ctrl = std::make_shared< Controller<T> >(streamer.CEs, p, mapping);
+  streamer.ctrl->setWeights(stage.weights, stage.bias);
+  if(p.filterSize == 1 || p.dilation == 1)
+  {
+    streamer.ctrl->setRowBands(_bandRows);
+  }
+  streamer.ctrl->setShadowWeights(_shadowWeights);
+  streamer.ctrl->setRelu(stage.relu);
+  streamer.ctrl->setRowLimit(0);
+  streamer.primedEvents = streamer.ctrl->getEventCounts();
+  streamer.image = 0;
+  streamer.written = 0;
+  streamer.pushed = 0;
+}
+
+/**
+* @brief  Run the images through the stages, every stage on its own CEs
+*
+* @tparam T Type of input and output data
+*
+* @param  images is the inputs of the first layer of every image, indexed [depth][row][column]
+* @param  outputs is resized and set to the outputs of the last layer of every image, when not null
+*
+* @return the stats of the run
+*/
+template<typename T>
+PipelineStats LayerPipeline<T>::run(const std::vector< Tensor<T> >& images, std::vector< Tensor<T> >* outputs)
+{
+  int nbOfStages = _stages.size();
+  if(nbOfStages == 0 || images.empty())
+  {
+    throw std::runtime_error("LayerPipeline need layers and images");
+  }
+  PipelineStats stats{true, (long)images.size(), 0, -1, 0, 0, std::vector<PipelineStageStats>(nbOfStages)};
+  if(outputs)
+  {
+    outputs->assign(images.size(), Tensor<T>());
+  }
+  const LayerHParam& first = _stages.front().layerHParam;
+  for(long i = 0; i < images.size(); i++)
+  {
+    if(images[i].shape() != std::vector<int>{first.inputDepth, first.inputHeight, first.inputWidth})
+    {
+      throw std::runtime_error("The image does not match the first layer");
+    }
+  }
+
+  // The first stage read the images from the memory, the next ones from their input FIFO
+  std::vector<Streamer> streamers(nbOfStages);
+  std::vector< std::deque<Row> > fifos(nbOfStages);
+  long drainSteps = 0;
+  for(int s = 0; s < nbOfStages; s++)
+  {
+    PipelineStageStats& stage = stats.stages[s];
+    stage.nbOfCEs = _stages[s].nbOfCEs;
+    stage.fifoRows = s == 0 ? 0 : fifoRows(s);
+    stage.fifoWords = (long)stage.fifoRows * _stages[s].layerHParam.inputDepth * _stages[s].layerHParam.inputWidth;
+    buildStreamer(_stages[s], streamers[s]);
+    drainSteps += streamers[s].ctrl->passSteps() + Controller<T>::weightLoadSteps;
+  }
+  streamers[0].ctrl->setInputs(images[0]);
+  streamers[0].written = first.inputHeight;
+
+  std::vector<long> imageDone(images.size(), 0);
+  long now = 0, stalled = 0;
+  while(streamers.back().image < images.size())
+  {
+    bool waiting = true;
+    for(int s = 0; s < nbOfStages; s++)
+    {
+      Streamer& st = streamers[s];
+      const LayerHParam& p = _stages[s].layerHParam;
+      PipelineStageStats& stage = stats.stages[s];
+      Controller<T>& ctrl = *st.ctrl;
+      if(st.image == images.size())
+      {
+        continue;
+      }
+
+      // The rows of the image in the FIFO, in order
+      for(int k = 0; s > 0 && k < fifos[s].size(); k++)
+      {
+        if(fifos[s][k].image == st.image && fifos[s][k].row == st.written)
+        {
+          ctrl.setInputRow(st.written++, fifos[s][k].values);
+        }
+      }
+
+      // A band start once its input rows are in, and there is a slot for its output rows
+      int inputLimit = rowsUnder(p, st.written);
+      int outputLimit = outputHeight(p);
+      if(s + 1 < nbOfStages)
+      {
+        int free = fifoRows(s + 1) - (int)fifos[s + 1].size() - (ctrl.getStartedRows() - st.pushed);
+        outputLimit = ctrl.getStartedRows() + std::max(0, free);
+      }
+      ctrl.setRowLimit(std::min(inputLimit, outputLimit));
+      int started = ctrl.getStartedRows();
+      long stalls = ctrl.getRowStallSteps();
+      ctrl.step();
+      if(ctrl.getStartedRows() > started)
+      {
+        st.bandStarts.push_back(now);
+      }
+      if(ctrl.getRowStallSteps() > stalls)
+      {
+        (inputLimit <= outputLimit ? stage.starvedCycles : stage.blockedCycles)++;
+      }
+      else
+      {
+        stage.busyCycles++;
+        waiting = false;
+      }
+
+      // The rows completed go to the next stage, or to the memory
+      int outH = outputHeight(p), outW = outputWidth(p);
+      if(st.pushed < ctrl.getCompletedRows())
+      {
+        stage.bandCycles = std::max(stage.bandCycles, now + 1 - st.bandStarts.front());
+        st.bandStarts.pop_front();
+      }
+      for(; st.pushed < ctrl.getCompletedRows(); st.pushed++)
+      {
+        Row row{st.image, st.pushed, ctrl.getOutputs().slice(1, st.pushed, st.pushed + 1).clone().reshape({p.nbOfFilter, outW})};
+        if(s + 1 < nbOfStages)
+        {
+          fifos[s + 1].push_back(row);
+          continue;
+        }
+        if(stats.firstRowLatency < 0)
+        {
+          stats.firstRowLatency = now + 1;
+        }
+        if(outputs)
+        {
+          if((*outputs)[row.image].empty())
+          {
+            (*outputs)[row.image] = Tensor<T>({p.nbOfFilter, outH, outW});
+          }
+          (*outputs)[row.image].slice(1, row.row, row.row + 1).assign(row.values.reshape({p.nbOfFilter, 1, outW}));
+        }
+        if(row.row == outH - 1)
+        {
+          imageDone[row.image] = now + 1;
+        }
+      }
+
+      // The input rows under no band left are popped, the next image start on the same CEs
+      if(ctrl.isHalted())
+      {
+        st.image++;
+        if(st.image < images.size())
+        {
+          ctrl.restart();
+          st.written = 0;
+          st.pushed = 0;
+          if(s == 0)
+          {
+            ctrl.setInputs(images[st.image]);
+            st.written = first.inputHeight;
+          }
+        }
+      }
+      int keep = ctrl.getCompletedRows() * p.stride - p.padding;
+      while(s > 0 && !fifos[s].empty() && (fifos[s].front().image < st.image
+                                           || (fifos[s].front().image == st.image && fifos[s].front().row < keep)))
+      {
+        fifos[s].pop_front();
+      }
+    }
+    now++;
+
+    // Every stage wait for another one longer than a pass can drain
+    stalled = waiting ? stalled + 1 : 0;
+    if(stalled > drainSteps)
+    {
+      throw std::logic_error("LayerPipeline deadlock");
+    }
+  }
+
+  for(int s = 0; s < nbOfStages; s++)
+  {
+    stats.stages[s].events = streamers[s].ctrl->getEventCounts();
+    stats.stages[s].events -= streamers[s].primedEvents;
+  }
+  stats.cycles = now;
+  stats.latency = imageDone.front();
+  stats.cyclesPerImage = images.size() > 1 ? double(imageDone.back() - imageDone.front()) / (images.size() - 1)
+                                           : double(stats.latency);
+  return stats;
+}
+
+/**
+* @brief  Run the images layer after layer, every layer on all the CEs of the stages
+*
+* @tparam T Type of input and output data
+*
+* @param  images is the inputs of the first layer of every image, indexed [depth][row][column]
+* @param  outputs is resized and set to the outputs of the last layer of every image, when not null
+*
+* @return the stats of the run, the row cycles of a stage are the cycles of its layer
+*/
+template<typename T>
+PipelineStats LayerPipeline<T>::runSequential(const std::vector< Tensor<T> >& images,
+                                              std::vector< Tensor<T> >* outputs)
+{
+  int nbOfStages = _stages.size();
+  if(nbOfStages == 0 || images.empty())
+  {
+    throw std::runtime_error("LayerPipeline need layers and images");
+  }
+  PipelineStats stats{false, (long)images.size(), 0, 0, 0, 0, std::vector<PipelineStageStats>(nbOfStages)};
+  if(outputs)
+  {
+    outputs->assign(images.size(), Tensor<T>());
+  }
+  int nbOfCEs = 0;
+  for(int s = 0; s < nbOfStages; s++)
+  {
+    nbOfCEs += _stages[s].nbOfCEs;
+  }
+  std::vector< std::shared_ptr<Engine> > engines;
+  for(int s = 0; s < nbOfStages; s++)
+  {
+    engines.push_back(buildEngine(_stages[s], _stages[s].layerHParam, nbOfCEs));
+    stats.stages[s].nbOfCEs = nbOfCEs;
+  }
+
+  for(int i = 0; i < images.size(); i++)
+  {
+    Tensor<T> activations = images[i];
+    for(int s = 0; s < nbOfStages; s++)
+    {
+      long cycles = runEngine(*engines[s], activations, stats.stages[s].events);
+      stats.stages[s].bandCycles = cycles;
+      stats.stages[s].busyCycles += cycles;
+      activations = engines[s]->ctrl->getOutputs().clone();
+      stats.cycles += cycles;
+    }
+    // The outputs of a layer are only complete after its last pass
+    if(i == 0)
+    {
+      stats.firstRowLatency = stats.cycles;
+      stats.latency = stats.cycles;
+    }
+    if(outputs)
+    {
+      (*outputs)[i] = activations;
+    }
+  }
+  stats.cyclesPerImage = double(stats.cycles) / images.size();
+  return stats;
+}
+
+/**
+* @brief  Write the comparison of the two modes, one line per mode then one line per stage
+*
+* @param  os is the stream written
+* @param  sequential is the stats returned by runSequential()
+* @param  pipelined is the stats returned by run()
+*/
+template<typename T>
+void LayerPipeline<T>::writeComparison(std::ostream& os, const PipelineStats& sequential, const PipelineStats& pipelined)
+{
+  os << "mode,images,cycles,first row,latency,cycles/image,speedup\n";
+  const PipelineStats* modes[2] = {&sequential, &pipelined};
+  for(int m = 0; m < 2; m++)
+  {
+    const PipelineStats& stats = *modes[m];
+    os << (stats.pipelined ? "pipelined" : "sequential") << "," << stats.images << "," << stats.cycles << ","
+       << stats.firstRowLatency << "," << stats.latency << "," << stats.cyclesPerImage << ","
+       << (stats.cyclesPerImage > 0 ? sequential.cyclesPerImage / stats.cyclesPerImage : 0) << "\n";
+  }
+  os << "stage,CEs,fifo rows,fifo words,band cycles,busy,starved,blocked\n";
+  for(int s = 0; s < pipelined.stages.size(); s++)
+  {
+    const PipelineStageStats& stage = pipelined.stages[s];
+    os << s << "," << stage.nbOfCEs << "," << stage.fifoRows << "," << stage.fifoWords << "," << stage.bandCycles
+       << "," << stage.busyCycles << "," << stage.starvedCycles << "," << stage.blockedCycles << "\n";
+  }
+}
+
+#endif //LAYERPIPELINE_HPP
@@ -0,0 +1,354 @@
+/**
+ *  @file    LineBuffer.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Input line buffer module
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module hold the input row FIFOs of the CEs. The input enter the last FIFO, the head of
+ *  every FIFO feed the next one and the PE row at the same place. A CE own its line buffer, or
+ *  several CEs read the same one: the window is then broadcast to all of them and every input is
+ *  written (and buffered) once instead of once per CE.
+ *
+ *        inputSig
+ *           |
+ *          \/
+ *  [row FIFO size - 1]---> PE row size - 1 of every reader
+ *           |
+ *          \/
+ *          ...
+ *           |
+ *          \/
+ *  [row FIFO 0]--------> PE row 0 of every reader
+ *
+ *  For a dilated filter the rows read by the PE rows are dilation input rows apart: the last
+ *  FIFO hold one input row and the others dilation input rows, so the line buffer hold the
+ *  (filterSize - 1) * dilation + 1 rows spanned by the filter.
+ */
+
+#ifndef LINEBUFFER_HPP
+#define LINEBUFFER_HPP
+
+#include "CNNP/Snapshot.hpp"
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Line buffer. Objects that hold the input rows FIFOs of one or more CEs
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class LineBuffer
+{
+  private:
+  T _inputSig;                          ///< The input signal as a T type
+  std::vector< std::queue<T> > _rows;   ///< The row FIFOs, row 0 is the oldest
+  int _nonZero;                         ///< Number of non zero values in the FIFOs
+  int _readers;                         ///< Number of CEs reading the FIFOs heads
+  int _dilation;                        ///< Input rows between two PE rows
+  long _writes;                         ///< Number of inputs written (steps) since construction
+
+  public:
+  static const unsigned int snapshotTag = 0x4C420001;   ///< Snapshot tag of the line buffer
+
+  LineBuffer(int nbOfRows, int fifoSize, int dilation = 1);
+  ~LineBuffer();
+  int getNbOfRows();
+  int getFifoSize();
+  int getDilation();
+  long getWords();
+  void setSigs(T input);
+  T getInputSig();
+  T getRow(int row);
+  bool isEmpty();
+  void addReader();
+  int getReaders();
+  long getWrites();
+  long getShifts();
+  long getSavedWrites();
+  long getSavedWords();
+  void step();
+  void skip(long steps);
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  LineBuffer object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  nbOfRows is the number of row FIFOs, the filter size of the readers
+* @param  fifoSize is the FIFO size. Should be equal to the (padded) input width
+* @param  dilation is the number of input rows between two PE rows
+*/
+template<typename T>
+LineBuffer<T>::LineBuffer(int nbOfRows, int fifoSize, int dilation) :
+    _inputSig(T(0)),
+    _rows(nbOfRows),
+    _nonZero(0),
+    _readers(0),
+    _dilation(dilation),
+    _writes(0)
+{
+  if(nbOfRows == 0 || dilation < 1)
+  {
+    throw std::runtime_error("LineBuffer need at least one row and a positive dilation");
+  }
+  for(int i = 0; i < _rows.size(); i++)
+  {
+    int size = (i == _rows.size() - 1) ? fifoSize : fifoSize * dilation;
+    for(int j = 0; j < size; j++)
+    {
+      _rows[i].emplace(T(0));
+    }
+  }
+}
+
+template<typename T>
+LineBuffer<T>::~LineBuffer()
+{}
+
+template<typename T>
+int LineBuffer<T>::getNbOfRows()
+{
+  return _rows.size();
+}
+
+/**
+* @brief  Function used to know the FIFO size given at construction, the size of the last FIFO
+*
+* @tparam T Type of input and output data
+*
+* @return the FIFO size
+*/
+template<typename T>
+int LineBuffer<T>::getFifoSize()
+{
+  return _rows.back().size();
+}
+
+template<typename T>
+int LineBuffer<T>::getDilation()
+{
+  return _dilation;
+}
+
+/**
+* @brief  Function used to know how many words the FIFOs hold
+*
+* @tparam T Type of input and output data
+*
+* @return the number of words of all the FIFOs
+*/
+template<typename T>
+long LineBuffer<T>::getWords()
+{
+  return (long)getFifoSize() * ((_rows.size() - 1) * _dilation + 1);
+}
+
+/**
+* @brief  Function used to set the input signal before each step
+*
+* @tparam T Type of input and output data
+*
+* @param  input is the next input to enter the last FIFO
+*/
+template<typename T>
+void LineBuffer<T>::setSigs(T input)
+{
+  _inputSig = input;
+}
+
+template<typename T>
+T LineBuffer<T>::getInputSig()
+{
+  return _inputSig;
+}
+
+/**
+* @brief  Function used to get the head of a row FIFO, the input of the PE row at the same place
+*
+* @tparam T Type of input and output data
+*
+* @param  row is the row index
+*
+* @return the head of the row FIFO
+*/
+template<typename T>
+T LineBuffer<T>::getRow(int row)
+{
+  return _rows[row].front();
+}
+
+/**
+* @brief  Function used to know if only zeros are left in the FIFOs
+*
+* @tparam T Type of input and output data
+*
+* @return true if the FIFOs are empty of non zero values
+*/
+template<typename T>
+bool LineBuffer<T>::isEmpty()
+{
+  return _nonZero == 0;
+}
+
+/**
+* @brief  Register a CE reading this line buffer
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void LineBuffer<T>::addReader()
+{
+  _readers++;
+}
+
+template<typename T>
+int LineBuffer<T>::getReaders()
+{
+  return _readers;
+}
+
+template<typename T>
+long LineBuffer<T>::getWrites()
+{
+  return _writes;
+}
+
+/**
+* @brief  Function used to know how many words entered the row FIFOs, one per FIFO per step
+*
+* @tparam T Type of input and output data
+*
+* @return the number of FIFO shifts
+*/
+template<typename T>
+long LineBuffer<T>::getShifts()
+{
+  return _writes * (long)_rows.size();
+}
+
+/**
+* @brief  Function used to know how many input writes the sharing saved, compared to one line
+*         buffer per CE
+*
+* @tparam T Type of input and output data
+*
+* @return the number of saved input writes
+*/
+template<typename T>
+long LineBuffer<T>::getSavedWrites()
+{
+  return (_readers > 1) ? _writes * (_readers - 1) : 0;
+}
+
+/**
+* @brief  Function used to know how many buffer words the sharing saved, compared to one line
+*         buffer per CE
+*
+* @tparam T Type of input and output data
+*
+* @return the number of saved buffer words
+*/
+template<typename T>
+long LineBuffer<T>::getSavedWords()
+{
+  return (_readers > 1) ? getWords() * (_readers - 1) : 0;
+}
+
+/**
+* @brief Execute one step, after all the readers stepped. Shift the input in the FIFOs.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void LineBuffer<T>::step()
+{
+  // Keep track of the non zero values in the FIFOs
+  if(!(_inputSig == T(0))){_nonZero++;}
+  if(!(_rows.front().front() == T(0))){_nonZero--;}
+  // new input into the lower fifo
+  _rows.back().push(_inputSig);
+  // top of other fifo into the bottom of the next fifo
+  for (int i = _rows.size() - 1; i >= 1; i--)
+  {
+    _rows[i - 1].push(_rows[i].front());
+    _rows[i].pop();
+  }
+  _rows.front().pop();
+  _writes++;
+}
+
+/**
+* @brief  Fast-forward over steps where only zeros are written in empty FIFOs
+*
+* @tparam T Type of input and output data
+*
+* @param  steps is the number of steps to skip
+*/
+template<typename T>
+void LineBuffer<T>::skip(long steps)
+{
+  if(!isEmpty())
+  {
+    throw std::logic_error("Cannot skip steps of a line buffer that is not empty");
+  }
+  _inputSig = T(0);
+  _writes += steps;
+}
+
+/**
+* @brief  Write the FIFOs and the input signal to a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void LineBuffer<T>::save(Snapshot& snap)
+{
+  snap.writeTag(snapshotTag);
+  snap.write(static_cast<int>(_rows.size()));
+  snap.write(getFifoSize());
+  snap.write(_dilation);
+  snap.write(_inputSig);
+  snap.write(_rows);
+  snap.write(_nonZero);
+  snap.write(_writes);
+}
+
+/**
+* @brief  Read the FIFOs and the input signal from a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read. It must come from a line buffer of the same size
+*/
+template<typename T>
+void LineBuffer<T>::restore(Snapshot& snap)
+{
+  int nbOfRows = 0, fifoSize = 0, dilation = 0;
+  snap.expect(snapshotTag, "LineBuffer");
+  snap.read(nbOfRows);
+  snap.read(fifoSize);
+  snap.read(dilation);
+  if(nbOfRows != _rows.size() || fifoSize != getFifoSize() || dilation != _dilation)
+  {
+    throw std::runtime_error("Snapshot line buffer size does not match");
+  }
+  snap.read(_inputSig);
+  snap.read(_rows);
+  snap.read(_nonZero);
+  snap.read(_writes);
+}
+
+#endif //LINEBUFFER_HPP
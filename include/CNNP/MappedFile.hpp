@@ -0,0 +1,104 @@
+/**
+ *  @file    MappedFile.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Read only memory mapped file
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module map a whole file in memory with mmap (POSIX), so the frames of an image stream are
+ *  read in place by the page cache instead of being copied in a buffer first.
+ */
+
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief Mapped file. Objects that map a file read only for their lifetime
+ */
+class MappedFile
+{
+  private:
+  void* _data;      ///< The mapping, NULL for an empty file
+  size_t _size;     ///< Size of the file in bytes
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  const unsigned char* data() const;
+  size_t size() const;
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  MappedFile object constructor. Map the whole file, read sequentially.
+*
+* @param  path is the path of the file
+*/
+inline MappedFile::MappedFile(const std::string& path) :
+    _data(NULL),
+    _size(0)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    throw std::runtime_error("Cannot open " + path);
+  }
+  struct stat info;
+  if(fstat(fd, &info) != 0)
+  {
+    close(fd);
+    throw std::runtime_error("Cannot stat " + path);
+  }
+  _size = info.st_size;
+  if(_size > 0)
+  {
+    _data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(_data == MAP_FAILED)
+    {
+      _data = NULL;
+      close(fd);
+      throw std::runtime_error("Cannot map " + path);
+    }
+    madvise(_data, _size, MADV_SEQUENTIAL);
+  }
+  // The mapping stay valid after the file is closed
+  close(fd);
+}
+
+/**
+* @brief  MappedFile object destructor. Unmap the file.
+*/
+inline MappedFile::~MappedFile()
+{
+  if(_data != NULL)
+  {
+    munmap(_data, _size);
+  }
+}
+
+inline const unsigned char* MappedFile::data() const
+{
+  return static_cast<const unsigned char*>(_data);
+}
+
+inline size_t MappedFile::size() const
+{
+  return _size;
+}
+
+#endif //MAPPEDFILE_HPP
@@ -5,7 +5,8 @@
 #ifndef MEMORY_HPP
 #define MEMORY_HPP
 
-#include "Types.hpp"
+#include <cstddef>
+#include <stdexcept>
 #include <vector>
 
 template <typename T>
@@ -14,9 +15,9 @@ class Memory
   public:
 
   /// A constant we're going to define which
-  /// tells us the maximum address we can
-  /// read or write from.
-  const T c_MaxAddress;
+  /// tells us the number of words we can
+  /// read or write.
+  const size_t c_Size;
 
   private:
 
@@ -24,11 +25,13 @@ class Memory
   /// be using.
   std::vector<T> m_MemorySpace;
 
+  void Check(size_t p_Address, size_t p_Words);
+
   public:
 
   /// Construct a Memory class instance
-  /// for us, and clear the memory
-  Memory();
+  /// of the given number of words, cleared
+  Memory(size_t p_Size = 256);
 
   /// Delete the memory class, releasing
   /// all the allocated memory space
@@ -38,10 +41,16 @@ class Memory
   void Clear();
 
   /// Function to read the given address value
-  const T &Read(const T &p_Address);
+  const T &Read(size_t p_Address);
 
   /// Function to write the value to the given address
-  void Write(const T &p_Address, const T &p_Value);
+  void Write(size_t p_Address, const T &p_Value);
+
+  /// Function to read consecutive words, for the bursts
+  void Read(size_t p_Address, T* p_Data, size_t p_Words);
+
+  /// Function to write consecutive words, for the bursts
+  void Write(size_t p_Address, const T* p_Data, size_t p_Words);
 
 };
 
@@ -49,40 +58,66 @@ class Memory
 // --------------- Templatized Implementation ---------------
 
 template<typename T>
-Memory<T>::Memory()
+Memory<T>::Memory(size_t p_Size)
     :
-    c_MaxAddress(255)  // The maximum constant
-{
-  std::vector<T> m_MemorySpace(c_MaxAddress, 0);
-  Clear(); // Our only function, clears the memory
-  // in C++ we allocate the variables in the
-  // constructor header, NOT here in the
-  // Constructor body!
-}
+    c_Size(p_Size),
+    m_MemorySpace(p_Size, T(0))
+{}
 
 template<typename T>
 Memory<T>::~Memory()
 {}
 
+template<typename T>
+void Memory<T>::Check(size_t p_Address, size_t p_Words)
+{
+  if (p_Address + p_Words > c_Size || p_Address + p_Words < p_Address)
+  {
+    throw std::runtime_error("Memory access out of range");
+  }
+}
+
 template<typename T>
 void Memory<T>::Clear()
 {
-  for (T i = 0; i < c_MaxAddress; ++i)
+  for (size_t i = 0; i < c_Size; ++i)
   {
-    m_MemorySpace[i] = 0;
+    m_MemorySpace[i] = T(0);
   }
 }
 
 template<typename T>
-const T &Memory<T>::Read(const T &p_Address)
+const T &Memory<T>::Read(size_t p_Address)
 {
+  Check(p_Address, 1);
   return m_MemorySpace[p_Address];
 }
 
 template<typename T>
-void Memory<T>::Write(const T &p_Address, const T &p_Value)
+void Memory<T>::Write(size_t p_Address, const T &p_Value)
 {
+  Check(p_Address, 1);
   m_MemorySpace[p_Address] = p_Value;
 }
 
+template<typename T>
+void Memory<T>::Read(size_t p_Address, T* p_Data, size_t p_Words)
+{
+  Check(p_Address, p_Words);
+  for (size_t i = 0; i < p_Words; ++i)
+  {
+    p_Data[i] = m_MemorySpace[p_Address + i];
+  }
+}
+
+template<typename T>
+void Memory<T>::Write(size_t p_Address, const T* p_Data, size_t p_Words)
+{
+  Check(p_Address, p_Words);
+  for (size_t i = 0; i < p_Words; ++i)
+  {
+    m_MemorySpace[p_Address + i] = p_Data[i];
+  }
+}
+
 #endif //MEMORY_HPP
@@ -0,0 +1,625 @@
+/**
+ *  @file    MicroController.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Microcoded controller running the instruction stream of a compiled network
+ *
+ *  @section DESCRIPTION
+ *
+ *  The micro controller fetch the packed instructions of a program one by one and decode them.
+ *  The loads and stores go through the memory port, the other instructions use the compute
+ *  units, so a load overlap the compute of the previous tile. The instructions are the only ISA
+ *  of the accelerator: a CONV is run by a Controller stepping the passes of the loaded tile, the
+ *  ACCUMULATE, ACTIVATE and POOL take one step per output value and CE. A SYNC wait for both.
+ *  The CEs and the Controller of a tile shape are built once and restored to their primed state
+ *  for every CONV on it.
+ *
+ *  The tile and the weights are double buffered: every bank hold its own values, a load fill the
+ *  other bank once the last CONV reading it is done, and a CONV read the banks holding its tile and
+ *  weights, so the next tile can be loaded before the last CONV of the current one. A CONV check
+ *  that its tile and weights are in the buffers, a program reusing a tile must not load it again.
+ *
+ *  The activations of every layer are kept, the layer inputs are read from them and the stored
+ *  outputs written to the next one. The DRAM words count the loads and the stores.
+ */
+
+#ifndef MICROCONTROLLER_HPP
+#define MICROCONTROLLER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "CE.hpp"
+#include "Controller.hpp"
+#include "EventCounts.hpp"
+#include "HyperParams.hpp"
+#include "NumericTraits.hpp"
+#include "Program.hpp"
+#include "Simulator.hpp"
+#include "Snapshot.hpp"
+#include "Tensor.hpp"
+
+/**
+ * @brief Micro controller. Objects that run the instruction stream of a program on the CEs
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class MicroController
+{
+  private:
+  /// A bank of the tile or weight buffer
+  struct Bank
+  {
+    int layer;          ///< -1 when empty
+    int filter;
+    int filters;
+    int channel;
+    int channels;
+    long ready;         ///< Cycle the load end
+    long release;       ///< Cycle the last CONV reading it end
+    Tensor<T> values;   ///< The tile [channel][row][column] or the weights
+    Tensor<T> bias;     ///< Bias of the weights, empty for a tile
+  };
+
+  /// The CEs and the controller of a tile shape, restored for every CONV
+  struct Engine
+  {
+    std::vector< CE<T> > CEs;
+    std::shared_ptr< Controller<T> > ctrl;
+    std::shared_ptr< Simulator<T> > sim;
+    Snapshot primed;
+    EventCounts primedEvents;
+  };
+
+  const Program<T>* _program;
+  std::vector<uint64_t> _stream;     ///< The packed instructions
+  int _nbOfCEs;
+  int _ceSize;                       ///< 0 use the filter size
+  MemHParam _memHParam;
+  bool _shadowWeights;
+
+  int _pc;                           ///< Next instruction
+  long _memFree;                     ///< Cycle the memory port is free
+  long _computeFree;                 ///< Cycle the compute units are free
+  Bank _tiles[2];
+  Bank _weightBanks[2];
+  int _tile;                         ///< Bank of the last tile loaded
+  int _weightBank;                   ///< Bank of the last weights loaded
+
+  std::map< std::vector<int>, std::shared_ptr<Engine> > _engines;   ///< By layer, channels and filters
+
+  std::vector< Tensor<T> > _activations;   ///< Inputs of every layer, then the outputs of the last one
+  Tensor<T> _partial;                ///< Outputs of the last CONV, [filters][row][column]
+  Tensor<T> _accumulators;           ///< Outputs of the current layer
+  Tensor<T> _pooled;                 ///< Pooled outputs of the current layer
+  int _accumulatorLayer;
+
+  long _computeCycles;
+  long _convCycles;
+  long _dramReads;
+  long _dramWrites;
+  std::vector<long> _executed;
+  EventCounts _events;
+
+  long transferCycles(long words);
+  void loadBank(Bank& bank, const Instruction& in, const Tensor<T>& values, const Tensor<T>& bias);
+  int findBank(const Bank* banks, const Instruction& in, bool weights);
+  Engine& engine(const Instruction& in);
+  void conv(const Instruction& in);
+  void compute(long values);
+  void prepareLayer(int layer);
+
+  public:
+  MicroController(const Program<T>& program, int nbOfCEs, MemHParam memHParam, int ceSize = 0);
+  ~MicroController();
+  void setShadowWeights(bool enable);
+  void setInputs(const Tensor<T>& inputs);
+  const Tensor<T>& getOutputs();
+  const Tensor<T>& getActivations(int layer);
+  bool isHalted();
+  void step();
+  long run();
+  long getCycles();
+  long getComputeCycles();
+  long getConvCycles();
+  long getDramReads();
+  long getDramWrites();
+  long getExecuted(Opcode opcode);
+  EventCounts getEventCounts();
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  MicroController object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  program is the compiled network, it must outlive the controller
+* @param  nbOfCEs is the number of CEs running the CONV
+* @param  memHParam is the memory, its bandwidth time the loads and stores
+* @param  ceSize is the CE size, 0 use the filter size of every layer
+*/
+template<typename T>
+MicroController<T>::MicroController(const Program<T>& program, int nbOfCEs, MemHParam memHParam, int ceSize) :
+    _program(&program),
+    _stream(program.encode()),
+    _nbOfCEs(nbOfCEs),
+    _ceSize(ceSize),
+    _memHParam(memHParam),
+    _shadowWeights(false),
+    _pc(0)
+{
+  if(nbOfCEs < 1)
+  {
+    throw std::runtime_error("The micro controller need at least one CE");
+  }
+  if(memHParam.wordBytes < 1 || memHParam.dramBytesPerCycle <= 0)
+  {
+    throw std::runtime_error("The memory need a word size and a bandwidth");
+  }
+}
+
+template<typename T>
+MicroController<T>::~MicroController()
+{}
+
+template<typename T>
+void MicroController<T>::setShadowWeights(bool enable)
+{
+  _shadowWeights = enable;
+  _engines.clear();
+}
+
+/**
+* @brief  Function used to set the image and restart the program
+*
+* @tparam T Type of input and output data
+*
+* @param  inputs is indexed [depth][row][column], the inputs of the first layer
+*/
+template<typename T>
+void MicroController<T>::setInputs(const Tensor<T>& inputs)
+{
+  const LayerHParam& p = _program->layers[0].layerHParam;
+  if(inputs.shape() != std::vector<int>{p.inputDepth, p.inputHeight, p.inputWidth})
+  {
+    throw std::runtime_error("The inputs do not match the first layer");
+  }
+  _activations.clear();
+  _activations.push_back(inputs.clone());
+  for(int l = 0; l < _program->layers.size(); l++)
+  {
+    const ProgramLayer<T>& layer = _program->layers[l];
+    _activations.push_back(Tensor<T>({layer.layerHParam.nbOfFilter, layer.storedHeight(), layer.storedWidth()}));
+  }
+  _pc = 0;
+  _memFree = 0;
+  _computeFree = 0;
+  for(int b = 0; b < 2; b++)
+  {
+    _tiles[b] = Bank{-1, 0, 0, 0, 0, 0, 0, Tensor<T>(), Tensor<T>()};
+    _weightBanks[b] = Bank{-1, 0, 0, 0, 0, 0, 0, Tensor<T>(), Tensor<T>()};
+  }
+  _tile = 0;
+  _weightBank = 0;
+  _accumulatorLayer = -1;
+  _computeCycles = 0;
+  _convCycles = 0;
+  _dramReads = 0;
+  _dramWrites = 0;
+  _executed.assign(NB_OF_OPCODES, 0);
+  _events = EventCounts();
+}
+
+/**
+* @brief  Function used to get the outputs of the last layer
+*
+* @tparam T Type of input and output data
+*
+* @return the outputs, indexed [filter][row][column]
+*/
+template<typename T>
+const Tensor<T>& MicroController<T>::getOutputs()
+{
+  return _activations.back();
+}
+
+/**
+* @brief  Function used to get the inputs of a layer, the layer after the last one is the outputs
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+const Tensor<T>& MicroController<T>::getActivations(int layer)
+{
+  return _activations.at(layer);
+}
+
+template<typename T>
+bool MicroController<T>::isHalted()
+{
+  return _pc >= _stream.size();
+}
+
+/**
+* @brief  Cycles of the memory port for some words
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+long MicroController<T>::transferCycles(long words)
+{
+  double bytes = (double)words * _memHParam.wordBytes;
+  return (long)std::ceil(bytes / _memHParam.dramBytesPerCycle);
+}
+
+/**
+* @brief  Load a bank through the memory port, once the last CONV reading it is done
+*
+* @tparam T Type of input and output data
+*
+* @param  values is the tile or the weights, kept by the bank
+* @param  bias is the bias of the weights, empty for a tile
+*/
+template<typename T>
+void MicroController<T>::loadBank(Bank& bank, const Instruction& in, const Tensor<T>& values, const Tensor<T>& bias)
+{
+  long words = values.size() + bias.size();
+  long start = std::max(_memFree, bank.release);
+  _memFree = start + transferCycles(words);
+  bank = Bank{in.layer, in.filter, in.filters, in.channel, in.channels, _memFree, bank.release, values, bias};
+  _dramReads += words;
+}
+
+/**
+* @brief  Find the bank holding the tile or the weights of an instruction
+*
+* @tparam T Type of input and output data
+*
+* @param  banks are the two banks of the buffer
+* @param  weights is true to match the filters too
+*
+* @return the bank, -1 if none
+*/
+template<typename T>
+int MicroController<T>::findBank(const Bank* banks, const Instruction& in, bool weights)
+{
+  for(int b = 0; b < 2; b++)
+  {
+    const Bank& bank = banks[b];
+    if(bank.layer == in.layer && bank.channel == in.channel && bank.channels == in.channels
+       && (!weights || (bank.filter == in.filter && bank.filters == in.filters)))
+    {
+      return b;
+    }
+  }
+  return -1;
+}
+
+/**
+* @brief  Get the engine of the tile shape of a CONV, built and primed on its first CONV. The
+*         window generator is used when the layer allow it, the pointwise mode for 1x1 filters.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+typename MicroController<T>::Engine& MicroController<T>::engine(const Instruction& in)
+{
+  std::vector<int> key{in.layer, in.channels, in.filters};
+  std::shared_ptr<Engine>& engine = _engines[key];
+  if(!engine)
+  {
+    // The layer restricted to the tile
+    LayerHParam p = _program->layers[in.layer].layerHParam;
+    if(p.groups > 1)
+    {
+      p.groups = in.filters / (p.nbOfFilter / p.groups);
+    }
+    p.inputDepth = in.channels;
+    p.nbOfFilter = in.filters;
+    int ceSize = _ceSize > 0 ? _ceSize : p.filterSize;
+    engine = std::make_shared<Engine>();
+    engine->CEs.assign(_nbOfCEs, CE<T>(ceSize, p.inputWidth + 2 * p.padding, std::max(p.dilation, 1)));
+    Mapping mapping = p.filterSize == 1 ? POINTWISE_MAPPING : (p.dilation <= 1 ? WINDOW_MAPPING : STREAM_MAPPING);
+    engine->ctrl = std::make_shared< Controller<T> >(engine->CEs, p, mapping);
+    engine->ctrl->setShadowWeights(_shadowWeights);
+    engine->sim = std::make_shared< Simulator<T> >(*engine->ctrl, engine->CEs);
+    engine->sim->save(engine->primed);
+    engine->primedEvents = engine->ctrl->getEventCounts();
+  }
+  return *engine;
+}
+
+/**
+* @brief  Take the compute units for some output values, one per CE and step
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void MicroController<T>::compute(long values)
+{
+  long cycles = (values + _nbOfCEs - 1) / _nbOfCEs;
+  _computeFree += cycles;
+  _computeCycles += cycles;
+  _events.bufferReads += values;
+  _events.bufferWrites += values;
+}
+
+/**
+* @brief  Allocate the accumulators of a layer on its first instruction
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void MicroController<T>::prepareLayer(int layer)
+{
+  if(_accumulatorLayer != layer)
+  {
+    const ProgramLayer<T>& l = _program->layers.at(layer);
+    _accumulators = Tensor<T>({l.layerHParam.nbOfFilter, l.outputHeight(), l.outputWidth()});
+    _pooled = Tensor<T>({l.layerHParam.nbOfFilter, l.storedHeight(), l.storedWidth()});
+    _accumulatorLayer = layer;
+  }
+}
+
+/**
+* @brief  Run a CONV on the loaded tile and weights with a Controller
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void MicroController<T>::conv(const Instruction& in)
+{
+  int t = findBank(_tiles, in, false);
+  int w = findBank(_weightBanks, in, true);
+  if(t < 0)
+  {
+    throw std::logic_error("The tile of the CONV is not loaded");
+  }
+  if(w < 0)
+  {
+    throw std::logic_error("The weights of the CONV are not loaded");
+  }
+  Bank& tile = _tiles[t];
+  Bank& weights = _weightBanks[w];
+
+  Engine& e = engine(in);
+  e.primed.rewind();
+  e.sim->restore(e.primed);
+  e.ctrl->setWeights(weights.values, weights.bias);
+  e.ctrl->setInputs(tile.values);
+  long cycles = e.sim->run(1L << 40);
+  _partial = e.ctrl->getOutputs().clone();
+
+  // The transfers are counted by the loads and the stores
+  EventCounts events = e.ctrl->getEventCounts();
+  events -= e.primedEvents;
+  events.dramReads = 0;
+  events.dramWrites = 0;
+  _events += events;
+
+  long start = std::max(_computeFree, std::max(tile.ready, weights.ready));
+  _computeFree = start + cycles;
+  tile.release = _computeFree;
+  weights.release = _computeFree;
+  _computeCycles += cycles;
+  _convCycles += cycles;
+}
+
+/**
+* @brief  Fetch, decode and execute the next instruction
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void MicroController<T>::step()
+{
+  if(isHalted())
+  {
+    return;
+  }
+  if(_activations.empty())
+  {
+    throw std::logic_error("The inputs must be set before running the program");
+  }
+  Instruction in = Instruction::decode(_stream[_pc]);
+  _pc++;
+  _executed[in.opcode]++;
+  if(in.opcode == SYNC)
+  {
+    _memFree = _computeFree = std::max(_memFree, _computeFree);
+    return;
+  }
+  if(in.layer >= _program->layers.size())
+  {
+    throw std::logic_error("The instruction layer is not in the program");
+  }
+  const ProgramLayer<T>& layer = _program->layers[in.layer];
+  const LayerHParam& p = layer.layerHParam;
+  prepareLayer(in.layer);
+  long outPlane = (long)layer.outputHeight() * layer.outputWidth();
+  Tensor<T> block = in.filters > 0 ? _accumulators.slice(0, in.filter, in.filter + in.filters) : Tensor<T>();
+
+  switch(in.opcode)
+  {
+    case LOAD_TILE: /// In the other bank, the last one loaded can still be read
+      _tile ^= 1;
+      loadBank(_tiles[_tile], in, _activations[in.layer].slice(0, in.channel, in.channel + in.channels).clone(),
+               Tensor<T>());
+      break;
+
+    case LOAD_WEIGHTS:
+    {
+      _weightBank ^= 1;
+      Tensor<T> weights = layer.weights.slice(0, in.filter, in.filter + in.filters);
+      if(p.groups <= 1)
+      {
+        weights = weights.slice(1, in.channel, in.channel + in.channels);
+      }
+      // The bias is only added with the first channels
+      Tensor<T> bias({in.filters});
+      if(in.channel == 0 || p.groups > 1)
+      {
+        bias.assign(layer.bias.slice(0, in.filter, in.filter + in.filters));
+      }
+      loadBank(_weightBanks[_weightBank], in, weights.clone(), bias);
+      break;
+    }
+
+    case CONV:
+      conv(in);
+      break;
+
+    case ACCUMULATE:
+      if(_partial.dim(0) != in.filters)
+      {
+        throw std::logic_error("The partial outputs are not the ones of the block");
+      }
+      for(long i = 0; i < _partial.size(); i++)
+      {
+        block.data()[i] = NumericTraits<T>::add(block.data()[i], _partial.data()[i]);
+      }
+      compute(_partial.size());
+      break;
+
+    case ACTIVATE:
+      for(long i = 0; i < in.filters * outPlane; i++)
+      {
+        block.data()[i] = NumericTraits<T>::relu(block.data()[i]);
+      }
+      compute(in.filters * outPlane);
+      break;
+
+    case POOL:
+    {
+      if(layer.poolSize < 1)
+      {
+        throw std::logic_error("The layer has no pooling");
+      }
+      Tensor<T> pooled = _pooled.slice(0, in.filter, in.filter + in.filters);
+      for(int f = 0; f < in.filters; f++)
+      {
+        for(int i = 0; i < pooled.dim(1); i++)
+        {
+          for(int j = 0; j < pooled.dim(2); j++)
+          {
+            T value = block(f, i * layer.poolStride, j * layer.poolStride);
+            for(int y = 0; y < layer.poolSize; y++)
+            {
+              for(int x = 0; x < layer.poolSize; x++)
+              {
+                T candidate = block(f, i * layer.poolStride + y, j * layer.poolStride + x);
+                value = candidate > value ? candidate : value;
+              }
+            }
+            pooled(f, i, j) = value;
+          }
+        }
+      }
+      compute(in.filters * outPlane);
+      break;
+    }
+
+    case STORE:
+    {
+      Tensor<T> stored = _activations[in.layer + 1].slice(0, in.filter, in.filter + in.filters);
+      stored.assign((layer.poolSize > 0 ? _pooled : _accumulators).slice(0, in.filter, in.filter + in.filters));
+      // The accumulators are free for the next block
+      block.fill(T(0));
+      long start = std::max(_memFree, _computeFree);
+      _memFree = start + transferCycles(stored.size());
+      _dramWrites += stored.size();
+      break;
+    }
+
+    default:
+      throw std::logic_error("Unknown opcode");
+  }
+}
+
+/**
+* @brief  Run the whole program
+*
+* @tparam T Type of input and output data
+*
+* @return the cycles of the program
+*/
+template<typename T>
+long MicroController<T>::run()
+{
+  while(!isHalted())
+  {
+    step();
+  }
+  return getCycles();
+}
+
+/**
+* @brief  Cycles to the last load, compute or store executed
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+long MicroController<T>::getCycles()
+{
+  return std::max(_memFree, _computeFree);
+}
+
+/**
+* @brief  Cycles the compute units are busy, CONV, ACCUMULATE, ACTIVATE and POOL
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+long MicroController<T>::getComputeCycles()
+{
+  return _computeCycles;
+}
+
+template<typename T>
+long MicroController<T>::getConvCycles()
+{
+  return _convCycles;
+}
+
+template<typename T>
+long MicroController<T>::getDramReads()
+{
+  return _dramReads;
+}
+
+template<typename T>
+long MicroController<T>::getDramWrites()
+{
+  return _dramWrites;
+}
+
+template<typename T>
+long MicroController<T>::getExecuted(Opcode opcode)
+{
+  return _executed.at(opcode);
+}
+
+/**
+* @brief  Events of the CONV controllers, the accumulator accesses and the DRAM words
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+EventCounts MicroController<T>::getEventCounts()
+{
+  EventCounts events = _events;
+  events.dramReads = _dramReads;
+  events.dramWrites = _dramWrites;
+  return events;
+}
+
+#endif //MICROCONTROLLER_HPP
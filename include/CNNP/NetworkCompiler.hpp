@@ -0,0 +1,501 @@
+/**
+ *  @file    NetworkCompiler.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Compiler of a layer list into the instruction stream of the microcoded controller
+ *
+ *  @section DESCRIPTION
+ *
+ *  The network is a list of convolution, batch norm, ReLU and max pooling layers. The compiler
+ *  run its passes in order:
+ *
+ *  Folding. A batch norm following a convolution is folded in its weights and bias, with
+ *  s = gamma / sqrt(variance + epsilon): w' = w * s and b' = (b - mean) * s + beta. The folding is
+ *  computed in the data type of the layer, s is rounded to it like the weights.
+ *
+ *  Fusion. The ReLU and the max pooling following a convolution are applied to its outputs
+ *  before they are stored, instead of a store and a load of the activations for each of them.
+ *  The ReLU and the max pooling commute, the ReLU is always applied first.
+ *
+ *  Tiling. A layer is cut in blocks of filters and tiles of input channels fitting the on-chip
+ *  buffers: a tile of channels in the input buffer, the weights of a block over these channels
+ *  in the weight buffer and the outputs of a block in the accumulators. The blocks of a grouped
+ *  layer are whole groups, with the channels of these groups.
+ *
+ *  Ordering. The tiles are ordered to reuse the input tile in the buffer. With all the outputs
+ *  of the layer in the accumulators, every input tile is loaded once and all the blocks are
+ *  computed on it. Otherwise the blocks are computed one after the other, and the channel tiles
+ *  of every other block are taken backward so a block start on the tile the previous one ended
+ *  on. A tile already in the buffer is not loaded again. Without the ordering, every block load
+ *  all its tiles in order.
+ *
+ *  The layers are separated by a SYNC, the next layer read the stores of the previous one.
+ */
+
+#ifndef NETWORKCOMPILER_HPP
+#define NETWORKCOMPILER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "HyperParams.hpp"
+#include "NumericTraits.hpp"
+#include "Program.hpp"
+#include "Tensor.hpp"
+
+/**
+ * @brief Network compiler. Objects that fold, fuse, tile and order a layer list into a program
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class NetworkCompiler
+{
+  private:
+  /// Kinds of layers of the list
+  enum LayerKind
+  {
+    CONVOLUTION_LAYER = 0,
+    BATCH_NORM_LAYER,
+    RELU_LAYER,
+    MAX_POOL_LAYER
+  };
+
+  /// A layer of the list, the fields of the other kinds are empty
+  struct Layer
+  {
+    LayerKind kind;
+    LayerHParam layerHParam;
+    Tensor<T> weights;
+    Tensor<T> bias;
+    std::vector<double> gamma;
+    std::vector<double> beta;
+    std::vector<double> mean;
+    std::vector<double> variance;
+    double epsilon;
+    int poolSize;
+    int poolStride;
+  };
+
+  /// Tiling of a layer
+  struct Tiling
+  {
+    int filters;      ///< Filters of a block
+    int channels;     ///< Input channels of a tile
+    bool grouped;     ///< The tile of a block is the channels of its groups
+  };
+
+  std::vector<Layer> _layers;
+  long _inputBufferWords;      ///< 0 hold a whole layer
+  long _weightBufferWords;     ///< 0 hold a whole layer
+  long _accumulatorWords;      ///< 0 hold a whole layer
+  bool _tileOrdering;
+
+  std::vector< ProgramLayer<T> > foldAndFuse();
+  void foldBatchNorm(ProgramLayer<T>& layer, const Layer& norm);
+  Tiling tileLayer(const ProgramLayer<T>& layer);
+  void emitLayer(int l, const ProgramLayer<T>& layer, std::vector<Instruction>& instructions);
+  void emitBlock(int l, const ProgramLayer<T>& layer, int filter, int filters, std::vector<Instruction>& instructions);
+
+  public:
+  NetworkCompiler(long inputBufferWords = 0, long weightBufferWords = 0, long accumulatorWords = 0);
+  ~NetworkCompiler();
+  void addConvolution(LayerHParam layerHParam, const Tensor<T>& weights, const Tensor<T>& bias);
+  void addBatchNorm(const std::vector<double>& gamma, const std::vector<double>& beta, const std::vector<double>& mean,
+                    const std::vector<double>& variance, double epsilon = 1e-5);
+  void addRelu();
+  void addMaxPool(int size, int stride);
+  void setTileOrdering(bool enable);
+  Program<T> compile();
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  NetworkCompiler object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  inputBufferWords is the size of the input tile buffer, 0 if it hold a whole layer
+* @param  weightBufferWords is the size of the weight buffer, 0 if it hold a whole layer
+* @param  accumulatorWords is the number of output accumulators, 0 if they hold a whole layer
+*/
+template<typename T>
+NetworkCompiler<T>::NetworkCompiler(long inputBufferWords, long weightBufferWords, long accumulatorWords) :
+    _inputBufferWords(inputBufferWords),
+    _weightBufferWords(weightBufferWords),
+    _accumulatorWords(accumulatorWords),
+    _tileOrdering(true)
+{}
+
+template<typename T>
+NetworkCompiler<T>::~NetworkCompiler()
+{}
+
+/**
+* @brief  Append a convolution layer to the list
+*
+* @tparam T Type of input and output data
+*
+* @param  layerHParam is the layer
+* @param  weights is indexed [filter][depth / groups][row][column]
+* @param  bias is indexed [filter]
+*/
+template<typename T>
+void NetworkCompiler<T>::addConvolution(LayerHParam layerHParam, const Tensor<T>& weights, const Tensor<T>& bias)
+{
+  if(layerHParam.type == FULLY_CONNECTED)
+  {
+    throw std::runtime_error("The network compiler only compile convolution layers");
+  }
+  int groups = layerHParam.groups > 0 ? layerHParam.groups : 1;
+  if(weights.shape() != std::vector<int>{layerHParam.nbOfFilter, layerHParam.inputDepth / groups,
+                                         layerHParam.filterSize, layerHParam.filterSize}
+     || bias.shape() != std::vector<int>{layerHParam.nbOfFilter})
+  {
+    throw std::runtime_error("The weights or the bias do not match the layer");
+  }
+  Layer layer = Layer();
+  layer.kind = CONVOLUTION_LAYER;
+  layer.layerHParam = layerHParam;
+  layer.weights = weights;
+  layer.bias = bias;
+  _layers.push_back(layer);
+}
+
+/**
+* @brief  Append a batch norm layer to the list, it must follow a convolution
+*
+* @tparam T Type of input and output data
+*
+* @param  gamma, beta, mean and variance are indexed [channel]
+* @param  epsilon is added to the variance
+*/
+template<typename T>
+void NetworkCompiler<T>::addBatchNorm(const std::vector<double>& gamma, const std::vector<double>& beta,
+                                      const std::vector<double>& mean, const std::vector<double>& variance,
+                                      double epsilon)
+{
+  if(beta.size() != gamma.size() || mean.size() != gamma.size() || variance.size() != gamma.size())
+  {
+    throw std::runtime_error("The batch norm parameters must have the same size");
+  }
+  Layer layer = Layer();
+  layer.kind = BATCH_NORM_LAYER;
+  layer.gamma = gamma;
+  layer.beta = beta;
+  layer.mean = mean;
+  layer.variance = variance;
+  layer.epsilon = epsilon;
+  _layers.push_back(layer);
+}
+
+template<typename T>
+void NetworkCompiler<T>::addRelu()
+{
+  Layer layer = Layer();
+  layer.kind = RELU_LAYER;
+  _layers.push_back(layer);
+}
+
+/**
+* @brief  Append a max pooling layer to the list
+*
+* @tparam T Type of input and output data
+*
+* @param  size is the pooling window size
+* @param  stride is the spacing of the windows
+*/
+template<typename T>
+void NetworkCompiler<T>::addMaxPool(int size, int stride)
+{
+  if(size < 1 || stride < 1)
+  {
+    throw std::runtime_error("The pooling size and stride must be at least 1");
+  }
+  Layer layer = Layer();
+  layer.kind = MAX_POOL_LAYER;
+  layer.poolSize = size;
+  layer.poolStride = stride;
+  _layers.push_back(layer);
+}
+
+/**
+* @brief  Function used to enable the ordering of the tiles for the input reuse
+*
+* @tparam T Type of input and output data
+*
+* @param  enable is false to load every tile of every block in order
+*/
+template<typename T>
+void NetworkCompiler<T>::setTileOrdering(bool enable)
+{
+  _tileOrdering = enable;
+}
+
+/**
+* @brief  Folding and fusion passes. Merge the batch norm, ReLU and max pooling layers in the
+*         convolution before them, and check that every convolution read the previous one.
+*
+* @tparam T Type of input and output data
+*
+* @return the convolution layers of the program
+*/
+template<typename T>
+std::vector< ProgramLayer<T> > NetworkCompiler<T>::foldAndFuse()
+{
+  std::vector< ProgramLayer<T> > layers;
+  for(int l = 0; l < _layers.size(); l++)
+  {
+    const Layer& layer = _layers[l];
+    if(layer.kind == CONVOLUTION_LAYER)
+    {
+      if(!layers.empty())
+      {
+        const ProgramLayer<T>& previous = layers.back();
+        const LayerHParam& p = layer.layerHParam;
+        if(p.inputDepth != previous.layerHParam.nbOfFilter || p.inputHeight != previous.storedHeight()
+           || p.inputWidth != previous.storedWidth())
+        {
+          throw std::runtime_error("The layer input does not match the outputs of the previous layer");
+        }
+      }
+      layers.push_back(ProgramLayer<T>{layer.layerHParam, layer.weights.clone(), layer.bias.clone(), false, 0, 1});
+      continue;
+    }
+    if(layers.empty())
+    {
+      throw std::runtime_error("A batch norm, ReLU or pooling layer must follow a convolution");
+    }
+    ProgramLayer<T>& fused = layers.back();
+    switch(layer.kind)
+    {
+      case BATCH_NORM_LAYER:
+        // The outputs must still be linear in the weights
+        if(fused.relu || fused.poolSize > 0)
+        {
+          throw std::runtime_error("A batch norm must directly follow a convolution to be folded");
+        }
+        foldBatchNorm(fused, layer);
+        break;
+
+      case RELU_LAYER:
+        if(fused.relu)
+        {
+          throw std::runtime_error("A convolution can only fuse one ReLU");
+        }
+        fused.relu = true;
+        break;
+
+      default:
+        if(fused.poolSize > 0)
+        {
+          throw std::runtime_error("A convolution can only fuse one pooling");
+        }
+        if(layer.poolSize > fused.outputWidth() || layer.poolSize > fused.outputHeight())
+        {
+          throw std::runtime_error("The pooling window is larger than the outputs");
+        }
+        fused.poolSize = layer.poolSize;
+        fused.poolStride = layer.poolStride;
+        break;
+    }
+  }
+  return layers;
+}
+
+/**
+* @brief  Fold a batch norm in the weights and bias of a convolution
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void NetworkCompiler<T>::foldBatchNorm(ProgramLayer<T>& layer, const Layer& norm)
+{
+  int filters = layer.layerHParam.nbOfFilter;
+  if(norm.gamma.size() != filters)
+  {
+    throw std::runtime_error("The batch norm must have a channel per filter");
+  }
+  long perFilter = layer.weights.size() / filters;
+  for(int f = 0; f < filters; f++)
+  {
+    T scale = NumericTraits<T>::fromDouble(norm.gamma[f] / std::sqrt(norm.variance[f] + norm.epsilon));
+    T* weights = layer.weights.data() + f * perFilter;
+    for(long i = 0; i < perFilter; i++)
+    {
+      weights[i] = NumericTraits<T>::mul(weights[i], scale);
+    }
+    T centered = NumericTraits<T>::add(layer.bias(f), NumericTraits<T>::fromDouble(-norm.mean[f]));
+    layer.bias(f) = NumericTraits<T>::add(NumericTraits<T>::mul(centered, scale),
+                                          NumericTraits<T>::fromDouble(norm.beta[f]));
+  }
+}
+
+/**
+* @brief  Tiling pass. The largest tile of channels fitting the input buffer, then the largest
+*         block of filters whose weights fit the weight buffer and outputs fit the accumulators.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+typename NetworkCompiler<T>::Tiling NetworkCompiler<T>::tileLayer(const ProgramLayer<T>& layer)
+{
+  const LayerHParam& p = layer.layerHParam;
+  long plane = (long)p.inputWidth * p.inputHeight;
+  long outPlane = (long)layer.outputWidth() * layer.outputHeight();
+  long filterWords = (long)p.filterSize * p.filterSize;
+  int groups = p.groups > 0 ? p.groups : 1;
+  long inputWords = _inputBufferWords > 0 ? _inputBufferWords : plane * p.inputDepth;
+  long weightWords = _weightBufferWords > 0 ? _weightBufferWords : (filterWords * p.inputDepth / groups + 1) * p.nbOfFilter;
+  long accumulatorWords = _accumulatorWords > 0 ? _accumulatorWords : outPlane * p.nbOfFilter;
+  if(groups > 1)
+  {
+    // Whole groups, the channels of the groups of the block
+    int groupChannels = p.inputDepth / groups;
+    int groupFilters = p.nbOfFilter / groups;
+    long blockGroups = std::min<long>(groups, inputWords / (plane * groupChannels));
+    blockGroups = std::min(blockGroups, weightWords / ((filterWords * groupChannels + 1) * groupFilters));
+    blockGroups = std::min(blockGroups, accumulatorWords / (outPlane * groupFilters));
+    if(blockGroups < 1)
+    {
+      throw std::runtime_error("The on-chip buffers cannot hold a group of the layer");
+    }
+    return Tiling{(int)blockGroups * groupFilters, (int)blockGroups * groupChannels, true};
+  }
+  long channels = std::min<long>(p.inputDepth, inputWords / plane);
+  if(channels < 1)
+  {
+    throw std::runtime_error("The input buffer cannot hold an input channel");
+  }
+  long filters = std::min<long>(p.nbOfFilter, weightWords / (filterWords * channels + 1));
+  filters = std::min(filters, accumulatorWords / outPlane);
+  if(filters < 1)
+  {
+    throw std::runtime_error("The weight buffer or the accumulators cannot hold a filter");
+  }
+  return Tiling{(int)filters, (int)channels, false};
+}
+
+/**
+* @brief  Ordering pass. Emit the instructions of the tiles of a layer.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void NetworkCompiler<T>::emitLayer(int l, const ProgramLayer<T>& layer, std::vector<Instruction>& instructions)
+{
+  const LayerHParam& p = layer.layerHParam;
+  Tiling tiling = tileLayer(layer);
+  int blocks = (p.nbOfFilter + tiling.filters - 1) / tiling.filters;
+  int tiles = tiling.grouped ? 1 : (p.inputDepth + tiling.channels - 1) / tiling.channels;
+  long outPlane = (long)layer.outputWidth() * layer.outputHeight();
+  long accumulatorWords = _accumulatorWords > 0 ? _accumulatorWords : outPlane * p.nbOfFilter;
+  int loaded = -1;   // First channel of the tile in the buffer
+
+  // Every input tile once, all the outputs in the accumulators
+  bool channelOuter = _tileOrdering && tiles > 1 && outPlane * p.nbOfFilter <= accumulatorWords;
+  std::vector< std::pair<int, int> > order;  // (block, tile)
+  if(channelOuter)
+  {
+    for(int t = 0; t < tiles; t++)
+    {
+      for(int b = 0; b < blocks; b++)
+      {
+        order.push_back(std::make_pair(b, t));
+      }
+    }
+  }
+  else
+  {
+    for(int b = 0; b < blocks; b++)
+    {
+      for(int t = 0; t < tiles; t++)
+      {
+        order.push_back(std::make_pair(b, _tileOrdering && b % 2 == 1 ? tiles - 1 - t : t));
+      }
+    }
+  }
+
+  for(int i = 0; i < order.size(); i++)
+  {
+    int filter = order[i].first * tiling.filters;
+    int filters = std::min(tiling.filters, p.nbOfFilter - filter);
+    int channel, channels;
+    if(tiling.grouped)
+    {
+      int groups = p.groups;
+      channel = filter / (p.nbOfFilter / groups) * (p.inputDepth / groups);
+      channels = filters / (p.nbOfFilter / groups) * (p.inputDepth / groups);
+    }
+    else
+    {
+      channel = order[i].second * tiling.channels;
+      channels = std::min(tiling.channels, p.inputDepth - channel);
+    }
+    if(!_tileOrdering || channel != loaded)
+    {
+      instructions.push_back(Instruction{LOAD_TILE, l, 0, 0, channel, channels});
+      loaded = channel;
+    }
+    instructions.push_back(Instruction{LOAD_WEIGHTS, l, filter, filters, channel, channels});
+    instructions.push_back(Instruction{CONV, l, filter, filters, channel, channels});
+    instructions.push_back(Instruction{ACCUMULATE, l, filter, filters, 0, 0});
+    // The outputs of the block are complete after its last tile
+    bool last = channelOuter ? order[i].second == tiles - 1
+                             : i + 1 == order.size() || order[i + 1].first != order[i].first;
+    if(last)
+    {
+      emitBlock(l, layer, filter, filters, instructions);
+    }
+  }
+  instructions.push_back(Instruction{SYNC, 0, 0, 0, 0, 0});
+}
+
+/**
+* @brief  Fusion pass. Emit the fused ReLU and pooling of a complete block, then its store.
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+void NetworkCompiler<T>::emitBlock(int l, const ProgramLayer<T>& layer, int filter, int filters,
+                                   std::vector<Instruction>& instructions)
+{
+  if(layer.relu)
+  {
+    instructions.push_back(Instruction{ACTIVATE, l, filter, filters, 0, 0});
+  }
+  if(layer.poolSize > 0)
+  {
+    instructions.push_back(Instruction{POOL, l, filter, filters, 0, 0});
+  }
+  instructions.push_back(Instruction{STORE, l, filter, filters, 0, 0});
+}
+
+/**
+* @brief  Run the passes on the layer list
+*
+* @tparam T Type of input and output data
+*
+* @return the program of the network
+*/
+template<typename T>
+Program<T> NetworkCompiler<T>::compile()
+{
+  Program<T> program;
+  program.layers = foldAndFuse();
+  if(program.layers.empty())
+  {
+    throw std::runtime_error("The network has no convolution layer");
+  }
+  for(int l = 0; l < program.layers.size(); l++)
+  {
+    emitLayer(l, program.layers[l], program.instructions);
+  }
+  return program;
+}
+
+#endif //NETWORKCOMPILER_HPP
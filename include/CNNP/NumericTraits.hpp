@@ -0,0 +1,284 @@
+/**
+ *  @file    NumericTraits.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Numeric backends of the processor model
+ *
+ *  @section DESCRIPTION
+ *
+ *  The PE, CE and controller only compute through NumericTraits<T>, so the same model run on any
+ *  data type T:
+ *    Fi::Fixed  -> the bit-accurate reference, the operators of libfi are used as is
+ *    float      -> fast exploration without quantization
+ *    int8_t, int16_t, int32_t -> raw fixed point words with 4, 8 and 16 fractional bits. The
+ *                  products are computed in the wider accumulator type and rounded (half up) by
+ *                  a shift. The MACs accumulate in the accumulator type, the words are saturated
+ *                  when narrowed back, like a DSP datapath with a wide accumulator.
+ *
+ *  Every backend define:
+ *    acc_type         -> type of the intermediate results
+ *    zero()           -> the zero value
+ *    fromDouble(v)    -> quantize a real value
+ *    toDouble(v)      -> real value of a word, for the types convertible to double
+ *    add(a, b), mul(a, b) -> the datapath operations on words
+ *    mac(w, x, acc)   -> w * x + acc, accumulated in acc_type
+ *    accumulate(a, b) -> a + b in acc_type, the adders of the partial sums
+ *    widen(v), narrow(acc) -> a word to acc_type and back, narrow saturate the raw words
+ *    relu(v)          -> max(v, 0)
+ *    minValue(), maxValue() -> the rails, the largest and smallest values of the type
+ *    saturates()      -> true if an overflow is clamped to the rails (Fi::Saturate and the raw words)
+ */
+
+#ifndef NUMERICTRAITS_HPP
+#define NUMERICTRAITS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @brief Numeric backend of the types with their own arithmetic operators (Fi::Fixed, float, double)
+ *
+ * @tparam T Type of the data
+ */
+template <typename T>
+struct NumericTraits
+{
+  typedef T acc_type;
+
+  static T zero()
+  {
+    return T(0);
+  }
+
+  static T fromDouble(double value)
+  {
+    return T(value);
+  }
+
+  static double toDouble(T value)
+  {
+    return static_cast<double>(value);
+  }
+
+  static T add(T a, T b)
+  {
+    return a + b;
+  }
+
+  static T mul(T a, T b)
+  {
+    return a * b;
+  }
+
+  static acc_type mac(T w, T x, acc_type acc)
+  {
+    return (w * x) + acc;
+  }
+
+  static acc_type accumulate(acc_type a, acc_type b)
+  {
+    return a + b;
+  }
+
+  static acc_type widen(T value)
+  {
+    return value;
+  }
+
+  static T narrow(acc_type value)
+  {
+    return value;
+  }
+
+  static T relu(T value)
+  {
+    return (value > T(0)) ? value : T(0);
+  }
+
+  static T maxValue()
+  {
+    static const T rail = searchRail(T(1));
+    return rail;
+  }
+
+  static T minValue()
+  {
+    static const T rail = searchRail(T(0) - T(1));
+    return rail;
+  }
+
+  static bool saturates()
+  {
+    static const bool saturating = searchSaturation();
+    return saturating;
+  }
+
+  /// Rail of the types without numeric_limits (Fi::Fixed). Double the value until it stop growing,
+  /// a saturating type is then on its rail. A wrapping or throwing type is on its largest power of
+  /// 2, the smaller powers of 2 are added while the sum still grow, down to the last bit.
+  static T searchRail(T value)
+  {
+    if(std::numeric_limits<T>::is_specialized)
+    {
+      return (value > T(0)) ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest();
+    }
+    try
+    {
+      while(true)
+      {
+        T next = value + value;
+        if(!grows(value, next))
+        {
+          break;
+        }
+        value = next;
+      }
+    }
+    catch(...)
+    {
+    }
+    for(T step = value * T(0.5); step != T(0); )
+    {
+      try
+      {
+        T next = value + step;
+        if(grows(value, next)){value = next;}
+      }
+      catch(...)
+      {
+      }
+      T half = step * T(0.5);
+      if(!((step > T(0)) ? (half < step) : (half > step)))
+      {
+        break;
+      }
+      step = half;
+    }
+    return value;
+  }
+
+  /// True if the sum past the rail is clamped, not wrapped (or thrown). The floats give infinity.
+  static bool searchSaturation()
+  {
+    try
+    {
+      return add(maxValue(), maxValue()) == maxValue();
+    }
+    catch(...)
+    {
+      return false;
+    }
+  }
+
+  /// True if next is further from zero than value, on the same side
+  static bool grows(T value, T next)
+  {
+    return (value > T(0)) ? (next > value) : (next < value);
+  }
+};
+
+/**
+ * @brief Numeric backend of the raw fixed point words
+ *
+ * @tparam S Type of the words
+ * @tparam A Type of the intermediate results, wide enough for a product
+ * @tparam F Number of fractional bits
+ */
+template <typename S, typename A, int F>
+struct RawNumericTraits
+{
+  typedef A acc_type;
+  static const int fracBits = F;
+
+  static S zero()
+  {
+    return S(0);
+  }
+
+  static S saturate(A value)
+  {
+    if(value > A(std::numeric_limits<S>::max())){return std::numeric_limits<S>::max();}
+    if(value < A(std::numeric_limits<S>::min())){return std::numeric_limits<S>::min();}
+    return S(value);
+  }
+
+  static S fromDouble(double value)
+  {
+    double scaled = std::floor(value * double(A(1) << F) + 0.5);
+    if(scaled > double(std::numeric_limits<S>::max())){return std::numeric_limits<S>::max();}
+    if(scaled < double(std::numeric_limits<S>::min())){return std::numeric_limits<S>::min();}
+    return S(scaled);
+  }
+
+  static double toDouble(S value)
+  {
+    return double(value) / double(A(1) << F);
+  }
+
+  static S add(S a, S b)
+  {
+    return saturate(A(a) + A(b));
+  }
+
+  static S mul(S a, S b)
+  {
+    return saturate((A(a) * A(b) + (A(1) << (F - 1))) >> F);
+  }
+
+  static A mac(S w, S x, A acc)
+  {
+    return ((A(w) * A(x) + (A(1) << (F - 1))) >> F) + acc;
+  }
+
+  static A accumulate(A a, A b)
+  {
+    return a + b;
+  }
+
+  static A widen(S value)
+  {
+    return A(value);
+  }
+
+  static S narrow(A value)
+  {
+    return saturate(value);
+  }
+
+  static S relu(S value)
+  {
+    return (value > S(0)) ? value : S(0);
+  }
+
+  static S maxValue()
+  {
+    return std::numeric_limits<S>::max();
+  }
+
+  static S minValue()
+  {
+    return std::numeric_limits<S>::min();
+  }
+
+  static bool saturates()
+  {
+    return true;
+  }
+};
+
+template <>
+struct NumericTraits<int8_t> : RawNumericTraits<int8_t, int32_t, 4>
+{};
+
+template <>
+struct NumericTraits<int16_t> : RawNumericTraits<int16_t, int32_t, 8>
+{};
+
+template <>
+struct NumericTraits<int32_t> : RawNumericTraits<int32_t, int64_t, 16>
+{};
+
+#endif //NUMERICTRAITS_HPP
@@ -10,6 +10,7 @@
  *
  *  This module, when given a weight, a input and a partial result, compute a MAC operation.
  *  The added reg0 delay the input to the next PE and permit the partials results to be added together.
+ *  The partial results (Sig2 and reg2) are in the accumulator type NumericTraits<T>::acc_type.
  *
  *  Sig1--->[reg0]-->[reg1]
  *       \
@@ -27,6 +28,9 @@
 #ifndef PE_H
 #define PE_H
 
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/Snapshot.hpp"
+
 /**
  * @brief Processing Element
  * Objects that compute a MAC.
@@ -36,19 +40,26 @@
 template <typename T>
 class PE
 {
+  public:
+  typedef typename NumericTraits<T>::acc_type acc_type;
+
   private:
-  T _reg0, _reg1, _reg2; ///< The PE registers as T type
+  T _reg0, _reg1;        ///< The PE input registers as T type
+  acc_type _reg2;        ///< The PE partial result register as accumulator type
   T _w;                  ///< The weight register as T type
-  T _sig1, _sig2, _sig3; ///< The PE signals as T type
+  T _sig1, _sig3;        ///< The PE input and weight signals as T type
+  acc_type _sig2;        ///< The PE partial result signal as accumulator type
   bool _wEnable;         ///< The PE signals as T type
 
   public:
   PE();
   ~PE();
-  void setSigs(T sig1, T sig2, T sig3, bool wEnable);
+  void setSigs(T sig1, acc_type sig2, T sig3, bool wEnable);
   T getReg1();
-  T getReg2();
-  T step();
+  acc_type getReg2();
+  acc_type step();
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
 };
 
 // --------------- Templatized Implementation ---------------
@@ -57,11 +68,11 @@ template<typename T>
 PE<T>::PE():
 _reg0(T(0)),
 _reg1(T(0)),
-_reg2(T(0)),
+_reg2(NumericTraits<T>::widen(T(0))),
 _w(T(0)),
 _sig1(T(0)),
-_sig2(T(0)),
 _sig3(T(0)),
+_sig2(NumericTraits<T>::widen(T(0))),
 _wEnable(false)
 {}
 
@@ -70,7 +81,7 @@ PE<T>::~PE()
 {}
 
 template<typename T>
-void PE<T>::setSigs(T sig1, T sig2,  T sig3, bool wEnable)
+void PE<T>::setSigs(T sig1, acc_type sig2,  T sig3, bool wEnable)
 {
   _sig1 = sig1;
   _sig2 = sig2;
@@ -85,19 +96,47 @@ T PE<T>::getReg1()
 }
 
 template<typename T>
-T PE<T>::getReg2()
+typename PE<T>::acc_type PE<T>::getReg2()
 {
   return _reg2;
 }
 
 template<typename T>
-T PE<T>::step()
+typename PE<T>::acc_type PE<T>::step()
 {
   // Internal signal propagation
   _reg1 = _reg0;
   _reg0 = _sig1;
-  _reg2 = (_w * _sig1) + _sig2;
+  _reg2 = NumericTraits<T>::mac(_w, _sig1, _sig2);
   if(_wEnable){_w = _sig3;}
+
+  return _reg2;
+}
+
+template<typename T>
+void PE<T>::save(Snapshot& snap)
+{
+  snap.write(_reg0);
+  snap.write(_reg1);
+  snap.write(_reg2);
+  snap.write(_w);
+  snap.write(_sig1);
+  snap.write(_sig2);
+  snap.write(_sig3);
+  snap.write(_wEnable);
+}
+
+template<typename T>
+void PE<T>::restore(Snapshot& snap)
+{
+  snap.read(_reg0);
+  snap.read(_reg1);
+  snap.read(_reg2);
+  snap.read(_w);
+  snap.read(_sig1);
+  snap.read(_sig2);
+  snap.read(_sig3);
+  snap.read(_wEnable);
 }
 
 #endif //PE_H
\ No newline at end of file
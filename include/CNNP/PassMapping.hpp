@@ -0,0 +1,755 @@
+/**
+ *  @file    PassMapping.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Address generation of a pass, one class per mapping of the layer on the CEs
+ *
+ *  @section DESCRIPTION
+ *
+ *  The Controller sequence the passes (weights load, shadow bank, DMA, outputs accumulation),
+ *  these classes walk the input buffer addresses fed to the CEs and the output addresses saved
+ *  on every step of a pass.
+ *
+ *  StreamMapping stream the padded input channel in the CE FIFOs, one pixel per step, and scrap
+ *  the windows straddling two rows or skipped by the stride. PointwiseMapping put the input
+ *  channels of the next pixel on the lanes. WindowMapping put the windows of the next outputs on
+ *  the lanes with the window generator, the first window of a row taking the steps of its refill.
+ *  On the lanes every step after the CE latency is an output, but the refill steps.
+ *
+ *  The driver registers of a mapping are saved in the controller snapshots.
+ */
+
+#ifndef PASSMAPPING_HPP
+#define PASSMAPPING_HPP
+
+#include <algorithm>
+#include <vector>
+#include "CNNP/EventCounts.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PassTiming.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "CNNP/Tensor.hpp"
+
+/// Shape of the passes of a layer on the CEs, set by the Controller
+struct PassGeometry
+{
+  int ceSize;              ///< Size of the CE PE arrays
+  int unroll;              ///< Adjacent outputs of a filter computed together, one per CE of a group
+  int lanes;               ///< Input channels per pass on the lanes, 1 when streamed
+  int groups;              ///< Number of filter groups
+  int bandRows;            ///< Output rows of a band, 0 for the whole layer
+  int outputWidth;
+  int outputHeight;
+  PassTiming timing;       ///< Steps constants of a pass
+};
+
+/**
+ * Input and output address generation of the passes of a layer mapping.
+ *
+ *@tparam T      Type of input and output data.
+ */
+template <typename T>
+class PassMapping
+{
+  protected:
+  LayerHParam _layerHParam;
+  PassGeometry _geometry;
+  const Tensor<T>& _inputs;      ///< The controller input buffer, indexed [depth][row][column]
+  EventCounts& _events;          ///< The controller events, the input buffer reads are counted here
+
+  public:
+  PassMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+              EventCounts& events);
+  virtual ~PassMapping();
+  virtual bool onLanes() = 0;
+  virtual void initInputPass(int channel, int tile, int band) = 0;
+  virtual void initOutputPass(int band) = 0;
+  virtual bool inputLogic(int step, T& input);
+  virtual bool laneLogic(int step, std::vector< std::vector< std::vector<T> > >& lanes);
+  virtual bool outputLogic(int step, int& saveHI, int& saveWI) = 0;
+  virtual int zeroInputSteps(int step, int maxSteps);
+  virtual void save(Snapshot& snap) = 0;
+  virtual void restore(Snapshot& snap) = 0;
+};
+
+/**
+ * Padded input channel streamed in the CE FIFOs.
+ *
+ *@tparam T      Type of input and output data.
+ */
+template <typename T>
+class StreamMapping : public PassMapping<T>
+{
+  private:
+  /// Indexes
+  int _inWI, _inHI, _inDI, _outWI, _outHI;
+  /// Driver registers
+  int _padCounter;
+  int _scrapCounter;
+  bool _rowEndFlag;
+  bool _scrapFlag;
+
+  public:
+  StreamMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+                EventCounts& events);
+  bool onLanes();
+  void initInputPass(int channel, int tile, int band);
+  void initOutputPass(int band);
+  bool inputLogic(int step, T& input);
+  bool outputLogic(int step, int& saveHI, int& saveWI);
+  int zeroInputSteps(int step, int maxSteps);
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
+};
+
+/**
+ * Stream of lanes steps, one pixel or one window of every output of a group per step.
+ *
+ *@tparam T      Type of input and output data.
+ */
+template <typename T>
+class LanesMapping : public PassMapping<T>
+{
+  protected:
+  int _inDI;                     ///< First input channel of the input pass
+  int _tile;                     ///< Tile of the folded filter of the input pass
+  int _inBand, _outBand;         ///< Band of output rows of the input and output passes
+
+  bool lanesPixel(int band, int step, int& outHI, int& outWI);
+  int groupEnd();
+  virtual void loadLanes(int outHI, int outWI, std::vector< std::vector< std::vector<T> > >& lanes) = 0;
+
+  public:
+  LanesMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+               EventCounts& events);
+  bool onLanes();
+  void initInputPass(int channel, int tile, int band);
+  void initOutputPass(int band);
+  bool laneLogic(int step, std::vector< std::vector< std::vector<T> > >& lanes);
+  bool outputLogic(int step, int& saveHI, int& saveWI);
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
+};
+
+/**
+ * Input channels of a pixel on the lanes, the CE PE array mapped across the channels.
+ *
+ *@tparam T      Type of input and output data.
+ */
+template <typename T>
+class PointwiseMapping : public LanesMapping<T>
+{
+  protected:
+  void loadLanes(int outHI, int outWI, std::vector< std::vector< std::vector<T> > >& lanes);
+
+  public:
+  PointwiseMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+                   EventCounts& events);
+};
+
+/**
+ * Windows of the outputs on the lanes, through the window generator.
+ *
+ *@tparam T      Type of input and output data.
+ */
+template <typename T>
+class WindowMapping : public LanesMapping<T>
+{
+  protected:
+  void loadLanes(int outHI, int outWI, std::vector< std::vector< std::vector<T> > >& lanes);
+
+  public:
+  WindowMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+                EventCounts& events);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  PassMapping object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  layerHParam is the layer, normalized by the Controller
+* @param  geometry is the shape of the passes
+* @param  inputs is the input buffer read
+* @param  events is the events counter of the input buffer reads
+*/
+template<typename T>
+PassMapping<T>::PassMapping(const LayerHParam& layerHParam, const PassGeometry& geometry, const Tensor<T>& inputs,
+                            EventCounts& events) :
+    _layerHParam(layerHParam),
+    _geometry(geometry),
+    _inputs(inputs),
+    _events(events)
+{}
+
+template<typename T>
+PassMapping<T>::~PassMapping()
+{}
+
+/**
+* @brief  Input driver of a streamed pass
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the input pass
+* @param  input is set to the input to load
+*
+* @return true if an input is loaded, false to load a zero. Always false on the lanes
+*/
+template<typename T>
+bool PassMapping<T>::inputLogic(int step, T& input)
+{
+  return false;
+}
+
+/**
+* @brief  Input driver of a lanes pass
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the input pass
+* @param  lanes is set to the lanes inputs of every CE of a group
+*
+* @return true if lanes are loaded. Always false when streamed
+*/
+template<typename T>
+bool PassMapping<T>::laneLogic(int step, std::vector< std::vector< std::vector<T> > >& lanes)
+{
+  return false;
+}
+
+/**
+* @brief  Function used to know how many of the next steps load a zero in the CEs
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the next step of the input pass
+* @param  maxSteps is the number of steps to look ahead
+*
+* @return the number of steps loading a zero, from the next one. The lanes are fed every step: 0
+*/
+template<typename T>
+int PassMapping<T>::zeroInputSteps(int step, int maxSteps)
+{
+  return 0;
+}
+
+/**
+* @brief  StreamMapping object constructor
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+StreamMapping<T>::StreamMapping(const LayerHParam& layerHParam, const PassGeometry& geometry,
+                                const Tensor<T>& inputs, EventCounts& events) :
+    PassMapping<T>(layerHParam, geometry, inputs, events),
+    _inWI(0), _inHI(0), _inDI(0), _outWI(0), _outHI(0),
+    _padCounter(layerHParam.padding),
+    _scrapCounter(0),
+    _rowEndFlag(false),
+    _scrapFlag(false)
+{}
+
+template<typename T>
+bool StreamMapping<T>::onLanes()
+{
+  return false;
+}
+
+/**
+* @brief  Reset the input driver registers at the beginning of a pass (one filter, one input channel)
+*
+* @tparam T Type of input and output data
+*
+* @param  channel is the input channel streamed
+* @param  tile is the tile of the filter, always 0 when streamed
+* @param  band is the band of output rows, always 0 when streamed
+*/
+template<typename T>
+void StreamMapping<T>::initInputPass(int channel, int tile, int band)
+{
+  _inWI = 0;
+  _inHI = 0;
+  _inDI = channel;
+  _padCounter = this->_layerHParam.padding;
+  _rowEndFlag = false;
+}
+
+/**
+* @brief  Reset the output driver registers at the beginning of a pass
+*
+* @tparam T Type of input and output data
+*
+* @param  band is the band of output rows, always 0 when streamed
+*/
+template<typename T>
+void StreamMapping<T>::initOutputPass(int band)
+{
+  _outWI = 0;
+  _outHI = 0;
+  _scrapCounter = 0;
+  _scrapFlag = false;
+}
+
+/**
+* @brief  Input driver. Walk the padded input channel of the input pass.
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the input pass
+* @param  input is set to the input to load
+*
+* @return true if an input is loaded, false to load a zero
+*/
+template<typename T>
+bool StreamMapping<T>::inputLogic(int step, T& input)
+{
+  const LayerHParam& p = this->_layerHParam;
+  const PassTiming& timing = this->_geometry.timing;
+  if(step < timing.inputSteps && step >= timing.topPaddingSteps) // else load zeros
+  {
+    if(_padCounter > 0 && !_rowEndFlag)
+    {
+      _padCounter--;
+    }
+    else if(_padCounter < p.padding && _rowEndFlag)
+    {
+      _padCounter++;
+      if(_padCounter == p.padding){_rowEndFlag = false;}
+    }
+    else
+    {
+      input = this->_inputs(_inDI, _inHI, _inWI);
+      this->_events.bufferReads++;
+
+      // Increment input data indexes
+      if(_inWI == p.inputWidth - 1)
+      {
+        _inWI = 0;
+        _inHI++;
+        _rowEndFlag = true;
+      }
+      else
+      {
+        _inWI++;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* @brief  Output driver. Take the valid windows of the output pass and scrap the others.
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the output pass
+* @param  saveHI is set to the output row to save
+* @param  saveWI is set to the output column to save
+*
+* @return true if the CE output is to be saved
+*/
+template<typename T>
+bool StreamMapping<T>::outputLogic(int step, int& saveHI, int& saveWI)
+{
+  const PassGeometry& geometry = this->_geometry;
+  if(step >= geometry.timing.outputSteps && _outHI < geometry.outputHeight)
+  {
+    if(!_scrapFlag) // The good stuff ;)
+    {
+      saveHI = _outHI;
+      saveWI = _outWI;
+
+      // Next row
+      if(_outWI == geometry.outputWidth - 1)
+      {
+        _outWI = 0;
+        _outHI++;
+        // End of row logic. Scrap transition steps and next rows steps because stride > 1
+        if(geometry.timing.nextRowSteps > 0)
+        {
+          _scrapFlag = true;
+          _scrapCounter += geometry.timing.nextRowSteps;
+        }
+      }
+      else // Next column
+      {
+        _outWI++;
+        // Stride inside a row logic
+        if(this->_layerHParam.stride - 1 >= 1)
+        {
+          _scrapFlag = true;
+          _scrapCounter = this->_layerHParam.stride - 1;
+        }
+      }
+      return true;
+    }
+    else // Scrap, dont take that output..
+    {
+      _scrapCounter--;
+      if(_scrapCounter == 0){_scrapFlag = false;}
+    }
+  }
+  return false;
+}
+
+/**
+* @brief  Function used to know how many of the next steps the input driver load a zero: the
+*         padding, the zero inputs and the end of the stream. The driver is run ahead on a copy,
+*         the input buffer reads it count are rolled back.
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the next step of the input pass
+* @param  maxSteps is the number of steps to look ahead
+*
+* @return the number of steps loading a zero, from the next one
+*/
+template<typename T>
+int StreamMapping<T>::zeroInputSteps(int step, int maxSteps)
+{
+  StreamMapping<T> ahead(*this);
+  EventCounts events = this->_events;
+
+  int steps = 0;
+  T input = T(0);
+  while(steps < maxSteps && !(ahead.inputLogic(step + steps, input) && input != T(0)))
+  {
+    steps++;
+  }
+
+  this->_events = events;
+  return steps;
+}
+
+/**
+* @brief  Write the driver registers to a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void StreamMapping<T>::save(Snapshot& snap)
+{
+  snap.write(_inWI);
+  snap.write(_inHI);
+  snap.write(_inDI);
+  snap.write(_outWI);
+  snap.write(_outHI);
+  snap.write(_padCounter);
+  snap.write(_scrapCounter);
+  snap.write(_rowEndFlag);
+  snap.write(_scrapFlag);
+}
+
+/**
+* @brief  Read the driver registers from a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read
+*/
+template<typename T>
+void StreamMapping<T>::restore(Snapshot& snap)
+{
+  snap.read(_inWI);
+  snap.read(_inHI);
+  snap.read(_inDI);
+  snap.read(_outWI);
+  snap.read(_outHI);
+  snap.read(_padCounter);
+  snap.read(_scrapCounter);
+  snap.read(_rowEndFlag);
+  snap.read(_scrapFlag);
+}
+
+/**
+* @brief  LanesMapping object constructor
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+LanesMapping<T>::LanesMapping(const LayerHParam& layerHParam, const PassGeometry& geometry,
+                              const Tensor<T>& inputs, EventCounts& events) :
+    PassMapping<T>(layerHParam, geometry, inputs, events),
+    _inDI(0),
+    _tile(0),
+    _inBand(0),
+    _outBand(0)
+{}
+
+template<typename T>
+bool LanesMapping<T>::onLanes()
+{
+  return true;
+}
+
+/**
+* @brief  Set the channels, the tile and the band of the input pass
+*
+* @tparam T Type of input and output data
+*
+* @param  channel is the first input channel of the pass
+* @param  tile is the tile of the folded filter, 0 if the filter fit in the CE
+* @param  band is the band of output rows
+*/
+template<typename T>
+void LanesMapping<T>::initInputPass(int channel, int tile, int band)
+{
+  _inDI = channel;
+  _tile = tile;
+  _inBand = band;
+}
+
+/**
+* @brief  Set the band of the output pass
+*
+* @tparam T Type of input and output data
+*
+* @param  band is the band of output rows
+*/
+template<typename T>
+void LanesMapping<T>::initOutputPass(int band)
+{
+  _outBand = band;
+}
+
+/**
+* @brief  Last input channel of the group of the input pass, + 1
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+int LanesMapping<T>::groupEnd()
+{
+  int groupDepth = this->_layerHParam.inputDepth / this->_geometry.groups;
+  return (_inDI / groupDepth + 1) * groupDepth;
+}
+
+/**
+* @brief  Lanes input driver. Put the pixel or the windows of the next outputs of the pass on the
+*         lanes.
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the input pass
+* @param  lanes is set to the lanes inputs of every CE of a group, indexed like the CE PEs. It is
+*         only allocated when its shape change, then cleared in place.
+*
+* @return true if lanes are loaded, false to load zeros
+*/
+template<typename T>
+bool LanesMapping<T>::laneLogic(int step, std::vector< std::vector< std::vector<T> > >& lanes)
+{
+  int size = this->_geometry.ceSize, unroll = this->_geometry.unroll;
+  if(lanes.size() != unroll || lanes.front().size() != size)
+  {
+    lanes.assign(unroll, std::vector< std::vector<T> >(size, std::vector<T>(size, T(0))));
+  }
+  else
+  {
+    for(int u = 0; u < unroll; u++)
+    {
+      for(int i = 0; i < size; i++)
+      {
+        std::fill(lanes[u][i].begin(), lanes[u][i].end(), T(0));
+      }
+    }
+  }
+  int outHI = 0, outWI = 0;
+  if(step >= 1 && step < this->_geometry.timing.inputSteps && lanesPixel(_inBand, step - 1, outHI, outWI))
+  {
+    loadLanes(outHI, outWI, lanes);
+    return true;
+  }
+  return false;
+}
+
+/**
+* @brief  Lanes output driver. Every step of the lanes stream after the PE array latency is an
+*         output, but the refill steps of the window generator.
+*
+* @tparam T Type of input and output data
+*
+* @param  step is the step of the output pass
+* @param  saveHI is set to the output row to save
+* @param  saveWI is set to the output column to save
+*
+* @return true if the CE output is to be saved
+*/
+template<typename T>
+bool LanesMapping<T>::outputLogic(int step, int& saveHI, int& saveWI)
+{
+  int outputSteps = this->_geometry.timing.outputSteps;
+  return step >= outputSteps && lanesPixel(_outBand, step - outputSteps, saveHI, saveWI);
+}
+
+/**
+* @brief  Function used to know which outputs a step of the lanes stream of a pass compute. An
+*         output row start with the refill of the window, the last of its steps put the first
+*         windows on the lanes.
+*
+* @tparam T Type of input and output data
+*
+* @param  band is the band of the pass, it give the first output row
+* @param  step is the step of the lanes stream, from 0
+* @param  outHI is set to the output row
+* @param  outWI is set to the first output column
+*
+* @return false if the step is a refill step of the window generator, or past the last row
+*/
+template<typename T>
+bool LanesMapping<T>::lanesPixel(int band, int step, int& outHI, int& outWI)
+{
+  const PassGeometry& geometry = this->_geometry;
+  int stepsPerRow = (geometry.outputWidth + geometry.unroll - 1) / geometry.unroll;
+  int rowSteps = geometry.timing.rowStartSteps + (stepsPerRow - 1) * geometry.timing.columnSteps;
+  int rowStep = step % rowSteps - (geometry.timing.rowStartSteps - 1);
+  outHI = band * (geometry.bandRows > 0 ? geometry.bandRows : geometry.outputHeight) + step / rowSteps;
+  if(rowStep < 0 || rowStep % geometry.timing.columnSteps != 0 || outHI >= geometry.outputHeight)
+  {
+    return false;
+  }
+  outWI = rowStep / geometry.timing.columnSteps * geometry.unroll;
+  return true;
+}
+
+/**
+* @brief  Write the driver registers to a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void LanesMapping<T>::save(Snapshot& snap)
+{
+  snap.write(_inDI);
+  snap.write(_tile);
+  snap.write(_inBand);
+  snap.write(_outBand);
+}
+
+/**
+* @brief  Read the driver registers from a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read
+*/
+template<typename T>
+void LanesMapping<T>::restore(Snapshot& snap)
+{
+  snap.read(_inDI);
+  snap.read(_tile);
+  snap.read(_inBand);
+  snap.read(_outBand);
+}
+
+/**
+* @brief  PointwiseMapping object constructor
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+PointwiseMapping<T>::PointwiseMapping(const LayerHParam& layerHParam, const PassGeometry& geometry,
+                                      const Tensor<T>& inputs, EventCounts& events) :
+    LanesMapping<T>(layerHParam, geometry, inputs, events)
+{}
+
+/**
+* @brief  Put the input channels of the pass of a pixel on the lanes of the first CE of a group
+*
+* @tparam T Type of input and output data
+*
+* @param  outHI is the output row
+* @param  outWI is the output column
+* @param  lanes is set to the channels, indexed like the CE PEs
+*/
+template<typename T>
+void PointwiseMapping<T>::loadLanes(int outHI, int outWI, std::vector< std::vector< std::vector<T> > >& lanes)
+{
+  int size = this->_geometry.ceSize;
+  int row = outHI * this->_layerHParam.stride;
+  int col = outWI * this->_layerHParam.stride;
+  int groupEnd = this->groupEnd();
+  for(int k = 0; k < this->_geometry.lanes && this->_inDI + k < groupEnd; k++)
+  {
+    lanes[0][k / size][k % size] = this->_inputs(this->_inDI + k, row, col);
+    this->_events.bufferReads++;
+  }
+}
+
+/**
+* @brief  WindowMapping object constructor
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+WindowMapping<T>::WindowMapping(const LayerHParam& layerHParam, const PassGeometry& geometry,
+                                const Tensor<T>& inputs, EventCounts& events) :
+    LanesMapping<T>(layerHParam, geometry, inputs, events)
+{}
+
+/**
+* @brief  Window generator. Put the windows of the outputs (outHI, outWI) to (outHI, outWI + unroll
+*         - 1) of the pass channels on the lanes, the padding is zeros. With a folded filter the
+*         windows are cut to the tile of the pass, with the channel packing the windows of every
+*         channel of the pass are side by side. The windows of an output overlap in one wide
+*         window, only its pixels entering the generator are read from the input buffer, the ones
+*         shared with the wide window on the left or above are kept by the generator.
+*
+* @tparam T Type of input and output data
+*
+* @param  outHI is the output row
+* @param  outWI is the first output column
+* @param  lanes is set to the window of every output, indexed like the CE PEs. The outputs past
+*         the end of the row keep zeros.
+*/
+template<typename T>
+void WindowMapping<T>::loadLanes(int outHI, int outWI, std::vector< std::vector< std::vector<T> > >& lanes)
+{
+  const LayerHParam& p = this->_layerHParam;
+  int size = this->_geometry.ceSize, filterSize = p.filterSize, stride = p.stride;
+  int tileSide = (filterSize + size - 1) / size, perRow = std::max(1, size / filterSize);
+  int top = (this->_tile / tileSide) * size, left = (this->_tile % tileSide) * size;
+  int height = std::min(size, filterSize - top), tileWidth = std::min(size, filterSize - left);
+  int outputs = std::min(this->_geometry.unroll, this->_geometry.outputWidth - outWI);
+  int width = (outputs - 1) * stride + tileWidth;
+  int groupEnd = this->groupEnd();
+  for(int c = 0; c < this->_geometry.lanes && this->_inDI + c < groupEnd; c++)
+  {
+    int laneI = (c / perRow) * filterSize, laneJ = (c % perRow) * filterSize;
+    for(int i = 0; i < height; i++)
+    {
+      int row = outHI * stride + top + i - p.padding;
+      for(int j = 0; j < width; j++)
+      {
+        int col = outWI * stride + left + j - p.padding;
+        if(row >= 0 && row < p.inputHeight && col >= 0 && col < p.inputWidth)
+        {
+          T pixel = this->_inputs(this->_inDI + c, row, col);
+          for(int o = 0; o < outputs; o++)
+          {
+            if(j - o * stride >= 0 && j - o * stride < tileWidth)
+            {
+              lanes[o][laneI + i][laneJ + j - o * stride] = pixel;
+            }
+          }
+          if((outHI == 0 || i >= height - stride) && (outWI == 0 || j >= tileWidth - stride))
+          {
+            this->_events.bufferReads++;
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif //PASSMAPPING_HPP
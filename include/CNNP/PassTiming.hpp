@@ -0,0 +1,141 @@
+/**
+ *  @file    PassTiming.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Steps constants of a pass
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module derive the steps a Controller pass take from the datapath it run on: the CE
+ *  pipeline latency, the line buffer FIFO depth and the mapping of the layer on the CEs. The
+ *  Controller sequence its passes with these constants and the PerfModel add them up, so the
+ *  two only differ by what the simulation count on top (stalls, bubbles of the shadow bank).
+ *
+ *  Streamed, the padded image enter the FIFOs one pixel per step. A pixel is on the PE rows a
+ *  FIFO later, the sum of a window is in the output register a CE latency after its last pixel.
+ *  On the lanes (pointwise mode and window generator), a pixel or a window is on the PE rows from
+ *  step 1, the window generator taking the steps its read port need to refill a window.
+ */
+
+#ifndef PASSTIMING_HPP
+#define PASSTIMING_HPP
+
+#include <algorithm>
+#include "CNNP/HyperParams.hpp"
+
+/**
+* @brief  Function used to know the latency of a CE. The partial sums of a window cross the size
+*         PEs of the rows, then the size adders.
+*
+* @param  size is the size of the CE PE array
+*
+* @return the steps between the step a window is on the PE rows and the step its sum is in the
+*         output register
+*/
+inline int ceLatency(int size)
+{
+  return 2 * size - 1;
+}
+
+/// Datapath and mapping a pass run on
+struct PassDatapath
+{
+  int ceSize;              ///< Size of the CE PE arrays
+  int fifoSize;            ///< Words of a line buffer FIFO row
+  bool pointwise;          ///< The PE array is mapped across the input channels
+  bool windowed;           ///< The window generator feed the lanes
+  int unroll;              ///< Adjacent outputs of a filter computed together
+  int readColumns;         ///< Columns of every window row read per step, 0 for the columns of a step
+  int bandRows;            ///< Output rows of a pass, 0 for the whole layer
+};
+
+/// Steps constants of a pass, see Controller
+struct PassTiming
+{
+  int maxStep;             ///< Steps of a pass, from the first input to the last output
+  int topPaddingSteps;     ///< Steps of the top padding
+  int inputSteps;          ///< Steps to stream the input of a pass
+  int outputSteps;         ///< Steps before the first output
+  int nextRowSteps;        ///< Scrapped steps between two output rows
+  int framePeriod;         ///< Steps between two passes with the shadow weights
+  int swapStep;            ///< Input step of the next pass where the shadow bank is swapped
+  int rowStartSteps;       ///< Lanes steps of the first window of an output row, refilling the window
+  int columnSteps;         ///< Lanes steps of the next windows of the row
+};
+
+/**
+* @brief  Compute the steps constants of a pass
+*
+* @param  p is the layer, a fully connected layer normalized to a one pixel high 1x1 layer
+* @param  datapath is the CEs and the mapping of the layer
+*
+* @return the steps constants
+*/
+inline PassTiming passTiming(const LayerHParam& p, const PassDatapath& datapath)
+{
+  PassTiming timing;
+  int size = datapath.ceSize;
+  int latency = ceLatency(size);
+  int dilation = std::max(p.dilation, 1);
+  int extent = (p.filterSize - 1) * dilation + 1;
+  int outputWidth = (p.inputWidth - extent + 2 * p.padding) / p.stride + 1;
+  int outputHeight = (p.inputHeight - extent + 2 * p.padding) / p.stride + 1;
+  int bandRows = datapath.bandRows > 0 ? datapath.bandRows : outputHeight;
+
+  timing.rowStartSteps = 1;
+  timing.columnSteps = 1;
+  if(datapath.pointwise || datapath.windowed)
+  {
+    // The first window of a row is read whole, the next ones only their new columns. The lanes
+    // skew the columns, the last column of the last pixel and its bias leave the PE rows size
+    // steps later, the weights of the next pass are swapped after that.
+    if(datapath.windowed)
+    {
+      int tileWidth = std::min(size, p.filterSize);
+      int width = (std::min(datapath.unroll, outputWidth) - 1) * p.stride + tileWidth;
+      int newColumns = width - std::max(0, tileWidth - p.stride);
+      int columns = datapath.readColumns > 0 ? datapath.readColumns : newColumns;
+      timing.rowStartSteps = (width + columns - 1) / columns;
+      timing.columnSteps = (newColumns + columns - 1) / columns;
+    }
+    int stepsPerRow = (outputWidth + datapath.unroll - 1) / datapath.unroll;
+    int pixels = (timing.rowStartSteps + (stepsPerRow - 1) * timing.columnSteps) * bandRows;
+    timing.topPaddingSteps = 0;
+    timing.inputSteps = pixels + 1;
+    timing.outputSteps = 1 + latency;
+    timing.maxStep = pixels + latency + 1;
+    timing.nextRowSteps = 0;
+    timing.framePeriod = pixels + size;
+    timing.swapStep = 0;
+    return timing;
+  }
+
+  int width = p.inputWidth + 2 * p.padding;
+  int fifo = datapath.fifoSize;
+  int stream = (p.inputHeight + 2 * p.padding) * width;
+  int firstWindow = (extent - 1) * width + extent - 1;          // Last pixel of the first window
+  timing.topPaddingSteps = p.padding * width;
+  timing.inputSteps = (p.inputHeight + p.padding) * width;
+  timing.outputSteps = firstWindow + fifo + latency;
+  timing.maxStep = stream - 1 + fifo + latency + 1;               // Last pixel of the stream out
+
+  // After the last output of a row, the end of the row and the (stride - 1) next rows are scrap
+  timing.nextRowSteps = p.stride * width - (outputWidth - 1) * p.stride - 1;
+
+  // The next pass stream after the bottom padding. Its swap wait for the last pixel of the pass to
+  // cross the two registers of every PE of its row, and must be before its first window is on the
+  // PE rows. Narrow input or 1x1 filter, add bubbles between the passes.
+  timing.framePeriod = stream;
+  timing.swapStep = fifo - 1 + 2 * (size - 1) + 1;
+  int lastSwapStep = firstWindow + fifo - 1;
+  if(timing.swapStep > lastSwapStep)
+  {
+    timing.framePeriod += timing.swapStep - lastSwapStep;
+    timing.swapStep = lastSwapStep;
+  }
+  return timing;
+}
+
+#endif //PASSTIMING_HPP
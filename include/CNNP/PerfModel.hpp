@@ -0,0 +1,525 @@
+/**
+ *  @file    PerfModel.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Analytical performance model
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module compute the cycles, the PE utilization, the on-chip buffer accesses and the DRAM
+ *  traffic of a layer in closed form, without simulating it. The step constants of a pass come
+ *  from passTiming(), like the ones the Controller sequence, so the model and the cycle accurate
+ *  simulation agree.
+ *
+ *  Without the shadow weights every pass load its weights then drain the pipeline:
+ *    cycles = passes * (weightLoadSteps + maxStep)
+ *  With the shadow weights the passes are streamed one period apart, the period being long
+ *  enough to stream a pass and to write the next weights on the port:
+ *    cycles = weightLoadSteps + sum(period) + maxStep
+ *
+ *  Every weight and bias is read once from the DRAM and every output written once, the partial
+ *  outputs stay in the output buffer. The passes walk the blocks of filters of a group, then the
+ *  input channels of the group: the inputs of a group are read once if they fit in the input
+ *  buffer, else once per block. Compressed weights and activations are read and written as
+ *  their records instead, see CompressedTensor.
+ *
+ *  With the window generator a convolution pass only take one step per valid output, the windows
+ *  that straddle two rows and the padding are never streamed. With the spatial unroll P, the CEs
+ *  work in groups of P on one filter, a group compute P adjacent outputs per step: the blocks
+ *  hold nbOfCEs / P filters and a pass take ceil(outputWidth / P) steps per output row. The
+ *  throughput is bought with P times the PEs per filter, getResources() estimate the hardware.
+ *
+ *  The window generator read the input buffer through a port of a number of columns of every
+ *  window row per step. The first window of an output row, (P - 1) * stride + filterSize columns
+ *  wide, is refilled before it is on the lanes, the next ones only read their new columns:
+ *    row steps = ceil(width / columns) + (ceil(outputWidth / P) - 1) * ceil(new columns / columns)
+ *
+ *  The window generator fold a filter larger than the CE in ceil(filterSize / ceSize)^2 tiles,
+ *  one pass each. With the channel packing a filter smaller than the CE take (ceSize /
+ *  filterSize)^2 input channels per pass. Both change the chunks of a filter:
+ *    chunks = ceil(channels / lanes) * tiles
+ *
+ *  A dilated filter span (filterSize - 1) * dilation + 1 input pixels: the output size, the FIFO
+ *  fill-up and the first window of a pass follow that extent, the PE and adder steps the
+ *  filterSize.
+ */
+
+#ifndef PERFMODEL_HPP
+#define PERFMODEL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PassTiming.hpp"
+
+/// Hardware resources of a configuration, in PEs and words of storage
+struct Resources
+{
+  long pes;                ///< PEs of all the CEs
+  long outputRegisters;    ///< CE output registers, P per filter computed in parallel
+  long windowRegisters;    ///< Words of the window generator, shared by all the CEs
+  long windowReadWords;    ///< Words the window generator read from the input buffer per step
+  long lineBufferWords;    ///< Words of the FIFO rows of the line buffer shared by the CEs
+};
+
+/**
+ * @brief Performance model. Objects that compute the performance of a layer in closed form
+ */
+class PerfModel
+{
+  private:
+  LayerHParam _layerHParam;   ///< Layer, normalized like the Controller does for a fully connected layer
+  MemHParam _memHParam;
+  int _ceSize;
+  int _nbOfCEs;
+  int _groups;
+  bool _pointwise;
+  bool _windowed;
+  int _unroll;
+  bool _packing;
+  int _readColumns;
+  bool _shadowWeights;
+  long _compressedWeightWords;   ///< Words of the weight records, 0 for dense weights
+  long _compressedInputWords;    ///< Words of the input records, 0 for dense inputs
+  long _compressedOutputWords;   ///< Words of the output records, 0 for dense outputs
+
+  int filterExtent();
+  int readColumns();
+
+  public:
+  static const int weightLoadSteps = 2;   ///< Steps needed for the weights to reach the PEs
+
+  PerfModel(LayerHParam layerHParam, int ceSize, int nbOfCEs, MemHParam memHParam);
+  ~PerfModel();
+  void setShadowWeights(bool enable);
+  void setPointwise(bool enable);
+  void setWindowGenerator(bool enable);
+  void setSpatialUnroll(int factor);
+  void setChannelPacking(bool enable);
+  void setWindowReadPort(int columns);
+  void setCompressedWeights(long words);
+  void setCompressedActivations(long inputWords, long outputWords);
+  int outputWidth();
+  int outputHeight();
+  int getLanes();
+  int getTiles();
+  int getChunks();
+  int getBlocks();
+  long getPasses();
+  PassTiming getPassTiming();
+  long getCycles();
+  long getMacs();
+  double getUtilization();
+  long getWeightFetches();
+  long getInputReads();
+  long getOutputAccesses();
+  long getLineBufferWrites();
+  int getInputFetches();
+  long getDramBytes();
+  long getDramCycles();
+  Resources getResources();
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  PerfModel object constructor
+*
+* @param  layerHParam is the layer
+* @param  ceSize is the size of the CEs PE arrays
+* @param  nbOfCEs is the number of CEs, computing different filters of the same pass
+* @param  memHParam is the memory
+*/
+inline PerfModel::PerfModel(LayerHParam layerHParam, int ceSize, int nbOfCEs, MemHParam memHParam) :
+    _layerHParam(layerHParam),
+    _memHParam(memHParam),
+    _ceSize(ceSize),
+    _nbOfCEs(nbOfCEs),
+    _groups(layerHParam.groups > 0 ? layerHParam.groups : 1),
+    _pointwise(false),
+    _windowed(false),
+    _unroll(1),
+    _packing(false),
+    _readColumns(0),
+    _shadowWeights(false),
+    _compressedWeightWords(0),
+    _compressedInputWords(0),
+    _compressedOutputWords(0)
+{
+  if(_layerHParam.type == FULLY_CONNECTED)
+  {
+    // The batch is a one pixel high image, one input per channel
+    _layerHParam.inputHeight = 1;
+    _layerHParam.filterSize = 1;
+    _layerHParam.stride = 1;
+    _layerHParam.padding = 0;
+    _layerHParam.groups = 1;
+    _groups = 1;
+    _pointwise = true;
+  }
+  _layerHParam.dilation = std::max(_layerHParam.dilation, 1);
+  if(_layerHParam.stride == 0)
+  {
+    throw std::runtime_error("Stride cannot be 0");
+  }
+  if(nbOfCEs <= 0)
+  {
+    throw std::runtime_error("PerfModel need at least one CE");
+  }
+}
+
+inline PerfModel::~PerfModel()
+{}
+
+inline void PerfModel::setShadowWeights(bool enable)
+{
+  _shadowWeights = enable;
+}
+
+/**
+* @brief  Function used to map the PE array across the input channels of a 1x1 layer
+*
+* @param  enable is true to compute CE size^2 input channels per pass
+*/
+inline void PerfModel::setPointwise(bool enable)
+{
+  if(enable && _layerHParam.filterSize != 1)
+  {
+    throw std::runtime_error("Pointwise mode need a 1x1 filter");
+  }
+  _pointwise = enable || _layerHParam.type == FULLY_CONNECTED;
+}
+
+/**
+* @brief  Function used to feed the PE array with the whole window of every valid output, like
+*         Controller::setWindowGenerator()
+*
+* @param  enable is true to skip the row transitions and the padding steps
+*/
+inline void PerfModel::setWindowGenerator(bool enable)
+{
+  if(enable && (_pointwise || _layerHParam.dilation > 1))
+  {
+    throw std::runtime_error("Window generator need a convolution layer without dilation");
+  }
+  _windowed = enable;
+}
+
+/**
+* @brief  Function used to compute factor adjacent outputs of every filter together, like
+*         Controller::setSpatialUnroll()
+*
+* @param  factor is the number of outputs computed together by a group of CEs
+*/
+inline void PerfModel::setSpatialUnroll(int factor)
+{
+  if(factor < 1 || (factor > 1 && !_windowed) || _nbOfCEs % factor != 0)
+  {
+    throw std::runtime_error("Spatial unroll need the window generator and a multiple of the factor CEs");
+  }
+  _unroll = factor;
+}
+
+/**
+* @brief  Function used to put the windows of several input channels side by side on the PE
+*         array, like Controller::setChannelPacking()
+*
+* @param  enable is true to compute (ceSize / filterSize)^2 channels per pass
+*/
+inline void PerfModel::setChannelPacking(bool enable)
+{
+  if(enable && !_windowed)
+  {
+    throw std::runtime_error("Channel packing need the window generator");
+  }
+  _packing = enable;
+}
+
+/**
+* @brief  Function used to set the width of the window generator read port, like
+*         Controller::setWindowReadPort()
+*
+* @param  columns is the number of columns of every window row read per step, 0 for the columns
+*         entering the window on a step
+*/
+inline void PerfModel::setWindowReadPort(int columns)
+{
+  if(columns < 0 || (columns > 0 && !_windowed))
+  {
+    throw std::runtime_error("Window read port need the window generator and a positive width");
+  }
+  _readColumns = columns;
+}
+
+/**
+* @brief  Function used to know the columns of every window row the window generator read per step
+*/
+inline int PerfModel::readColumns()
+{
+  int tileWidth = std::min(_ceSize, _layerHParam.filterSize);
+  int width = (std::min(_unroll, outputWidth()) - 1) * _layerHParam.stride + tileWidth;
+  return _readColumns > 0 ? _readColumns : width - std::max(0, tileWidth - _layerHParam.stride);
+}
+
+/**
+* @brief  Function used to read the weights compressed from the DRAM
+*
+* @param  words is the words of the records (CompressedTensor::getWords()), 0 for dense weights
+*/
+inline void PerfModel::setCompressedWeights(long words)
+{
+  _compressedWeightWords = words;
+}
+
+/**
+* @brief  Function used to read the inputs and write the outputs compressed, like the activations
+*         between two layers
+*
+* @param  inputWords is the words of the input records, 0 for dense inputs
+* @param  outputWords is the words of the output records, 0 for dense outputs
+*/
+inline void PerfModel::setCompressedActivations(long inputWords, long outputWords)
+{
+  _compressedInputWords = inputWords;
+  _compressedOutputWords = outputWords;
+}
+
+/**
+* @brief  Function used to know how many input channels a pass compute
+*
+* @return ceSize^2 in pointwise mode, (ceSize / filterSize)^2 with the channel packing, else 1
+*/
+inline int PerfModel::getLanes()
+{
+  if(_pointwise)
+  {
+    return _ceSize * _ceSize;
+  }
+  int perRow = _ceSize / _layerHParam.filterSize;
+  return (_packing && perRow > 1) ? perRow * perRow : 1;
+}
+
+/**
+* @brief  Function used to know how many passes fold a filter larger than the CE on one channel
+*
+* @return the number of tiles of ceSize^2 weights, 1 if the filter fit in the CE
+*/
+inline int PerfModel::getTiles()
+{
+  int tileSide = (_layerHParam.filterSize + _ceSize - 1) / _ceSize;
+  return _windowed ? tileSide * tileSide : 1;
+}
+
+inline int PerfModel::filterExtent()
+{
+  return (_layerHParam.filterSize - 1) * _layerHParam.dilation + 1;
+}
+
+inline int PerfModel::outputWidth()
+{
+  return (_layerHParam.inputWidth - filterExtent() + 2 * _layerHParam.padding) / _layerHParam.stride + 1;
+}
+
+inline int PerfModel::outputHeight()
+{
+  return (_layerHParam.inputHeight - filterExtent() + 2 * _layerHParam.padding) / _layerHParam.stride + 1;
+}
+
+/**
+* @brief  Function used to know how many passes compute a filter
+*
+* @return the number of chunks of input channels of a group, times the tiles of the filter
+*/
+inline int PerfModel::getChunks()
+{
+  return (_layerHParam.inputDepth / _groups + getLanes() - 1) / getLanes() * getTiles();
+}
+
+/**
+* @brief  Function used to know how many blocks of filters, one filter per group of CEs, a group
+*         of filters has
+*
+* @return the number of blocks
+*/
+inline int PerfModel::getBlocks()
+{
+  int filters = _nbOfCEs / _unroll;
+  return (_layerHParam.nbOfFilter / _groups + filters - 1) / filters;
+}
+
+inline long PerfModel::getPasses()
+{
+  return (long)_groups * getBlocks() * getChunks();
+}
+
+/**
+* @brief  Compute the steps constants of a pass
+*
+* @return the steps constants
+*/
+inline PassTiming PerfModel::getPassTiming()
+{
+  // The streamed windows line up when a FIFO row hold a padded input row
+  int fifoSize = _layerHParam.inputWidth + 2 * _layerHParam.padding;
+  return passTiming(_layerHParam, PassDatapath{_ceSize, fifoSize, _pointwise, _windowed, _unroll, _readColumns, 0});
+}
+
+/**
+* @brief  Function used to know how many cycles the layer take
+*
+* @return the number of cycles
+*/
+inline long PerfModel::getCycles()
+{
+  PassTiming timing = getPassTiming();
+  long passes = getPasses();
+  if(!_shadowWeights)
+  {
+    return passes * (weightLoadSteps + timing.maxStep);
+  }
+
+  // The next weights and bias are written on the port from the start of the first pass, then
+  // from the swap of every pass. The next pass wait for the shadow bank to be ready.
+  long portSteps = _ceSize * _ceSize + 1;
+  long firstPeriod = std::max<long>(timing.framePeriod, portSteps);
+  long period = std::max<long>(timing.framePeriod, timing.swapStep + 1 + portSteps);
+  long cycles = weightLoadSteps + timing.maxStep;
+  if(passes > 1)
+  {
+    cycles += firstPeriod + (passes - 2) * period;
+  }
+  return cycles;
+}
+
+/**
+* @brief  Function used to know how many useful MACs the layer need
+*
+* @return the number of MACs
+*/
+inline long PerfModel::getMacs()
+{
+  return (long)_layerHParam.nbOfFilter * outputHeight() * outputWidth()
+         * _layerHParam.filterSize * _layerHParam.filterSize * (_layerHParam.inputDepth / _groups);
+}
+
+/**
+* @brief  Function used to know the fraction of the PEs doing useful MACs
+*
+* @return the PE utilization, between 0 and 1
+*/
+inline double PerfModel::getUtilization()
+{
+  return double(getMacs()) / (double(getCycles()) * _ceSize * _ceSize * _nbOfCEs);
+}
+
+/**
+* @brief  Function used to know how many weights words are sent to the CEs. Every busy CE of a
+*         pass receive a full PE array of weights.
+*
+* @return the number of weight words
+*/
+inline long PerfModel::getWeightFetches()
+{
+  return (long)getChunks() * _layerHParam.nbOfFilter * _ceSize * _ceSize;
+}
+
+/**
+* @brief  Function used to know how many words are read from the input buffer. Every pass read
+*         its input channels, padding excluded, once for all the CEs.
+*
+* @return the number of input buffer reads
+*/
+inline long PerfModel::getInputReads()
+{
+  long pixels = _pointwise ? (long)outputHeight() * outputWidth()
+                           : (long)_layerHParam.inputHeight * _layerHParam.inputWidth;
+  return (long)getBlocks() * _layerHParam.inputDepth * pixels;
+}
+
+/**
+* @brief  Function used to know how many words are read and written in the output buffer. Every
+*         busy CE of a pass accumulate its partial outputs.
+*
+* @return the number of output buffer accesses
+*/
+inline long PerfModel::getOutputAccesses()
+{
+  return 2L * getChunks() * _layerHParam.nbOfFilter * outputHeight() * outputWidth();
+}
+
+/**
+* @brief  Function used to know how many inputs are written in the line buffers. The CEs share
+*         one line buffer, written every cycle.
+*
+* @return the number of line buffer writes
+*/
+inline long PerfModel::getLineBufferWrites()
+{
+  return getCycles();
+}
+
+/**
+* @brief  Function used to know how many times the inputs are read from the DRAM
+*
+* @return 1 if the inputs of a group fit in the input buffer, else the number of blocks
+*/
+inline int PerfModel::getInputFetches()
+{
+  long groupWords = (long)(_layerHParam.inputDepth / _groups) * _layerHParam.inputHeight * _layerHParam.inputWidth;
+  return (_memHParam.inputBufferWords == 0 || groupWords <= _memHParam.inputBufferWords) ? 1 : getBlocks();
+}
+
+/**
+* @brief  Function used to know how many bytes move between the DRAM and the layer buffers
+*
+* @return the number of DRAM bytes
+*/
+inline long PerfModel::getDramBytes()
+{
+  const LayerHParam& p = _layerHParam;
+  long weights = (long)p.nbOfFilter * (p.inputDepth / _groups) * p.filterSize * p.filterSize;
+  long inputs = _compressedInputWords > 0 ? _compressedInputWords : (long)p.inputDepth * p.inputHeight * p.inputWidth;
+  long outputs = _compressedOutputWords > 0 ? _compressedOutputWords : (long)p.nbOfFilter * outputHeight() * outputWidth();
+  long words =   inputs * getInputFetches()                                            // Inputs
+               + (_compressedWeightWords > 0 ? _compressedWeightWords : weights)        // Weights
+               + p.nbOfFilter                                                          // Bias
+               + outputs;                                                              // Outputs
+  return words * _memHParam.wordBytes;
+}
+
+/**
+* @brief  Function used to know how many cycles the DRAM traffic take at the DRAM bandwidth
+*
+* @return the number of DRAM cycles
+*/
+inline long PerfModel::getDramCycles()
+{
+  if(_memHParam.dramBytesPerCycle <= 0)
+  {
+    throw std::runtime_error("DRAM bandwidth must be positive");
+  }
+  return (long)std::ceil(getDramBytes() / _memHParam.dramBytesPerCycle);
+}
+
+/**
+* @brief  Function used to estimate the hardware of the configuration
+*
+* @return the resources
+*/
+inline Resources PerfModel::getResources()
+{
+  const LayerHParam& p = _layerHParam;
+  Resources resources;
+  resources.pes = (long)_nbOfCEs * _ceSize * _ceSize;
+  resources.outputRegisters = _nbOfCEs;
+  resources.windowRegisters = _windowed ? (long)p.filterSize * ((_unroll - 1) * p.stride + p.filterSize) : 0;
+  resources.windowReadWords = _windowed ? (long)getLanes() * std::min(_ceSize, p.filterSize) * readColumns() : 0;
+  int rows = (_ceSize - 1) * p.dilation + 1;
+  resources.lineBufferWords = _pointwise ? 0 : (long)rows * (p.inputWidth + 2 * p.padding);
+  return resources;
+}
+
+#endif //PERFMODEL_HPP
@@ -0,0 +1,203 @@
+/**
+ *  @file    Program.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Instruction stream of the microcoded controller
+ *
+ *  @section DESCRIPTION
+ *
+ *  A program is the layers of a network, with their weights, and the instructions computing them
+ *  tile by tile. A tile is a block of filters of a layer over a range of its input channels:
+ *
+ *  LOAD_TILE     load the input channels [channel, channel + channels) of the layer in the tile buffer
+ *  LOAD_WEIGHTS  load the weights of the filter block over these channels, and the bias
+ *  CONV          compute the partial outputs of the filter block on the loaded tile
+ *  ACCUMULATE    add the partial outputs to the accumulators of the filter block
+ *  ACTIVATE      apply the ReLU to the complete outputs of the filter block
+ *  POOL          max pool the outputs of the filter block
+ *  STORE         store the outputs of the filter block, the input of the next layer
+ *  SYNC          wait for every load, compute and store in flight
+ *
+ *  An instruction is encoded in a 64 bits word: the opcode on 4 bits, the layer on 8 bits and
+ *  the filter and channel fields on 13 bits each.
+ */
+
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "HyperParams.hpp"
+#include "Tensor.hpp"
+
+/// Operations of the microcoded controller
+enum Opcode
+{
+  LOAD_TILE = 0,
+  LOAD_WEIGHTS,
+  CONV,
+  ACCUMULATE,
+  ACTIVATE,
+  POOL,
+  STORE,
+  SYNC,
+  NB_OF_OPCODES
+};
+
+/// Mnemonic of an opcode
+inline const char* opcodeName(Opcode opcode)
+{
+  static const char* names[NB_OF_OPCODES] = {"LOAD_TILE", "LOAD_WEIGHTS", "CONV", "ACCUMULATE", "ACTIVATE",
+                                             "POOL", "STORE", "SYNC"};
+  return names[opcode];
+}
+
+/// An instruction, the fields an opcode does not use are 0
+struct Instruction
+{
+  Opcode opcode;
+  int layer;        ///< Layer of the program
+  int filter;       ///< First filter of the block
+  int filters;      ///< Filters of the block
+  int channel;      ///< First input channel of the tile
+  int channels;     ///< Input channels of the tile
+
+  static const int layerBits = 8;
+  static const int fieldBits = 13;
+
+  /// Instruction packed in a word
+  uint64_t encode() const
+  {
+    int fields[4] = {filter, filters, channel, channels};
+    if(layer < 0 || layer >= (1 << layerBits))
+    {
+      throw std::logic_error("The layer does not fit the instruction");
+    }
+    uint64_t word = ((uint64_t)opcode << layerBits) | (uint64_t)layer;
+    for(int i = 0; i < 4; i++)
+    {
+      if(fields[i] < 0 || fields[i] >= (1 << fieldBits))
+      {
+        throw std::logic_error("A filter or channel field does not fit the instruction");
+      }
+      word = (word << fieldBits) | (uint64_t)fields[i];
+    }
+    return word;
+  }
+
+  /// Instruction of a packed word
+  static Instruction decode(uint64_t word)
+  {
+    int fields[4];
+    uint64_t mask = (1 << fieldBits) - 1;
+    for(int i = 3; i >= 0; i--)
+    {
+      fields[i] = (int)(word & mask);
+      word >>= fieldBits;
+    }
+    int layer = (int)(word & ((1 << layerBits) - 1));
+    return Instruction{(Opcode)(word >> layerBits), layer, fields[0], fields[1], fields[2], fields[3]};
+  }
+
+  bool operator==(const Instruction& other) const
+  {
+    return opcode == other.opcode && layer == other.layer && filter == other.filter && filters == other.filters
+           && channel == other.channel && channels == other.channels;
+  }
+};
+
+/// A convolution layer of a program, the batch norm folded in its weights and bias
+template <typename T>
+struct ProgramLayer
+{
+  LayerHParam layerHParam;
+  Tensor<T> weights;    ///< Indexed [filter][depth / groups][row][column]
+  Tensor<T> bias;       ///< Indexed [filter]
+  bool relu;            ///< The ReLU is fused, applied before the store
+  int poolSize;         ///< The max pooling is fused, 0 without pooling
+  int poolStride;
+
+  int outputWidth() const
+  {
+    const LayerHParam& p = layerHParam;
+    int extent = (p.filterSize - 1) * (p.dilation > 1 ? p.dilation : 1) + 1;
+    return (p.inputWidth - extent + 2 * p.padding) / p.stride + 1;
+  }
+
+  int outputHeight() const
+  {
+    const LayerHParam& p = layerHParam;
+    int extent = (p.filterSize - 1) * (p.dilation > 1 ? p.dilation : 1) + 1;
+    return (p.inputHeight - extent + 2 * p.padding) / p.stride + 1;
+  }
+
+  /// Width of the stored outputs, pooled or not
+  int storedWidth() const
+  {
+    return poolSize > 0 ? (outputWidth() - poolSize) / poolStride + 1 : outputWidth();
+  }
+
+  int storedHeight() const
+  {
+    return poolSize > 0 ? (outputHeight() - poolSize) / poolStride + 1 : outputHeight();
+  }
+};
+
+/// The layers of a network and the instructions computing them
+template <typename T>
+struct Program
+{
+  std::vector< ProgramLayer<T> > layers;
+  std::vector<Instruction> instructions;
+
+  /// The instructions packed, one word each
+  std::vector<uint64_t> encode() const
+  {
+    std::vector<uint64_t> words(instructions.size());
+    for(int i = 0; i < instructions.size(); i++)
+    {
+      words[i] = instructions[i].encode();
+    }
+    return words;
+  }
+
+  /// Number of instructions of an opcode
+  int count(Opcode opcode) const
+  {
+    int n = 0;
+    for(int i = 0; i < instructions.size(); i++)
+    {
+      n += instructions[i].opcode == opcode;
+    }
+    return n;
+  }
+
+  /// Listing of the instructions, one per line
+  void write(std::ostream& os) const
+  {
+    for(int i = 0; i < instructions.size(); i++)
+    {
+      const Instruction& in = instructions[i];
+      os << i << ": " << opcodeName(in.opcode);
+      if(in.opcode != SYNC)
+      {
+        os << " layer " << in.layer;
+      }
+      if(in.opcode != SYNC && in.opcode != LOAD_TILE)
+      {
+        os << " filters " << in.filter << "+" << in.filters;
+      }
+      if(in.opcode == LOAD_TILE || in.opcode == LOAD_WEIGHTS || in.opcode == CONV)
+      {
+        os << " channels " << in.channel << "+" << in.channels;
+      }
+      os << "\n";
+    }
+  }
+};
+
+#endif //PROGRAM_HPP
@@ -0,0 +1,141 @@
+/**
+ *  @file    RangeProfile.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Value range and saturation profiling of the datapath
+ *
+ *  @section DESCRIPTION
+ *
+ *  The CE record every value written in the PE outputs (reg2), the synchronization registers, the
+ *  row adders and the output register, the controller the outputs accumulated between the chunks.
+ *  The PE outputs, synchronization registers and adders are in the accumulator type
+ *  (NumericTraits<T>::acc_type), the output register and the accumulated outputs in T.
+ *  For every point the min and max values and the number of saturations are kept. For the types
+ *  that clamp an overflow (NumericTraits<T>::saturates(), Fi::Saturate and the raw words), a value
+ *  on a rail of the type (minValue() or maxValue()) is counted as a saturation. A zero is not, it
+ *  is the lower rail of the unsigned types but also the value of every idle register. A wrapping
+ *  or throwing type and the floats never saturate.
+ *
+ *  The rows and steps skipped by the activity tracking are recorded too, in bulk, with the values
+ *  they hold, so the profile is the same with and without the tracking. The min and max tell how
+ *  many integer bits of TBIT each point use.
+ *
+ *  The profiling cost a compare per value. Compile with CNNP_RANGE_PROFILE=0 to remove it, the
+ *  profiles then stay empty.
+ */
+
+#ifndef RANGEPROFILE_HPP
+#define RANGEPROFILE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "NumericTraits.hpp"
+
+#ifndef CNNP_RANGE_PROFILE
+#define CNNP_RANGE_PROFILE 1
+#endif
+
+/// Range of the values written in one point of the datapath
+template <typename T>
+struct RangeStats
+{
+  long samples;          ///< Values recorded
+  long saturations;      ///< Values on a rail of the type
+  T min;
+  T max;
+
+  RangeStats() :
+      samples(0),
+      saturations(0),
+      min(T(0)),
+      max(T(0))
+  {}
+
+  void record(T value)
+  {
+    record(value, 1);
+  }
+
+  /// Record the same value count times, for the steps skipped in bulk
+  void record(T value, long count)
+  {
+#if CNNP_RANGE_PROFILE
+    if(count <= 0){return;}
+    if(samples == 0 || value < min){min = value;}
+    if(samples == 0 || value > max){max = value;}
+    if(NumericTraits<T>::saturates() && value != NumericTraits<T>::zero()
+       && (value == NumericTraits<T>::maxValue() || value == NumericTraits<T>::minValue()))
+    {
+      saturations += count;
+    }
+    samples += count;
+#endif
+  }
+
+  RangeStats& operator+=(const RangeStats& other)
+  {
+    if(other.samples == 0){return *this;}
+    if(samples == 0 || other.min < min){min = other.min;}
+    if(samples == 0 || other.max > max){max = other.max;}
+    samples += other.samples;
+    saturations += other.saturations;
+    return *this;
+  }
+};
+
+/// Ranges of the points of the datapath of a layer
+template <typename T>
+struct RangeProfile
+{
+  typedef typename NumericTraits<T>::acc_type acc_type;
+
+  RangeStats<acc_type> peOutputs;   ///< PE reg2, the partial sums along a row, in the accumulator type
+  RangeStats<acc_type> syncRegs;    ///< Synchronization registers between the rows
+  RangeStats<acc_type> adders;      ///< Row adders results
+  RangeStats<T> outputs;        ///< CE output register, saturated to T
+  RangeStats<T> accumulators;   ///< Outputs accumulated by the controller between the chunks
+
+  RangeProfile& operator+=(const RangeProfile& other)
+  {
+    peOutputs += other.peOutputs;
+    syncRegs += other.syncRegs;
+    adders += other.adders;
+    outputs += other.outputs;
+    accumulators += other.accumulators;
+    return *this;
+  }
+
+  long saturations() const
+  {
+    return peOutputs.saturations + syncRegs.saturations + adders.saturations + outputs.saturations
+           + accumulators.saturations;
+  }
+
+  /// One line per point: layer, point, samples, saturations, min, max
+  void write(std::ostream& os, const std::string& layer) const
+  {
+    writeStats(os, layer, "pe", peOutputs);
+    writeStats(os, layer, "sync", syncRegs);
+    writeStats(os, layer, "adder", adders);
+    writeStats(os, layer, "output", outputs);
+    writeStats(os, layer, "accumulator", accumulators);
+  }
+
+  template <typename V>
+  static void writeStats(std::ostream& os, const std::string& layer, const std::string& point,
+                         const RangeStats<V>& stats)
+  {
+    os << layer << "," << point << "," << stats.samples << "," << stats.saturations << ","
+       << printable(stats.min) << "," << printable(stats.max) << "\n";
+  }
+
+  /// The int8_t words are printed as numbers, not characters
+  template <typename V>
+  static const V& printable(const V& value){return value;}
+  static int printable(int8_t value){return value;}
+};
+
+#endif //RANGEPROFILE_HPP
@@ -0,0 +1,245 @@
+/**
+ *  @file    Roofline.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Roofline report
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module place the layers of a network against the roofline of the processor. The roof
+ *  is the peak compute (PEs * clock MACs/s) and the DRAM bandwidth (bytes/s):
+ *    attainable = min(peak, intensity * bandwidth)
+ *  where the arithmetic intensity of a layer is its MACs per DRAM byte, from the performance
+ *  model under the chosen tiling. The simulated throughput is the layer MACs over the simulated
+ *  cycles, or the DRAM cycles if longer (the DRAM transfers overlap the computation). The DRAM
+ *  cycles are the busy cycles of the DmaEngine that fetched the layer in the simulation, or the
+ *  model estimate when the layer was simulated from the buffers.
+ *
+ *  The report is a CSV table and an ASCII log-log chart.
+ */
+
+#ifndef ROOFLINE_HPP
+#define ROOFLINE_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+
+/// A layer on the roofline
+struct RooflinePoint
+{
+  std::string name;
+  long macs;               ///< Useful MACs of the layer
+  long dramBytes;          ///< DRAM bytes of the layer
+  long cycles;             ///< Simulated cycles
+  long dramCycles;         ///< Cycles of the DRAM transfers, simulated or from the model
+  double intensity;        ///< MACs per DRAM byte
+  double attainable;       ///< Roofline throughput at the intensity, in MACs/s
+  double simulated;        ///< Simulated throughput, in MACs/s
+  bool memoryBound;        ///< The intensity is left of the ridge point
+};
+
+/**
+ * @brief Roofline. Objects that place layers against the compute and bandwidth roofs
+ */
+class Roofline
+{
+  private:
+  int _nbOfPEs;            ///< PEs of all the CEs
+  MemHParam _memHParam;
+  double _clockMHz;
+  std::vector<RooflinePoint> _layers;
+
+  public:
+  Roofline(int nbOfPEs, MemHParam memHParam, double clockMHz);
+  ~Roofline();
+  double getPeak();
+  double getBandwidth();
+  double getRidge();
+  void addLayer(const std::string& name, PerfModel& model, long cycles, long dmaCycles = -1);
+  const std::vector<RooflinePoint>& getLayers();
+  void writeCsv(std::ostream& os);
+  void writeChart(std::ostream& os, int width = 64, int height = 20);
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  Roofline object constructor
+*
+* @param  nbOfPEs is the number of PEs of all the CEs
+* @param  memHParam is the memory, its bandwidth is in bytes per cycle
+* @param  clockMHz is the clock frequency
+*/
+inline Roofline::Roofline(int nbOfPEs, MemHParam memHParam, double clockMHz) :
+    _nbOfPEs(nbOfPEs),
+    _memHParam(memHParam),
+    _clockMHz(clockMHz)
+{
+  if(nbOfPEs <= 0 || memHParam.dramBytesPerCycle <= 0 || clockMHz <= 0)
+  {
+    throw std::runtime_error("Roofline need PEs, a DRAM bandwidth and a clock");
+  }
+}
+
+inline Roofline::~Roofline()
+{}
+
+/**
+* @brief  Function used to know the peak compute throughput
+*
+* @return the peak in MACs/s
+*/
+inline double Roofline::getPeak()
+{
+  return _nbOfPEs * _clockMHz * 1e6;
+}
+
+/**
+* @brief  Function used to know the DRAM bandwidth
+*
+* @return the bandwidth in bytes/s
+*/
+inline double Roofline::getBandwidth()
+{
+  return _memHParam.dramBytesPerCycle * _clockMHz * 1e6;
+}
+
+/**
+* @brief  Function used to know the intensity where the layers stop being memory bound
+*
+* @return the ridge point in MACs/byte
+*/
+inline double Roofline::getRidge()
+{
+  return getPeak() / getBandwidth();
+}
+
+/**
+* @brief  Add a layer to the report
+*
+* @param  name is the layer name
+* @param  model is the layer performance model, with the memory of the roofline
+* @param  cycles is the simulated cycles of the layer, or -1 to take the model cycles
+* @param  dmaCycles is the busy cycles of the DMA engine of the simulation, or -1 to take the model
+*         DRAM cycles
+*/
+inline void Roofline::addLayer(const std::string& name, PerfModel& model, long cycles, long dmaCycles)
+{
+  RooflinePoint point;
+  point.name = name;
+  point.macs = model.getMacs();
+  point.dramBytes = model.getDramBytes();
+  point.cycles = (cycles >= 0) ? cycles : model.getCycles();
+  point.dramCycles = (dmaCycles >= 0) ? dmaCycles : model.getDramCycles();
+  point.intensity = double(point.macs) / point.dramBytes;
+  point.attainable = std::min(getPeak(), point.intensity * getBandwidth());
+  point.simulated = point.macs * _clockMHz * 1e6 / std::max(point.cycles, point.dramCycles);
+  point.memoryBound = point.intensity < getRidge();
+  _layers.push_back(point);
+}
+
+inline const std::vector<RooflinePoint>& Roofline::getLayers()
+{
+  return _layers;
+}
+
+/**
+* @brief  Write the layers as CSV, one line per layer. Throughputs are in GMAC/s.
+*
+* @param  os is the stream written
+*/
+inline void Roofline::writeCsv(std::ostream& os)
+{
+  char line[256];
+  os << "layer,macs,dram_bytes,intensity,cycles,dram_cycles,attainable_gmacs,simulated_gmacs,bound\n";
+  for(int i = 0; i < _layers.size(); i++)
+  {
+    const RooflinePoint& p = _layers[i];
+    std::snprintf(line, sizeof(line), ",%ld,%ld,%.4f,%ld,%ld,%.4f,%.4f,%s\n", p.macs, p.dramBytes,
+                  p.intensity, p.cycles, p.dramCycles, p.attainable / 1e9, p.simulated / 1e9,
+                  p.memoryBound ? "memory" : "compute");
+    os << p.name << line;
+  }
+}
+
+/**
+* @brief  Write a log-log chart of the roofline, throughput against intensity. The roof is drawn
+*         with '/' under the ridge point and '-' above it, every layer is marked with its index
+*         (1 to 9, then A to Z) at its simulated throughput.
+*
+* @param  os is the stream written
+* @param  width is the number of columns of the plot
+* @param  height is the number of rows of the plot
+*/
+inline void Roofline::writeChart(std::ostream& os, int width, int height)
+{
+  // Axes ranges, a quarter of a decade around the ridge point and the layers
+  double minX = getRidge(), maxX = getRidge(), minY = getPeak(), maxY = getPeak();
+  for(int i = 0; i < _layers.size(); i++)
+  {
+    minX = std::min(minX, _layers[i].intensity);
+    maxX = std::max(maxX, _layers[i].intensity);
+    minY = std::min(minY, std::min(_layers[i].simulated, _layers[i].attainable));
+  }
+  double x0 = std::log10(minX) - 0.25, x1 = std::log10(maxX) + 0.25;
+  double y0 = std::log10(minY) - 0.25, y1 = std::log10(maxY) + 0.25;
+
+  std::vector<std::string> plot(height, std::string(width, ' '));
+  for(int col = 0; col < width; col++)
+  {
+    double x = std::pow(10.0, x0 + (x1 - x0) * (col + 0.5) / width);
+    double roof = std::min(getPeak(), x * getBandwidth());
+    int row = (int)((std::log10(roof) - y0) / (y1 - y0) * height);
+    if(row >= 0 && row < height)
+    {
+      plot[height - 1 - row][col] = (x < getRidge()) ? '/' : '-';
+    }
+  }
+  for(int i = 0; i < _layers.size(); i++)
+  {
+    int col = (int)((std::log10(_layers[i].intensity) - x0) / (x1 - x0) * width);
+    int row = (int)((std::log10(_layers[i].simulated) - y0) / (y1 - y0) * height);
+    col = std::max(0, std::min(width - 1, col));
+    row = std::max(0, std::min(height - 1, row));
+    // Layers on the same spot are put side by side
+    while(col < width - 1 && std::isalnum(plot[height - 1 - row][col])){col++;}
+    plot[height - 1 - row][col] = (i < 9) ? char('1' + i) : char('A' + (i - 9) % 26);
+  }
+
+  char label[128];
+  os << "GMAC/s (log)\n";
+  for(int row = 0; row < height; row++)
+  {
+    // Only the top and bottom rows are labeled
+    double y = std::pow(10.0, y1 - (y1 - y0) * (row + 0.5) / height);
+    std::snprintf(label, sizeof(label), "%10.3g |", y / 1e9);
+    os << ((row == 0 || row == height - 1) ? label : "           |") << plot[row] << "\n";
+  }
+  os << "           +" << std::string(width, '-') << "\n";
+  std::snprintf(label, sizeof(label), "%.3g", std::pow(10.0, x0));
+  std::string left(label);
+  std::snprintf(label, sizeof(label), "%.3g MAC/byte (log)", std::pow(10.0, x1));
+  std::string right(label);
+  os << "            " << left << std::string(std::max<int>(1, width - left.size() - right.size()), ' ') << right << "\n";
+  std::snprintf(label, sizeof(label), "Peak %.3g GMAC/s, bandwidth %.3g GB/s, ridge %.3g MAC/byte\n",
+                getPeak() / 1e9, getBandwidth() / 1e9, getRidge());
+  os << label;
+  for(int i = 0; i < _layers.size(); i++)
+  {
+    std::snprintf(label, sizeof(label), "  %c %-16s ", (i < 9) ? char('1' + i) : char('A' + (i - 9) % 26),
+                  _layers[i].name.c_str());
+    os << label << (_layers[i].memoryBound ? "memory bound" : "compute bound") << "\n";
+  }
+}
+
+#endif //ROOFLINE_HPP
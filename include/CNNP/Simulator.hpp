@@ -0,0 +1,225 @@
+/**
+ *  @file    Simulator.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Activity tracking simulation kernel
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module clock the Controller (and through it the CE) until the layer is done. Instead of
+ *  calling step() on every cycle, it fast-forward the spans where the Controller only feed zeros
+ *  and the CE is idle, with bulk cycle accounting. Inside the CE, the PE rows that only see zeros
+ *  are not stepped either. The outputs stay cycle exact.
+ *
+ *  The quiet spans are the padding, the zero inputs and the drain of a streamed pass, once the
+ *  CE has drained the last non zero input: the windows saved meanwhile only hold the bias, the
+ *  Controller save the output registers of the idle CEs without stepping them. The pointwise and
+ *  windowed modes feed the lanes every step, so they have no quiet span. With shadow weights, the
+ *  steps sending the next pass weights on the port and the start of the next pass are clocked.
+ *  The quiet PE rows are skipped inside the CE in every mode.
+ */
+
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include "CNNP/Controller.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Snapshot.hpp"
+#include <vector>
+
+/**
+ * @brief Simulation kernel. Objects that run a Controller and count the simulated cycles
+ *
+ * @tparam T Type of input and output data
+ */
+template <typename T>
+class Simulator
+{
+  private:
+  Controller<T>* _controller;   ///< The controller to clock
+  std::vector< CE<T>* > _CEs;   ///< The CEs driven by the controller
+  long _cycles;                 ///< Number of simulated cycles
+  long _steppedCycles;          ///< Number of cycles where the controller was stepped
+  long _skippedCycles;          ///< Number of cycles fast-forwarded in bulk
+
+  public:
+  Simulator(Controller<T>& controller, CE<T>& ce);
+  Simulator(Controller<T>& controller, std::vector< CE<T> >& CEs);
+  ~Simulator();
+  bool step();
+  long run(long maxCycles);
+  long getCycles();
+  long getSteppedCycles();
+  long getSkippedCycles();
+  void save(Snapshot& snap);
+  void restore(Snapshot& snap);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  Simulator object constructor
+*
+* @tparam T Type of input and output data
+*
+* @param  controller is the controller to clock
+* @param  ce is the CE driven by the controller
+*/
+template<typename T>
+Simulator<T>::Simulator(Controller<T>& controller, CE<T>& ce) :
+    _controller(&controller),
+    _CEs(1, &ce),
+    _cycles(0),
+    _steppedCycles(0),
+    _skippedCycles(0)
+{}
+
+/**
+* @brief  Simulator object constructor, for a controller driving several CEs
+*
+* @tparam T Type of input and output data
+*
+* @param  controller is the controller to clock
+* @param  CEs is the CEs driven by the controller
+*/
+template<typename T>
+Simulator<T>::Simulator(Controller<T>& controller, std::vector< CE<T> >& CEs) :
+    _controller(&controller),
+    _cycles(0),
+    _steppedCycles(0),
+    _skippedCycles(0)
+{
+  for(int k = 0; k < CEs.size(); k++)
+  {
+    _CEs.push_back(&CEs[k]);
+  }
+}
+
+/**
+* @brief  Simulator object destructor
+*
+* @tparam T Type of input and output data
+*/
+template<typename T>
+Simulator<T>::~Simulator()
+{}
+
+/**
+* @brief  Advance the simulation to the next event. Either one step or a whole quiet span.
+*
+* @tparam T Type of input and output data
+*
+* @return false if the controller is halted
+*/
+template<typename T>
+bool Simulator<T>::step()
+{
+  if(_controller->isHalted())
+  {
+    return false;
+  }
+
+  bool idle = true;
+  for(int k = 0; k < _CEs.size() && idle; k++)
+  {
+    idle = _CEs[k]->isIdle();
+  }
+  // The controller look ahead only for idle CEs, the whole span is then skipped
+  int quiet = idle ? _controller->quietSteps() : 0;
+  if(quiet > 0)
+  {
+    _controller->skip(quiet);
+    _cycles += quiet;
+    _skippedCycles += quiet;
+  }
+  else
+  {
+    _controller->step();
+    _cycles++;
+    _steppedCycles++;
+  }
+  return true;
+}
+
+/**
+* @brief  Run the simulation until the controller halt
+*
+* @tparam T Type of input and output data
+*
+* @param  maxCycles is the maximum number of cycles to simulate. A quiet span can end a little past it.
+*
+* @return the number of simulated cycles
+*/
+template<typename T>
+long Simulator<T>::run(long maxCycles)
+{
+  long start = _cycles;
+  while(_cycles - start < maxCycles && step())
+  {}
+  return _cycles - start;
+}
+
+template<typename T>
+long Simulator<T>::getCycles()
+{
+  return _cycles;
+}
+
+template<typename T>
+long Simulator<T>::getSteppedCycles()
+{
+  return _steppedCycles;
+}
+
+template<typename T>
+long Simulator<T>::getSkippedCycles()
+{
+  return _skippedCycles;
+}
+
+/**
+* @brief  Write the whole simulator state (controller, CEs and cycle counters) to a snapshot
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void Simulator<T>::save(Snapshot& snap)
+{
+  snap.writeTag(Snapshot::magic);
+  _controller->save(snap);
+  for(int k = 0; k < _CEs.size(); k++)
+  {
+    _CEs[k]->save(snap);
+  }
+  snap.write(_cycles);
+  snap.write(_steppedCycles);
+  snap.write(_skippedCycles);
+}
+
+/**
+* @brief  Read the whole simulator state from a snapshot. Restoring the same snapshot in several
+*         simulators fork the run.
+*
+* @tparam T Type of input and output data
+*
+* @param  snap is the snapshot read
+*/
+template<typename T>
+void Simulator<T>::restore(Snapshot& snap)
+{
+  snap.expect(Snapshot::magic, "simulator");
+  _controller->restore(snap);
+  for(int k = 0; k < _CEs.size(); k++)
+  {
+    _CEs[k]->restore(snap);
+  }
+  snap.read(_cycles);
+  snap.read(_steppedCycles);
+  snap.read(_skippedCycles);
+}
+
+#endif //SIMULATOR_HPP
@@ -0,0 +1,222 @@
+/**
+ *  @file    Snapshot.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Binary blob of the simulator state
+ *
+ *  @section DESCRIPTION
+ *
+ *  The modules write their registers in a Snapshot with save() and read them back with restore().
+ *  Values are copied byte for byte, so the data type T must be trivially copyable (Fi::Fixed is).
+ *  A snapshot can be kept in memory to fork many runs from a warmed-up pipeline, or written to a
+ *  file to checkpoint a long run. It is only valid for the same build (same T and endianness).
+ */
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Simulator state snapshot. Objects that serialize registers to a byte buffer
+ */
+class Snapshot
+{
+  private:
+  std::vector<unsigned char> _data;   ///< The serialized state
+  size_t _readPos;                    ///< Where the next read() start
+
+  public:
+  static const unsigned int magic = 0x434E4E50;   ///< "CNNP"
+
+  Snapshot();
+  ~Snapshot();
+  size_t size();
+  void rewind();
+  void clear();
+  void saveToFile(const std::string& path);
+  void loadFromFile(const std::string& path);
+
+  template <typename V> void write(const V& value);
+  template <typename V> void read(V& value);
+  template <typename V> void write(const std::vector<V>& values);
+  template <typename V> void read(std::vector<V>& values);
+  template <typename V> void write(const std::queue<V>& values);
+  template <typename V> void read(std::queue<V>& values);
+  void writeTag(unsigned int tag);
+  void expect(unsigned int tag, const char* what);
+};
+
+// --------------- Implementation ---------------
+
+inline Snapshot::Snapshot() :
+    _readPos(0)
+{}
+
+inline Snapshot::~Snapshot()
+{}
+
+/**
+* @brief  Function used to know the size of the snapshot
+*
+* @return the size in bytes
+*/
+inline size_t Snapshot::size()
+{
+  return _data.size();
+}
+
+/**
+* @brief  Restart the reading at the beginning, to restore the same snapshot again
+*/
+inline void Snapshot::rewind()
+{
+  _readPos = 0;
+}
+
+inline void Snapshot::clear()
+{
+  _data.clear();
+  _readPos = 0;
+}
+
+/**
+* @brief  Write the snapshot to a file
+*
+* @param  path is the file path
+*/
+inline void Snapshot::saveToFile(const std::string& path)
+{
+  std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+  if(!file)
+  {
+    throw std::runtime_error("Cannot open snapshot file " + path);
+  }
+  file.write(reinterpret_cast<const char*>(_data.data()), _data.size());
+  if(!file)
+  {
+    throw std::runtime_error("Cannot write snapshot file " + path);
+  }
+}
+
+/**
+* @brief  Read a snapshot from a file. The reading restart at the beginning.
+*
+* @param  path is the file path
+*/
+inline void Snapshot::loadFromFile(const std::string& path)
+{
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if(!file)
+  {
+    throw std::runtime_error("Cannot open snapshot file " + path);
+  }
+  _data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  _readPos = 0;
+}
+
+template <typename V>
+void Snapshot::write(const V& value)
+{
+  static_assert(std::is_trivially_copyable<V>::value, "Snapshot values are copied byte for byte");
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+  _data.insert(_data.end(), bytes, bytes + sizeof(V));
+}
+
+template <typename V>
+void Snapshot::read(V& value)
+{
+  static_assert(std::is_trivially_copyable<V>::value, "Snapshot values are copied byte for byte");
+  if(_readPos + sizeof(V) > _data.size())
+  {
+    throw std::runtime_error("Snapshot is truncated");
+  }
+  std::memcpy(reinterpret_cast<unsigned char*>(&value), &_data[_readPos], sizeof(V));
+  _readPos += sizeof(V);
+}
+
+template <typename V>
+void Snapshot::write(const std::vector<V>& values)
+{
+  write(static_cast<unsigned int>(values.size()));
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    write(values[i]);
+  }
+}
+
+template <typename V>
+void Snapshot::read(std::vector<V>& values)
+{
+  unsigned int count = 0;
+  read(count);
+  values.resize(count);
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    read(values[i]);
+  }
+}
+
+template <typename V>
+void Snapshot::write(const std::queue<V>& values)
+{
+  std::queue<V> copy(values);
+  write(static_cast<unsigned int>(copy.size()));
+  while(!copy.empty())
+  {
+    write(copy.front());
+    copy.pop();
+  }
+}
+
+template <typename V>
+void Snapshot::read(std::queue<V>& values)
+{
+  unsigned int count = 0;
+  read(count);
+  values = std::queue<V>();
+  for(unsigned int i = 0; i < count; i++)
+  {
+    V value;
+    read(value);
+    values.push(value);
+  }
+}
+
+/**
+* @brief  Write a tag identifying the module that write the next values
+*
+* @param  tag is the module tag
+*/
+inline void Snapshot::writeTag(unsigned int tag)
+{
+  write(tag);
+}
+
+/**
+* @brief  Read a tag written by the module and check it match, to catch a restore in the wrong
+*         module or a corrupted snapshot early.
+*
+* @param  tag is the expected tag
+* @param  what is the name of the module for the error message
+*/
+inline void Snapshot::expect(unsigned int tag, const char* what)
+{
+  unsigned int value = 0;
+  read(value);
+  if(value != tag)
+  {
+    throw std::runtime_error(std::string("Snapshot does not contain a ") + what + " here");
+  }
+}
+
+#endif //SNAPSHOT_HPP
@@ -0,0 +1,776 @@
+/**
+ *  @file    Tensor.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Strided tensor
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module hold a N dimensions buffer in a single contiguous allocation, on the heap or in an
+ *  Arena. An element is at data() + sum(index * stride). Views (operator[], slice, transpose)
+ *  only change the shape and strides and share the data, like the copies of a Tensor do. Use
+ *  clone() or assign() to copy the values. A contiguous tensor can be handed to a memory or a DMA
+ *  in one piece with data() and size().
+ */
+
+#ifndef TENSOR_HPP
+#define TENSOR_HPP
+
+#include "CNNP/Arena.hpp"
+#include "CNNP/Snapshot.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Tensor. Objects that index a contiguous buffer with a shape and strides
+ *
+ * @tparam T Type of the elements
+ */
+template <typename T>
+class Tensor
+{
+  private:
+  std::shared_ptr<T> _storage;    ///< Keep the allocation alive, shared by the copies and the views
+  T* _data;                       ///< First element of this tensor
+  std::vector<int> _shape;        ///< Size of every axis
+  std::vector<int> _strides;      ///< Distance between two elements of every axis, in elements
+
+  void allocate(const std::shared_ptr<Arena>& arena);
+  long offset(const std::vector<int>& index) const;
+  bool next(std::vector<int>& index) const;
+  Tensor element(int index) const;
+
+  public:
+  Tensor();
+  explicit Tensor(const std::vector<int>& shape);
+  Tensor(const std::vector<int>& shape, const std::shared_ptr<Arena>& arena);
+  Tensor(std::initializer_list<int> shape);
+  template <typename V, typename = typename std::enable_if<std::is_same<V, T>::value && !std::is_same<V, int>::value>::type>
+  explicit Tensor(const std::vector<V>& values);
+  explicit Tensor(const std::vector< std::vector<T> >& values);
+  explicit Tensor(const std::vector< std::vector< std::vector<T> > >& values);
+  explicit Tensor(const std::vector< std::vector< std::vector< std::vector<T> > > >& values);
+  ~Tensor();
+  static Tensor fromValues(const std::vector<T>& values);
+
+  int rank() const;
+  int dim(int axis) const;
+  const std::vector<int>& shape() const;
+  const std::vector<int>& strides() const;
+  long size() const;
+  bool empty() const;
+  bool isContiguous() const;
+  T* data();
+  const T* data() const;
+
+  T& operator()(int i);
+  T& operator()(int i, int j);
+  T& operator()(int i, int j, int k);
+  T& operator()(int i, int j, int k, int l);
+  const T& operator()(int i) const;
+  const T& operator()(int i, int j) const;
+  const T& operator()(int i, int j, int k) const;
+  const T& operator()(int i, int j, int k, int l) const;
+
+  Tensor operator[](int index);
+  const Tensor operator[](int index) const;
+  Tensor slice(int axis, int begin, int end) const;
+  Tensor transpose(int axis0, int axis1) const;
+  Tensor reshape(const std::vector<int>& shape) const;
+  Tensor clone() const;
+  Tensor clone(const std::shared_ptr<Arena>& arena) const;
+  void assign(const Tensor& other);
+  void fill(T value);
+  bool operator==(const Tensor& other) const;
+  bool operator!=(const Tensor& other) const;
+  void save(Snapshot& snap) const;
+  void restore(Snapshot& snap);
+};
+
+// --------------- Templatized Implementation ---------------
+
+/**
+* @brief  Tensor object constructor. An empty tensor, of rank 0.
+*
+* @tparam T Type of the elements
+*/
+template<typename T>
+Tensor<T>::Tensor() :
+    _data(NULL)
+{}
+
+/**
+* @brief  Tensor object constructor. The elements are allocated on the heap and set to zero.
+*
+* @tparam T Type of the elements
+*
+* @param  shape is the size of every axis
+*/
+template<typename T>
+Tensor<T>::Tensor(const std::vector<int>& shape) :
+    _data(NULL),
+    _shape(shape)
+{
+  allocate(std::shared_ptr<Arena>());
+}
+
+/**
+* @brief  Tensor object constructor. The elements are allocated in an arena and set to zero.
+*
+* @tparam T Type of the elements
+*
+* @param  shape is the size of every axis
+* @param  arena is the arena, kept alive by the tensor and its views
+*/
+template<typename T>
+Tensor<T>::Tensor(const std::vector<int>& shape, const std::shared_ptr<Arena>& arena) :
+    _data(NULL),
+    _shape(shape)
+{
+  allocate(arena);
+}
+
+/**
+* @brief  Tensor object constructor from a literal shape, like Tensor<T>({depth, height, width}).
+*         The elements are allocated on the heap and set to zero.
+*
+* @tparam T Type of the elements
+*
+* @param  shape is the size of every axis
+*/
+template<typename T>
+Tensor<T>::Tensor(std::initializer_list<int> shape) :
+    _data(NULL),
+    _shape(shape)
+{
+  allocate(std::shared_ptr<Arena>());
+}
+
+/**
+* @brief  Tensor object constructors from nested vectors, of rank 1 to 4. The rank 1 constructor is
+*         not available for Tensor<int>, a vector of int is a shape, see fromValues().
+*
+* @tparam T Type of the elements
+*
+* @param  values is the nested vectors, all the vectors of a level must have the same size
+*/
+template<typename T>
+template<typename V, typename>
+Tensor<T>::Tensor(const std::vector<V>& values) :
+    _data(NULL)
+{
+  *this = fromValues(values);
+}
+
+template<typename T>
+Tensor<T>::Tensor(const std::vector< std::vector<T> >& values) :
+    _data(NULL)
+{
+  _shape.push_back(values.size());
+  _shape.push_back(values.empty() ? 0 : values.front().size());
+  allocate(std::shared_ptr<Arena>());
+  for(int i = 0; i < _shape[0]; i++)
+  {
+    if(values[i].size() != _shape[1])
+    {
+      throw std::runtime_error("Tensor need vectors of the same size");
+    }
+    for(int j = 0; j < _shape[1]; j++)
+    {
+      (*this)(i, j) = values[i][j];
+    }
+  }
+}
+
+template<typename T>
+Tensor<T>::Tensor(const std::vector< std::vector< std::vector<T> > >& values) :
+    _data(NULL)
+{
+  _shape.push_back(values.size());
+  if(!values.empty())
+  {
+    Tensor<T> first(values.front());
+    _shape.insert(_shape.end(), first.shape().begin(), first.shape().end());
+  }
+  else
+  {
+    _shape.resize(3, 0);
+  }
+  allocate(std::shared_ptr<Arena>());
+  for(int i = 0; i < _shape[0]; i++)
+  {
+    (*this)[i].assign(Tensor<T>(values[i]));
+  }
+}
+
+template<typename T>
+Tensor<T>::Tensor(const std::vector< std::vector< std::vector< std::vector<T> > > >& values) :
+    _data(NULL)
+{
+  _shape.push_back(values.size());
+  if(!values.empty())
+  {
+    Tensor<T> first(values.front());
+    _shape.insert(_shape.end(), first.shape().begin(), first.shape().end());
+  }
+  else
+  {
+    _shape.resize(4, 0);
+  }
+  allocate(std::shared_ptr<Arena>());
+  for(int i = 0; i < _shape[0]; i++)
+  {
+    (*this)[i].assign(Tensor<T>(values[i]));
+  }
+}
+
+/**
+* @brief  Tensor object destructor. The data is freed with the last copy or view.
+*
+* @tparam T Type of the elements
+*/
+template<typename T>
+Tensor<T>::~Tensor()
+{}
+
+/**
+* @brief  Allocate the elements for the shape, with row major strides, and set them to zero
+*
+* @tparam T Type of the elements
+*
+* @param  arena is the arena to allocate from, or null for the heap
+*/
+template<typename T>
+void Tensor<T>::allocate(const std::shared_ptr<Arena>& arena)
+{
+  _strides.assign(_shape.size(), 1);
+  for(int axis = (int)_shape.size() - 2; axis >= 0; axis--)
+  {
+    _strides[axis] = _strides[axis + 1] * _shape[axis + 1];
+  }
+  for(int axis = 0; axis < _shape.size(); axis++)
+  {
+    if(_shape[axis] < 0)
+    {
+      throw std::runtime_error("Tensor shape cannot be negative");
+    }
+  }
+
+  long count = size();
+  if(arena)
+  {
+    T* memory = static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    for(long i = 0; i < count; i++)
+    {
+      new (memory + i) T(0);
+    }
+    // The arena free the memory, the deleter only keep it alive
+    std::shared_ptr<Arena> keepAlive(arena);
+    _storage = std::shared_ptr<T>(memory, [keepAlive](T*){});
+  }
+  else
+  {
+    _storage = std::shared_ptr<T>(new T[count > 0 ? count : 1](), std::default_delete<T[]>());
+    for(long i = 0; i < count; i++)
+    {
+      _storage.get()[i] = T(0);
+    }
+  }
+  _data = _storage.get();
+}
+
+/**
+* @brief  Position of an element from the data pointer
+*
+* @tparam T Type of the elements
+*
+* @param  index is the index of the element on every axis
+*
+* @return the offset in elements
+*/
+template<typename T>
+long Tensor<T>::offset(const std::vector<int>& index) const
+{
+  long position = 0;
+  for(int axis = 0; axis < index.size(); axis++)
+  {
+    position += (long)index[axis] * _strides[axis];
+  }
+  return position;
+}
+
+/**
+* @brief  Increment an index in row major order
+*
+* @tparam T Type of the elements
+*
+* @param  index is the index incremented
+*
+* @return false after the last element
+*/
+template<typename T>
+bool Tensor<T>::next(std::vector<int>& index) const
+{
+  for(int axis = (int)index.size() - 1; axis >= 0; axis--)
+  {
+    if(++index[axis] < _shape[axis])
+    {
+      return true;
+    }
+    index[axis] = 0;
+  }
+  return false;
+}
+
+/**
+* @brief  Function used to make a rank 1 tensor from values, for every element type
+*
+* @tparam T Type of the elements
+*
+* @param  values is the elements
+*
+* @return the tensor
+*/
+template<typename T>
+Tensor<T> Tensor<T>::fromValues(const std::vector<T>& values)
+{
+  Tensor<T> tensor(std::vector<int>(1, values.size()));
+  for(int i = 0; i < values.size(); i++)
+  {
+    tensor._data[i] = values[i];
+  }
+  return tensor;
+}
+
+template<typename T>
+int Tensor<T>::rank() const
+{
+  return _shape.size();
+}
+
+template<typename T>
+int Tensor<T>::dim(int axis) const
+{
+  return _shape[axis];
+}
+
+template<typename T>
+const std::vector<int>& Tensor<T>::shape() const
+{
+  return _shape;
+}
+
+template<typename T>
+const std::vector<int>& Tensor<T>::strides() const
+{
+  return _strides;
+}
+
+/**
+* @brief  Function used to know the number of elements
+*
+* @tparam T Type of the elements
+*
+* @return the product of the shape, 0 for an empty tensor
+*/
+template<typename T>
+long Tensor<T>::size() const
+{
+  if(_shape.empty())
+  {
+    return 0;
+  }
+  long count = 1;
+  for(int axis = 0; axis < _shape.size(); axis++)
+  {
+    count *= _shape[axis];
+  }
+  return count;
+}
+
+template<typename T>
+bool Tensor<T>::empty() const
+{
+  return size() == 0;
+}
+
+/**
+* @brief  Function used to know if the elements are back to back in row major order, so the
+*         tensor can be copied in one piece from data()
+*
+* @tparam T Type of the elements
+*
+* @return true if the tensor is contiguous
+*/
+template<typename T>
+bool Tensor<T>::isContiguous() const
+{
+  int stride = 1;
+  for(int axis = (int)_shape.size() - 1; axis >= 0; axis--)
+  {
+    if(_shape[axis] != 1 && _strides[axis] != stride)
+    {
+      return false;
+    }
+    stride *= _shape[axis];
+  }
+  return true;
+}
+
+template<typename T>
+T* Tensor<T>::data()
+{
+  return _data;
+}
+
+template<typename T>
+const T* Tensor<T>::data() const
+{
+  return _data;
+}
+
+template<typename T>
+T& Tensor<T>::operator()(int i)
+{
+  return _data[(long)i * _strides[0]];
+}
+
+template<typename T>
+T& Tensor<T>::operator()(int i, int j)
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1]];
+}
+
+template<typename T>
+T& Tensor<T>::operator()(int i, int j, int k)
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1] + (long)k * _strides[2]];
+}
+
+template<typename T>
+T& Tensor<T>::operator()(int i, int j, int k, int l)
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1] + (long)k * _strides[2] + (long)l * _strides[3]];
+}
+
+template<typename T>
+const T& Tensor<T>::operator()(int i) const
+{
+  return _data[(long)i * _strides[0]];
+}
+
+template<typename T>
+const T& Tensor<T>::operator()(int i, int j) const
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1]];
+}
+
+template<typename T>
+const T& Tensor<T>::operator()(int i, int j, int k) const
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1] + (long)k * _strides[2]];
+}
+
+template<typename T>
+const T& Tensor<T>::operator()(int i, int j, int k, int l) const
+{
+  return _data[(long)i * _strides[0] + (long)j * _strides[1] + (long)k * _strides[2] + (long)l * _strides[3]];
+}
+
+/**
+* @brief  View of one element of the first axis, with one axis less. The view of a const tensor is
+*         const, its values cannot be written.
+*
+* @tparam T Type of the elements
+*
+* @param  index is the index on the first axis
+*
+* @return the view, sharing the data
+*/
+template<typename T>
+Tensor<T> Tensor<T>::operator[](int index)
+{
+  return element(index);
+}
+
+template<typename T>
+const Tensor<T> Tensor<T>::operator[](int index) const
+{
+  return element(index);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::element(int index) const
+{
+  if(_shape.empty() || index < 0 || index >= _shape[0])
+  {
+    throw std::out_of_range("Tensor index out of range");
+  }
+  Tensor<T> view(*this);
+  view._data = _data + (long)index * _strides[0];
+  view._shape.erase(view._shape.begin());
+  view._strides.erase(view._strides.begin());
+  return view;
+}
+
+/**
+* @brief  View of a range of an axis
+*
+* @tparam T Type of the elements
+*
+* @param  axis is the axis sliced
+* @param  begin is the first index kept
+* @param  end is one past the last index kept
+*
+* @return the view, sharing the data
+*/
+template<typename T>
+Tensor<T> Tensor<T>::slice(int axis, int begin, int end) const
+{
+  if(axis < 0 || axis >= _shape.size() || begin < 0 || end > _shape[axis] || begin > end)
+  {
+    throw std::out_of_range("Tensor slice out of range");
+  }
+  Tensor<T> view(*this);
+  view._data = _data + (long)begin * _strides[axis];
+  view._shape[axis] = end - begin;
+  return view;
+}
+
+/**
+* @brief  View with two axes swapped
+*
+* @tparam T Type of the elements
+*
+* @param  axis0 is the first axis
+* @param  axis1 is the second axis
+*
+* @return the view, sharing the data
+*/
+template<typename T>
+Tensor<T> Tensor<T>::transpose(int axis0, int axis1) const
+{
+  Tensor<T> view(*this);
+  std::swap(view._shape[axis0], view._shape[axis1]);
+  std::swap(view._strides[axis0], view._strides[axis1]);
+  return view;
+}
+
+/**
+* @brief  View with another shape of the same number of elements. The tensor must be contiguous.
+*
+* @tparam T Type of the elements
+*
+* @param  shape is the new shape
+*
+* @return the view, sharing the data
+*/
+template<typename T>
+Tensor<T> Tensor<T>::reshape(const std::vector<int>& shape) const
+{
+  if(!isContiguous())
+  {
+    throw std::runtime_error("Cannot reshape a tensor that is not contiguous");
+  }
+  Tensor<T> view(*this);
+  view._shape = shape;
+  if(view.size() != size())
+  {
+    throw std::runtime_error("Tensor reshape must keep the number of elements");
+  }
+  view._strides.assign(shape.size(), 1);
+  for(int axis = (int)shape.size() - 2; axis >= 0; axis--)
+  {
+    view._strides[axis] = view._strides[axis + 1] * shape[axis + 1];
+  }
+  return view;
+}
+
+/**
+* @brief  Copy of the values in a new contiguous tensor, on the heap or in an arena
+*
+* @tparam T Type of the elements
+*
+* @return the copy
+*/
+template<typename T>
+Tensor<T> Tensor<T>::clone() const
+{
+  return clone(std::shared_ptr<Arena>());
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::clone(const std::shared_ptr<Arena>& arena) const
+{
+  Tensor<T> copy(_shape, arena);
+  copy.assign(*this);
+  return copy;
+}
+
+/**
+* @brief  Copy the values of a tensor of the same shape in this one (and in the views sharing it)
+*
+* @tparam T Type of the elements
+*
+* @param  other is the tensor copied
+*/
+template<typename T>
+void Tensor<T>::assign(const Tensor& other)
+{
+  if(other._shape != _shape)
+  {
+    throw std::runtime_error("Tensor shapes does not match");
+  }
+  if(empty())
+  {
+    return;
+  }
+  if(isContiguous() && other.isContiguous())
+  {
+    std::copy(other._data, other._data + size(), _data);
+    return;
+  }
+  std::vector<int> index(_shape.size(), 0);
+  do
+  {
+    _data[offset(index)] = other._data[other.offset(index)];
+  } while(next(index));
+}
+
+template<typename T>
+void Tensor<T>::fill(T value)
+{
+  if(empty())
+  {
+    return;
+  }
+  std::vector<int> index(_shape.size(), 0);
+  do
+  {
+    _data[offset(index)] = value;
+  } while(next(index));
+}
+
+/**
+* @brief  Compare the shapes and the values, not the strides
+*
+* @tparam T Type of the elements
+*
+* @param  other is the tensor compared
+*
+* @return true if equal
+*/
+template<typename T>
+bool Tensor<T>::operator==(const Tensor& other) const
+{
+  if(other._shape != _shape)
+  {
+    return false;
+  }
+  if(empty())
+  {
+    return true;
+  }
+  std::vector<int> index(_shape.size(), 0);
+  do
+  {
+    if(!(_data[offset(index)] == other._data[other.offset(index)]))
+    {
+      return false;
+    }
+  } while(next(index));
+  return true;
+}
+
+template<typename T>
+bool Tensor<T>::operator!=(const Tensor& other) const
+{
+  return !(*this == other);
+}
+
+/**
+* @brief  Write the shape and the values to a snapshot
+*
+* @tparam T Type of the elements
+*
+* @param  snap is the snapshot written
+*/
+template<typename T>
+void Tensor<T>::save(Snapshot& snap) const
+{
+  snap.write(_shape);
+  if(empty())
+  {
+    return;
+  }
+  std::vector<int> index(_shape.size(), 0);
+  do
+  {
+    snap.write(_data[offset(index)]);
+  } while(next(index));
+}
+
+/**
+* @brief  Read the values from a snapshot, in this tensor of the same shape
+*
+* @tparam T Type of the elements
+*
+* @param  snap is the snapshot read
+*/
+template<typename T>
+void Tensor<T>::restore(Snapshot& snap)
+{
+  std::vector<int> shape;
+  snap.read(shape);
+  if(shape != _shape)
+  {
+    throw std::runtime_error("Snapshot tensor shape does not match");
+  }
+  if(empty())
+  {
+    return;
+  }
+  std::vector<int> index(_shape.size(), 0);
+  do
+  {
+    snap.read(_data[offset(index)]);
+  } while(next(index));
+}
+
+/**
+* @brief  Print the shape and the values, nested like the axes
+*
+* @tparam T Type of the elements
+*/
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const Tensor<T>& tensor)
+{
+  if(tensor.rank() == 0)
+  {
+    return os << "{}";
+  }
+  os << "{";
+  for(int i = 0; i < tensor.dim(0); i++)
+  {
+    if(i != 0){os << ", ";}
+    if(tensor.rank() == 1)
+    {
+      os << tensor(i);
+    }
+    else
+    {
+      os << tensor[i];
+    }
+  }
+  return os << "}";
+}
+
+#endif //TENSOR_HPP
@@ -0,0 +1,305 @@
+/**
+ *  @file    WorkerPool.hpp
+ *  @author  Thierry Pouplier (gortium)
+ *  @date    19/10/2018
+ *  @version 1.0
+ *
+ *  @brief Pool of spinning worker threads
+ *
+ *  @section DESCRIPTION
+ *
+ *  This module run a job split in chunks on a fixed set of threads, once per simulated cycle.
+ *  The caller thread run the first chunk. The other threads spin on a generation counter and
+ *  the caller spin until they all are done. No lock is taken while the jobs come every cycle,
+ *  so a cycle cost two atomic round trips instead of a mutex and a condition variable. A worker
+ *  that spun for spinsBeforePark without a job park on a condition variable, so an idle pool
+ *  do not burn its cores, and run() only take the lock to wake the parked workers. A job run
+ *  every cycle is bound once with bind(), then run() do not copy it.
+ *
+ *  OwnedWorkerPool hold the pool of an object that can be copied: every copy get its own pool
+ *  of the same size, so two copies never share the workers nor the bound job.
+ */
+
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Pool of worker threads synchronized with a lock-free spin barrier
+ */
+class WorkerPool
+{
+  private:
+  std::vector<std::thread> _threads;          ///< The worker threads (the caller is chunk 0)
+  std::function<void(int)> _job;              ///< The bound job, called with the chunk index
+  const void* _owner;                         ///< The object that bound the job, 0 if none
+  std::atomic<unsigned> _generation;          ///< Incremented to release the workers
+  std::atomic<int> _pending;                  ///< Number of workers that did not finish the current generation
+  std::atomic<bool> _stop;                    ///< Ask the workers to exit
+  std::atomic<int> _parked;                   ///< Number of workers waiting on the condition variable
+  std::mutex _mutex;                          ///< Protect the parking
+  std::condition_variable _wake;              ///< Wake the parked workers
+
+  void work(int chunk);
+  void wakeParked();
+
+  public:
+  static const int spinsBeforeYield = 4096;   ///< Spins before giving the core back while waiting
+  static const int spinsBeforePark = 1 << 16; ///< Spins without a job before a worker park
+
+  explicit WorkerPool(int nbThreads);
+  ~WorkerPool();
+  int size();
+  void bind(const std::function<void(int)>& job, const void* owner = 0);
+  bool isBoundTo(const void* owner);
+  void run();
+  void run(const std::function<void(int)>& job);
+};
+
+// --------------- Implementation ---------------
+
+/**
+* @brief  WorkerPool object constructor
+*
+* @param  nbThreads is the number of threads, caller included
+*/
+inline WorkerPool::WorkerPool(int nbThreads) :
+    _owner(0),
+    _generation(0),
+    _pending(0),
+    _stop(false),
+    _parked(0)
+{
+  if(nbThreads < 1)
+  {
+    throw std::runtime_error("WorkerPool need at least one thread");
+  }
+  for(int i = 1; i < nbThreads; i++)
+  {
+    _threads.push_back(std::thread(&WorkerPool::work, this, i));
+  }
+}
+
+/**
+* @brief  WorkerPool object destructor. Release and join the workers.
+*/
+inline WorkerPool::~WorkerPool()
+{
+  _stop.store(true);
+  _generation.fetch_add(1);
+  wakeParked();
+  for(int i = 0; i < _threads.size(); i++)
+  {
+    _threads[i].join();
+  }
+}
+
+/**
+* @brief  Function used to know the number of chunks a job is split in
+*
+* @return the number of threads, caller included
+*/
+inline int WorkerPool::size()
+{
+  return _threads.size() + 1;
+}
+
+/**
+* @brief  Bind the job run by run(). The job is copied here only.
+*
+* @param  job is the function called with the chunk index
+* @param  owner is the object the job work on, to know if it is still bound
+*/
+inline void WorkerPool::bind(const std::function<void(int)>& job, const void* owner)
+{
+  _job = job;
+  _owner = owner;
+}
+
+/**
+* @brief  Function used to know if the bound job is the one of an object
+*
+* @param  owner is the object given to bind()
+*
+* @return true if the job of owner is bound
+*/
+inline bool WorkerPool::isBoundTo(const void* owner)
+{
+  return _job && _owner == owner;
+}
+
+/**
+* @brief  Run the bound job, job(0) .. job(size() - 1) in parallel, and wait for all of them
+*/
+inline void WorkerPool::run()
+{
+  if(!_job)
+  {
+    throw std::logic_error("WorkerPool run without a bound job");
+  }
+  if(_threads.empty())
+  {
+    _job(0);
+    return;
+  }
+
+  _pending.store(_threads.size(), std::memory_order_relaxed);
+  _generation.fetch_add(1);
+  wakeParked();
+
+  _job(0);
+
+  int spins = 0;
+  while(_pending.load(std::memory_order_acquire) != 0)
+  {
+    if(++spins == spinsBeforeYield)
+    {
+      spins = 0;
+      std::this_thread::yield();
+    }
+  }
+}
+
+/**
+* @brief  Bind a job and run it once
+*
+* @param  job is the function called with the chunk index
+*/
+inline void WorkerPool::run(const std::function<void(int)>& job)
+{
+  bind(job);
+  run();
+}
+
+/**
+* @brief  Wake the parked workers after a new generation. The generation and the parked count are
+*         sequentially consistent, so either run() see the worker parked or the worker see the
+*         new generation before it wait.
+*/
+inline void WorkerPool::wakeParked()
+{
+  if(_parked.load() > 0)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _wake.notify_all();
+  }
+}
+
+/**
+* @brief  Worker thread loop
+*
+* @param  chunk is the chunk index of this worker
+*/
+inline void WorkerPool::work(int chunk)
+{
+  unsigned seen = 0;
+  while(true)
+  {
+    int spins = 0;
+    unsigned generation;
+    while((generation = _generation.load(std::memory_order_acquire)) == seen)
+    {
+      if(++spins == spinsBeforePark)
+      {
+        // No job for a while, sleep until the next one
+        std::unique_lock<std::mutex> lock(_mutex);
+        _parked.fetch_add(1);
+        _wake.wait(lock, [this, seen]{return _generation.load() != seen;});
+        _parked.fetch_sub(1);
+        spins = 0;
+      }
+      else if(spins % spinsBeforeYield == 0)
+      {
+        std::this_thread::yield();
+      }
+    }
+    seen = generation;
+
+    if(_stop.load(std::memory_order_acquire))
+    {
+      return;
+    }
+
+    _job(chunk);
+    _pending.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Worker pool owned by one object. A copy get its own pool of the same size, a move take the pool.
+ */
+class OwnedWorkerPool
+{
+  private:
+  std::unique_ptr<WorkerPool> _pool;   ///< The pool, none to run serially
+
+  public:
+  OwnedWorkerPool();
+  OwnedWorkerPool(const OwnedWorkerPool& other);
+  OwnedWorkerPool(OwnedWorkerPool&& other) noexcept;
+  OwnedWorkerPool& operator=(const OwnedWorkerPool& other);
+  OwnedWorkerPool& operator=(OwnedWorkerPool&& other) noexcept;
+  void reset(int nbThreads);
+  WorkerPool* get();
+};
+
+inline OwnedWorkerPool::OwnedWorkerPool()
+{}
+
+inline OwnedWorkerPool::OwnedWorkerPool(const OwnedWorkerPool& other)
+{
+  reset(other._pool ? other._pool->size() : 0);
+}
+
+inline OwnedWorkerPool::OwnedWorkerPool(OwnedWorkerPool&& other) noexcept :
+    _pool(std::move(other._pool))
+{}
+
+inline OwnedWorkerPool& OwnedWorkerPool::operator=(const OwnedWorkerPool& other)
+{
+  if(this != &other)
+  {
+    reset(other._pool ? other._pool->size() : 0);
+  }
+  return *this;
+}
+
+inline OwnedWorkerPool& OwnedWorkerPool::operator=(OwnedWorkerPool&& other) noexcept
+{
+  _pool = std::move(other._pool);
+  return *this;
+}
+
+/**
+* @brief  Start a new pool, the previous one is joined
+*
+* @param  nbThreads is the number of threads, caller included. 0 for no pool
+*/
+inline void OwnedWorkerPool::reset(int nbThreads)
+{
+  _pool.reset();
+  if(nbThreads > 0)
+  {
+    _pool.reset(new WorkerPool(nbThreads));
+  }
+}
+
+/**
+* @brief  Function used to get the pool
+*
+* @return the pool, NULL if none
+*/
+inline WorkerPool* OwnedWorkerPool::get()
+{
+  return _pool.get();
+}
+
+#endif //WORKERPOOL_HPP
@@ -1,8 +1,162 @@
 //
 // Created by gortium on 2/16/18.
 //
-int main()
+// Stream images through a convolution layer. The frames are read from a file or a directory
+// (binary PGM/PPM or raw 8 bits frames) and decoded by a prefetch thread while the simulator
+// compute the current frame. Print the latency of every frame and the frames per second of the
+// simulated hardware (at the given clock) and of the host simulator. The numeric backend is
+// chosen with -t: fixed (Fi::Fixed<16,8>, bit-accurate, the default), float, int8, int16 or int32.
+//
+// Usage: CNNP <file or directory> [-r WxHxD] [-k filterSize] [-f nbOfFilter] [-n nbOfCEs]
+//             [-c clockMHz] [-p prefetch] [-t backend]
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/ImageStream.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/RangeProfile.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> DataType;
+typedef std::chrono::steady_clock Clock;
+
+/// Stream options
+struct Options
+{
+  std::string path;
+  int width, height, depth;
+  int filterSize, nbOfFilter, nbOfCEs, prefetch;
+  double clockMHz;
+};
+
+static double elapsedMs(Clock::time_point start, Clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static int usage()
+{
+  std::fprintf(stderr, "Usage: CNNP <file or directory> [-r WxHxD] [-k filterSize] [-f nbOfFilter]"
+                       " [-n nbOfCEs] [-c clockMHz] [-p prefetch] [-t fixed|float|int8|int16|int32]\n");
+  return 1;
+}
+
+/// Stream the frames through the layer with the numeric backend T
+template <typename T>
+int run(const Options& opt)
 {
+  int filterSize = opt.filterSize, nbOfFilter = opt.nbOfFilter, nbOfCEs = opt.nbOfCEs;
+  double clockMHz = opt.clockMHz;
+  try
+  {
+    ImageStream<T> stream(opt.path, opt.width, opt.height, opt.depth, opt.prefetch);
+    // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+    LayerHParam layerHParam{stream.getWidth(), stream.getHeight(), stream.getDepth(), nbOfFilter,
+                            filterSize, 1, filterSize / 2};
+    int fifoSize = layerHParam.inputWidth + layerHParam.padding * 2;
+
+    // Fixed averaging weights, the stream is about the timing
+    Tensor<T> weights({nbOfFilter, layerHParam.inputDepth, filterSize, filterSize});
+    Tensor<T> bias({nbOfFilter});
+    weights.fill(NumericTraits<T>::fromDouble(1.0 / (filterSize * filterSize)));
+
+    std::printf("%dx%dx%d frames, %d %dx%d filters on %d CE(s) at %.1f MHz\n", layerHParam.inputWidth,
+                layerHParam.inputHeight, layerHParam.inputDepth, nbOfFilter, filterSize, filterSize, nbOfCEs, clockMHz);
+    std::printf("%6s %12s %14s %12s %12s\n", "frame", "cycles", "hw lat (us)", "host (ms)", "wait (ms)");
+
+    long frames = 0, totalCycles = 0;
+    double totalWaitMs = 0;
+    RangeProfile<T> ranges;
+    Clock::time_point start = Clock::now();
+    Tensor<T> frame;
+    while(true)
+    {
+      Clock::time_point frameStart = Clock::now();
+      if(!stream.next(frame))
+      {
+        break;
+      }
+      Clock::time_point decoded = Clock::now();
 
+      std::vector< CE<T> > CEs(nbOfCEs, CE<T>(filterSize, fifoSize));
+      Controller<T> ctrl(CEs, layerHParam);
+      ctrl.setWeights(weights, bias);
+      ctrl.setInputs(frame);
+      ctrl.setShadowWeights(true);
+      Simulator<T> sim(ctrl, CEs);
+      long cycles = sim.run(1L << 40);
+      Clock::time_point done = Clock::now();
+      ranges += ctrl.getRangeProfile();
+
+      double waitMs = elapsedMs(frameStart, decoded);
+      std::printf("%6ld %12ld %14.2f %12.3f %12.3f\n", frames, cycles, cycles / clockMHz,
+                  elapsedMs(decoded, done), waitMs);
+      frames++;
+      totalCycles += cycles;
+      totalWaitMs += waitMs;
+    }
+    double hostMs = elapsedMs(start, Clock::now());
+
+    if(frames == 0)
+    {
+      std::printf("No frame\n");
+      return 0;
+    }
+    std::printf("%ld frames, hardware %.1f frames/s, host %.2f frames/s (%.1f%% waiting for frames)\n", frames,
+                clockMHz * 1e6 * frames / totalCycles, frames * 1000.0 / hostMs, 100.0 * totalWaitMs / hostMs);
+#if CNNP_RANGE_PROFILE
+    // The datapath ranges over all the frames, to size TBIT
+    std::ostringstream report;
+    ranges.write(report, "layer");
+    std::printf("layer,point,samples,saturations,min,max\n%s", report.str().c_str());
+#endif
+  }
+  catch(const std::exception& e)
+  {
+    std::fprintf(stderr, "CNNP: %s\n", e.what());
+    return 1;
+  }
+  return 0;
 }
 
+int main(int argc, char* argv[])
+{
+  if(argc < 2)
+  {
+    return usage();
+  }
+  Options opt{argv[1], 0, 0, 0, 3, 4, 1, 2, 100.0};
+  std::string backend = "fixed";
+  for(int i = 2; i + 1 < argc; i += 2)
+  {
+    if(std::strcmp(argv[i], "-r") == 0 && std::sscanf(argv[i + 1], "%dx%dx%d", &opt.width, &opt.height, &opt.depth) == 3){}
+    else if(std::strcmp(argv[i], "-k") == 0){opt.filterSize = std::atoi(argv[i + 1]);}
+    else if(std::strcmp(argv[i], "-f") == 0){opt.nbOfFilter = std::atoi(argv[i + 1]);}
+    else if(std::strcmp(argv[i], "-n") == 0){opt.nbOfCEs = std::atoi(argv[i + 1]);}
+    else if(std::strcmp(argv[i], "-c") == 0){opt.clockMHz = std::atof(argv[i + 1]);}
+    else if(std::strcmp(argv[i], "-p") == 0){opt.prefetch = std::atoi(argv[i + 1]);}
+    else if(std::strcmp(argv[i], "-t") == 0){backend = argv[i + 1];}
+    else{return usage();}
+  }
+
+  if(backend == "fixed"){return run<DataType>(opt);}
+  if(backend == "float"){return run<float>(opt);}
+  if(backend == "int8"){return run<int8_t>(opt);}
+  if(backend == "int16"){return run<int16_t>(opt);}
+  if(backend == "int32"){return run<int32_t>(opt);}
+  return usage();
+}
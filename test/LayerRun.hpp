@@ -0,0 +1,153 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Single layer runner shared by the tests and the benches. Run one layer on fresh CEs and return
+// its outputs and counters. The layer is set in the controller buffers, or fetched from a memory
+// through a DMA engine, the weights dense or compressed and expanded by a decompressor. In the
+// memory the layer tensors are back to back: the weights (or their records), the bias, the inputs
+// and the outputs, read back after the run.
+//
+// The options cover the mappings of the controller, the tests and the benches set the ones they
+// compare and keep the defaults: a stream of the padded inputs from the buffers, on one CE of the
+// filter size, without the shadow weights.
+
+#ifndef CNNP_LAYERRUN_H
+#define CNNP_LAYERRUN_H
+
+#include "CNNP/CE.hpp"
+#include "CNNP/Compression.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/EventCounts.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+/// How a layer is run
+struct LayerRunOptions
+{
+  int nbOfCEs = 1;
+  int ceSize = 0;                   ///< Size of the CEs, 0 for the filter size
+  Mapping mapping = STREAM_MAPPING;
+  int unroll = 1;                   ///< Spatial unroll, with the window mapping
+  bool packing = false;             ///< Channel packing, with the window mapping
+  int readColumns = 0;              ///< Window read port, with the window mapping
+  bool shadowWeights = false;
+  bool dma = false;                 ///< Fetch the layer from a memory and store the outputs back
+  DmaHParam dmaHParam{16, 4, 30, 0.5};
+  int weightsPerCycle = 0;          ///< Expansion rate of the compressed weights, 0 for dense weights. Need the DMA
+};
+
+/// Outputs and counters of a layer run
+template <typename T>
+struct LayerRun
+{
+  Tensor<T> outputs;                ///< Indexed [filter][row][column]
+  long cycles;
+  long exposedLoadSteps;            ///< Steps where the CEs only loaded weights
+  long hiddenLoadSteps;             ///< Steps where the weights were loaded while the CEs computed
+  long dmaStallSteps;               ///< Steps waiting for a DMA transfer
+  long dmaBusyCycles;               ///< Cycles the DMA engine moved data
+  long savedWords;                  ///< Weight words the decompressor did not fetch
+  long decompressorBusyCycles;      ///< Cycles the decompressor expanded weights
+  long fifoWords;                   ///< Words of the line buffer of the CEs
+  long weightFetches;               ///< Weight words sent to the CEs
+  EventCounts events;               ///< Events of the controller, the CEs count their own
+};
+
+/**
+* @brief  Run a layer on fresh CEs until the controller halt
+*
+* @tparam T Type of input and output data
+*
+* @param  p is the layer
+* @param  weights is indexed [filter][depth / groups][row][column]
+* @param  bias is indexed [filter]
+* @param  inputs is indexed [depth][row][column], [input][1][image] for a fully connected layer
+* @param  options is how the layer is run
+*
+* @return the outputs and the counters
+*/
+template <typename T>
+LayerRun<T> runLayer(const LayerHParam& p, const Tensor<T>& weights, const Tensor<T>& bias,
+                     const Tensor<T>& inputs, const LayerRunOptions& options)
+{
+  bool fc = p.type == FULLY_CONNECTED;
+  if(options.weightsPerCycle > 0 && !options.dma)
+  {
+    throw std::logic_error("Compressed weights are fetched by the DMA engine");
+  }
+  int ceSize = options.ceSize > 0 ? options.ceSize : p.filterSize;
+  int dilation = options.mapping == STREAM_MAPPING ? std::max(p.dilation, 1) : 1;
+  std::vector< CE<T> > CEs(options.nbOfCEs, CE<T>(ceSize, fc ? 1 : p.inputWidth + 2 * p.padding, dilation));
+  Controller<T> ctrl(CEs, p, options.mapping);
+  if(options.mapping == WINDOW_MAPPING)
+  {
+    ctrl.setSpatialUnroll(options.unroll);
+    ctrl.setChannelPacking(options.packing);
+    ctrl.setWindowReadPort(options.readColumns);
+  }
+  int outputWords = p.nbOfFilter * ctrl.outputHeight() * ctrl.outputWidth();
+
+  CompressedTensor<T> compressed = options.weightsPerCycle > 0 ? CompressedTensor<T>::compress(weights)
+                                                               : CompressedTensor<T>();
+  size_t weightWords = options.weightsPerCycle > 0 ? compressed.getWords() : weights.size();
+  DmaLayout layout{0, weightWords, weightWords + bias.size(), weightWords + bias.size() + inputs.size()};
+  Memory<T> memory(options.dma ? layout.outputs + outputWords : 0);
+  DmaEngine<T> dma(memory, options.dmaHParam);
+  Decompressor<T> decompressor(dma, compressed, std::max(options.weightsPerCycle, 1));
+  if(options.dma)
+  {
+    memory.Write(layout.bias, bias.data(), bias.size());
+    memory.Write(layout.inputs, inputs.data(), inputs.size());
+    ctrl.setDma(dma, layout);
+    if(options.weightsPerCycle > 0)
+    {
+      compressed.write(memory, layout.weights);
+      ctrl.setWeightDecompressor(decompressor);
+    }
+    else
+    {
+      memory.Write(layout.weights, weights.data(), weights.size());
+    }
+  }
+  else
+  {
+    ctrl.setWeights(weights, bias);
+    ctrl.setInputs(fc ? inputs.reshape(std::vector<int>{p.inputDepth, p.inputWidth}).transpose(0, 1) : inputs);
+  }
+  ctrl.setShadowWeights(options.shadowWeights);
+
+  Simulator<T> sim(ctrl, CEs);
+  LayerRun<T> run;
+  run.cycles = sim.run(1L << 40);
+  if(!ctrl.isHalted() || !decompressor.isIdle())
+  {
+    throw std::runtime_error("Layer run did not halt");
+  }
+  run.exposedLoadSteps = ctrl.getExposedLoadSteps();
+  run.hiddenLoadSteps = ctrl.getHiddenLoadSteps();
+  run.dmaStallSteps = ctrl.getDmaStallSteps();
+  run.dmaBusyCycles = dma.getBusyCycles();
+  run.savedWords = options.weightsPerCycle > 0 ? decompressor.getSavedWords() : 0;
+  run.decompressorBusyCycles = options.weightsPerCycle > 0 ? decompressor.getBusyCycles() : 0;
+  run.fifoWords = CEs.front().getLineBuffer().getWords();
+  run.weightFetches = ctrl.getWeightFetches();
+  run.events = ctrl.getEventCounts();
+  if(options.dma)
+  {
+    run.outputs = Tensor<T>(std::vector<int>{p.nbOfFilter, ctrl.outputHeight(), ctrl.outputWidth()});
+    memory.Read(layout.outputs, run.outputs.data(), outputWords);
+  }
+  else
+  {
+    run.outputs = ctrl.getOutputs().clone();
+  }
+  return run;
+}
+
+#endif //CNNP_LAYERRUN_H
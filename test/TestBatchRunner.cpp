@@ -0,0 +1,152 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/BatchRunner.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include "TestHelpers.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// The tests
+TEST(BatchRunnerTest, EmptyWorkerStealHalfARange)
+{
+  // Ranges [0, 3) [3, 6) [6, 10)
+  WorkStealingQueue queue(3, 10);
+  long item;
+  for(int i = 0; i < 3; i++)
+  {
+    ASSERT_TRUE(queue.pop(0, item));
+    EXPECT_EQ(i, item);
+  }
+  // The back half of [3, 6) is [4, 6)
+  ASSERT_TRUE(queue.pop(0, item));
+  EXPECT_EQ(4, item);
+  EXPECT_EQ(1, queue.getSteals());
+  ASSERT_TRUE(queue.pop(0, item));
+  EXPECT_EQ(5, item);
+  ASSERT_TRUE(queue.pop(1, item));
+  EXPECT_EQ(3, item);
+}
+
+TEST(BatchRunnerTest, EveryItemTakenOnce)
+{
+  const int workers = 4;
+  const long items = 20000;
+  WorkStealingQueue queue(workers, items);
+  std::vector< std::atomic<int> > taken(items);
+  for(long i = 0; i < items; i++){taken[i].store(0);}
+  std::atomic<int> finished(0);
+  std::vector<std::thread> threads;
+  for(int w = 0; w < workers; w++)
+  {
+    threads.push_back(std::thread([&, w]()
+    {
+      long item;
+      while(queue.pop(w, item))
+      {
+        taken[item].fetch_add(1);
+        // The first worker stall after its first item, the others steal the rest of its range
+        while(w == 0 && finished.load() < workers - 1){std::this_thread::yield();}
+      }
+      finished.fetch_add(1);
+    }));
+  }
+  for(int w = 0; w < workers; w++){threads[w].join();}
+  for(long i = 0; i < items; i++)
+  {
+    ASSERT_EQ(1, taken[i].load()) << "item " << i;
+  }
+  EXPECT_GT(queue.getSteals(), 0);
+}
+
+TEST(BatchRunnerTest, SameResultsAsSequentialRuns)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{8, 6, 3, 4, 3, 1, 1};
+  std::srand(11);
+  Tensor<TestType> weights = randomTensor<TestType>({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize}, 0.125);
+  Tensor<TestType> bias = randomTensor<TestType>({p.nbOfFilter}, 0.25);
+  std::vector< Tensor<TestType> > images;
+  for(int i = 0; i < 13; i++)
+  {
+    images.push_back(randomTensor<TestType>({p.inputDepth, p.inputHeight, p.inputWidth}, 0.25));
+    // Some images are sparse, so the images take different cycles
+    if(i % 3 == 0){images.back().fill(TestType(0));}
+  }
+
+  // Reference, one fresh simulator per image
+  std::vector< Tensor<TestType> > refOutputs;
+  std::vector<long> refCycles;
+  for(int i = 0; i < images.size(); i++)
+  {
+    std::vector< CE<TestType> > CEs(2, CE<TestType>(p.filterSize, p.inputWidth + 2 * p.padding));
+    Controller<TestType> ctrl(CEs, p);
+    ctrl.setWeights(weights, bias);
+    ctrl.setShadowWeights(true);
+    ctrl.setInputs(images[i]);
+    Simulator<TestType> sim(ctrl, CEs);
+    refCycles.push_back(sim.run(1000000));
+    refOutputs.push_back(ctrl.getOutputs().clone());
+  }
+
+  BatchRunner<TestType> runner(p, 2, weights, bias);
+  runner.setShadowWeights(true);
+  for(int threads = 1; threads <= 3; threads += 2)
+  {
+    std::vector< Tensor<TestType> > outputs;
+    BatchStats stats = runner.run(images, threads, &outputs);
+    EXPECT_EQ(threads, stats.threads);
+    ASSERT_EQ(images.size(), outputs.size());
+    long total = 0;
+    for(int i = 0; i < images.size(); i++)
+    {
+      EXPECT_EQ(refOutputs[i], outputs[i]) << "image " << i << " threads " << threads;
+      EXPECT_EQ(refCycles[i], stats.perImage[i].cycles);
+      EXPECT_GE(stats.perImage[i].worker, 0);
+      EXPECT_LT(stats.perImage[i].worker, threads);
+      // The inputs are read once per image, the weights once per worker
+      EXPECT_EQ(images[i].size(), stats.perImage[i].events.dramReads);
+      total += refCycles[i];
+    }
+    EXPECT_EQ(total, stats.totalCycles);
+  }
+}
+
+TEST(BatchRunnerTest, ScalingReport)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{6, 6, 2, 2, 3, 1, 1};
+  std::srand(2);
+  BatchRunner<TestType> runner(p, 1, randomTensor<TestType>({2, 2, 3, 3}, 0.125), randomTensor<TestType>({2}, 0.25));
+  std::vector< Tensor<TestType> > images(6, randomTensor<TestType>({2, 6, 6}, 0.25));
+  std::vector<BatchStats> scaling = runner.scaling(images, 2);
+  ASSERT_EQ(2, scaling.size());
+  EXPECT_EQ(scaling[0].totalCycles, scaling[1].totalCycles);
+  std::ostringstream os;
+  BatchRunner<TestType>::writeScaling(os, scaling);
+  std::string report = os.str();
+  EXPECT_EQ(3, std::count(report.begin(), report.end(), '\n'));
+  EXPECT_EQ(0, report.find("threads,images"));
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -9,12 +9,18 @@
 #include "CNNP/CE.hpp"
 #include "CNNP/PE.hpp"
 #include "CNNP/HyperParams.hpp"
+#include "CNNP/Tensor.hpp"
 #include "gtest/gtest.h"
 #include <queue>
 #include <vector>
 #include <deque>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <thread>
 
 typedef Fi::Fixed<8,4,Fi::SIGNED,Fi::Throw,Fi::Classic> TestType;
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> WideType;
 
 /// Tests fixtures
 struct CEFixture : public ::testing::Test
@@ -35,18 +41,18 @@ struct CEFixture : public ::testing::Test
 /// Test data structures
 struct ConvData
 {
-  std::vector< std::vector<TestType> > weights;
-  std::vector< std::vector<TestType> > inputs;
-  std::vector< std::vector<TestType> > results;
+  Tensor<TestType> weights;
+  Tensor<TestType> inputs;
+  Tensor<TestType> results;
   TestType bias;
   LayerHParam layerHParam;
 
   friend std::ostream&operator<<(std::ostream& os, const ConvData& obj)
   {
     os << "weight:";
-    for(int i = 0 ; i < obj.weights.size(); ++i)
-      for(int j = 0 ; j < obj.weights[i].size(); ++j)
-        os << obj.weights[i][j] << "\n";
+    for(int i = 0 ; i < obj.weights.dim(0); ++i)
+      for(int j = 0 ; j < obj.weights.dim(1); ++j)
+        os << obj.weights(i, j) << "\n";
     return os;
   }
 };
@@ -69,6 +75,8 @@ TEST_P(ConvTestCase, ConvTest)
   bool scrapFlag = false;
   bool loadInputFlag = false;
   bool saveOutputFlag = false;
+  TestType inputValue = TestType(0);
+  TestType expectedValue = TestType(0);
 
 
   int maxStep =   data.layerHParam.inputHeight * data.layerHParam.inputWidth        /* Steps for all the image          */
@@ -98,11 +106,19 @@ TEST_P(ConvTestCase, ConvTest)
                      * (data.layerHParam.stride - 1)       // ..for every stride > 1
                      - 1;                                  // -1 because it begin down counting next step
 
+  // The CE weight signals are rows
+  std::vector< std::vector<TestType> > weights(data.weights.dim(0), std::vector<TestType>(data.weights.dim(1)));
+  for(int i = 0; i < data.weights.dim(0); i++)
+    for(int j = 0; j < data.weights.dim(1); j++)
+      weights[i][j] = data.weights(i, j);
+
   // Init CE
   SetUp(data.layerHParam.filterSize, data.layerHParam.inputWidth + data.layerHParam.padding * 2);
 
   /// Load weight and bias
-  _CE->setSigs(TestType(0), data.weights, true, data.bias, true);
+  // Two enabled steps: the weights are latched in the weight registers, then in the PEs
+  _CE->setSigs(TestType(0), weights, true, data.bias, true);
+  _CE->step();
   _CE->step();
 
   for(int i = 0; i < maxStep; i++)
@@ -126,6 +142,8 @@ TEST_P(ConvTestCase, ConvTest)
       else
       {
         loadInputFlag = true;
+        // Read before the increment, the indexes are past the image after its last input
+        inputValue = data.inputs(inHI, inWI);
 
         // Increment input data indexes
         if(inWI == data.layerHParam.inputWidth - 1)
@@ -152,6 +170,8 @@ TEST_P(ConvTestCase, ConvTest)
       {
         // Check answer
         saveOutputFlag = true;
+        // Read before the increment, same as the input
+        expectedValue = data.results(outHI, outWI);
 
         // Increment output data indexes and scrapFlag
         // Next row
@@ -196,11 +216,11 @@ TEST_P(ConvTestCase, ConvTest)
     /// Input
     if(loadInputFlag)
     {
-      _CE->setSigs(data.inputs[inHI][inWI], data.weights, false, data.bias, false);
+      _CE->setSigs(inputValue, weights, false, data.bias, false);
     }
     else
     {
-      _CE->setSigs(TestType(0), data.weights, false, data.bias, false);
+      _CE->setSigs(TestType(0), weights, false, data.bias, false);
     }
 
     /// STEP
@@ -210,7 +230,7 @@ TEST_P(ConvTestCase, ConvTest)
     // Nothing good ever happen before that
     if(saveOutputFlag)
     {
-      EXPECT_EQ(data.results[outHI][outWI], _CE->getOutputReg());
+      EXPECT_EQ(expectedValue, _CE->getOutputReg());
     }
     else
     {
@@ -219,18 +239,128 @@ TEST_P(ConvTestCase, ConvTest)
   }
 }
 
+TEST(ThreadedCETest, CycleIdenticalToSerial)
+{
+  const int filterSize = 11;
+  const int fifoSize = 20;
+  CE<WideType> serialCE(filterSize, fifoSize);
+  CE<WideType> threadedCE(filterSize, fifoSize);
+  threadedCE.setThreads(4, 1);
+  EXPECT_FALSE(serialCE.isParallel());
+  EXPECT_TRUE(threadedCE.isParallel());
+
+  // No thread below the crossover size, nor with a single thread
+  CE<WideType> smallCE(3, fifoSize);
+  smallCE.setThreads(4, 5);
+  EXPECT_FALSE(smallCE.isParallel());
+  CE<WideType> singleCE(filterSize, fifoSize);
+  singleCE.setThreads(1, 1);
+  EXPECT_FALSE(singleCE.isParallel());
+
+  std::srand(42);
+  std::vector< std::vector<WideType> > weights(filterSize, std::vector<WideType>(filterSize));
+  for(int i = 0; i < filterSize; i++)
+    for(int j = 0; j < filterSize; j++)
+      weights[i][j] = WideType((std::rand() % 9 - 4) * 0.125);
+
+  /// Load weight and bias
+  for(int i = 0; i < 2; i++)
+  {
+    serialCE.setSigs(WideType(0), weights, true, WideType(0.5), true);
+    threadedCE.setSigs(WideType(0), weights, true, WideType(0.5), true);
+    serialCE.step();
+    threadedCE.step();
+  }
+  // A copy start its own workers
+  CE<WideType> copyCE = threadedCE;
+  EXPECT_TRUE(copyCE.isParallel());
+
+  // Random inputs with zero runs, so some rows are skipped
+  for(int i = 0; i < filterSize * fifoSize * 3; i++)
+  {
+    WideType input = (i / fifoSize) % 3 == 0 ? WideType(0) : WideType((std::rand() % 9 - 4) * 0.25);
+    serialCE.setSigs(input, weights, false, WideType(0.5), false);
+    threadedCE.setSigs(input, weights, false, WideType(0.5), false);
+    copyCE.setSigs(input, weights, false, WideType(0.5), false);
+    serialCE.step();
+    threadedCE.step();
+    copyCE.step();
+    ASSERT_EQ(serialCE.getOutputReg(), threadedCE.getOutputReg());
+    ASSERT_EQ(serialCE.getOutputReg(), copyCE.getOutputReg());
+  }
+  EXPECT_EQ(serialCE.getSkippedRowSteps(), threadedCE.getSkippedRowSteps());
+}
+
+TEST(ThreadedCETest, CopiesSteppedFromSeveralThreads)
+{
+  const int filterSize = 11;
+  const int fifoSize = 20;
+  CE<WideType> serialCE(filterSize, fifoSize);
+  CE<WideType> threadedCE(filterSize, fifoSize);
+  threadedCE.setThreads(2, 1);
+  std::vector< CE<WideType> > copies(2, threadedCE);
+
+  std::srand(43);
+  std::vector< std::vector<WideType> > weights(filterSize, std::vector<WideType>(filterSize));
+  for(int i = 0; i < filterSize; i++)
+    for(int j = 0; j < filterSize; j++)
+      weights[i][j] = WideType((std::rand() % 9 - 4) * 0.125);
+  std::vector<WideType> inputs(filterSize * fifoSize * 2);
+  for(int i = 0; i < inputs.size(); i++){inputs[i] = WideType((std::rand() % 9 - 4) * 0.25);}
+
+  // Every copy on its own host thread, with a pause long enough for the workers to park
+  std::vector< std::vector<WideType> > outputs(3);
+  auto drive = [&](CE<WideType>& ce, std::vector<WideType>& out, bool pause)
+  {
+    for(int i = 0; i < 2; i++)
+    {
+      ce.setSigs(WideType(0), weights, true, WideType(0.5), true);
+      ce.step();
+    }
+    for(int i = 0; i < inputs.size(); i++)
+    {
+      if(pause && i == inputs.size() / 2)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+      ce.setSigs(inputs[i], weights, false, WideType(0.5), false);
+      ce.step();
+      out.push_back(ce.getOutputReg());
+    }
+  };
+  drive(serialCE, outputs[0], false);
+  std::thread first(drive, std::ref(copies[0]), std::ref(outputs[1]), true);
+  std::thread second(drive, std::ref(copies[1]), std::ref(outputs[2]), false);
+  first.join();
+  second.join();
+  EXPECT_EQ(outputs[0], outputs[1]);
+  EXPECT_EQ(outputs[0], outputs[2]);
+}
+
+TEST(CETest, RejectsWeightsOfAnotherSize)
+{
+  CE<TestType> ce(5, 5);
+  std::vector< std::vector<TestType> > weights(3, std::vector<TestType>(3, TestType(0.5)));
+  EXPECT_THROW(ce.setSigs(TestType(0), weights, true, TestType(0), true), std::runtime_error);
+  weights.assign(5, std::vector<TestType>(5, TestType(0.5)));
+  weights[4].pop_back();
+  EXPECT_THROW(ce.setSigs(TestType(0), weights, true, TestType(0), true), std::runtime_error);
+  weights[4].push_back(TestType(0.5));
+  EXPECT_NO_THROW(ce.setSigs(TestType(0), weights, true, TestType(0), true));
+}
+
 /// Tests instantiations
 INSTANTIATE_TEST_CASE_P(SmallInput, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(2.75)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(2.75)}}),
              TestType(0.5),
              // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{3,3,1,1,3,1,0}
@@ -239,19 +369,19 @@ INSTANTIATE_TEST_CASE_P(SmallInput, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(BigInput, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(2.75),TestType(2.75),TestType(2.75)},
-                                                  {TestType(2.75),TestType(2.75),TestType(2.75)},
-                                                  {TestType(2.75),TestType(2.75),TestType(2.75)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(2.75),TestType(2.75),TestType(2.75)},
+                                                                   {TestType(2.75),TestType(2.75),TestType(2.75)},
+                                                                   {TestType(2.75),TestType(2.75),TestType(2.75)}}),
              TestType(0.5),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{5,5,1,1,3,1,0}
@@ -260,19 +390,19 @@ INSTANTIATE_TEST_CASE_P(BigInput, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(SmallFilter, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)}}),
              TestType(0.5),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{5,5,1,1,2,1,0}
@@ -281,15 +411,15 @@ INSTANTIATE_TEST_CASE_P(SmallFilter, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(reallySmallFilter, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(0.25),TestType(0.25),TestType(0.25)},
-                                                  {TestType(0.25),TestType(0.25),TestType(0.25)},
-                                                  {TestType(0.25),TestType(0.25),TestType(0.25)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.25),TestType(0.25),TestType(0.25)},
+                                                                   {TestType(0.25),TestType(0.25),TestType(0.25)},
+                                                                   {TestType(0.25),TestType(0.25),TestType(0.25)}}),
              TestType(0.0),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{3,3,1,1,1,1,0}
@@ -298,21 +428,21 @@ INSTANTIATE_TEST_CASE_P(reallySmallFilter, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(OnePadding, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(1.0),TestType(1.5), TestType(1.5), TestType(1.5), TestType(1.0)},
-                                                  {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
-                                                  {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
-                                                  {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
-                                                  {TestType(1.0),TestType(1.5), TestType(1.5), TestType(1.5), TestType(1.0)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(1.0),TestType(1.5), TestType(1.5), TestType(1.5), TestType(1.0)},
+                                                                   {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(2.25),TestType(2.25),TestType(2.25),TestType(1.5)},
+                                                                   {TestType(1.0),TestType(1.5), TestType(1.5), TestType(1.5), TestType(1.0)}}),
              TestType(0.0),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{5,5,1,1,3,1,1}
@@ -321,23 +451,23 @@ INSTANTIATE_TEST_CASE_P(OnePadding, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(TwoPadding, ConvTestCase, testing::Values(
     // Weights, Inputs, Rsults, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.25), TestType(0.5), TestType(0.75), TestType(0.75), TestType(0.75), TestType(0.5), TestType(0.25)},
-                                                  {TestType(0.5),  TestType(1.0), TestType(1.5),  TestType(1.5),  TestType(1.5),  TestType(1.0), TestType(0.5)},
-                                                  {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
-                                                  {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
-                                                  {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
-                                                  {TestType(0.5),  TestType(1.0), TestType(1.5),  TestType(1.5),  TestType(1.5),  TestType(1.0), TestType(0.5)},
-                                                  {TestType(0.25), TestType(0.5), TestType(0.75), TestType(0.75), TestType(0.75), TestType(0.5), TestType(0.25)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.25), TestType(0.5), TestType(0.75), TestType(0.75), TestType(0.75), TestType(0.5), TestType(0.25)},
+                                                                   {TestType(0.5),  TestType(1.0), TestType(1.5),  TestType(1.5),  TestType(1.5),  TestType(1.0), TestType(0.5)},
+                                                                   {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
+                                                                   {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
+                                                                   {TestType(0.75), TestType(1.5), TestType(2.25), TestType(2.25), TestType(2.25), TestType(1.5), TestType(0.75)},
+                                                                   {TestType(0.5),  TestType(1.0), TestType(1.5),  TestType(1.5),  TestType(1.5),  TestType(1.0), TestType(0.5)},
+                                                                   {TestType(0.25), TestType(0.5), TestType(0.75), TestType(0.75), TestType(0.75), TestType(0.5), TestType(0.25)}}),
              TestType(0.0),                                                                                       
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{5,5,1,1,3,1,2}
@@ -346,19 +476,19 @@ INSTANTIATE_TEST_CASE_P(TwoPadding, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(TwoStride, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5)}}),
              TestType(0.5),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
              LayerHParam{6,6,1,1,2,2,0}
@@ -0,0 +1,290 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "CNNP/Compression.hpp"
+#include "gtest/gtest.h"
+#include "TestHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Deterministic random weights, zeroPercent of them pruned
+template <typename T>
+Tensor<T> prunedWeights(const std::vector<int>& shape, int zeroPercent)
+{
+  Tensor<T> weights(shape);
+  for(int i = 0; i < weights.size(); i++)
+  {
+    int value = std::rand() % 8 + 1;
+    weights.data()[i] = (std::rand() % 100 < zeroPercent) ? T(0) : T((std::rand() % 2) ? value : -value);
+  }
+  return weights;
+}
+
+/// Run a layer from a memory, with dense or compressed weights
+LayerRun<TestType> runCompressedLayer(const LayerHParam& p, int nbOfCEs, bool shadow, int weightsPerCycle,
+                                      const Tensor<TestType>& weights)
+{
+  std::srand(5);
+  Tensor<TestType> bias = randomTensor<TestType>({p.nbOfFilter}, 0.125);
+  Tensor<TestType> inputs = randomTensor<TestType>({p.inputDepth, p.inputHeight, p.inputWidth}, 0.25);
+  LayerRunOptions options;
+  options.nbOfCEs = nbOfCEs;
+  options.shadowWeights = shadow;
+  options.dma = true;
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  options.dmaHParam = DmaHParam{16, 4, 30, 0.5};
+  options.weightsPerCycle = weightsPerCycle;
+  return runLayer(p, weights, bias, inputs, options);
+}
+
+/// The tests
+TEST(CompressionTest, RecordsExpandToTheDenseWeights)
+{
+  std::srand(1);
+  // 75 weights per filter span several mask words of int8_t
+  Tensor<int8_t> weights = prunedWeights<int8_t>({4, 3, 5, 5}, 60);
+  for(int i = 0; i < 75; i++)
+  {
+    weights.data()[75 + i] = 0;       // Empty filter
+    weights.data()[150 + i] = i + 1;  // Dense filter
+  }
+  CompressedTensor<int8_t> compressed = CompressedTensor<int8_t>::compress(weights);
+  EXPECT_EQ(4, compressed.getRecords());
+  EXPECT_EQ(75, compressed.getRecordWords());
+  EXPECT_EQ(10, compressed.getMaskWords());
+  long nonZeros = 0;
+  for(int i = 0; i < weights.size(); i++){nonZeros += weights.data()[i] != 0;}
+  EXPECT_EQ(nonZeros, compressed.getNonZeros());
+  EXPECT_EQ(4 * 10 + nonZeros, compressed.getWords());
+  EXPECT_EQ(10 + compressed.getOffset(1), compressed.getOffset(2));
+  EXPECT_EQ(10 + 75, compressed.getOffset(3) - compressed.getOffset(2));
+
+  // Any range of a record, from the memory image
+  Memory<int8_t> memory(compressed.getWords() + 3);
+  compressed.write(memory, 3);
+  std::vector<int8_t> records(compressed.getWords());
+  memory.Read(3, records.data(), records.size());
+  for(int filter = 0; filter < 4; filter++)
+  {
+    for(int first = 0; first < 75; first += 13)
+    {
+      int count = std::min(29, 75 - first);
+      std::vector<int8_t> dense(count, -1);
+      compressed.expand(records.data(), filter, first, count, dense.data());
+      for(int i = 0; i < count; i++)
+      {
+        ASSERT_EQ(weights.data()[filter * 75 + first + i], dense[i]) << filter << " " << first + i;
+      }
+    }
+  }
+  std::vector<int8_t> dense(2);
+  EXPECT_THROW(compressed.expand(records.data(), 0, 74, 2, dense.data()), std::runtime_error);
+
+  // The masks of a wide type are raw bytes too
+  std::srand(2);
+  Tensor<TestType> fixed = prunedWeights<TestType>({3, 2, 3, 3}, 50);
+  CompressedTensor<TestType> fixedCompressed = CompressedTensor<TestType>::compress(fixed);
+  std::vector<TestType> fixedDense(18);
+  fixedCompressed.expand(fixedCompressed.getImage().data(), 2, 0, 18, fixedDense.data());
+  for(int i = 0; i < 18; i++)
+  {
+    EXPECT_EQ(fixed(2, i / 9, i / 3 % 3, i % 3), fixedDense[i]);
+  }
+}
+
+TEST(CompressionTest, LayerFromCompressedTensor)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  std::vector<LayerHParam> layers{{7, 6, 3, 4, 3, 1, 1}, {8, 5, 4, 4, 3, 2, 1, 2}, {6, 6, 5, 3, 1, 1, 0}};
+  for(int l = 0; l < layers.size(); l++)
+  {
+    LayerHParam p = layers[l];
+    int groups = p.groups > 0 ? p.groups : 1;
+    std::srand(3);
+    Tensor<TestType> weights = prunedWeights<TestType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize,
+                                                        p.filterSize}, 70);
+    CompressedTensor<TestType> compressed = CompressedTensor<TestType>::compress(weights);
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      for(int nbOfCEs = 1; nbOfCEs <= 2; nbOfCEs++)
+      {
+        LayerRun<TestType> dense = runCompressedLayer(p, nbOfCEs, shadow, 0, weights);
+        LayerRun<TestType> fast = runCompressedLayer(p, nbOfCEs, shadow, 64, weights);
+        LayerRun<TestType> slow = runCompressedLayer(p, nbOfCEs, shadow, 1, weights);
+        EXPECT_EQ(dense.outputs, fast.outputs) << "layer " << l;
+        EXPECT_EQ(dense.outputs, slow.outputs) << "layer " << l;
+        // Every record is fetched once
+        EXPECT_EQ(weights.size() - compressed.getWords(), fast.savedWords);
+        EXPECT_EQ(dense.events.dramReads - fast.savedWords, fast.events.dramReads);
+        EXPECT_EQ(dense.events.dramWrites, fast.events.dramWrites);
+        // A weight per cycle is the decompression time
+        EXPECT_EQ(weights.size(), slow.decompressorBusyCycles);
+        EXPECT_LE(fast.decompressorBusyCycles, slow.decompressorBusyCycles);
+        EXPECT_LE(fast.cycles, slow.cycles);
+        EXPECT_GE(slow.dmaStallSteps, fast.dmaStallSteps);
+      }
+    }
+  }
+
+  // The decompressor must be fed by the controller DMA engine
+  LayerHParam p{7, 6, 3, 4, 3, 1, 1};
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 9));
+  Controller<TestType> ctrl(CEs, p);
+  Memory<TestType> memory(1024);
+  DmaEngine<TestType> dma(memory, DmaHParam{16, 4, 30, 0.5});
+  CompressedTensor<TestType> compressed = CompressedTensor<TestType>::compress(prunedWeights<TestType>({4, 3, 3, 3}, 50));
+  Decompressor<TestType> decompressor(dma, compressed, 4);
+  EXPECT_THROW(ctrl.setWeightDecompressor(decompressor), std::logic_error);
+  ctrl.setDma(dma, DmaLayout{0, 200, 300, 500});
+  ctrl.setWeightDecompressor(decompressor);
+  CompressedTensor<TestType> other = CompressedTensor<TestType>::compress(prunedWeights<TestType>({4, 2, 3, 3}, 50));
+  Decompressor<TestType> wrong(dma, other, 4);
+  EXPECT_THROW(ctrl.setWeightDecompressor(wrong), std::runtime_error);
+}
+
+TEST(CompressionTest, ActivationsMoveCompressedBetweenLayers)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam first{8, 6, 3, 4, 3, 1, 1};
+  LayerHParam second{8, 6, 4, 3, 3, 1, 1};
+  std::srand(7);
+  Tensor<TestType> weights1 = prunedWeights<TestType>({4, 3, 3, 3}, 30);
+  Tensor<TestType> weights2 = prunedWeights<TestType>({3, 4, 3, 3}, 30);
+  Tensor<TestType> bias1({4}), bias2({3});
+  Tensor<TestType> inputs({3, 6, 8});
+  for(int i = 0; i < inputs.size(); i++){inputs.data()[i] = TestType((std::rand() % 9 - 4) * 0.25);}
+  for(int i = 0; i < 4; i++){bias1.data()[i] = TestType((std::rand() % 9 - 4) * 0.125);}
+  int plane = 6 * 8;
+
+  // Reference, the dense chain without DMA
+  std::vector< CE<TestType> > refCEs1(1, CE<TestType>(3, 10)), refCEs2(1, CE<TestType>(3, 10));
+  Controller<TestType> ref1(refCEs1, first), ref2(refCEs2, second);
+  ref1.setWeights(weights1, bias1);
+  ref1.setInputs(inputs);
+  ref1.setRelu(true);
+  Simulator<TestType>(ref1, refCEs1).run(1000000);
+  Tensor<TestType> activations = ref1.getOutputs().clone();
+  ref2.setWeights(weights2, bias2);
+  ref2.setInputs(activations);
+  Simulator<TestType>(ref2, refCEs2).run(1000000);
+  long zeros = 0;
+  for(int i = 0; i < activations.size(); i++)
+  {
+    ASSERT_FALSE(activations.data()[i] < TestType(0));
+    zeros += activations.data()[i] == TestType(0);
+  }
+  ASSERT_GT(zeros, activations.size() / 4);
+
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    for(int nbOfCEs = 1; nbOfCEs <= 2; nbOfCEs++)
+    {
+      // Both layers in one memory, the second one read the records stored by the first one
+      DmaLayout layout1{0, 108, 112, 256};
+      DmaLayout layout2{512, 620, 256, 640};
+      Memory<TestType> memory(1024);
+      memory.Write(layout1.weights, weights1.data(), weights1.size());
+      memory.Write(layout1.bias, bias1.data(), bias1.size());
+      memory.Write(layout1.inputs, inputs.data(), inputs.size());
+      memory.Write(layout2.weights, weights2.data(), weights2.size());
+      memory.Write(layout2.bias, bias2.data(), bias2.size());
+      // burstWords, maxOutstanding, latency, wordsPerCycle
+      DmaEngine<TestType> dma1(memory, DmaHParam{16, 4, 30, 0.5}), dma2(memory, DmaHParam{16, 4, 30, 0.5});
+
+      std::vector< CE<TestType> > CEs1(nbOfCEs, CE<TestType>(3, 10));
+      Controller<TestType> ctrl1(CEs1, first);
+      CompressedTensor<TestType> records(4, plane);
+      Compressor<TestType> compressor(dma1, records, 8);
+      ctrl1.setDma(dma1, layout1);
+      ctrl1.setOutputCompressor(compressor);
+      ctrl1.setRelu(true);
+      ctrl1.setShadowWeights(shadow);
+      Simulator<TestType>(ctrl1, CEs1).run(1000000);
+      ASSERT_TRUE(ctrl1.isHalted());
+      EXPECT_TRUE(compressor.isIdle());
+      EXPECT_EQ(ref1.getOutputs(), ctrl1.getOutputs());
+      EXPECT_EQ(4, records.getAppended());
+      EXPECT_EQ(4 * plane - zeros + 4 * records.getMaskWords(), records.getWords());
+      EXPECT_EQ(records.getWords(), compressor.getStoredWords());
+      EXPECT_EQ(4L * plane - records.getWords(), compressor.getSavedWords());
+      EXPECT_GT(compressor.getRatio(), 1.0);
+      EXPECT_EQ(records.getWords(), ctrl1.getEventCounts().dramWrites);
+      EXPECT_EQ(4 * plane / 8, compressor.getBusyCycles());
+
+      std::vector< CE<TestType> > CEs2(nbOfCEs, CE<TestType>(3, 10));
+      Controller<TestType> ctrl2(CEs2, second);
+      Decompressor<TestType> decompressor(dma2, records, 8);
+      ctrl2.setDma(dma2, layout2);
+      ctrl2.setInputDecompressor(decompressor);
+      ctrl2.setShadowWeights(shadow);
+      Simulator<TestType>(ctrl2, CEs2).run(1000000);
+      ASSERT_TRUE(ctrl2.isHalted());
+      Tensor<TestType> outputs({3, 6, 8});
+      memory.Read(layout2.outputs, outputs.data(), outputs.size());
+      EXPECT_EQ(ref2.getOutputs(), outputs) << "shadow " << shadow << " CEs " << nbOfCEs;
+      // Every record is fetched once
+      EXPECT_EQ(compressor.getSavedWords(), decompressor.getSavedWords());
+      EXPECT_EQ(weights2.size() + bias2.size() + records.getWords(), ctrl2.getEventCounts().dramReads);
+    }
+  }
+
+  // The stages must match the layer and use the controller DMA engine
+  Memory<TestType> memory(1024);
+  DmaEngine<TestType> dma(memory, DmaHParam{16, 4, 30, 0.5});
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 10));
+  Controller<TestType> ctrl(CEs, second);
+  CompressedTensor<TestType> outputs(3, plane), wrongOutputs(4, plane), inputs2(4, plane);
+  Compressor<TestType> compressor(dma, outputs, 8), wrongCompressor(dma, wrongOutputs, 8);
+  Decompressor<TestType> decompressor(dma, inputs2, 8);
+  EXPECT_THROW(ctrl.setOutputCompressor(compressor), std::logic_error);
+  ctrl.setDma(dma, DmaLayout{0, 200, 300, 500});
+  ctrl.setOutputCompressor(compressor);
+  EXPECT_THROW(ctrl.setOutputCompressor(wrongCompressor), std::runtime_error);
+  ctrl.setInputDecompressor(decompressor);
+  // The records of the inputs were not compressed when the decompressor was built
+  std::vector<TestType> channel(plane, TestType(1));
+  for(int c = 0; c < 4; c++){inputs2.append(channel.data());}
+  EXPECT_THROW(decompressor.fetch(0, 0, 4), std::logic_error);
+  EXPECT_THROW(inputs2.append(channel.data()), std::logic_error);
+  EXPECT_THROW(compressor.submit(0, channel.data(), 1, 1), std::logic_error);
+}
+
+TEST(CompressionTest, ModelReadTheRecords)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{13, 13, 256, 384, 3, 1, 1};
+  // wordBytes, dramBytesPerCycle, inputBufferWords
+  PerfModel model(p, 3, 1, MemHParam{2, 1.0, 0});
+  long dense = model.getDramBytes();
+  long weights = 384L * 256 * 9;
+  model.setCompressedWeights(weights / 3);
+  EXPECT_EQ(dense - 2 * (weights - weights / 3), model.getDramBytes());
+  model.setCompressedWeights(0);
+  EXPECT_EQ(dense, model.getDramBytes());
+  long inputs = 256L * 13 * 13, outputs = 384L * 13 * 13;
+  model.setCompressedActivations(inputs / 2, outputs / 4);
+  EXPECT_EQ(dense - 2 * (inputs - inputs / 2) - 2 * (outputs - outputs / 4), model.getDramBytes());
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
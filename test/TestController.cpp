@@ -10,6 +10,7 @@
 #include "CNNP/CE.hpp"
 #include "CNNP/PE.hpp"
 #include "CNNP/HyperParams.hpp"
+#include "CNNP/Tensor.hpp"
 #include "gtest/gtest.h"
 #include <queue>
 #include <vector>
@@ -21,17 +22,16 @@ typedef Fi::Fixed<8,4,Fi::SIGNED,Fi::Throw,Fi::Classic> TestType;
 struct CtrlFixture : public ::testing::Test
 {
   protected:
-  CE<TestType>* _CE;
-  Controller _controller;
-  CEFixture() {}
-  virtual ~CEFixture() {}
-  void SetUp(const int filterSize, const int inputWidth)
+  std::vector< CE<TestType> > _CEs;
+  Controller<TestType>* _controller;
+  CtrlFixture() : _controller(NULL) {}
+  virtual ~CtrlFixture() {}
+  void SetUp(const LayerHParam& layerHParam)
   {
-    _CE = new CE<TestType>(filterSize, inputWidth);
-    _controller = new controller<TestType>();
+    _CEs.assign(1, CE<TestType>(layerHParam.filterSize, layerHParam.inputWidth + layerHParam.padding * 2));
+    _controller = new Controller<TestType>(_CEs, layerHParam);
   }
   virtual void TearDown() {
-    delete _CE;
     delete _controller;
   }
 };
@@ -39,24 +39,20 @@ struct CtrlFixture : public ::testing::Test
 /// Test data structures
 struct ConvData
 {
-  std::vector< std::vector<TestType> > weights;
-  std::vector< std::vector<TestType> > inputs;
-  std::vector< std::vector<TestType> > results;
+  Tensor<TestType> weights;
+  Tensor<TestType> inputs;
+  Tensor<TestType> results;
   TestType bias;
   LayerHParam layerHParam;
 
   friend std::ostream&operator<<(std::ostream& os, const ConvData& obj)
   {
-    os << "weight:";
-    for(int i = 0 ; i < obj.weights.size(); ++i)
-      for(int j = 0 ; j < obj.weights[i].size(); ++j)
-        os << obj.weights[i][j] << "\n";
-    return os;
+    return os << "weight:" << obj.weights;
   }
 };
 
 /// Test cases
-struct ConvTestCase : CEFixture, testing::WithParamInterface<ConvData> {};
+struct ConvTestCase : CtrlFixture, testing::WithParamInterface<ConvData> {};
 
 
 /// The tests
@@ -65,35 +61,37 @@ TEST_P(ConvTestCase, ConvTest)
   // Get the data
   const ParamType data = GetParam();
 
-  // Variables
-  int inWI = 0, inHI = 0, outWI = 0, outHI = 0;
+  // Init CE and controller
+  SetUp(data.layerHParam);
+  Tensor<TestType> bias({1});
+  bias(0) = data.bias;
+  _controller->setWeights(data.weights.reshape({1, 1, data.weights.dim(0), data.weights.dim(1)}), bias);
+  _controller->setInputs(data.inputs.reshape({1, data.inputs.dim(0), data.inputs.dim(1)}));
 
-  // Init CE
-  SetUp(data.layerHParam.filterSize, data.layerHParam.inputWidth);
-
-  for(int i = 0;
-      i < data.layerHParam.inputHeight * data.layerHParam.inputWidth     // Steps for all the image
-          + data.layerHParam.filterSize * 2                              // Steps between FIFO and output
-          + data.layerHParam.inputWidth - 1                              // Steps to get the last input out
-          + 1;                                                           // Steps to load weights and bias
-      i++)
+  int maxStep = Controller<TestType>::weightLoadSteps + _controller->passSteps();
+  for(int i = 0; i < maxStep; i++)
   {
-    c
+    EXPECT_FALSE(_controller->isHalted());
+    _controller->step();
   }
+  EXPECT_TRUE(_controller->isHalted());
+
+  // Check answer
+  EXPECT_EQ(data.results, _controller->getOutputs()[0]);
 }
 
 /// Tests instantiations
 INSTANTIATE_TEST_CASE_P(SmallInput, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
 
-             std::vector< std::vector<TestType> >{{TestType(2.75)}},
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(2.75)}}),
              TestType(0.5),
              // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, sliding, padding
              LayerHParam{3,3,1,1,3,1,0}
@@ -102,19 +100,19 @@ INSTANTIATE_TEST_CASE_P(SmallInput, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(BiggerInput, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(2.75),TestType(2.75),TestType(2.75)},
-                                                  {TestType(2.75),TestType(2.75),TestType(2.75)},
-                                                  {TestType(2.75),TestType(2.75),TestType(2.75)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(2.75),TestType(2.75),TestType(2.75)},
+                                                                   {TestType(2.75),TestType(2.75),TestType(2.75)},
+                                                                   {TestType(2.75),TestType(2.75),TestType(2.75)}}),
              TestType(0.5),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, sliding, padding
              LayerHParam{5,5,1,1,3,1,0}
@@ -123,25 +121,47 @@ INSTANTIATE_TEST_CASE_P(BiggerInput, ConvTestCase, testing::Values(
 
 INSTANTIATE_TEST_CASE_P(SmallerFilter, ConvTestCase, testing::Values(
     // Weights, Inputs, Results, Bias, Layer params
-    ConvData{std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
-                                                  {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}},
-
-             std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
-                                                  {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)}},
+    ConvData{Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)},
+                                                                   {TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5),TestType(0.5)}}),
+
+             Tensor<TestType>(std::vector< std::vector<TestType> >{{TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)},
+                                                                   {TestType(1.5),TestType(1.5),TestType(1.5),TestType(1.5)}}),
              TestType(0.5),
         // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, sliding, padding
              LayerHParam{5,5,1,1,2,1,0}
     }
 ));
 
+TEST(ControllerTest, StatesSequenceThePasses)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, sliding, padding
+  LayerHParam layerHParam{5,5,2,2,3,1,1};
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 7));
+    Controller<TestType> controller(CEs, layerHParam);
+    controller.setShadowWeights(shadow);
+    std::vector<int> states(1, controller.getState());
+    while(!controller.isHalted())
+    {
+      controller.step();
+      if(controller.getState() != states.back()){states.push_back(controller.getState());}
+    }
+    // Every pass is loaded then computed, with the shadow weights only the first one is loaded
+    std::vector<int> expected{1, 2, 1, 2, 1, 2, 1, 2, 0};
+    if(shadow){expected = std::vector<int>{1, 2, 0};}
+    EXPECT_EQ(expected, states) << "shadow " << shadow;
+  }
+}
+
 int main(int argc, char* argv[])
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,225 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/DmaEngine.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Memory.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include "TestHelpers.hpp"
+#include "LayerRun.hpp"
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Run a DMA engine until it is idle, return the cycles
+long drain(DmaEngine<TestType>& dma)
+{
+  long cycles = 0;
+  while(!dma.isIdle())
+  {
+    dma.step();
+    cycles++;
+  }
+  return cycles;
+}
+
+/// Deterministic random layer
+struct RandomLayer
+{
+  Tensor<TestType> weights;
+  Tensor<TestType> bias;
+  Tensor<TestType> inputs;
+};
+
+RandomLayer randomLayer(const LayerHParam& p)
+{
+  int groups = p.groups > 0 ? p.groups : 1;
+  std::srand(3);
+  RandomLayer layer;
+  layer.weights = randomTensor<TestType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize}, 0.125);
+  layer.bias = randomTensor<TestType>({p.nbOfFilter}, 0.125);
+  layer.inputs = randomTensor<TestType>({p.inputDepth, p.inputHeight, p.inputWidth}, 0.25);
+  return layer;
+}
+
+/// Run a random layer, from the buffers or from a memory through a DMA engine
+LayerRun<TestType> runDmaLayer(const LayerHParam& p, int nbOfCEs, bool shadow, bool withDma, DmaHParam dmaHParam)
+{
+  RandomLayer layer = randomLayer(p);
+  LayerRunOptions options;
+  options.nbOfCEs = nbOfCEs;
+  options.ceSize = p.type == FULLY_CONNECTED ? 3 : 0;
+  options.shadowWeights = shadow;
+  options.dma = withDma;
+  options.dmaHParam = dmaHParam;
+  return runLayer(p, layer.weights, layer.bias, layer.inputs, options);
+}
+
+/// The tests
+TEST(DmaTest, MemoryBoundsAreChecked)
+{
+  Memory<TestType> memory(16);
+  memory.Write(15, TestType(1));
+  EXPECT_EQ(TestType(1), memory.Read(15));
+  EXPECT_THROW(memory.Read(16), std::runtime_error);
+  TestType words[4];
+  EXPECT_THROW(memory.Write(14, words, 4), std::runtime_error);
+  memory.Clear();
+  EXPECT_EQ(TestType(0), memory.Read(15));
+}
+
+TEST(DmaTest, TwoDimensionalDescriptorInBursts)
+{
+  Memory<TestType> memory(256);
+  for(int i = 0; i < 256; i++){memory.Write(i, TestType((i % 32) * 0.25));}
+
+  // 3 rows of 10 words, 32 words apart in the memory, 12 apart in the buffer
+  std::vector<TestType> buffer(36, TestType(-1));
+  long cycles[2];
+  for(int outstanding = 1, run = 0; run < 2; outstanding = 4, run++)
+  {
+    // burstWords, maxOutstanding, latency, wordsPerCycle
+    DmaEngine<TestType> dma(memory, DmaHParam{4, outstanding, 20, 2.0});
+    long load = dma.submit(DmaDescriptor<TestType>{5, buffer.data(), 3, 10, 32, 12, false});
+    EXPECT_FALSE(dma.isDone(load));
+    cycles[run] = drain(dma);
+    EXPECT_TRUE(dma.isDone(load));
+    EXPECT_EQ(9, dma.getBursts());
+    EXPECT_EQ(30, dma.getWords());
+  }
+  for(int row = 0; row < 3; row++)
+  {
+    for(int i = 0; i < 12; i++)
+    {
+      EXPECT_EQ((i < 10) ? TestType((5 + i) * 0.25) : TestType(-1), buffer[row * 12 + i]);
+    }
+  }
+  // One burst at a time pay the latency every burst (rows of 4, 4 and 2 words), 4 outstanding overlap it
+  EXPECT_EQ(6 * (20 + 2) + 3 * (20 + 1), cycles[0]);
+  EXPECT_LT(cycles[1], cycles[0] / 2);
+
+  // Store back in another place
+  DmaEngine<TestType> dma(memory, DmaHParam{8, 2, 5, 1.0});
+  dma.submit(DmaDescriptor<TestType>{100, buffer.data(), 3, 10, 10, 12, true});
+  drain(dma);
+  EXPECT_EQ(TestType(5 * 0.25), memory.Read(100));
+  EXPECT_EQ(TestType(14 * 0.25), memory.Read(129));
+}
+
+TEST(DmaTest, LayersFetchedFromMemory)
+{
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  DmaHParam dmaHParam{16, 4, 30, 1.0};
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  std::vector<LayerHParam> layers{LayerHParam{8, 8, 3, 5, 3, 1, 1, 0, CONVOLUTION},
+                                  LayerHParam{9, 7, 4, 4, 3, 2, 1, 2, CONVOLUTION},
+                                  LayerHParam{4, 1, 20, 3, 1, 1, 0, 0, FULLY_CONNECTED}};
+  for(int l = 0; l < layers.size(); l++)
+  {
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      LayerRun<TestType> ref = runDmaLayer(layers[l], 2, shadow, false, dmaHParam);
+      LayerRun<TestType> run = runDmaLayer(layers[l], 2, shadow, true, dmaHParam);
+      EXPECT_EQ(ref.outputs, run.outputs) << "layer " << l << " shadow " << shadow;
+      EXPECT_GT(run.dmaStallSteps, 0);
+      if(shadow)
+      {
+        EXPECT_GT(run.cycles, ref.cycles);
+      }
+      else
+      {
+        // Without shadow weights the controller only wait for the DMA before a pass
+        EXPECT_EQ(ref.cycles + run.dmaStallSteps, run.cycles);
+      }
+      // Every word of the layer moved once
+      EXPECT_EQ(ref.events.dramReads, run.events.dramReads);
+      EXPECT_EQ(ref.events.dramWrites, run.events.dramWrites);
+    }
+  }
+}
+
+TEST(DmaTest, SnapshotFetchThePassesLeftAgain)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{8, 8, 3, 4, 3, 1, 1};
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  DmaHParam dmaHParam{8, 4, 20, 1.0};
+  LayerRun<TestType> ref = runDmaLayer(p, 2, true, false, dmaHParam);
+  RandomLayer layer = randomLayer(p);
+  const Tensor<TestType>& weights = layer.weights;
+  const Tensor<TestType>& bias = layer.bias;
+  const Tensor<TestType>& inputs = layer.inputs;
+  DmaLayout layout{0, size_t(weights.size()), size_t(weights.size() + bias.size()),
+                   size_t(weights.size() + bias.size() + inputs.size())};
+  int outputWords = ref.outputs.size();
+
+  // Checkpoint in the middle of the layer, after some blocks are stored, while the DMA is idle
+  Snapshot snap;
+  for(int fork = 0; fork < 2; fork++)
+  {
+    Memory<TestType> memory(layout.outputs + outputWords);
+    memory.Write(layout.weights, weights.data(), weights.size());
+    memory.Write(layout.bias, bias.data(), bias.size());
+    memory.Write(layout.inputs, inputs.data(), inputs.size());
+    DmaEngine<TestType> dma(memory, dmaHParam);
+    std::vector< CE<TestType> > CEs(2, CE<TestType>(3, p.inputWidth + 2 * p.padding));
+    Controller<TestType> ctrl(CEs, p);
+    ctrl.setDma(dma, layout);
+    Simulator<TestType> sim(ctrl, CEs);
+    if(fork == 0)
+    {
+      ctrl.setShadowWeights(true);
+      sim.run(ref.cycles);
+      while(!dma.isIdle()){sim.run(1);}
+      ASSERT_EQ(2, ctrl.getState());
+      sim.save(snap);
+    }
+    else
+    {
+      snap.rewind();
+      sim.restore(snap);
+      // The next pass and the blocks already stored go through this DMA engine
+      EXPECT_FALSE(dma.isIdle());
+    }
+    sim.run(10000000);
+    EXPECT_TRUE(ctrl.isHalted());
+    Tensor<TestType> outputs({p.nbOfFilter, ctrl.outputHeight(), ctrl.outputWidth()});
+    memory.Read(layout.outputs, outputs.data(), outputWords);
+    EXPECT_EQ(ref.outputs, outputs) << "fork " << fork;
+  }
+}
+
+TEST(DmaTest, TransfersOverlapComputation)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam layerHParam{12, 12, 4, 6, 3, 1, 1};
+  // burstWords, maxOutstanding, latency, wordsPerCycle
+  LayerRun<TestType> serial = runDmaLayer(layerHParam, 2, true, true, DmaHParam{8, 1, 40, 1.0});
+  LayerRun<TestType> pipelined = runDmaLayer(layerHParam, 2, true, true, DmaHParam{8, 8, 40, 1.0});
+  EXPECT_EQ(serial.outputs, pipelined.outputs);
+  EXPECT_LT(pipelined.dmaStallSteps, serial.dmaStallSteps);
+  EXPECT_LT(pipelined.dmaBusyCycles, serial.dmaBusyCycles);
+  // Most of the transfer time is hidden behind the passes
+  EXPECT_LT(pipelined.dmaStallSteps, pipelined.dmaBusyCycles / 2);
+
+  // A slow DMA is exposed
+  LayerRun<TestType> slow = runDmaLayer(layerHParam, 2, true, true, DmaHParam{8, 8, 40, 0.05});
+  EXPECT_GT(slow.dmaStallSteps, slow.dmaBusyCycles / 2);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/EnergyModel.hpp"
+#include "CNNP/EventCounts.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Run a layer with the given inputs, return its events. steps is set to the cycles not fast-forwarded.
+EventCounts runLayer(LayerHParam layerHParam, const Tensor<TestType>& inputs, int nbOfCEs, bool tracking,
+                     Tensor<TestType>& outputs, long& steps)
+{
+  int groupDepth = layerHParam.inputDepth / (layerHParam.groups > 0 ? layerHParam.groups : 1);
+  Tensor<TestType> weights({layerHParam.nbOfFilter, groupDepth, layerHParam.filterSize, layerHParam.filterSize});
+  Tensor<TestType> bias({layerHParam.nbOfFilter});
+  weights.fill(TestType(0.25));
+  bias.fill(TestType(0.5));
+
+  std::vector< CE<TestType> > CEs(nbOfCEs, CE<TestType>(layerHParam.filterSize,
+                                                        layerHParam.inputWidth + 2 * layerHParam.padding));
+  for(int k = 0; k < nbOfCEs; k++)
+  {
+    CEs[k].setActivityTracking(tracking);
+  }
+  Controller<TestType> ctrl(CEs, layerHParam);
+  ctrl.setWeights(weights, bias);
+  ctrl.setInputs(inputs);
+  Simulator<TestType> sim(ctrl, CEs);
+  sim.run(1000000);
+  steps = sim.getSteppedCycles();
+  EXPECT_TRUE(ctrl.isHalted());
+  outputs = ctrl.getOutputs().clone();
+  return ctrl.getEventCounts();
+}
+
+/// The tests
+TEST(EnergyTest, EventsOfADenseLayer)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam layerHParam{8, 8, 2, 4, 3, 1, 1};
+  Tensor<TestType> inputs({2, 8, 8});
+  inputs.fill(TestType(0.25));
+  Tensor<TestType> outputs;
+  long steps = 0;
+  EventCounts events = runLayer(layerHParam, inputs, 2, false, outputs, steps);
+
+  // Without activity tracking every PE of every CE compute every step, only the quiet padding is skipped
+  EXPECT_EQ(steps * 9 * 2, events.macs);
+  EXPECT_EQ(steps * 3 * 2, events.adds);
+  EXPECT_EQ(steps * 2 * 2, events.syncShifts);
+  // The shared line buffer shift every row FIFO once per cycle
+  EXPECT_GE(events.fifoShifts, steps * 3);
+  // The weights, bias and inputs are read once, the outputs written once
+  EXPECT_EQ(4 * 2 * 9 + 4 + 2 * 8 * 8, events.dramReads);
+  EXPECT_EQ(4 * 8 * 8, events.dramWrites);
+  // Every input of every pass is read from the buffer, every output of every pass accumulated
+  long passes = 2 * 2;
+  EXPECT_GE(events.bufferReads, passes * 8 * 8 + 2 * passes * 8 * 8 + 4 * 8 * 8);
+  EXPECT_EQ(events.dramReads + 4 * 2 * 8 * 8, events.bufferWrites);
+}
+
+TEST(EnergyTest, ActivityTrackingSavesPeEvents)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam layerHParam{12, 12, 1, 2, 3, 1, 1};
+  Tensor<TestType> inputs({1, 12, 12});
+  inputs(0, 5, 5) = TestType(1);
+
+  Tensor<TestType> denseOutputs, sparseOutputs;
+  long denseSteps = 0, sparseSteps = 0;
+  EventCounts dense = runLayer(layerHParam, inputs, 1, false, denseOutputs, denseSteps);
+  EventCounts sparse = runLayer(layerHParam, inputs, 1, true, sparseOutputs, sparseSteps);
+
+  EXPECT_EQ(denseOutputs, sparseOutputs);
+  EXPECT_LT(sparse.macs, dense.macs / 2);
+  EXPECT_LT(sparse.regWrites, dense.regWrites);
+  // The memory accesses do not depend on the data
+  EXPECT_EQ(dense.bufferReads, sparse.bufferReads);
+  EXPECT_EQ(dense.dramReads, sparse.dramReads);
+  EXPECT_EQ(dense.fifoShifts, sparse.fifoShifts);
+
+  EnergyModel model;
+  EXPECT_LT(model.evaluate("sparse", sparse).pe, model.evaluate("dense", dense).pe);
+}
+
+TEST(EnergyTest, ReportByHierarchyLevel)
+{
+  EventCounts events = EventCounts();
+  events.macs = 100;
+  events.regReads = 300;
+  events.regWrites = 300;
+  events.fifoShifts = 50;
+  events.syncShifts = 20;
+  events.adds = 30;
+  events.bufferReads = 10;
+  events.bufferWrites = 5;
+  events.dramReads = 2;
+  events.dramWrites = 1;
+
+  EnergyModel model;
+  model.addLayer("conv", events);
+  model.addLayer("fc", events, 4);
+
+  const LayerEnergy& conv = model.getLayers()[0];
+  EXPECT_DOUBLE_EQ(700, conv.pe);
+  EXPECT_DOUBLE_EQ(2 * 50 + 2 * 20 + 30, conv.array);
+  EXPECT_DOUBLE_EQ(6 * 15, conv.buffer);
+  EXPECT_DOUBLE_EQ(200 * 3, conv.dram);
+  EXPECT_DOUBLE_EQ(conv.pe + conv.array + conv.buffer + conv.dram, conv.total);
+
+  // A batched layer is shared by the images
+  const LayerEnergy& fc = model.getLayers()[1];
+  EXPECT_DOUBLE_EQ(conv.total / 4, fc.total);
+  EXPECT_DOUBLE_EQ(25, fc.macs);
+
+  LayerEnergy inference = model.getInference();
+  EXPECT_DOUBLE_EQ(conv.total + fc.total, inference.total);
+  EXPECT_DOUBLE_EQ(inference.pe + inference.array + inference.buffer + inference.dram, inference.total);
+  EXPECT_DOUBLE_EQ(125, inference.macs);
+
+  std::ostringstream csv, report;
+  model.writeCsv(csv);
+  model.writeReport(report);
+  EXPECT_EQ(0u, csv.str().find("layer,images,macs,pe,array,buffer,dram,total"));
+  EXPECT_NE(std::string::npos, csv.str().find("\ninference,"));
+  EXPECT_NE(std::string::npos, report.str().find("fc"));
+  EXPECT_NE(std::string::npos, report.str().find("inference"));
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,22 @@
+//
+// Created by gortium on 10/19/18.
+//
+// Helpers shared by the tests and the benches
+
+#ifndef CNNP_TESTHELPERS_H
+#define CNNP_TESTHELPERS_H
+
+#include "CNNP/Tensor.hpp"
+#include <cstdlib>
+#include <vector>
+
+/// Deterministic random tensor, multiples of scale from -4 to 4, drawn from std::rand()
+template <typename T>
+Tensor<T> randomTensor(const std::vector<int>& shape, double scale)
+{
+  Tensor<T> tensor(shape);
+  for(int i = 0; i < tensor.size(); i++){tensor.data()[i] = T((std::rand() % 9 - 4) * scale);}
+  return tensor;
+}
+
+#endif //CNNP_TESTHELPERS_H
@@ -0,0 +1,119 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/ImageStream.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Tests fixtures
+struct StreamFixture : public ::testing::Test
+{
+  protected:
+  std::string _dir;
+  std::vector<std::string> _files;
+  virtual void SetUp()
+  {
+    char dir[] = "/tmp/TestImageStreamXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    _dir = dir;
+  }
+  virtual void TearDown()
+  {
+    for(int i = 0; i < _files.size(); i++)
+    {
+      std::remove(_files[i].c_str());
+    }
+    rmdir(_dir.c_str());
+  }
+  std::string writeFile(const std::string& name, const std::string& content)
+  {
+    std::string path = _dir + "/" + name;
+    FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(content.data(), 1, content.size(), file);
+    std::fclose(file);
+    _files.push_back(path);
+    return path;
+  }
+};
+
+/// The tests
+TEST_F(StreamFixture, PgmFramesInAFile)
+{
+  // Two 3x2 frames back to back, with a comment
+  std::string frames = std::string("P5\n# comment\n3 2\n255\n") + std::string("\x00\x40\x80\xc0\xff\x20", 6)
+                     + std::string("P5 3 2 255\n") + std::string(6, '\x10');
+  ImageStream<TestType> stream(writeFile("frames.pgm", frames), 0, 0, 0);
+  EXPECT_EQ(3, stream.getWidth());
+  EXPECT_EQ(2, stream.getHeight());
+  EXPECT_EQ(1, stream.getDepth());
+
+  Tensor<TestType> frame;
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), frame.shape());
+  EXPECT_EQ(TestType(0), frame(0, 0, 0));
+  EXPECT_EQ(TestType(0.25), frame(0, 0, 1));
+  EXPECT_EQ(TestType(0.75), frame(0, 1, 0));
+  EXPECT_EQ(TestType(255 / 256.0), frame(0, 1, 1));
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(TestType(16 / 256.0), frame(0, 1, 2));
+  EXPECT_FALSE(stream.next(frame));
+}
+
+TEST_F(StreamFixture, PpmChannelsAreSplit)
+{
+  // One 2x1 frame, RGB interleaved
+  ImageStream<TestType> stream(writeFile("frame.ppm", std::string("P6 2 1 255\n") + "\x40\x80\xc0\x20\x10\x08"), 0, 0, 0);
+  Tensor<TestType> frame;
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(std::vector<int>({3, 1, 2}), frame.shape());
+  EXPECT_EQ(TestType(0.25), frame(0, 0, 0));
+  EXPECT_EQ(TestType(0.5), frame(1, 0, 0));
+  EXPECT_EQ(TestType(0.125), frame(0, 0, 1));
+  EXPECT_EQ(TestType(8 / 256.0), frame(2, 0, 1));
+}
+
+TEST_F(StreamFixture, RawFramesInADirectory)
+{
+  // 2x2x2 frames, channel after channel. The files are read in name order
+  writeFile("b.raw", std::string(8, '\x80'));
+  writeFile("a.raw", std::string("\x00\x10\x20\x30\x40\x50\x60\x70", 8) + std::string(8, '\x40'));
+  EXPECT_THROW(ImageStream<TestType>(_dir, 0, 0, 0), std::runtime_error);
+
+  ImageStream<TestType> stream(_dir, 2, 2, 2, 1);
+  Tensor<TestType> frame;
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(TestType(0x30 / 256.0), frame(0, 1, 1));
+  EXPECT_EQ(TestType(0x60 / 256.0), frame(1, 1, 0));
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(TestType(0.25), frame(1, 0, 1));
+  ASSERT_TRUE(stream.next(frame));
+  EXPECT_EQ(TestType(0.5), frame(0, 0, 0));
+  EXPECT_FALSE(stream.next(frame));
+  EXPECT_EQ(3, stream.getDecoded());
+}
+
+TEST_F(StreamFixture, DecodeErrorsAreThrownByNext)
+{
+  ImageStream<TestType> stream(writeFile("short.pgm", std::string("P5 4 4 255\n") + std::string(10, '\x01')), 0, 0, 0);
+  Tensor<TestType> frame;
+  EXPECT_THROW(stream.next(frame), std::runtime_error);
+  EXPECT_THROW(ImageStream<TestType>(writeFile("deep.pgm", "P5 1 1 65535\n\x01\x01"), 0, 0, 0), std::runtime_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
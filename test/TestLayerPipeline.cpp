@@ -0,0 +1,213 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/LayerPipeline.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include "TestHelpers.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// A pipeline of the layers, with random weights
+LayerPipeline<TestType> buildPipeline(const std::vector<LayerHParam>& layers, const std::vector<int>& CEs)
+{
+  LayerPipeline<TestType> pipeline;
+  for(int l = 0; l < layers.size(); l++)
+  {
+    const LayerHParam& p = layers[l];
+    int groups = p.groups > 0 ? p.groups : 1;
+    Tensor<TestType> weights = randomTensor<TestType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize}, 0.125);
+    Tensor<TestType> bias = randomTensor<TestType>({p.nbOfFilter}, 0.125);
+    pipeline.addLayer(p, weights, bias, CEs[l], l + 1 < layers.size());
+  }
+  return pipeline;
+}
+
+/// The tests
+TEST(LayerPipelineTest, SameOutputsAsLayerSequential)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  std::vector<LayerHParam> layers{{10, 8, 3, 4, 3, 1, 1}, {10, 8, 4, 6, 3, 2, 1, 2}, {5, 4, 6, 5, 1, 1, 0},
+                                  {5, 4, 5, 3, 3, 1, 0}};
+  std::srand(3);
+  LayerPipeline<TestType> pipeline = buildPipeline(layers, {2, 1, 1, 3});
+  std::vector< Tensor<TestType> > images;
+  for(int i = 0; i < 3; i++){images.push_back(randomTensor<TestType>({3, 8, 10}, 0.25));}
+
+  // Reference, the first image through a controller per layer
+  Tensor<TestType> activations = images[0];
+  std::srand(3);
+  for(int l = 0; l < layers.size(); l++)
+  {
+    const LayerHParam& p = layers[l];
+    int groups = p.groups > 0 ? p.groups : 1;
+    Tensor<TestType> weights = randomTensor<TestType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize}, 0.125);
+    Tensor<TestType> bias = randomTensor<TestType>({p.nbOfFilter}, 0.125);
+    std::vector< CE<TestType> > CEs(1, CE<TestType>(p.filterSize, p.inputWidth + 2 * p.padding));
+    Controller<TestType> ctrl(CEs, p);
+    ctrl.setWeights(weights, bias);
+    ctrl.setInputs(activations);
+    ctrl.setRelu(l + 1 < layers.size());
+    Simulator<TestType>(ctrl, CEs).run(10000000);
+    activations = ctrl.getOutputs().clone();
+  }
+
+  std::vector< Tensor<TestType> > sequentialOutputs;
+  PipelineStats sequential = pipeline.runSequential(images, &sequentialOutputs);
+  EXPECT_EQ(activations, sequentialOutputs[0]);
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    pipeline.setShadowWeights(shadow);
+    for(int rows = 0; rows <= 4; rows += 3)
+    {
+      pipeline.setFifoRows(rows);
+      std::vector< Tensor<TestType> > outputs;
+      PipelineStats pipelined = pipeline.run(images, &outputs);
+      ASSERT_EQ(images.size(), outputs.size());
+      for(int i = 0; i < images.size(); i++)
+      {
+        EXPECT_EQ(sequentialOutputs[i], outputs[i]) << "image " << i << " rows " << rows << " shadow " << shadow;
+      }
+      EXPECT_TRUE(pipelined.pipelined);
+      EXPECT_EQ(3, pipelined.images);
+      EXPECT_LT(pipelined.firstRowLatency, pipelined.latency);
+      EXPECT_LE(pipelined.latency, pipelined.cycles);
+      // A stage compute the bands of every image, one after the other
+      for(int s = 0; s < layers.size(); s++)
+      {
+        int outH = (layers[s].inputHeight - layers[s].filterSize + 2 * layers[s].padding) / layers[s].stride + 1;
+        EXPECT_GT(pipelined.stages[s].bandCycles, 0);
+        EXPECT_LE(pipelined.stages[s].busyCycles, 3L * outH * pipelined.stages[s].bandCycles);
+        EXPECT_LE(pipelined.stages[s].busyCycles + pipelined.stages[s].starvedCycles
+                  + pipelined.stages[s].blockedCycles, pipelined.cycles);
+      }
+      // The last stage write to the memory, it is never blocked
+      EXPECT_EQ(0, pipelined.stages.back().blockedCycles);
+    }
+  }
+  pipeline.setFifoRows(2);
+  EXPECT_THROW(pipeline.run(images), std::runtime_error);
+
+  // Bands of several rows, the last one shorter
+  pipeline.setFifoRows(0);
+  pipeline.setBandRows(3);
+  std::vector< Tensor<TestType> > outputs;
+  pipeline.run(images, &outputs);
+  for(int i = 0; i < images.size(); i++)
+  {
+    EXPECT_EQ(sequentialOutputs[i], outputs[i]) << "image " << i << " bands of 3 rows";
+  }
+  pipeline.setFifoRows(5);
+  EXPECT_THROW(pipeline.run(images), std::runtime_error);
+  EXPECT_THROW(pipeline.setBandRows(0), std::runtime_error);
+}
+
+TEST(LayerPipelineTest, PipelineCutTheLatency)
+{
+  // Three narrow layers: two CEs per stage, against six CEs per layer where four have no filter
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  std::vector<LayerHParam> layers{{16, 16, 2, 2, 3, 1, 1}, {16, 16, 2, 2, 3, 1, 1}, {16, 16, 2, 2, 3, 1, 1}};
+  std::srand(4);
+  LayerPipeline<TestType> pipeline = buildPipeline(layers, {2, 2, 2});
+  pipeline.setShadowWeights(true);
+  std::vector< Tensor<TestType> > images(4, randomTensor<TestType>({2, 16, 16}, 0.25));
+  PipelineStats sequential = pipeline.runSequential(images);
+  EXPECT_FALSE(sequential.pipelined);
+  EXPECT_EQ(6, sequential.stages[0].nbOfCEs);
+  EXPECT_EQ(sequential.latency * 4, sequential.cycles);
+  EXPECT_EQ(sequential.latency, sequential.firstRowLatency);
+  PipelineStats pipelined;
+  for(int rows = 1; rows <= 4; rows *= 4)
+  {
+    pipeline.setBandRows(rows);
+    pipelined = pipeline.run(images);
+    EXPECT_LT(pipelined.firstRowLatency * 2, sequential.firstRowLatency) << rows;
+    EXPECT_LT(pipelined.latency, sequential.latency) << rows;
+    EXPECT_LT(pipelined.cyclesPerImage, sequential.cyclesPerImage) << rows;
+    // The stages are balanced, an image leave the pipeline within 16 rows of a stage
+    EXPECT_LE(pipelined.cyclesPerImage, 16 / rows * pipelined.stages[0].bandCycles) << rows;
+  }
+
+  std::ostringstream os;
+  LayerPipeline<TestType>::writeComparison(os, sequential, pipelined);
+  std::string report = os.str();
+  EXPECT_EQ(7, std::count(report.begin(), report.end(), '\n'));
+  EXPECT_EQ(0, report.find("mode,images"));
+}
+
+TEST(LayerPipelineTest, StagesKeepTheirStateBetweenBands)
+{
+  // A chain of windowed, strided and pointwise layers, a CE per filter
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  std::vector<LayerHParam> layers{{16, 16, 3, 4, 3, 1, 1}, {16, 16, 4, 4, 3, 1, 1}, {16, 16, 4, 8, 3, 2, 1},
+                                  {8, 8, 8, 4, 1, 1, 0}};
+  std::srand(6);
+  LayerPipeline<TestType> pipeline = buildPipeline(layers, {4, 4, 8, 4});
+  pipeline.setShadowWeights(true);
+  std::vector< Tensor<TestType> > images;
+  for(int i = 0; i < 3; i++){images.push_back(randomTensor<TestType>({3, 16, 16}, 0.25));}
+  std::vector< Tensor<TestType> > sequentialOutputs;
+  PipelineStats sequential = pipeline.runSequential(images, &sequentialOutputs);
+  for(int rows = 1; rows <= 2; rows++)
+  {
+    pipeline.setBandRows(rows);
+    std::vector< Tensor<TestType> > outputs;
+    PipelineStats pipelined = pipeline.run(images, &outputs);
+    EXPECT_EQ(sequentialOutputs, outputs) << rows;
+    // The bands do not rerun the layer, the image is through before the sequential one
+    EXPECT_LT(pipelined.latency, sequential.latency) << rows;
+    EXPECT_LT(pipelined.cyclesPerImage, sequential.cyclesPerImage) << rows;
+    for(int s = 0; s < layers.size(); s++)
+    {
+      EXPECT_LT(pipelined.stages[s].busyCycles, pipelined.cycles) << rows;
+    }
+  }
+}
+
+TEST(LayerPipelineTest, FullFifoStallTheProducer)
+{
+  // A cheap layer feeding a layer ten times slower
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  std::vector<LayerHParam> layers{{8, 16, 2, 2, 3, 1, 1}, {8, 16, 2, 20, 3, 1, 1}};
+  std::srand(5);
+  LayerPipeline<TestType> pipeline = buildPipeline(layers, {2, 1});
+  std::vector< Tensor<TestType> > images(1, randomTensor<TestType>({2, 16, 8}, 0.25));
+  pipeline.setFifoRows(3);
+  PipelineStats small = pipeline.run(images);
+  pipeline.setFifoRows(16);
+  PipelineStats large = pipeline.run(images);
+  EXPECT_GT(small.stages[0].blockedCycles, 0);
+  EXPECT_EQ(0, large.stages[0].blockedCycles);
+  EXPECT_EQ(3 * 2 * 8, small.stages[1].fifoWords);
+  // With the smallest FIFO, the consumer also wait for the producer after every row
+  EXPECT_LT(large.stages[1].starvedCycles, small.stages[1].starvedCycles);
+  EXPECT_LT(large.latency, small.latency);
+  EXPECT_EQ(0, small.stages[1].blockedCycles);
+
+  // The layers must chain, and have rows
+  LayerPipeline<TestType> wrong;
+  wrong.addLayer(layers[0], randomTensor<TestType>({2, 2, 3, 3}, 0.125), randomTensor<TestType>({2}, 0.125), 1);
+  EXPECT_THROW(wrong.addLayer(LayerHParam{8, 16, 3, 2, 3, 1, 1}, randomTensor<TestType>({2, 3, 3, 3}, 0.125),
+                              randomTensor<TestType>({2}, 0.125), 1), std::runtime_error);
+  EXPECT_THROW(wrong.addLayer(LayerHParam{1, 1, 2, 2, 1, 1, 0, 0, FULLY_CONNECTED}, randomTensor<TestType>({2, 2, 1, 1}, 0.125),
+                              randomTensor<TestType>({2}, 0.125), 1), std::runtime_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
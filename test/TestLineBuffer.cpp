@@ -0,0 +1,107 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/LineBuffer.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "gtest/gtest.h"
+#include <stdexcept>
+
+typedef Fi::Fixed<8,4,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// The tests
+TEST(LineBufferTest, RowsAreDelayedByTheFifoSize)
+{
+  LineBuffer<TestType> lines(3, 4);
+
+  // The input i reach the head of row 2 after 4 steps, row 1 after 8 and row 0 after 12
+  for(int i = 1; i <= 12; i++)
+  {
+    lines.setSigs(TestType(i * 0.25));
+    lines.step();
+    if(i >= 4){EXPECT_EQ(TestType((i - 3) * 0.25), lines.getRow(2));}
+    if(i >= 8){EXPECT_EQ(TestType((i - 7) * 0.25), lines.getRow(1));}
+    if(i >= 12){EXPECT_EQ(TestType((i - 11) * 0.25), lines.getRow(0));}
+  }
+  EXPECT_FALSE(lines.isEmpty());
+
+  // Flush with zeros
+  for(int i = 0; i < 12; i++)
+  {
+    lines.setSigs(TestType(0));
+    lines.step();
+  }
+  EXPECT_TRUE(lines.isEmpty());
+  EXPECT_EQ(24, lines.getWrites());
+}
+
+TEST(LineBufferTest, DilatedRowsAreDilationRowsApart)
+{
+  // Rows of 4 inputs, dilation 2: row 2 read the input 4 steps late, row 1 12 and row 0 20
+  LineBuffer<TestType> lines(3, 4, 2);
+  EXPECT_EQ(4, lines.getFifoSize());
+  EXPECT_EQ(20, lines.getWords());
+  for(int i = 1; i <= 20; i++)
+  {
+    lines.setSigs(TestType(i * 0.125));
+    lines.step();
+    if(i >= 4){EXPECT_EQ(TestType((i - 3) * 0.125), lines.getRow(2));}
+    if(i >= 12){EXPECT_EQ(TestType((i - 11) * 0.125), lines.getRow(1));}
+    if(i >= 20){EXPECT_EQ(TestType((i - 19) * 0.125), lines.getRow(0));}
+  }
+  EXPECT_THROW(LineBuffer<TestType>(3, 4, 0), std::runtime_error);
+}
+
+TEST(LineBufferTest, SharingCounters)
+{
+  LineBuffer<TestType> lines(3, 5);
+  lines.addReader();
+  EXPECT_EQ(0, lines.getSavedWords());
+
+  lines.addReader();
+  lines.addReader();
+  lines.skip(10);
+  EXPECT_EQ(10, lines.getWrites());
+  EXPECT_EQ(20, lines.getSavedWrites());
+  EXPECT_EQ(30, lines.getSavedWords());
+
+  lines.setSigs(TestType(1));
+  lines.step();
+  EXPECT_THROW(lines.skip(1), std::logic_error);
+}
+
+TEST(LineBufferTest, SnapshotRoundTrip)
+{
+  LineBuffer<TestType> lines(2, 3);
+  for(int i = 1; i <= 4; i++)
+  {
+    lines.setSigs(TestType(i * 0.5));
+    lines.step();
+  }
+  Snapshot snap;
+  lines.save(snap);
+
+  LineBuffer<TestType> copy(2, 3);
+  copy.restore(snap);
+  for(int i = 0; i < 6; i++)
+  {
+    EXPECT_EQ(lines.getRow(0), copy.getRow(0));
+    EXPECT_EQ(lines.getRow(1), copy.getRow(1));
+    lines.step();
+    copy.step();
+  }
+
+  LineBuffer<TestType> other(2, 4);
+  snap.rewind();
+  EXPECT_THROW(other.restore(snap), std::runtime_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
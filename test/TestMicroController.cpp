@@ -0,0 +1,321 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/MicroController.hpp"
+#include "CNNP/NetworkCompiler.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/Program.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include "TestHelpers.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Outputs of a layer on a controller, with the ReLU and the max pooling
+Tensor<TestType> referenceLayer(const LayerHParam& p, const Tensor<TestType>& weights, const Tensor<TestType>& bias,
+                                const Tensor<TestType>& inputs, int poolSize, int poolStride)
+{
+  std::vector< CE<TestType> > CEs(2, CE<TestType>(p.filterSize, p.inputWidth + 2 * p.padding));
+  Controller<TestType> ctrl(CEs, p);
+  ctrl.setWeights(weights, bias);
+  ctrl.setInputs(inputs);
+  ctrl.setRelu(true);
+  Simulator<TestType>(ctrl, CEs).run(10000000);
+  Tensor<TestType> outputs = ctrl.getOutputs().clone();
+  if(poolSize == 0)
+  {
+    return outputs;
+  }
+  int height = (outputs.dim(1) - poolSize) / poolStride + 1;
+  int width = (outputs.dim(2) - poolSize) / poolStride + 1;
+  Tensor<TestType> pooled({outputs.dim(0), height, width});
+  for(int f = 0; f < outputs.dim(0); f++)
+  {
+    for(int i = 0; i < height; i++)
+    {
+      for(int j = 0; j < width; j++)
+      {
+        TestType value = outputs(f, i * poolStride, j * poolStride);
+        for(int y = 0; y < poolSize; y++)
+        {
+          for(int x = 0; x < poolSize; x++)
+          {
+            TestType candidate = outputs(f, i * poolStride + y, j * poolStride + x);
+            value = candidate > value ? candidate : value;
+          }
+        }
+        pooled(f, i, j) = value;
+      }
+    }
+  }
+  return pooled;
+}
+
+/// The tests
+TEST(MicroControllerTest, InstructionsPackInAWord)
+{
+  Instruction in{CONV, 3, 17, 8, 4095, 8191};
+  uint64_t word = in.encode();
+  EXPECT_EQ(in, Instruction::decode(word));
+  EXPECT_EQ(SYNC, Instruction::decode(Instruction{SYNC, 0, 0, 0, 0, 0}.encode()).opcode);
+  EXPECT_THROW((Instruction{CONV, 256, 0, 0, 0, 0}.encode()), std::logic_error);
+  EXPECT_THROW((Instruction{CONV, 0, 8192, 0, 0, 0}.encode()), std::logic_error);
+  EXPECT_THROW((Instruction{CONV, 0, 0, 0, -1, 0}.encode()), std::logic_error);
+  EXPECT_STREQ("ACCUMULATE", opcodeName(ACCUMULATE));
+
+  // A single layer, a single tile
+  std::srand(1);
+  NetworkCompiler<TestType> compiler;
+  compiler.addConvolution(LayerHParam{6, 6, 2, 3, 3, 1, 1}, randomTensor<TestType>({3, 2, 3, 3}, 0.125),
+                          randomTensor<TestType>({3}, 0.125));
+  Program<TestType> program = compiler.compile();
+  std::vector<Instruction> expected{{LOAD_TILE, 0, 0, 0, 0, 2}, {LOAD_WEIGHTS, 0, 0, 3, 0, 2}, {CONV, 0, 0, 3, 0, 2},
+                                    {ACCUMULATE, 0, 0, 3, 0, 0}, {STORE, 0, 0, 3, 0, 0}, {SYNC, 0, 0, 0, 0, 0}};
+  EXPECT_EQ(expected, program.instructions);
+  EXPECT_EQ(expected.size(), program.encode().size());
+  std::ostringstream os;
+  program.write(os);
+  EXPECT_EQ("2: CONV layer 0 filters 0+3 channels 0+2", os.str().substr(os.str().find("2:"), 40));
+
+  // A CONV without its tile
+  program.instructions.erase(program.instructions.begin());
+  MicroController<TestType> micro(program, 1, MemHParam{2, 4.0});
+  micro.setInputs(randomTensor<TestType>({2, 6, 6}, 0.25));
+  EXPECT_THROW(micro.run(), std::logic_error);
+}
+
+TEST(MicroControllerTest, SameOutputsAsTheLayerControllers)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  std::vector<LayerHParam> layers{{8, 8, 3, 6, 3, 1, 1}, {4, 4, 6, 4, 3, 1, 1, 2}, {4, 4, 4, 5, 1, 1, 0}};
+  std::vector<int> pools{2, 0, 0};
+  std::srand(2);
+  std::vector< Tensor<TestType> > weights, bias;
+  for(int l = 0; l < layers.size(); l++)
+  {
+    const LayerHParam& p = layers[l];
+    int groups = p.groups > 0 ? p.groups : 1;
+    weights.push_back(randomTensor<TestType>({p.nbOfFilter, p.inputDepth / groups, p.filterSize, p.filterSize}, 0.125));
+    bias.push_back(randomTensor<TestType>({p.nbOfFilter}, 0.125));
+  }
+  Tensor<TestType> image = randomTensor<TestType>({3, 8, 8}, 0.25);
+  Tensor<TestType> reference = image;
+  for(int l = 0; l < layers.size(); l++)
+  {
+    reference = referenceLayer(layers[l], weights[l], bias[l], reference, pools[l], 2);
+  }
+
+  // Whole layers in the buffers, then tiles of channels and blocks of filters
+  long buffers[2][3] = {{0, 0, 0}, {2 * 64, 2 * (3 * 9 + 1), 2 * 64}};
+  for(int b = 0; b < 2; b++)
+  {
+    for(int ordering = 0; ordering < 2; ordering++)
+    {
+      NetworkCompiler<TestType> compiler(buffers[b][0], buffers[b][1], buffers[b][2]);
+      compiler.setTileOrdering(ordering);
+      for(int l = 0; l < layers.size(); l++)
+      {
+        compiler.addConvolution(layers[l], weights[l], bias[l]);
+        compiler.addRelu();
+        if(pools[l] > 0)
+        {
+          compiler.addMaxPool(pools[l], 2);
+        }
+      }
+      Program<TestType> program = compiler.compile();
+      ASSERT_EQ(3, program.layers.size());
+      EXPECT_EQ(3, program.count(SYNC));
+      EXPECT_EQ(program.count(STORE), program.count(ACTIVATE));
+      EXPECT_EQ(program.count(CONV), program.count(ACCUMULATE));
+
+      MicroController<TestType> micro(program, 2, MemHParam{2, 4.0});
+      micro.setShadowWeights(true);
+      micro.setInputs(image);
+      long cycles = micro.run();
+      EXPECT_TRUE(micro.isHalted());
+      EXPECT_EQ(reference, micro.getOutputs()) << "buffers " << b << " ordering " << ordering;
+      EXPECT_EQ(program.count(CONV), micro.getExecuted(CONV));
+      EXPECT_LT(micro.getConvCycles(), micro.getComputeCycles());
+      EXPECT_LE(micro.getComputeCycles(), cycles);
+      EXPECT_EQ(5 * 16 + 4 * 16 + 6 * 16, micro.getDramWrites());
+      EXPECT_GT(micro.getEventCounts().macs, 0);
+      if(b == 0)
+      {
+        // A block and a tile per layer, the pooling of the first one fused
+        EXPECT_EQ(3, program.count(CONV));
+        EXPECT_EQ(1, program.count(POOL));
+        EXPECT_EQ(3 * 64 + 6 * 16 + 4 * 16 + 6 * 3 * 9 + 6 + 4 * 3 * 9 + 4 + 5 * 4 + 5, micro.getDramReads());
+      }
+      else
+      {
+        // The input buffer hold two channels of the first layer: two tiles, three blocks
+        EXPECT_LT(3, program.count(CONV));
+        EXPECT_EQ(3, program.count(POOL));
+      }
+    }
+  }
+}
+
+TEST(MicroControllerTest, BatchNormIsFolded)
+{
+  LayerHParam p{6, 6, 2, 4, 3, 1, 1};
+  std::srand(3);
+  Tensor<TestType> weights = randomTensor<TestType>({4, 2, 3, 3}, 0.125);
+  Tensor<TestType> bias = randomTensor<TestType>({4}, 0.125);
+  Tensor<TestType> image = randomTensor<TestType>({2, 6, 6}, 0.25);
+  std::vector<double> gamma{1.0, 0.5, 2.0, -1.0}, beta{0.25, 0.0, -0.5, 0.125}, mean{0.0, 0.125, -0.25, 0.5},
+                      variance{1.0, 0.25, 4.0, 1.0};
+
+  // The batch norm applied to the weights by hand
+  Tensor<TestType> folded = weights.clone();
+  Tensor<TestType> foldedBias = bias.clone();
+  for(int f = 0; f < 4; f++)
+  {
+    TestType scale = NumericTraits<TestType>::fromDouble(gamma[f] / std::sqrt(variance[f] + 1e-5));
+    for(int i = 0; i < 18; i++)
+    {
+      folded.data()[f * 18 + i] = NumericTraits<TestType>::mul(weights.data()[f * 18 + i], scale);
+    }
+    TestType centered = NumericTraits<TestType>::add(bias(f), NumericTraits<TestType>::fromDouble(-mean[f]));
+    foldedBias(f) = NumericTraits<TestType>::add(NumericTraits<TestType>::mul(centered, scale),
+                                                 NumericTraits<TestType>::fromDouble(beta[f]));
+  }
+
+  NetworkCompiler<TestType> compiler;
+  compiler.addConvolution(p, weights, bias);
+  compiler.addBatchNorm(gamma, beta, mean, variance);
+  compiler.addMaxPool(2, 2);
+  compiler.addRelu();
+  Program<TestType> program = compiler.compile();
+  EXPECT_EQ(folded, program.layers[0].weights);
+  EXPECT_EQ(foldedBias, program.layers[0].bias);
+  EXPECT_TRUE(program.layers[0].relu);
+  EXPECT_EQ(2, program.layers[0].poolSize);
+  // The list weights are not changed
+  EXPECT_NE(folded, weights);
+
+  NetworkCompiler<TestType> plain;
+  plain.addConvolution(p, folded, foldedBias);
+  plain.addRelu();
+  plain.addMaxPool(2, 2);
+  Program<TestType> reference = plain.compile();
+  EXPECT_EQ(reference.instructions, program.instructions);
+  MicroController<TestType> micro(program, 2, MemHParam{2, 4.0});
+  micro.setInputs(image);
+  micro.run();
+  EXPECT_EQ(referenceLayer(p, folded, foldedBias, image, 2, 2), micro.getOutputs());
+
+  // A batch norm must fold in the convolution before it, and the layers must chain
+  NetworkCompiler<TestType> wrong;
+  wrong.addRelu();
+  EXPECT_THROW(wrong.compile(), std::runtime_error);
+  NetworkCompiler<TestType> afterRelu;
+  afterRelu.addConvolution(p, weights, bias);
+  afterRelu.addRelu();
+  afterRelu.addBatchNorm(gamma, beta, mean, variance);
+  EXPECT_THROW(afterRelu.compile(), std::runtime_error);
+  NetworkCompiler<TestType> chain;
+  chain.addConvolution(p, weights, bias);
+  chain.addMaxPool(2, 2);
+  chain.addConvolution(p, weights, bias);
+  EXPECT_THROW(chain.compile(), std::runtime_error);
+  EXPECT_THROW(chain.addBatchNorm(gamma, beta, mean, {1.0}), std::runtime_error);
+  NetworkCompiler<TestType> small(6 * 6 - 1);
+  small.addConvolution(p, weights, bias);
+  EXPECT_THROW(small.compile(), std::runtime_error);
+}
+
+TEST(MicroControllerTest, TileOrderReuseTheInputs)
+{
+  // Four tiles of two channels, four blocks of two filters
+  LayerHParam p{8, 8, 8, 8, 3, 1, 1};
+  std::srand(4);
+  Tensor<TestType> weights = randomTensor<TestType>({8, 8, 3, 3}, 0.0625);
+  Tensor<TestType> bias = randomTensor<TestType>({8}, 0.125);
+  Tensor<TestType> image = randomTensor<TestType>({8, 8, 8}, 0.25);
+  long inputWords = 2 * 64, weightWords = 2 * (2 * 9 + 1);
+
+  Tensor<TestType> outputs;
+  long loads[3], reads[3];
+  // In order, backward every other block, every tile once with all the accumulators
+  for(int run = 0; run < 3; run++)
+  {
+    NetworkCompiler<TestType> compiler(inputWords, weightWords, run == 2 ? 8 * 64 : 2 * 64);
+    compiler.setTileOrdering(run > 0);
+    compiler.addConvolution(p, weights, bias);
+    compiler.addRelu();
+    Program<TestType> program = compiler.compile();
+    EXPECT_EQ(16, program.count(CONV));
+    EXPECT_EQ(16, program.count(LOAD_WEIGHTS));
+    EXPECT_EQ(4, program.count(STORE));
+    MicroController<TestType> micro(program, 2, MemHParam{2, 1.0});
+    micro.setInputs(image);
+    micro.run();
+    if(run == 0)
+    {
+      outputs = micro.getOutputs().clone();
+    }
+    EXPECT_EQ(outputs, micro.getOutputs()) << run;
+    loads[run] = program.count(LOAD_TILE);
+    reads[run] = micro.getDramReads();
+  }
+  EXPECT_EQ(16, loads[0]);
+  EXPECT_EQ(4 + 3 * 3, loads[1]);
+  EXPECT_EQ(4, loads[2]);
+  EXPECT_EQ(reads[0] - 3 * 2 * 64, reads[1]);
+  EXPECT_EQ(reads[0] - 12 * 2 * 64, reads[2]);
+}
+
+TEST(MicroControllerTest, TilesAreKeptPerBank)
+{
+  // Two tiles of two channels, one block of filters
+  LayerHParam p{8, 8, 4, 4, 3, 1, 1};
+  std::srand(5);
+  Tensor<TestType> weights = randomTensor<TestType>({4, 4, 3, 3}, 0.0625);
+  Tensor<TestType> bias = randomTensor<TestType>({4}, 0.125);
+  Tensor<TestType> image = randomTensor<TestType>({4, 8, 8}, 0.25);
+  NetworkCompiler<TestType> compiler(2 * 64, 4 * (2 * 9 + 1), 4 * 64);
+  compiler.addConvolution(p, weights, bias);
+  Program<TestType> program = compiler.compile();
+  ASSERT_EQ(LOAD_TILE, program.instructions[4].opcode);
+  MicroController<TestType> micro(program, 2, MemHParam{2, 1.0});
+  micro.setInputs(image);
+  micro.run();
+
+  // The second tile loaded in the other bank before the first CONV, both CONV read their own bank
+  Program<TestType> prefetch = program;
+  Instruction second = prefetch.instructions[4];
+  prefetch.instructions.erase(prefetch.instructions.begin() + 4);
+  prefetch.instructions.insert(prefetch.instructions.begin() + 1, second);
+  MicroController<TestType> early(prefetch, 2, MemHParam{2, 1.0});
+  early.setInputs(image);
+  early.run();
+  EXPECT_EQ(micro.getOutputs(), early.getOutputs());
+  EXPECT_EQ(micro.getConvCycles(), early.getConvCycles());
+
+  // A third load overwrite the first tile
+  Program<TestType> overwrite = prefetch;
+  overwrite.instructions.insert(overwrite.instructions.begin() + 2, second);
+  MicroController<TestType> late(overwrite, 2, MemHParam{2, 1.0});
+  late.setInputs(image);
+  EXPECT_THROW(late.run(), std::logic_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
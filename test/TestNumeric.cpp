@@ -0,0 +1,173 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Simulate a convolution layer with the backend T, return the outputs as doubles
+template <typename T>
+std::vector<double> simulate(LayerHParam p, bool shadow, const std::vector<double>& weights,
+                             const std::vector<double>& bias, const std::vector<double>& inputs)
+{
+  Tensor<T> weightsTensor({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize});
+  Tensor<T> biasTensor({p.nbOfFilter});
+  Tensor<T> inputsTensor({p.inputDepth, p.inputHeight, p.inputWidth});
+  for(int i = 0; i < weights.size(); i++){weightsTensor.data()[i] = NumericTraits<T>::fromDouble(weights[i]);}
+  for(int i = 0; i < bias.size(); i++){biasTensor.data()[i] = NumericTraits<T>::fromDouble(bias[i]);}
+  for(int i = 0; i < inputs.size(); i++){inputsTensor.data()[i] = NumericTraits<T>::fromDouble(inputs[i]);}
+
+  std::vector< CE<T> > CEs(2, CE<T>(p.filterSize, p.inputWidth + 2 * p.padding));
+  Controller<T> ctrl(CEs, p);
+  ctrl.setWeights(weightsTensor, biasTensor);
+  ctrl.setInputs(inputsTensor);
+  ctrl.setShadowWeights(shadow);
+  Simulator<T> sim(ctrl, CEs);
+  sim.run(1000000);
+  EXPECT_TRUE(ctrl.isHalted());
+
+  std::vector<double> outputs;
+  for(int i = 0; i < ctrl.getOutputs().size(); i++)
+  {
+    outputs.push_back(NumericTraits<T>::toDouble(ctrl.getOutputs().data()[i]));
+  }
+  return outputs;
+}
+
+/// Reference convolution in double
+std::vector<double> reference(LayerHParam p, const std::vector<double>& weights, const std::vector<double>& bias,
+                              const std::vector<double>& inputs)
+{
+  int outH = (p.inputHeight - p.filterSize + 2 * p.padding) / p.stride + 1;
+  int outW = (p.inputWidth - p.filterSize + 2 * p.padding) / p.stride + 1;
+  std::vector<double> outputs;
+  for(int f = 0; f < p.nbOfFilter; f++)
+    for(int y = 0; y < outH; y++)
+      for(int x = 0; x < outW; x++)
+      {
+        double sum = bias[f];
+        for(int d = 0; d < p.inputDepth; d++)
+          for(int i = 0; i < p.filterSize; i++)
+            for(int j = 0; j < p.filterSize; j++)
+            {
+              int row = y * p.stride + i - p.padding, col = x * p.stride + j - p.padding;
+              if(row >= 0 && row < p.inputHeight && col >= 0 && col < p.inputWidth)
+              {
+                sum += weights[((f * p.inputDepth + d) * p.filterSize + i) * p.filterSize + j]
+                       * inputs[(d * p.inputHeight + row) * p.inputWidth + col];
+              }
+            }
+        outputs.push_back(sum);
+      }
+  return outputs;
+}
+
+/// The tests
+template <typename T>
+class BackendTest : public ::testing::Test
+{};
+
+typedef ::testing::Types<float, double, int16_t, int32_t> NativeBackends;
+TYPED_TEST_CASE(BackendTest, NativeBackends);
+
+TYPED_TEST(BackendTest, SameLayerOnEveryBackend)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{7, 6, 2, 3, 3, 1, 1};
+  std::srand(5);
+  std::vector<double> weights(3 * 2 * 9), bias(3), inputs(2 * 6 * 7);
+  // Values exact with 4 fractional bits, the sums stay in range of every backend
+  for(int i = 0; i < weights.size(); i++){weights[i] = (std::rand() % 9 - 4) * 0.0625;}
+  for(int i = 0; i < bias.size(); i++){bias[i] = (std::rand() % 9 - 4) * 0.25;}
+  for(int i = 0; i < inputs.size(); i++){inputs[i] = (std::rand() % 9 - 4) * 0.25;}
+
+  std::vector<double> ref = reference(p, weights, bias, inputs);
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    std::vector<double> outputs = simulate<TypeParam>(p, shadow, weights, bias, inputs);
+    ASSERT_EQ(ref.size(), outputs.size());
+    for(int i = 0; i < ref.size(); i++)
+    {
+      EXPECT_NEAR(ref[i], outputs[i], 1e-6) << "output " << i;
+    }
+  }
+}
+
+TEST(NumericTest, RawWordsShiftAndSaturate)
+{
+  typedef NumericTraits<int16_t> Q8;
+  EXPECT_EQ(256, Q8::fromDouble(1.0));
+  EXPECT_EQ(-64, Q8::fromDouble(-0.25));
+  EXPECT_EQ(32767, Q8::fromDouble(1000.0));
+  EXPECT_DOUBLE_EQ(0.75, Q8::toDouble(Q8::mul(Q8::fromDouble(1.5), Q8::fromDouble(0.5))));
+  // The product is rounded half up
+  EXPECT_EQ(1, Q8::mul(1, 128));
+  EXPECT_EQ(0, Q8::mul(1, 127));
+  EXPECT_EQ(32767, Q8::add(32000, 1000));
+  // The MACs accumulate in the accumulator type, saturated when narrowed back to a word
+  EXPECT_EQ(-10001 * 256, Q8::mac(Q8::fromDouble(100), Q8::fromDouble(-100), Q8::widen(Q8::fromDouble(-1))));
+  EXPECT_EQ(-32768, Q8::narrow(Q8::mac(Q8::fromDouble(100), Q8::fromDouble(-100), Q8::widen(Q8::fromDouble(-1)))));
+  EXPECT_EQ(0, Q8::relu(-5));
+
+  typedef NumericTraits<int8_t> Q4;
+  EXPECT_EQ(16, Q4::fromDouble(1.0));
+  EXPECT_EQ(256, Q4::mac(Q4::fromDouble(4.0), Q4::fromDouble(4.0), 0));
+  EXPECT_EQ(127, Q4::narrow(Q4::mac(Q4::fromDouble(4.0), Q4::fromDouble(4.0), 0)));
+  EXPECT_EQ(-128, Q4::add(-100, -100));
+}
+
+TEST(NumericTest, Int8PartialSumsDoNotOverflow)
+{
+  // The partial sums of a window reach 10.25, past the int8_t words (Q4, at most 7.9375), but the
+  // output is 2.75. Saturated in the words, the PE and the adders would give 2.4375.
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{4, 4, 1, 1, 3, 1, 0};
+  std::vector<double> weights{1, 1, 0,
+                              -1, -1, 0,
+                              0.5, 0, 0};
+  std::vector<double> bias{0.25};
+  std::vector<double> inputs(16, 5.0);
+
+  std::vector<double> ref = reference(p, weights, bias, inputs);
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    std::vector<double> outputs = simulate<int8_t>(p, shadow, weights, bias, inputs);
+    ASSERT_EQ(ref.size(), outputs.size());
+    for(int i = 0; i < ref.size(); i++)
+    {
+      EXPECT_DOUBLE_EQ(2.75, ref[i]);
+      EXPECT_DOUBLE_EQ(ref[i], outputs[i]) << "output " << i;
+    }
+  }
+}
+
+TEST(NumericTest, FixedPointBackendUseLibfi)
+{
+  typedef NumericTraits<TestType> Fixed;
+  EXPECT_EQ(TestType(0), Fixed::zero());
+  EXPECT_EQ(TestType(0.5), Fixed::fromDouble(0.5));
+  EXPECT_EQ(TestType(0.5) * TestType(0.75) + TestType(1), Fixed::mac(TestType(0.5), TestType(0.75), TestType(1)));
+  EXPECT_EQ(TestType(0), Fixed::relu(TestType(-1)));
+  EXPECT_EQ(TestType(2), Fixed::relu(TestType(2)));
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
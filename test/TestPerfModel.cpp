@@ -0,0 +1,289 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Output registers of the CEs after every compute step of a layer, and the layer inputs
+struct OutputTrace
+{
+  std::vector< std::vector<TestType> > regs;   ///< Output register of every CE, per compute step
+  Tensor<TestType> inputs;
+  int outputHeight;
+  int outputWidth;
+};
+
+/// Run a layer and record the CE output registers, from the first compute step. A filter only keep
+/// its center tap, on the first channel, and add its index + 1. The inputs are all different and
+/// between 0 and 1, so every sum identify the filter and the window it is the output of.
+OutputTrace traceOutputs(const LayerHParam& p, int ceSize, int nbOfCEs, Mapping mapping, int unroll,
+                         int readColumns, bool shadow)
+{
+  std::vector< CE<TestType> > CEs(nbOfCEs, CE<TestType>(ceSize, p.inputWidth + 2 * p.padding,
+                                                        mapping == POINTWISE_MAPPING ? 1 : p.dilation));
+  Controller<TestType> ctrl(CEs, p, mapping);
+  Tensor<TestType> weights({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize});
+  Tensor<TestType> bias({p.nbOfFilter});
+  Tensor<TestType> inputs({p.inputDepth, p.inputHeight, p.inputWidth});
+  for(int f = 0; f < p.nbOfFilter; f++)
+  {
+    weights(f, 0, p.filterSize / 2, p.filterSize / 2) = TestType(1);
+    bias(f) = TestType(f + 1);
+  }
+  for(int i = 0; i < inputs.size(); i++){inputs.data()[i] = TestType((i + 1) / 128.0);}
+  ctrl.setWeights(weights, bias);
+  ctrl.setInputs(inputs);
+  ctrl.setPointwise(mapping == POINTWISE_MAPPING);
+  ctrl.setWindowGenerator(mapping == WINDOW_MAPPING);
+  ctrl.setSpatialUnroll(unroll);
+  ctrl.setWindowReadPort(readColumns);
+  ctrl.setShadowWeights(shadow);
+
+  OutputTrace trace;
+  while(!ctrl.isHalted())
+  {
+    bool compute = ctrl.getState() == 2 || !trace.regs.empty();
+    ctrl.step();
+    if(compute)
+    {
+      std::vector<TestType> regs;
+      for(int k = 0; k < nbOfCEs; k++){regs.push_back(CEs[k].getOutputReg());}
+      trace.regs.push_back(regs);
+    }
+  }
+  trace.inputs = inputs;
+  trace.outputHeight = ctrl.outputHeight();
+  trace.outputWidth = ctrl.outputWidth();
+  return trace;
+}
+
+/// Sum of a window of the layer of traceOutputs(), its center pixel + filter + 1
+TestType windowSum(const OutputTrace& trace, const LayerHParam& p, int filter, int hi, int wi)
+{
+  int center = p.filterSize / 2 * std::max(p.dilation, 1) - p.padding;
+  int h = hi * p.stride + center;
+  int w = wi * p.stride + center;
+  bool padded = h < 0 || h >= p.inputHeight || w < 0 || w >= p.inputWidth;
+  return TestType((padded ? 0.0 : (double)trace.inputs(0, h, w)) + filter + 1);
+}
+
+/// First compute step, from a step, where the output register of a CE hold a value. -1 if never
+int firstStepOf(const OutputTrace& trace, int ce, TestType value, int from)
+{
+  for(int i = from; i < (int)trace.regs.size(); i++)
+  {
+    if(trace.regs[i][ce] == value){return i;}
+  }
+  return -1;
+}
+
+/// The tests
+TEST(PerfModelTest, MatchesTheSimulationOnRandomShapes)
+{
+  std::srand(35);
+  for(int t = 0; t < 150; t++)
+  {
+    // Random convolution, with or without the window generator, spatial unroll and folding, or
+    // pointwise layer on a CE of any size
+    LayerHParam layerHParam = LayerHParam();
+    bool pointwise = std::rand() % 4 == 0;
+    int groups = 1 + std::rand() % 3;
+    layerHParam.filterSize = pointwise ? 1 : 1 + std::rand() % 4;
+    layerHParam.stride = 1 + std::rand() % 3;
+    layerHParam.padding = std::rand() % layerHParam.filterSize;
+    layerHParam.groups = (std::rand() % 2) ? groups : 0;
+    groups = layerHParam.groups > 0 ? groups : 1;
+    layerHParam.inputWidth = layerHParam.filterSize + std::rand() % 8;
+    layerHParam.inputHeight = layerHParam.filterSize + std::rand() % 8;
+    layerHParam.inputDepth = groups * (1 + std::rand() % (pointwise ? 12 : 3));
+    layerHParam.nbOfFilter = groups * (1 + std::rand() % 4);
+    int ceSize = pointwise ? 1 + std::rand() % 3 : layerHParam.filterSize;
+    int nbOfCEs = 1 + std::rand() % 3;
+    bool shadow = std::rand() % 2;
+    bool windowed = !pointwise && t % 3 == 1;
+    int unroll = (windowed && t % 2) ? nbOfCEs : 1;
+    // The window generator fold the filter on a CE of any size, or pack the channels
+    bool packing = windowed && t % 4 == 1;
+    // The window generator read port, 0 for the columns of a step
+    int readColumns = windowed ? t % 4 : 0;
+    ceSize = windowed ? 1 + (t / 3) % 5 : ceSize;
+    // The line buffer path run dilated filters
+    layerHParam.dilation = (!windowed && !pointwise && t % 5 == 2) ? 2 + t % 2 : 1;
+    int extent = (layerHParam.filterSize - 1) * layerHParam.dilation + 1;
+    layerHParam.inputWidth = std::max(layerHParam.inputWidth, extent);
+    layerHParam.inputHeight = std::max(layerHParam.inputHeight, extent);
+
+    std::vector< CE<TestType> > CEs(nbOfCEs, CE<TestType>(ceSize, layerHParam.inputWidth + layerHParam.padding * 2,
+                                                          pointwise ? 1 : layerHParam.dilation));
+    Controller<TestType> ctrl(CEs, layerHParam, pointwise ? POINTWISE_MAPPING : (windowed ? WINDOW_MAPPING : STREAM_MAPPING));
+    ctrl.setWeights(Tensor<TestType>({layerHParam.nbOfFilter, layerHParam.inputDepth / groups,
+                                      layerHParam.filterSize, layerHParam.filterSize}),
+                    Tensor<TestType>({layerHParam.nbOfFilter}));
+    ctrl.setInputs(Tensor<TestType>({layerHParam.inputDepth, layerHParam.inputHeight, layerHParam.inputWidth}));
+    ctrl.setPointwise(pointwise);
+    ctrl.setWindowGenerator(windowed);
+    ctrl.setChannelPacking(packing);
+    ctrl.setSpatialUnroll(unroll);
+    ctrl.setWindowReadPort(readColumns);
+    ctrl.setShadowWeights(shadow);
+    Simulator<TestType> sim(ctrl, CEs);
+    sim.run(10000000);
+    ASSERT_TRUE(ctrl.isHalted());
+
+    PerfModel model(layerHParam, ceSize, nbOfCEs, MemHParam{2, 4.0});
+    model.setPointwise(pointwise);
+    model.setWindowGenerator(windowed);
+    model.setChannelPacking(packing);
+    model.setSpatialUnroll(unroll);
+    model.setWindowReadPort(readColumns);
+    model.setShadowWeights(shadow);
+    EXPECT_EQ(ctrl.getTotalSteps(), model.getCycles()) << "case " << t;
+    EXPECT_EQ(ctrl.getMacs(), model.getMacs()) << "case " << t;
+    EXPECT_EQ(ctrl.getWeightFetches(), model.getWeightFetches()) << "case " << t;
+    if(nbOfCEs > 1)
+    {
+      EXPECT_EQ(ctrl.getInputWrites(), model.getLineBufferWrites()) << "case " << t;
+    }
+    EXPECT_GT(model.getUtilization(), 0.0);
+    EXPECT_LE(model.getUtilization(), 1.0);
+  }
+}
+
+TEST(PerfModelTest, PassTimingMatchesTheCEOutputs)
+{
+  // The steps where the sums leave the CEs, independently of the steps the Controller save them.
+  // The layers end on a full window, their last output leave on the last step of the pass.
+  struct Case
+  {
+    LayerHParam p;
+    int ceSize;
+    int nbOfCEs;
+    Mapping mapping;
+    int unroll;
+    int readColumns;
+  };
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type, dilation
+  std::vector<Case> cases = {
+      {LayerHParam{7, 6, 1, 2, 3, 1, 1}, 3, 1, STREAM_MAPPING, 1, 0},
+      {LayerHParam{7, 7, 1, 2, 3, 2, 0, 1, CONVOLUTION, 2}, 3, 1, STREAM_MAPPING, 1, 0},
+      {LayerHParam{5, 4, 4, 2, 1, 1, 0}, 2, 1, POINTWISE_MAPPING, 1, 0},
+      {LayerHParam{6, 5, 1, 2, 3, 1, 1}, 3, 1, WINDOW_MAPPING, 1, 0},
+      {LayerHParam{6, 5, 1, 2, 3, 1, 1}, 3, 1, WINDOW_MAPPING, 1, 1},
+      {LayerHParam{6, 5, 1, 2, 3, 1, 1}, 3, 2, WINDOW_MAPPING, 2, 0}};
+
+  for(int c = 0; c < (int)cases.size(); c++)
+  {
+    const Case& t = cases[c];
+    PassTiming timing = passTiming(t.p, PassDatapath{t.ceSize, t.p.inputWidth + 2 * t.p.padding,
+                                                     t.mapping == POINTWISE_MAPPING, t.mapping == WINDOW_MAPPING,
+                                                     t.unroll, t.readColumns, 0});
+
+    // One filter per pass, the passes drained between them
+    OutputTrace trace = traceOutputs(t.p, t.ceSize, t.nbOfCEs, t.mapping, t.unroll, t.readColumns, false);
+    int outH = trace.outputHeight;
+    int outW = trace.outputWidth;
+    int lastCE = (outW - 1) % t.unroll;
+    // The first window of a row is complete after its refill
+    int first = firstStepOf(trace, 0, windowSum(trace, t.p, 0, 0, 0), 0);
+    EXPECT_EQ(timing.outputSteps + timing.rowStartSteps - 1, first) << "case " << c;
+    EXPECT_EQ(timing.maxStep - 1, firstStepOf(trace, lastCE, windowSum(trace, t.p, 0, outH - 1, outW - 1), first))
+        << "case " << c;
+
+    // The shadow bank stream the second filter a frame period after the first, without bubble
+    trace = traceOutputs(t.p, t.ceSize, t.nbOfCEs, t.mapping, t.unroll, t.readColumns, true);
+    first = firstStepOf(trace, 0, windowSum(trace, t.p, 0, 0, 0), 0);
+    EXPECT_EQ(timing.framePeriod + first, firstStepOf(trace, 0, windowSum(trace, t.p, 1, 0, 0), first + 1))
+        << "case " << c;
+  }
+}
+
+TEST(PerfModelTest, FullyConnectedBatch)
+{
+  // inputWidth (batch), inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  LayerHParam layerHParam{8, 1, 20, 6, 1, 1, 0, 0, FULLY_CONNECTED};
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 1));
+  Controller<TestType> ctrl(CEs, layerHParam);
+  ctrl.setWeights(Tensor<TestType>({6, 20}), Tensor<TestType>({6}));
+  ctrl.setInputs(Tensor<TestType>({8, 20}));
+  ctrl.setShadowWeights(true);
+  while(!ctrl.isHalted())
+  {
+    ctrl.step();
+  }
+
+  PerfModel model(layerHParam, 3, 1, MemHParam{2, 4.0});
+  model.setShadowWeights(true);
+  EXPECT_EQ(ctrl.getTotalSteps(), model.getCycles());
+  EXPECT_EQ(3 * 6 * 9, model.getWeightFetches());
+}
+
+TEST(PerfModelTest, BuffersAndDramTraffic)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  PerfModel model(LayerHParam{8, 6, 4, 5, 3, 1, 1}, 3, 2, MemHParam{2, 4.0});
+  EXPECT_EQ(8, model.outputWidth());
+  EXPECT_EQ(6, model.outputHeight());
+  // Every input channel is streamed once per block of 2 filters
+  EXPECT_EQ(3, model.getBlocks());
+  EXPECT_EQ(3 * 4 * 8 * 6, model.getInputReads());
+  // Every filter accumulate one partial output plane per input channel
+  EXPECT_EQ(2 * 4 * 5 * 8 * 6, model.getOutputAccesses());
+  // Inputs, weights, bias and outputs, 2 bytes each
+  long words = 4 * 8 * 6 + 5 * 4 * 9 + 5 + 5 * 8 * 6;
+  EXPECT_EQ(2 * words, model.getDramBytes());
+  EXPECT_EQ((2 * words + 3) / 4, model.getDramCycles());
+
+  // An input buffer too small for the layer inputs is refilled for every block
+  PerfModel tiled(LayerHParam{8, 6, 4, 5, 3, 1, 1}, 3, 2, MemHParam{2, 4.0, 4 * 8 * 6 - 1});
+  EXPECT_EQ(3, tiled.getInputFetches());
+  EXPECT_EQ(model.getDramBytes() + 2 * 2 * 4 * 8 * 6, tiled.getDramBytes());
+}
+
+TEST(PerfModelTest, SpatialUnrollTradeAreaForThroughput)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam layerHParam{16, 16, 4, 8, 3, 1, 1};
+  long cycles[5];
+  for(int unroll = 1; unroll <= 4; unroll *= 2)
+  {
+    // Two filters computed in parallel, unroll CEs each
+    PerfModel model(layerHParam, 3, 2 * unroll, MemHParam{2, 4.0});
+    model.setWindowGenerator(true);
+    model.setSpatialUnroll(unroll);
+    cycles[unroll] = model.getCycles();
+    Resources resources = model.getResources();
+    EXPECT_EQ(2 * unroll * 9, resources.pes);
+    EXPECT_EQ(2 * unroll, resources.outputRegisters);
+    EXPECT_EQ(3 * (unroll + 2), resources.windowRegisters);
+    EXPECT_EQ(3 * unroll, resources.windowReadWords);
+    EXPECT_EQ(3 * 18, resources.lineBufferWords);
+  }
+  EXPECT_LT(cycles[2], cycles[1]);
+  EXPECT_LT(cycles[4], cycles[2]);
+
+  PerfModel model(layerHParam, 3, 2, MemHParam{2, 4.0});
+  EXPECT_THROW(model.setSpatialUnroll(2), std::runtime_error);
+  model.setWindowGenerator(true);
+  EXPECT_THROW(model.setSpatialUnroll(3), std::runtime_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,167 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/overflow/Throw.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/NumericTraits.hpp"
+#include "CNNP/RangeProfile.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+typedef Fi::Fixed<8,4,Fi::SIGNED,Fi::Throw,Fi::Classic> ThrowType;
+
+/// Run a convolution layer with deterministic random values scaled by scale, return its profile
+template <typename T>
+RangeProfile<T> profileLayer(LayerHParam p, double scale, Tensor<T>& outputs, bool tracking = true)
+{
+  Tensor<T> weights({p.nbOfFilter, p.inputDepth, p.filterSize, p.filterSize});
+  Tensor<T> bias({p.nbOfFilter});
+  Tensor<T> inputs({p.inputDepth, p.inputHeight, p.inputWidth});
+  std::srand(7);
+  for(int i = 0; i < weights.size(); i++){weights.data()[i] = NumericTraits<T>::fromDouble((std::rand() % 9 - 4) * 0.25);}
+  for(int i = 0; i < bias.size(); i++){bias.data()[i] = NumericTraits<T>::fromDouble((std::rand() % 9 - 4) * 0.25);}
+  for(int i = 0; i < inputs.size(); i++){inputs.data()[i] = NumericTraits<T>::fromDouble((std::rand() % 9 - 4) * scale);}
+
+  std::vector< CE<T> > CEs(2, CE<T>(p.filterSize, p.inputWidth + 2 * p.padding));
+  Controller<T> ctrl(CEs, p);
+  ctrl.setWeights(weights, bias);
+  ctrl.setInputs(inputs);
+  if(tracking)
+  {
+    Simulator<T> sim(ctrl, CEs);
+    sim.run(1000000);
+  }
+  else
+  {
+    // Every CE step, every row, no fast-forward
+    for(int k = 0; k < CEs.size(); k++){CEs[k].setActivityTracking(false);}
+    for(int i = 0; i < 1000000 && !ctrl.isHalted(); i++){ctrl.step();}
+  }
+  EXPECT_TRUE(ctrl.isHalted());
+  outputs = ctrl.getOutputs().clone();
+  return ctrl.getRangeProfile();
+}
+
+/// The tests
+TEST(RangeProfileTest, RailsOfTheBackends)
+{
+  EXPECT_EQ(32767, NumericTraits<int16_t>::maxValue());
+  EXPECT_EQ(-128, NumericTraits<int8_t>::minValue());
+  EXPECT_EQ(FLT_MAX, NumericTraits<float>::maxValue());
+  // Found by the saturating operators of libfi
+  EXPECT_EQ(TestType(128 - 1.0 / 256), NumericTraits<TestType>::maxValue());
+  EXPECT_EQ(TestType(-128), NumericTraits<TestType>::minValue());
+  // Refined below the largest power of 2 when the type throw
+  EXPECT_EQ(ThrowType(8 - 1.0 / 16), NumericTraits<ThrowType>::maxValue());
+  EXPECT_EQ(ThrowType(-8), NumericTraits<ThrowType>::minValue());
+  EXPECT_TRUE(NumericTraits<TestType>::saturates());
+  EXPECT_TRUE(NumericTraits<int8_t>::saturates());
+  EXPECT_FALSE(NumericTraits<ThrowType>::saturates());
+  EXPECT_FALSE(NumericTraits<float>::saturates());
+
+  // Only a clamping type count its rails
+  RangeStats<ThrowType> railStats;
+  railStats.record(NumericTraits<ThrowType>::maxValue());
+  EXPECT_EQ(0, railStats.saturations);
+
+  RangeStats<int16_t> stats;
+  stats.record(-3);
+  stats.record(32767);
+  stats.record(5);
+  RangeStats<int16_t> other;
+  other.record(-32768);
+  stats += other;
+  EXPECT_EQ(4, stats.samples);
+  EXPECT_EQ(2, stats.saturations);
+  EXPECT_EQ(-32768, stats.min);
+  EXPECT_EQ(32767, stats.max);
+}
+
+TEST(RangeProfileTest, LayerRangesAndSaturations)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerHParam p{8, 7, 4, 3, 3, 1, 1};
+  Tensor<TestType> outputs;
+  RangeProfile<TestType> profile = profileLayer<TestType>(p, 0.25, outputs);
+  EXPECT_EQ(0, profile.saturations());
+  EXPECT_GT(profile.peOutputs.samples, 0);
+  EXPECT_GT(profile.syncRegs.samples, 0);
+  EXPECT_GT(profile.adders.samples, 0);
+  EXPECT_GT(profile.outputs.samples, 0);
+  // Every chunk accumulate in the outputs
+  EXPECT_GE(profile.accumulators.samples, outputs.size());
+  TestType min = outputs.data()[0], max = outputs.data()[0];
+  for(int i = 0; i < outputs.size(); i++)
+  {
+    if(outputs.data()[i] < min){min = outputs.data()[i];}
+    if(outputs.data()[i] > max){max = outputs.data()[i];}
+  }
+  EXPECT_TRUE(profile.accumulators.min <= min);
+  EXPECT_TRUE(profile.accumulators.max >= max);
+  EXPECT_TRUE(profile.adders.max >= profile.outputs.max);
+
+  // Inputs near the rails saturate the datapath
+  profile = profileLayer<TestType>(p, 30.0, outputs);
+  EXPECT_GT(profile.peOutputs.saturations, 0);
+  EXPECT_GT(profile.saturations(), profile.peOutputs.saturations);
+
+  Tensor<int16_t> wordOutputs;
+  RangeProfile<int16_t> words = profileLayer<int16_t>(p, 30.0, wordOutputs);
+  EXPECT_GT(words.saturations(), 0);
+}
+
+TEST(RangeProfileTest, SameProfileWithoutActivityTracking)
+{
+  // Sparse rows of zeros, so rows and steps are skipped
+  LayerHParam p{8, 7, 4, 3, 3, 1, 2};
+  Tensor<TestType> tracked, stepped;
+  RangeProfile<TestType> fast = profileLayer<TestType>(p, 30.0, tracked, true);
+  RangeProfile<TestType> slow = profileLayer<TestType>(p, 30.0, stepped, false);
+  EXPECT_EQ(stepped, tracked);
+  const RangeStats<TestType>* a[] = {&fast.peOutputs, &fast.syncRegs, &fast.adders, &fast.outputs, &fast.accumulators};
+  const RangeStats<TestType>* b[] = {&slow.peOutputs, &slow.syncRegs, &slow.adders, &slow.outputs, &slow.accumulators};
+  for(int i = 0; i < 5; i++)
+  {
+    EXPECT_EQ(b[i]->samples, a[i]->samples) << "point " << i;
+    EXPECT_EQ(b[i]->saturations, a[i]->saturations) << "point " << i;
+    EXPECT_EQ(b[i]->min, a[i]->min) << "point " << i;
+    EXPECT_EQ(b[i]->max, a[i]->max) << "point " << i;
+  }
+}
+
+TEST(RangeProfileTest, ReportHasOneLinePerPoint)
+{
+  RangeProfile<int8_t> profile;
+  // The output register is a word, the adders are in the accumulator type
+  profile.outputs.record(-128);
+  profile.outputs.record(12);
+  profile.adders.record(-128);
+  std::ostringstream os;
+  profile.write(os, "conv1");
+  std::string report = os.str();
+  EXPECT_NE(std::string::npos, report.find("conv1,output,2,1,-128,12\n"));
+  EXPECT_NE(std::string::npos, report.find("conv1,adder,1,0,-128,-128\n"));
+  EXPECT_NE(std::string::npos, report.find("conv1,pe,0,0,0,0\n"));
+  EXPECT_EQ(5, std::count(report.begin(), report.end(), '\n'));
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,88 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/PerfModel.hpp"
+#include "CNNP/Roofline.hpp"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+
+/// The tests
+TEST(RooflineTest, LayersAgainstTheRoofs)
+{
+  MemHParam memHParam{2, 4.0, 0};
+  Roofline roofline(18, memHParam, 100.0);
+  EXPECT_DOUBLE_EQ(1.8e9, roofline.getPeak());
+  EXPECT_DOUBLE_EQ(4e8, roofline.getBandwidth());
+  EXPECT_DOUBLE_EQ(4.5, roofline.getRidge());
+
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+  PerfModel conv(LayerHParam{32, 32, 8, 16, 3, 1, 1, 0, CONVOLUTION}, 3, 2, memHParam);
+  PerfModel fc(LayerHParam{1, 1, 512, 10, 1, 1, 0, 0, FULLY_CONNECTED}, 3, 2, memHParam);
+  roofline.addLayer("conv", conv, -1);
+  roofline.addLayer("fc", fc, 1000000);
+
+  const RooflinePoint& convPoint = roofline.getLayers()[0];
+  EXPECT_DOUBLE_EQ(double(conv.getMacs()) / conv.getDramBytes(), convPoint.intensity);
+  EXPECT_FALSE(convPoint.memoryBound);
+  EXPECT_DOUBLE_EQ(roofline.getPeak(), convPoint.attainable);
+  EXPECT_EQ(conv.getCycles(), convPoint.cycles);
+  EXPECT_LE(convPoint.simulated, convPoint.attainable);
+
+  // A fully connected layer use every weight once
+  const RooflinePoint& fcPoint = roofline.getLayers()[1];
+  EXPECT_TRUE(fcPoint.memoryBound);
+  EXPECT_DOUBLE_EQ(fcPoint.intensity * roofline.getBandwidth(), fcPoint.attainable);
+  EXPECT_DOUBLE_EQ(fc.getMacs() * 100e6 / 1000000, fcPoint.simulated);
+}
+
+TEST(RooflineTest, SimulatedDmaCycles)
+{
+  MemHParam memHParam{2, 4.0, 0};
+  Roofline roofline(18, memHParam, 100.0);
+  PerfModel fc(LayerHParam{1, 1, 512, 10, 1, 1, 0, 0, FULLY_CONNECTED}, 3, 2, memHParam);
+  roofline.addLayer("model", fc, 100);
+  roofline.addLayer("dma", fc, 100, 4 * fc.getDramCycles());
+
+  // The simulated transfers replace the model estimate of a memory bound layer
+  const RooflinePoint& model = roofline.getLayers()[0];
+  const RooflinePoint& dma = roofline.getLayers()[1];
+  EXPECT_EQ(fc.getDramCycles(), model.dramCycles);
+  EXPECT_EQ(4 * fc.getDramCycles(), dma.dramCycles);
+  EXPECT_DOUBLE_EQ(fc.getMacs() * 100e6 / dma.dramCycles, dma.simulated);
+  EXPECT_DOUBLE_EQ(model.simulated / 4, dma.simulated);
+  EXPECT_EQ(model.intensity, dma.intensity);
+}
+
+TEST(RooflineTest, CsvAndChart)
+{
+  MemHParam memHParam{2, 4.0, 0};
+  Roofline roofline(9, memHParam, 100.0);
+  PerfModel conv(LayerHParam{16, 16, 4, 4, 3, 1, 1, 0, CONVOLUTION}, 3, 1, memHParam);
+  roofline.addLayer("conv", conv, -1);
+
+  std::ostringstream csv;
+  roofline.writeCsv(csv);
+  std::string header, line;
+  std::istringstream lines(csv.str());
+  std::getline(lines, header);
+  std::getline(lines, line);
+  EXPECT_EQ(0u, header.find("layer,macs,dram_bytes,intensity"));
+  EXPECT_EQ(0u, line.find("conv,"));
+  EXPECT_NE(std::string::npos, line.find(",compute"));
+
+  std::ostringstream chart;
+  roofline.writeChart(chart, 40, 10);
+  EXPECT_NE(std::string::npos, chart.str().find('1'));
+  EXPECT_NE(std::string::npos, chart.str().find('/'));
+  EXPECT_NE(std::string::npos, chart.str().find("1 conv"));
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
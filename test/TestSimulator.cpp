@@ -0,0 +1,712 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/Simulator.hpp"
+#include "CNNP/Controller.hpp"
+#include "CNNP/CE.hpp"
+#include "CNNP/HyperParams.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "CNNP/Tensor.hpp"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef Fi::Fixed<16,8,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// Test data structures
+struct LayerData
+{
+  Tensor<TestType> weights;
+  Tensor<TestType> inputs;
+  Tensor<TestType> bias;
+  LayerHParam layerHParam;
+  double density;
+
+  friend std::ostream&operator<<(std::ostream& os, const LayerData& obj)
+  {
+    return os
+        << "inputWidth:" << obj.layerHParam.inputWidth
+        << " filterSize:" << obj.layerHParam.filterSize
+        << " padding:" << obj.layerHParam.padding
+        << " groups:" << obj.layerHParam.groups
+        << " dilation:" << obj.layerHParam.dilation
+        << " density:" << obj.density;
+  }
+};
+
+/// Make a layer with deterministic random values. Only a "density" fraction of the inputs are non zero.
+LayerData makeLayer(LayerHParam layerHParam, double density, unsigned int seed)
+{
+  LayerData data;
+  data.layerHParam = layerHParam;
+  data.density = density;
+  std::srand(seed);
+  int groupDepth = layerHParam.inputDepth / (layerHParam.groups > 0 ? layerHParam.groups : 1);
+
+  data.weights = Tensor<TestType>({layerHParam.nbOfFilter, groupDepth, layerHParam.filterSize, layerHParam.filterSize});
+  data.inputs = Tensor<TestType>({layerHParam.inputDepth, layerHParam.inputHeight, layerHParam.inputWidth});
+  data.bias = Tensor<TestType>({layerHParam.nbOfFilter});
+  data.bias.fill(TestType(0.5));
+
+  for(int f = 0; f < layerHParam.nbOfFilter; f++)
+    for(int d = 0; d < groupDepth; d++)
+      for(int i = 0; i < layerHParam.filterSize; i++)
+        for(int j = 0; j < layerHParam.filterSize; j++)
+          data.weights(f, d, i, j) = TestType((std::rand() % 9 - 4) * 0.25);
+
+  for(int d = 0; d < layerHParam.inputDepth; d++)
+    for(int i = 0; i < layerHParam.inputHeight; i++)
+      for(int j = 0; j < layerHParam.inputWidth; j++)
+        if(std::rand() % 100 < density * 100)
+          data.inputs(d, i, j) = TestType((std::rand() % 9 - 4) * 0.25);
+
+  return data;
+}
+
+/// Reference convolution
+Tensor<TestType> refConv(const LayerData& data, int outH, int outW)
+{
+  const LayerHParam& p = data.layerHParam;
+  int groups = p.groups > 0 ? p.groups : 1;
+  int dilation = p.dilation > 0 ? p.dilation : 1;
+  int groupDepth = p.inputDepth / groups;
+  Tensor<TestType> out({p.nbOfFilter, outH, outW});
+  for(int f = 0; f < p.nbOfFilter; f++)
+    for(int y = 0; y < outH; y++)
+      for(int x = 0; x < outW; x++)
+      {
+        TestType sum = data.bias(f);
+        int firstChannel = (f / (p.nbOfFilter / groups)) * groupDepth;
+        for(int d = 0; d < groupDepth; d++)
+          for(int i = 0; i < p.filterSize; i++)
+            for(int j = 0; j < p.filterSize; j++)
+            {
+              int inY = y * p.stride + i * dilation - p.padding;
+              int inX = x * p.stride + j * dilation - p.padding;
+              if(inY >= 0 && inX >= 0 && inY < p.inputHeight && inX < p.inputWidth)
+              {
+                sum = sum + data.weights(f, d, i, j) * data.inputs(firstChannel + d, inY, inX);
+              }
+            }
+        out(f, y, x) = sum;
+      }
+  return out;
+}
+
+/// Test cases
+struct SimTestCase : testing::TestWithParam<LayerData> {};
+
+/// The tests
+TEST_P(SimTestCase, SameOutputsAsLockstep)
+{
+  // Get the data
+  const ParamType data = GetParam();
+  int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+
+  // Lockstep reference, every module stepped every cycle
+  std::vector< CE<TestType> > lockCEs(1, CE<TestType>(data.layerHParam.filterSize, fifoSize));
+  lockCEs.front().setActivityTracking(false);
+  Controller<TestType> lockCtrl(lockCEs, data.layerHParam);
+  lockCtrl.setWeights(data.weights, data.bias);
+  lockCtrl.setInputs(data.inputs);
+  long lockCycles = 0;
+  while(!lockCtrl.isHalted())
+  {
+    lockCtrl.step();
+    lockCycles++;
+  }
+
+  // Activity tracking kernel
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(data.layerHParam.filterSize, fifoSize));
+  Controller<TestType> ctrl(CEs, data.layerHParam);
+  ctrl.setWeights(data.weights, data.bias);
+  ctrl.setInputs(data.inputs);
+  Simulator<TestType> sim(ctrl, CEs.front());
+  sim.run(lockCycles * 2);
+
+  EXPECT_TRUE(ctrl.isHalted());
+  EXPECT_EQ(lockCycles, sim.getCycles());
+  EXPECT_EQ(lockCycles, CEs.front().getSteps());
+  EXPECT_EQ(sim.getCycles(), sim.getSteppedCycles() + sim.getSkippedCycles());
+  EXPECT_EQ(lockCtrl.getOutputs(), ctrl.getOutputs());
+  EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs());
+}
+
+TEST(SimTest, SparsePaddedLayerIsFastForwarded)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerData data = makeLayer(LayerHParam{16,16,1,1,3,1,2}, 0.0, 1);
+  data.inputs(0, 15, 15) = TestType(1);
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 20));
+  Controller<TestType> ctrl(CEs, data.layerHParam);
+  ctrl.setWeights(data.weights, data.bias);
+  ctrl.setInputs(data.inputs);
+  Simulator<TestType> sim(ctrl, CEs.front());
+  sim.run(100000);
+
+  EXPECT_TRUE(ctrl.isHalted());
+  // Every idle step, up to the last input, is skipped
+  EXPECT_GT(sim.getSkippedCycles(), sim.getCycles() / 2);
+  EXPECT_EQ(CEs.front().getIdleSteps(), sim.getSkippedCycles());
+  EXPECT_GT(CEs.front().getSkippedRowSteps(), 0);
+  EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs());
+}
+
+TEST(SimTest, ZeroRowsAndDrainAreFastForwarded)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerData data = makeLayer(LayerHParam{16,16,2,3,3,1,1}, 0.0, 2);
+  // Non zero inputs in the first rows only, the rest of every pass is zero rows, padding and drain
+  for(int j = 0; j < 15; j += 3)
+  {
+    data.inputs(0, 1, j) = TestType(1);
+    data.inputs(1, 2, j + 1) = TestType(-0.5);
+  }
+
+  for(int shadow = 0; shadow < 2; shadow++)
+  {
+    // Lockstep reference
+    std::vector< CE<TestType> > lockCEs(2, CE<TestType>(3, 18));
+    Controller<TestType> lockCtrl(lockCEs, data.layerHParam);
+    lockCtrl.setWeights(data.weights, data.bias);
+    lockCtrl.setInputs(data.inputs);
+    lockCtrl.setShadowWeights(shadow);
+    while(!lockCtrl.isHalted())
+    {
+      lockCtrl.step();
+    }
+
+    std::vector< CE<TestType> > CEs(2, CE<TestType>(3, 18));
+    Controller<TestType> ctrl(CEs, data.layerHParam);
+    ctrl.setWeights(data.weights, data.bias);
+    ctrl.setInputs(data.inputs);
+    ctrl.setShadowWeights(shadow);
+    Simulator<TestType> sim(ctrl, CEs);
+    sim.run(1000000);
+
+    EXPECT_TRUE(ctrl.isHalted());
+    EXPECT_EQ(lockCtrl.getTotalSteps(), sim.getCycles());
+    EXPECT_EQ(lockCtrl.getOutputs(), ctrl.getOutputs());
+    EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs());
+    EXPECT_EQ(lockCtrl.getEventCounts().bufferReads, ctrl.getEventCounts().bufferReads);
+    EXPECT_EQ(lockCtrl.getEventCounts().bufferWrites, ctrl.getEventCounts().bufferWrites);
+    // Past the first rows, the passes are skipped up to their last step
+    EXPECT_GT(sim.getSkippedCycles(), sim.getCycles() / 2);
+  }
+}
+
+TEST(SimTest, SnapshotForkAndResume)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerData data = makeLayer(LayerHParam{8,8,2,2,3,1,1}, 0.5, 7);
+  int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, fifoSize));
+  Controller<TestType> ctrl(CEs, data.layerHParam);
+  ctrl.setWeights(data.weights, data.bias);
+  ctrl.setInputs(data.inputs);
+  Simulator<TestType> sim(ctrl, CEs.front());
+
+  // Warm up past the first FIFO fill-up, then checkpoint
+  sim.run(ctrl.passSteps() + ctrl.passSteps() / 2);
+  Snapshot snap;
+  sim.save(snap);
+  snap.saveToFile("TestSimulator.snapshot");
+  sim.run(100000);
+  ASSERT_TRUE(ctrl.isHalted());
+
+  // Fork twice from memory, and resume once from the file. The weights and inputs come from the snapshot
+  for(int fork = 0; fork < 3; fork++)
+  {
+    std::vector< CE<TestType> > forkCEs(1, CE<TestType>(3, fifoSize));
+    Controller<TestType> forkCtrl(forkCEs, data.layerHParam);
+    Simulator<TestType> forkSim(forkCtrl, forkCEs.front());
+
+    Snapshot fileSnap;
+    if(fork == 2)
+    {
+      fileSnap.loadFromFile("TestSimulator.snapshot");
+      forkSim.restore(fileSnap);
+    }
+    else
+    {
+      snap.rewind();
+      forkSim.restore(snap);
+    }
+    forkSim.run(100000);
+
+    EXPECT_TRUE(forkCtrl.isHalted());
+    EXPECT_EQ(sim.getCycles(), forkSim.getCycles());
+    EXPECT_EQ(ctrl.getOutputs(), forkCtrl.getOutputs());
+  }
+  std::remove("TestSimulator.snapshot");
+
+  // The layer must match, field by field
+  LayerHParam other = data.layerHParam;
+  other.dilation = 2;
+  std::vector< CE<TestType> > otherCEs(1, CE<TestType>(3, fifoSize, 2));
+  Controller<TestType> otherCtrl(otherCEs, other);
+  snap.rewind();
+  EXPECT_THROW(Simulator<TestType>(otherCtrl, otherCEs.front()).restore(snap), std::runtime_error);
+}
+
+TEST(SimTest, ShadowWeightsHideFilterSwitch)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  const LayerHParam layers[] = {LayerHParam{8,8,2,3,3,1,1}, LayerHParam{6,7,3,2,1,1,0},
+                                LayerHParam{9,9,1,4,5,2,2}, LayerHParam{3,3,2,2,2,1,1}};
+  for(int l = 0; l < 4; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.7, 10 + l);
+    int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+    long cycles[2];
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      std::vector< CE<TestType> > CEs(1, CE<TestType>(data.layerHParam.filterSize, fifoSize));
+      Controller<TestType> ctrl(CEs, data.layerHParam);
+      ctrl.setWeights(data.weights, data.bias);
+      ctrl.setInputs(data.inputs);
+      ctrl.setShadowWeights(shadow);
+      Simulator<TestType> sim(ctrl, CEs.front());
+      cycles[shadow] = sim.run(1000000);
+
+      EXPECT_TRUE(ctrl.isHalted()) << data;
+      EXPECT_EQ(cycles[shadow], ctrl.getTotalSteps()) << data;
+      EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data;
+      if(shadow)
+      {
+        EXPECT_EQ(long(Controller<TestType>::weightLoadSteps), ctrl.getExposedLoadSteps()) << data;
+        EXPECT_GT(ctrl.getHiddenLoadSteps(), 0) << data;
+      }
+    }
+    EXPECT_LT(cycles[1], cycles[0]) << data;
+  }
+}
+
+TEST(SimTest, GroupedAndDepthwiseLayers)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam layers[] = {LayerHParam{7,6,4,4,3,1,1,4}, LayerHParam{6,6,4,6,3,2,1,2},
+                                LayerHParam{8,5,3,6,2,1,0,3}};
+  for(int l = 0; l < 3; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 20 + l);
+    int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      std::vector< CE<TestType> > CEs(1, CE<TestType>(data.layerHParam.filterSize, fifoSize));
+      Controller<TestType> ctrl(CEs, data.layerHParam);
+      ctrl.setWeights(data.weights, data.bias);
+      ctrl.setInputs(data.inputs);
+      ctrl.setShadowWeights(shadow);
+      Simulator<TestType> sim(ctrl, CEs.front());
+      sim.run(1000000);
+
+      EXPECT_TRUE(ctrl.isHalted()) << data;
+      EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 8));
+  EXPECT_THROW(Controller<TestType>(CEs, LayerHParam{8,8,4,6,3,1,0,4}), std::runtime_error);
+}
+
+TEST(SimTest, PointwiseModeMatchesReference)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam layers[] = {LayerHParam{5,4,9,3,1,1,0}, LayerHParam{6,6,20,4,1,1,0},
+                                LayerHParam{7,5,12,4,1,2,0,2}, LayerHParam{1,1,5,3,1,1,0}};
+  for(int l = 0; l < 4; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 30 + l);
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      // The same 3x3 CE for every layer, its FIFOs are bypassed
+      std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 3));
+      Controller<TestType> ctrl(CEs, data.layerHParam, POINTWISE_MAPPING);
+      ctrl.setWeights(data.weights, data.bias);
+      ctrl.setInputs(data.inputs);
+      ctrl.setShadowWeights(shadow);
+      Simulator<TestType> sim(ctrl, CEs.front());
+      sim.run(1000000);
+
+      EXPECT_TRUE(ctrl.isHalted()) << data;
+      EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 8));
+  Controller<TestType> ctrl(CEs, LayerHParam{8,8,1,1,3,1,0});
+  EXPECT_THROW(ctrl.setPointwise(true), std::runtime_error);
+}
+
+TEST(SimTest, WindowGeneratorSkipsRowTransitions)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam layers[] = {LayerHParam{7,6,3,4,3,1,1}, LayerHParam{9,7,4,4,3,2,1,2},
+                                LayerHParam{6,6,4,4,3,1,0,4}, LayerHParam{8,5,2,3,2,1,1}};
+  for(int l = 0; l < 4; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 40 + l);
+    int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      long cycles[2];
+      for(int windowed = 0; windowed < 2; windowed++)
+      {
+        // The 2x2 filter run on a 3x3 CE with the window generator
+        int ceSize = windowed ? 3 : data.layerHParam.filterSize;
+        std::vector< CE<TestType> > CEs(2, CE<TestType>(ceSize, fifoSize));
+        Controller<TestType> ctrl(CEs, data.layerHParam, windowed ? WINDOW_MAPPING : STREAM_MAPPING);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setShadowWeights(shadow);
+        Simulator<TestType> sim(ctrl, CEs);
+        cycles[windowed] = sim.run(1000000);
+
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data;
+      }
+      // No straddling window nor padding step
+      EXPECT_LT(cycles[1], cycles[0]) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 8));
+  Controller<TestType> ctrl(CEs, LayerHParam{8,8,1,1,1,1,0}, POINTWISE_MAPPING);
+  EXPECT_THROW(ctrl.setWindowGenerator(true), std::runtime_error);
+}
+
+TEST(SimTest, SpatialUnrollComputesAdjacentOutputs)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam layers[] = {LayerHParam{7,6,3,4,3,1,1}, LayerHParam{9,7,4,4,3,2,1,2},
+                                LayerHParam{8,5,2,3,2,1,1}};
+  for(int l = 0; l < 3; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 50 + l);
+    int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      long cycles[4], fetches[4];
+      for(int unroll = 1; unroll <= 3; unroll++)
+      {
+        // Two filters computed in parallel, unroll CEs each
+        std::vector< CE<TestType> > CEs(2 * unroll, CE<TestType>(3, fifoSize));
+        Controller<TestType> ctrl(CEs, data.layerHParam, WINDOW_MAPPING);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setSpatialUnroll(unroll);
+        ctrl.setShadowWeights(shadow);
+        Simulator<TestType> sim(ctrl, CEs);
+        cycles[unroll] = sim.run(1000000);
+        fetches[unroll] = ctrl.getWeightFetches();
+
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data << "unroll " << unroll;
+      }
+      EXPECT_LT(cycles[2], cycles[1]) << data;
+      EXPECT_LE(cycles[3], cycles[2]) << data;
+      // The weights are broadcast to the CEs of a filter
+      EXPECT_EQ(fetches[1], fetches[3]) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(2, CE<TestType>(3, 9));
+  Controller<TestType> ctrl(CEs, LayerHParam{7,6,3,4,3,1,1});
+  EXPECT_THROW(ctrl.setSpatialUnroll(2), std::runtime_error);
+  ctrl.setWindowGenerator(true);
+  EXPECT_THROW(ctrl.setSpatialUnroll(3), std::runtime_error);
+  ctrl.setSpatialUnroll(2);
+  EXPECT_THROW(ctrl.setWindowGenerator(false), std::runtime_error);
+}
+
+TEST(SimTest, WindowReadPortRefillsTheRows)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam layers[] = {LayerHParam{7,6,3,4,3,1,1}, LayerHParam{9,7,4,4,3,2,1,2}};
+  for(int l = 0; l < 2; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 60 + l);
+    int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+    for(int unroll = 1; unroll <= 2; unroll++)
+    {
+      // Port of 1 column, of the new columns of a step, and wide enough for a whole window
+      const int ports[] = {1, 0, 16};
+      long cycles[3];
+      for(int p = 0; p < 3; p++)
+      {
+        std::vector< CE<TestType> > CEs(2 * unroll, CE<TestType>(3, fifoSize));
+        Controller<TestType> ctrl(CEs, data.layerHParam, WINDOW_MAPPING);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setSpatialUnroll(unroll);
+        ctrl.setWindowReadPort(ports[p]);
+        ctrl.setShadowWeights(true);
+        Simulator<TestType> sim(ctrl, CEs);
+        cycles[p] = sim.run(1000000);
+
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs())
+          << data << "unroll " << unroll << " port " << ports[p];
+      }
+      // The first window of every row is refilled
+      EXPECT_GE(cycles[0], cycles[1]) << data;
+      EXPECT_GT(cycles[1], cycles[2]) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(2, CE<TestType>(3, 9));
+  Controller<TestType> ctrl(CEs, LayerHParam{7,6,3,4,3,1,1});
+  EXPECT_THROW(ctrl.setWindowReadPort(2), std::runtime_error);
+  ctrl.setWindowGenerator(true);
+  EXPECT_THROW(ctrl.setWindowReadPort(-1), std::runtime_error);
+  ctrl.setWindowReadPort(2);
+  EXPECT_THROW(ctrl.setWindowGenerator(false), std::runtime_error);
+}
+
+TEST(SimTest, FilterFoldingAndChannelPacking)
+{
+  // Large filters folded on a 3x3 CE
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups
+  const LayerHParam large[] = {LayerHParam{8,7,2,3,5,1,2}, LayerHParam{13,11,2,2,7,2,1}, LayerHParam{9,8,4,4,4,1,1,2}};
+  for(int l = 0; l < 3; l++)
+  {
+    LayerData data = makeLayer(large[l], 0.8, 60 + l);
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      for(int unroll = 1; unroll <= 2; unroll++)
+      {
+        std::vector< CE<TestType> > CEs(2, CE<TestType>(3, data.layerHParam.inputWidth + data.layerHParam.padding * 2));
+        Controller<TestType> ctrl(CEs, data.layerHParam, WINDOW_MAPPING);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setSpatialUnroll(unroll);
+        ctrl.setShadowWeights(shadow);
+        Simulator<TestType> sim(ctrl, CEs);
+        sim.run(1000000);
+
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data << "unroll " << unroll;
+      }
+    }
+  }
+
+  // Small filters packed on a 7x7 CE, 4 channels of 3x3 or 9 channels of 2x2 per pass
+  const LayerHParam small[] = {LayerHParam{8,6,6,3,3,1,1}, LayerHParam{7,7,10,4,2,2,0}, LayerHParam{6,6,8,4,3,1,1,2}};
+  for(int l = 0; l < 3; l++)
+  {
+    LayerData data = makeLayer(small[l], 0.8, 70 + l);
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      long cycles[2];
+      for(int packing = 0; packing < 2; packing++)
+      {
+        std::vector< CE<TestType> > CEs(2, CE<TestType>(7, data.layerHParam.inputWidth + data.layerHParam.padding * 2));
+        Controller<TestType> ctrl(CEs, data.layerHParam, WINDOW_MAPPING);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setChannelPacking(packing);
+        ctrl.setShadowWeights(shadow);
+        Simulator<TestType> sim(ctrl, CEs);
+        cycles[packing] = sim.run(1000000);
+
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data << "packing " << packing;
+      }
+      EXPECT_LT(cycles[1], cycles[0]) << data;
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 8));
+  Controller<TestType> ctrl(CEs, LayerHParam{8,6,6,3,3,1,1});
+  EXPECT_THROW(ctrl.setChannelPacking(true), std::runtime_error);
+  ctrl.setWindowGenerator(true);
+  ctrl.setChannelPacking(true);
+  EXPECT_THROW(ctrl.setWindowGenerator(false), std::runtime_error);
+
+  // A CE of another size than the filter is only fed by the lanes, the FIFOs path would index
+  // the 3x3 weights as 5x5
+  std::vector< CE<TestType> > largeCEs(1, CE<TestType>(5, 5));
+  EXPECT_THROW(Controller<TestType>(largeCEs, LayerHParam{5,5,1,1,3,1,0}), std::runtime_error);
+  Controller<TestType> windowCtrl(largeCEs, LayerHParam{5,5,1,1,3,1,0}, WINDOW_MAPPING);
+  EXPECT_THROW(windowCtrl.setWindowGenerator(false), std::runtime_error);
+  Controller<TestType> pointwiseCtrl(largeCEs, LayerHParam{5,5,1,1,1,1,0}, POINTWISE_MAPPING);
+  EXPECT_THROW(pointwiseCtrl.setPointwise(false), std::runtime_error);
+}
+
+TEST(SimTest, DilatedConvolution)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type, dilation
+  const LayerHParam layers[] = {LayerHParam{9,8,2,3,3,1,2,0,CONVOLUTION,2}, LayerHParam{12,10,2,2,3,2,3,0,CONVOLUTION,3},
+                                LayerHParam{8,9,4,4,2,1,1,2,CONVOLUTION,3}, LayerHParam{11,10,1,2,3,1,0,0,CONVOLUTION,4}};
+  for(int l = 0; l < 4; l++)
+  {
+    LayerData data = makeLayer(layers[l], 0.8, 80 + l);
+    const LayerHParam& p = data.layerHParam;
+    int fifoSize = p.inputWidth + p.padding * 2;
+    int extent = (p.filterSize - 1) * p.dilation + 1;
+
+    // The same layer with the filter stuffed with zeros up to its extent
+    LayerData stuffed = data;
+    stuffed.layerHParam.filterSize = extent;
+    stuffed.layerHParam.dilation = 1;
+    stuffed.weights = Tensor<TestType>({p.nbOfFilter, data.weights.shape()[1], extent, extent});
+    for(int f = 0; f < p.nbOfFilter; f++)
+      for(int d = 0; d < data.weights.shape()[1]; d++)
+        for(int i = 0; i < p.filterSize; i++)
+          for(int j = 0; j < p.filterSize; j++)
+            stuffed.weights(f, d, i * p.dilation, j * p.dilation) = data.weights(f, d, i, j);
+
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      for(int nbOfCEs = 1; nbOfCEs <= 2; nbOfCEs++)
+      {
+        std::vector< CE<TestType> > CEs(nbOfCEs, CE<TestType>(p.filterSize, fifoSize, p.dilation));
+        Controller<TestType> ctrl(CEs, p);
+        ctrl.setWeights(data.weights, data.bias);
+        ctrl.setInputs(data.inputs);
+        ctrl.setShadowWeights(shadow);
+        Simulator<TestType> sim(ctrl, CEs);
+        long cycles = sim.run(1000000);
+        EXPECT_TRUE(ctrl.isHalted()) << data;
+        EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs()) << data;
+
+        std::vector< CE<TestType> > stuffedCEs(nbOfCEs, CE<TestType>(extent, fifoSize));
+        Controller<TestType> stuffedCtrl(stuffedCEs, stuffed.layerHParam);
+        stuffedCtrl.setWeights(stuffed.weights, stuffed.bias);
+        stuffedCtrl.setInputs(stuffed.inputs);
+        stuffedCtrl.setShadowWeights(shadow);
+        Simulator<TestType> stuffedSim(stuffedCtrl, stuffedCEs);
+        long stuffedCycles = stuffedSim.run(1000000);
+        EXPECT_EQ(stuffedCtrl.getOutputs(), ctrl.getOutputs()) << data;
+        // The PE rows only wait for the filterSize taps, the line buffer hold the same rows
+        EXPECT_LT(cycles, stuffedCycles) << data;
+        EXPECT_EQ(stuffedCEs.front().getLineBuffer().getWords(), CEs.front().getLineBuffer().getWords());
+      }
+    }
+  }
+
+  std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 10));
+  EXPECT_THROW(Controller<TestType>(CEs, LayerHParam{8,8,1,1,3,1,1,0,CONVOLUTION,2}), std::runtime_error);
+}
+
+TEST(SimTest, FullyConnectedBatch)
+{
+  const int nbOfInputs = 27, nbOfOutputs = 5;
+  const int batches[] = {1, 3, 10};
+  for(int b = 0; b < 3; b++)
+  {
+    int batch = batches[b];
+    std::srand(40 + b);
+    Tensor<TestType> weights({nbOfOutputs, nbOfInputs});
+    Tensor<TestType> images({batch, nbOfInputs});
+    Tensor<TestType> bias({nbOfOutputs});
+    bias.fill(TestType(-0.5));
+    for(int o = 0; o < nbOfOutputs; o++)
+      for(int i = 0; i < nbOfInputs; i++)
+        weights(o, i) = TestType((std::rand() % 9 - 4) * 0.125);
+    for(int n = 0; n < batch; n++)
+      for(int i = 0; i < nbOfInputs; i++)
+        images(n, i) = TestType((std::rand() % 9 - 4) * 0.25);
+
+    for(int shadow = 0; shadow < 2; shadow++)
+    {
+      // inputWidth (batch), inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding, groups, type
+      LayerHParam layerHParam{batch, 1, nbOfInputs, nbOfOutputs, 1, 1, 0, 0, FULLY_CONNECTED};
+      std::vector< CE<TestType> > CEs(1, CE<TestType>(3, 3));
+      Controller<TestType> ctrl(CEs, layerHParam);
+      ctrl.setWeights(weights, bias);
+      ctrl.setInputs(images);
+      ctrl.setShadowWeights(shadow);
+      Simulator<TestType> sim(ctrl, CEs.front());
+      sim.run(1000000);
+
+      ASSERT_TRUE(ctrl.isHalted());
+      Tensor<TestType> outputs = ctrl.getBatchOutputs();
+      for(int n = 0; n < batch; n++)
+        for(int o = 0; o < nbOfOutputs; o++)
+        {
+          TestType sum = bias(o);
+          for(int i = 0; i < nbOfInputs; i++)
+          {
+            sum = sum + weights(o, i) * images(n, i);
+          }
+          EXPECT_EQ(sum, outputs(n, o)) << "batch:" << batch << " image:" << n << " output:" << o;
+        }
+
+      // Every weight is fetched once and used by every image of the batch
+      EXPECT_EQ(nbOfInputs * nbOfOutputs, ctrl.getWeightFetches());
+      EXPECT_EQ(batch * ctrl.getWeightFetches(), ctrl.getMacs());
+    }
+  }
+}
+
+TEST(SimTest, SharedLineBufferAcrossCEs)
+{
+  // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+  LayerData data = makeLayer(LayerHParam{9,7,2,5,3,1,1}, 0.6, 50);
+  int fifoSize = data.layerHParam.inputWidth + data.layerHParam.padding * 2;
+
+  std::vector< CE<TestType> > oneCE(1, CE<TestType>(3, fifoSize));
+  Controller<TestType> oneCtrl(oneCE, data.layerHParam);
+  oneCtrl.setWeights(data.weights, data.bias);
+  oneCtrl.setInputs(data.inputs);
+  Simulator<TestType> oneSim(oneCtrl, oneCE);
+  oneSim.run(1000000);
+
+  // Three filters at once, the last block only use two CEs
+  std::vector< CE<TestType> > CEs(3, CE<TestType>(3, fifoSize));
+  Controller<TestType> ctrl(CEs, data.layerHParam);
+  ctrl.setWeights(data.weights, data.bias);
+  ctrl.setInputs(data.inputs);
+  ctrl.setShadowWeights(true);
+  Simulator<TestType> sim(ctrl, CEs);
+  sim.run(1000000);
+
+  EXPECT_TRUE(ctrl.isHalted());
+  EXPECT_EQ(refConv(data, ctrl.outputHeight(), ctrl.outputWidth()), ctrl.getOutputs());
+  EXPECT_LT(3 * sim.getCycles(), oneSim.getCycles() * 2);
+  EXPECT_TRUE(CEs.back().isLineBufferShared());
+  EXPECT_EQ(sim.getCycles(), ctrl.getInputWrites());
+  EXPECT_EQ(2 * ctrl.getInputWrites(), ctrl.getSavedInputWrites());
+  EXPECT_EQ(oneCtrl.getWeightFetches(), ctrl.getWeightFetches());
+}
+
+TEST(SimTest, SnapshotRejectsOtherShapes)
+{
+  CE<TestType> ce(3, 10);
+  Snapshot snap;
+  ce.save(snap);
+
+  CE<TestType> other(5, 10);
+  EXPECT_THROW(other.restore(snap), std::runtime_error);
+}
+
+/// Tests instantiations
+INSTANTIATE_TEST_CASE_P(Dense, SimTestCase, testing::Values(
+    // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+    makeLayer(LayerHParam{5,5,1,1,3,1,0}, 1.0, 1),
+    makeLayer(LayerHParam{7,6,2,2,3,2,1}, 1.0, 2),
+    makeLayer(LayerHParam{6,6,1,1,1,1,0}, 1.0, 3)
+));
+
+INSTANTIATE_TEST_CASE_P(Sparse, SimTestCase, testing::Values(
+    // inputWidth, inputHeight, inputDepth, nbOfFilter, filterSize, stride, padding
+    makeLayer(LayerHParam{12,12,1,1,3,1,1}, 0.1, 4),
+    makeLayer(LayerHParam{9,11,2,2,5,1,2}, 0.05, 5),
+    makeLayer(LayerHParam{10,10,1,2,2,2,1}, 0.2, 6)
+));
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
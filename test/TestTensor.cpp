@@ -0,0 +1,132 @@
+//
+// Created by gortium on 10/19/18.
+//
+
+
+#include "fi/Fixed.hpp"
+#include "fi/overflow/Saturate.hpp"
+#include "fi/rounding/Classic.hpp"
+#include "CNNP/Arena.hpp"
+#include "CNNP/Tensor.hpp"
+#include "CNNP/Snapshot.hpp"
+#include "gtest/gtest.h"
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+typedef Fi::Fixed<8,4,Fi::SIGNED,Fi::Saturate,Fi::Classic> TestType;
+
+/// The tests
+TEST(TensorTest, RowMajorContiguousLayout)
+{
+  Tensor<TestType> tensor({2, 3, 4});
+  EXPECT_EQ(3, tensor.rank());
+  EXPECT_EQ(24, tensor.size());
+  EXPECT_EQ(std::vector<int>({12, 4, 1}), tensor.strides());
+  EXPECT_TRUE(tensor.isContiguous());
+
+  for(int i = 0; i < tensor.size(); i++)
+  {
+    tensor.data()[i] = TestType(i * 0.25);
+  }
+  EXPECT_EQ(TestType((1 * 12 + 2 * 4 + 3) * 0.25), tensor(1, 2, 3));
+  EXPECT_EQ(TestType(0), tensor(0, 0, 0));
+}
+
+TEST(TensorTest, ViewsShareTheData)
+{
+  Tensor<TestType> tensor({3, 4});
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 4; j++)
+      tensor(i, j) = TestType(i + j * 0.25);
+
+  // Row view
+  Tensor<TestType> row = tensor[1];
+  EXPECT_EQ(std::vector<int>({4}), row.shape());
+  row(2) = TestType(-1);
+  EXPECT_EQ(TestType(-1), tensor(1, 2));
+
+  // The row of a const tensor is const
+  const Tensor<TestType>& constTensor = tensor;
+  EXPECT_TRUE((std::is_const<decltype(constTensor[1])>::value));
+  EXPECT_FALSE((std::is_const<decltype(tensor[1])>::value));
+  EXPECT_EQ(tensor(1, 2), constTensor[1](2));
+
+  // Column slice is strided
+  Tensor<TestType> cols = tensor.slice(1, 1, 3);
+  EXPECT_EQ(std::vector<int>({3, 2}), cols.shape());
+  EXPECT_FALSE(cols.isContiguous());
+  EXPECT_EQ(tensor(2, 1), cols(2, 0));
+
+  // Transpose and reshape
+  Tensor<TestType> transposed = tensor.transpose(0, 1);
+  EXPECT_EQ(tensor(2, 3), transposed(3, 2));
+  EXPECT_EQ(tensor(1, 1), tensor.reshape({12})(5));
+  EXPECT_THROW(cols.reshape({6}), std::runtime_error);
+  EXPECT_THROW(tensor.reshape({5, 2}), std::runtime_error);
+  EXPECT_THROW(tensor.slice(0, 2, 4), std::out_of_range);
+
+  // Copying a strided view make it contiguous, and independent
+  Tensor<TestType> copy = cols.clone();
+  EXPECT_TRUE(copy.isContiguous());
+  EXPECT_EQ(cols, copy);
+  copy(0, 0) = TestType(3);
+  EXPECT_NE(cols, copy);
+}
+
+TEST(TensorTest, NestedVectorsConversion)
+{
+  std::vector< std::vector< std::vector<TestType> > > nested(2,
+      std::vector< std::vector<TestType> >(3, std::vector<TestType>(2, TestType(0))));
+  nested[1][2][0] = TestType(1.5);
+  Tensor<TestType> tensor(nested);
+  EXPECT_EQ(std::vector<int>({2, 3, 2}), tensor.shape());
+  EXPECT_EQ(TestType(1.5), tensor(1, 2, 0));
+
+  nested[0].pop_back();
+  EXPECT_THROW(Tensor<TestType> ragged(nested), std::runtime_error);
+}
+
+TEST(TensorTest, ArenaBuffersAreBackToBack)
+{
+  std::shared_ptr<Arena> arena = std::make_shared<Arena>(1024);
+  Tensor<TestType> weights({4, 3, 3}, arena);
+  Tensor<TestType> inputs({2, 8}, arena);
+  EXPECT_EQ(1, arena->getNbOfBlocks());
+  EXPECT_EQ((36 + 16) * sizeof(TestType), arena->getAllocated());
+  EXPECT_EQ(TestType(0), inputs(1, 7));
+  EXPECT_LE(weights.data() + weights.size(), inputs.data());
+
+  // A buffer bigger than a block get its own
+  Tensor<TestType> big({2048}, arena);
+  EXPECT_EQ(2, arena->getNbOfBlocks());
+
+  // The tensors keep the arena alive
+  arena.reset();
+  weights.fill(TestType(0.5));
+  EXPECT_EQ(TestType(0.5), weights(3, 2, 2));
+}
+
+TEST(TensorTest, SnapshotRoundTrip)
+{
+  Tensor<TestType> tensor({2, 2});
+  tensor(1, 0) = TestType(2.5);
+  Snapshot snap;
+  tensor.save(snap);
+
+  Tensor<TestType> restored({2, 2});
+  snap.rewind();
+  restored.restore(snap);
+  EXPECT_EQ(tensor, restored);
+
+  Tensor<TestType> other({4});
+  snap.rewind();
+  EXPECT_THROW(other.restore(snap), std::runtime_error);
+}
+
+int main(int argc, char* argv[])
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}